@@ -0,0 +1,412 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ApartmentPool.cpp
+//! \brief  The ApartmentPool class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "ApartmentPool.hpp"
+
+#ifdef _MSC_VER
+// Linker directives.
+#pragma comment(lib, "ole32")
+#endif
+
+namespace COM
+{
+
+//! The thread message used to ask an apartment to create an object.
+static const UINT WM_CREATE_INSTANCE = WM_APP + 0x100;
+
+////////////////////////////////////////////////////////////////////////////////
+// The TLS slot which holds the apartment of each pool thread. It's shared by
+// every pool and is allocated by the first one and then kept until the module
+// is unloaded. So an object can find its apartment without touching a pool,
+// which may be being stopped and destroyed by another thread. A pool thread
+// clears its slot before it exits and the pool waits for its threads before
+// it's destroyed, so a non-null apartment is always alive.
+
+namespace
+{
+
+//! The shared TLS slot, if allocated.
+volatile LONG g_nTlsIndex = static_cast<LONG>(TLS_OUT_OF_INDEXES);
+
+////////////////////////////////////////////////////////////////////////////////
+//! The helper class used to free the TLS slot when the module unloads.
+
+class TlsSlotCleanup
+{
+public:
+	//! Destructor.
+	~TlsSlotCleanup()
+	{
+		if (g_nTlsIndex != static_cast<LONG>(TLS_OUT_OF_INDEXES))
+			::TlsFree(static_cast<DWORD>(g_nTlsIndex));
+	}
+};
+
+//! The module unload hook.
+TlsSlotCleanup g_oTlsSlotCleanup;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the shared TLS slot, allocating it on first request.
+
+DWORD AllocTlsSlot()
+{
+	LONG nIndex = g_nTlsIndex;
+
+	if (nIndex != static_cast<LONG>(TLS_OUT_OF_INDEXES))
+		return static_cast<DWORD>(nIndex);
+
+	DWORD dwIndex = ::TlsAlloc();
+
+	if (dwIndex == TLS_OUT_OF_INDEXES)
+		throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to allocate the apartment pool TLS slot"));
+
+	// Publish the slot, unless another pool beat us to it.
+	nIndex = ::InterlockedCompareExchange(&g_nTlsIndex, static_cast<LONG>(dwIndex), static_cast<LONG>(TLS_OUT_OF_INDEXES));
+
+	if (nIndex != static_cast<LONG>(TLS_OUT_OF_INDEXES))
+	{
+		::TlsFree(dwIndex);
+		dwIndex = static_cast<DWORD>(nIndex);
+	}
+
+	return dwIndex;
+}
+
+//namespace
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction with the number of apartments.
+
+ApartmentPool::ApartmentPool(size_t nApartments)
+	: m_oApartments()
+	, m_dwTlsIndex(AllocTlsSlot())
+	, m_oFrequency()
+{
+	ASSERT(nApartments != 0);
+
+	::QueryPerformanceFrequency(&m_oFrequency);
+
+	try
+	{
+		Start(nApartments);
+	}
+	catch (...)
+	{
+		Stop();
+		throw;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+ApartmentPool::~ApartmentPool()
+{
+	Stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the metrics for an apartment.
+
+ApartmentStats ApartmentPool::GetStats(size_t nApartment) const
+{
+	ASSERT(nApartment < m_oApartments.size());
+
+	const Apartment* pApartment = m_oApartments[nApartment];
+	ApartmentStats   oStats;
+
+	oStats.m_nObjects     = pApartment->m_nObjects;
+	oStats.m_nQueued      = pApartment->m_nQueued;
+	oStats.m_nCalls       = pApartment->m_nCalls;
+	oStats.m_nCallTime    = TicksToUs(pApartment->m_nCallTime);
+	oStats.m_nMaxCallTime = static_cast<ulong>(TicksToUs(pApartment->m_nMaxCallTime));
+
+	return oStats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Account for an object created on the calling thread. This returns the
+//! object count of the apartment, which the object passes to OnDestroyObject()
+//! when it's destroyed, or nullptr if the thread isn't one of a pool's. The
+//! count is decremented through the pointer, rather than the TLS slot of the
+//! releasing thread, as an object which isn't apartment threaded can be
+//! released on any thread. This only reads the calling thread's slot and so is
+//! safe whilst a pool is stopped. A pool is only stopped when the server is
+//! idle and every object holds a server lock, so an apartment outlives the
+//! objects created in it.
+
+volatile LONG* ApartmentPool::OnCreateObject()
+{
+	LONG nIndex = g_nTlsIndex;
+
+	if (nIndex == static_cast<LONG>(TLS_OUT_OF_INDEXES))
+		return nullptr;
+
+	Apartment* pApartment = static_cast<Apartment*>(::TlsGetValue(static_cast<DWORD>(nIndex)));
+
+	if (pApartment == nullptr)
+		return nullptr;
+
+	::InterlockedIncrement(&pApartment->m_nObjects);
+
+	return &pApartment->m_nObjects;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create an object on the least loaded apartment and return a pointer to it
+//! marshalled into the caller's apartment. The caller waits for the request to
+//! be served, pumping messages if it is itself an STA.
+
+HRESULT ApartmentPool::CreateInstance(const CLSID& rCLSID, const IID& rIID, void** ppInterface)
+{
+	ASSERT(ppInterface != nullptr);
+
+	*ppInterface = nullptr;
+
+	CreateRequest oRequest;
+
+	oRequest.m_pCLSID  = &rCLSID;
+	oRequest.m_pIID    = &rIID;
+	oRequest.m_hDone   = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	oRequest.m_pStream = nullptr;
+
+	if (oRequest.m_hDone == nullptr)
+		return COM_FAILURE(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to create the request event")).Report();
+
+	Apartment* pApartment = SelectApartment();
+
+	::InterlockedIncrement(&pApartment->m_nQueued);
+
+	if (!::PostThreadMessage(pApartment->m_dwThreadID, WM_CREATE_INSTANCE, 0, reinterpret_cast<LPARAM>(&oRequest)))
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(::GetLastError());
+
+		::InterlockedDecrement(&pApartment->m_nQueued);
+		::CloseHandle(oRequest.m_hDone);
+
+		return COM_FAILURE(hr, TXT("Failed to queue the request on the apartment")).Report();
+	}
+
+	DWORD dwIndex = 0;
+
+	// The request lives on our stack, so we must wait for it whatever happens.
+	if (FAILED(::CoWaitForMultipleHandles(0, INFINITE, 1, &oRequest.m_hDone, &dwIndex)))
+		::WaitForSingleObject(oRequest.m_hDone, INFINITE);
+
+	::CloseHandle(oRequest.m_hDone);
+
+	if (oRequest.m_oResult.Failed())
+		return oRequest.m_oResult.Report();
+
+	return ::CoGetInterfaceAndReleaseStream(oRequest.m_pStream, rIID, ppInterface);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Start the apartment threads. Each thread is started and then waited on
+//! until it has initialised COM and created its message queue, so that a
+//! request can be posted to it immediately.
+
+void ApartmentPool::Start(size_t nApartments)
+{
+	m_oApartments.reserve(nApartments);
+
+	for (size_t i = 0; i != nApartments; ++i)
+	{
+		Apartment* pApartment = new Apartment;
+
+		pApartment->m_pPool        = this;
+		pApartment->m_hThread      = nullptr;
+		pApartment->m_dwThreadID   = 0;
+		pApartment->m_hReady       = ::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		pApartment->m_hrInit       = S_OK;
+		pApartment->m_nObjects     = 0;
+		pApartment->m_nQueued      = 0;
+		pApartment->m_nCalls       = 0;
+		pApartment->m_nCallTime    = 0;
+		pApartment->m_nMaxCallTime = 0;
+
+		m_oApartments.push_back(pApartment);
+
+		if (pApartment->m_hReady == nullptr)
+			throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to create the apartment start-up event"));
+
+		pApartment->m_hThread = ::CreateThread(nullptr, 0, ThreadProc, pApartment, 0, &pApartment->m_dwThreadID);
+
+		if (pApartment->m_hThread == nullptr)
+			throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to create an apartment thread"));
+
+		::WaitForSingleObject(pApartment->m_hReady, INFINITE);
+
+		if (FAILED(pApartment->m_hrInit))
+			throw WCL::ComException(pApartment->m_hrInit, TXT("Failed to initialise COM on an apartment thread"));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Stop the apartment threads. Uninitialising COM on an apartment disconnects
+//! any objects left in it, so the server should be idle. This waits for the
+//! threads to exit and so must not be called under the loader lock.
+
+void ApartmentPool::Stop()
+{
+	for (Apartments::const_iterator it = m_oApartments.begin(); it != m_oApartments.end(); ++it)
+	{
+		Apartment* pApartment = *it;
+
+		if (pApartment->m_hThread != nullptr)
+		{
+			::PostThreadMessage(pApartment->m_dwThreadID, WM_QUIT, 0, 0);
+			::WaitForSingleObject(pApartment->m_hThread, INFINITE);
+			::CloseHandle(pApartment->m_hThread);
+		}
+
+		if (pApartment->m_hReady != nullptr)
+			::CloseHandle(pApartment->m_hReady);
+
+		delete pApartment;
+	}
+
+	m_oApartments.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Select the least loaded apartment. The counters are read without a lock, so
+//! two concurrent requests may pick the same apartment, which only matters
+//! until the next request.
+
+ApartmentPool::Apartment* ApartmentPool::SelectApartment()
+{
+	ASSERT(!m_oApartments.empty());
+
+	Apartment* pBest = m_oApartments.front();
+	long       nBest = pBest->m_nObjects + pBest->m_nQueued;
+
+	for (size_t i = 1; (i != m_oApartments.size()) && (nBest != 0); ++i)
+	{
+		Apartment* pApartment = m_oApartments[i];
+		long       nLoad      = pApartment->m_nObjects + pApartment->m_nQueued;
+
+		if (nLoad < nBest)
+		{
+			pBest = pApartment;
+			nBest = nLoad;
+		}
+	}
+
+	return pBest;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Serve a request to create an object, on the apartment thread. The object is
+//! marshalled into a stream for the requesting thread. Any failure is kept so
+//! that it's reported on the requesting thread.
+
+void ApartmentPool::ServeRequest(CreateRequest& oRequest)
+{
+	try
+	{
+		IUnknownPtr pUnknown = Server::This().CreateObject(*oRequest.m_pCLSID);
+
+		if (pUnknown.get() == nullptr)
+		{
+			oRequest.m_oResult = COM_FAILURE(E_FAIL, TXT("The server does not implement the class"));
+			return;
+		}
+
+		HRESULT hr = ::CoMarshalInterThreadInterfaceInStream(*oRequest.m_pIID, pUnknown.get(), &oRequest.m_pStream);
+
+		if (FAILED(hr))
+			oRequest.m_oResult = COM_FAILURE(hr, TXT("Failed to marshal the object out of its apartment"));
+	}
+	catch (const WCL::ComException& e)
+	{
+		oRequest.m_oResult = COM::Failure(e.m_result, tstring(e.twhat()), __FUNCTION__);
+	}
+	catch (const std::bad_alloc&)
+	{
+		oRequest.m_oResult = COM_FAILURE(E_OUTOFMEMORY, TXT("Out of memory"));
+	}
+	catch (const Core::Exception& e)
+	{
+		oRequest.m_oResult = COM::Failure(E_UNEXPECTED, tstring(e.twhat()), __FUNCTION__);
+	}
+	catch (...)
+	{
+		oRequest.m_oResult = COM_FAILURE(E_UNEXPECTED, TXT("Unknown exception"));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The apartment thread function. This is a plain GetMessage() pump, as the
+//! thread has no windows of its own; the calls into the apartment arrive as
+//! messages for the hidden COM window and are timed as they're dispatched.
+
+DWORD WINAPI ApartmentPool::ThreadProc(LPVOID pParam)
+{
+	Apartment*     pApartment = static_cast<Apartment*>(pParam);
+	ApartmentPool* pPool      = pApartment->m_pPool;
+	MSG            oMsg;
+
+	pApartment->m_hrInit = ::CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+
+	// Force the creation of the message queue.
+	::PeekMessage(&oMsg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+	::TlsSetValue(pPool->m_dwTlsIndex, pApartment);
+
+	bool bInitialised = SUCCEEDED(pApartment->m_hrInit);
+
+	::SetEvent(pApartment->m_hReady);
+
+	if (!bInitialised)
+		return 0;
+
+	while (::GetMessage(&oMsg, nullptr, 0, 0) > 0)
+	{
+		if ( (oMsg.hwnd == nullptr) && (oMsg.message == WM_CREATE_INSTANCE) )
+		{
+			CreateRequest* pRequest = reinterpret_cast<CreateRequest*>(oMsg.lParam);
+
+			::InterlockedDecrement(&pApartment->m_nQueued);
+
+			ServeRequest(*pRequest);
+
+			::SetEvent(pRequest->m_hDone);
+			continue;
+		}
+
+		LARGE_INTEGER oStart;
+		LARGE_INTEGER oEnd;
+
+		::QueryPerformanceCounter(&oStart);
+		::DispatchMessage(&oMsg);
+		::QueryPerformanceCounter(&oEnd);
+
+		ULONGLONG nTicks = static_cast<ULONGLONG>(oEnd.QuadPart - oStart.QuadPart);
+
+		++pApartment->m_nCalls;
+		pApartment->m_nCallTime += nTicks;
+
+		if (nTicks > pApartment->m_nMaxCallTime)
+			pApartment->m_nMaxCallTime = nTicks;
+	}
+
+	::TlsSetValue(pPool->m_dwTlsIndex, nullptr);
+	::CoUninitialize();
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert performance counter ticks to microseconds.
+
+ULONGLONG ApartmentPool::TicksToUs(ULONGLONG nTicks) const
+{
+	return nTicks * 1000000 / static_cast<ULONGLONG>(m_oFrequency.QuadPart);
+}
+
+//namespace COM
+}
@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ApartmentPool.hpp
+//! \brief  The ApartmentPool class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_APARTMENTPOOL_HPP
+#define COM_APARTMENTPOOL_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <vector>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The metrics for a single apartment in an ApartmentPool. The values are read
+//! without synchronising with the apartment thread and so are approximate
+//! whilst the pool is busy.
+
+struct ApartmentStats
+{
+	long		m_nObjects;		//!< The number of live objects created in the apartment.
+	long		m_nQueued;		//!< The number of creation requests waiting to be served.
+	ULONGLONG	m_nCalls;		//!< The number of messages (i.e. incoming calls) dispatched.
+	ULONGLONG	m_nCallTime;	//!< The total time spent dispatching messages (us).
+	ulong		m_nMaxCallTime;	//!< The longest time spent dispatching a message (us).
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! A pool of single-threaded apartments used to host apartment threaded
+//! objects. Each apartment is a thread which runs a message pump. An object is
+//! created on the least loaded apartment and a marshalled pointer returned to
+//! the caller, so calls to objects on different apartments run concurrently.
+//!
+//! The load of an apartment is the number of live ObjectBase derived objects
+//! created on its thread, plus any creation requests queued for it. An object
+//! remembers the apartment it was created in and so is taken off that count
+//! whichever thread releases it.
+
+class ApartmentPool : private Core::NotCopyable
+{
+public:
+	//! Construction with the number of apartments.
+	ApartmentPool(size_t nApartments); // throw(ComException)
+
+	//! Destructor.
+	~ApartmentPool();
+
+	//
+	// Properties.
+	//
+
+	//! Get the number of apartments.
+	size_t Count() const;
+
+	//! Get the metrics for an apartment.
+	ApartmentStats GetStats(size_t nApartment) const;
+
+	//! Query if the calling thread is one of the pool's apartments.
+	bool IsPoolThread() const;
+
+	//
+	// Methods.
+	//
+
+	//! Create an object on the least loaded apartment.
+	HRESULT CreateInstance(const CLSID& rCLSID, const IID& rIID, void** ppInterface); // throw()
+
+	//! Account for an object created on the calling thread.
+	static volatile LONG* OnCreateObject(); // throw()
+
+	//! Account for the destruction of an object.
+	static void OnDestroyObject(volatile LONG* pObjects); // throw()
+
+private:
+	//! The state of a single apartment.
+	struct Apartment
+	{
+		ApartmentPool*	m_pPool;		//!< The owning pool.
+		HANDLE			m_hThread;		//!< The apartment thread.
+		DWORD			m_dwThreadID;	//!< The apartment thread ID.
+		HANDLE			m_hReady;		//!< Signalled once the thread has started.
+		HRESULT			m_hrInit;		//!< The result of initialising COM.
+		volatile LONG	m_nObjects;		//!< The number of live objects created here.
+		volatile LONG	m_nQueued;		//!< The number of queued creation requests.
+		ULONGLONG		m_nCalls;		//!< The number of messages dispatched.
+		ULONGLONG		m_nCallTime;	//!< The total time dispatching messages (ticks).
+		ULONGLONG		m_nMaxCallTime;	//!< The longest message dispatch (ticks).
+	};
+
+	//! A request to create an object, owned by the requesting thread.
+	struct CreateRequest
+	{
+		const CLSID*	m_pCLSID;		//!< The class to create.
+		const IID*		m_pIID;			//!< The interface requested.
+		HANDLE			m_hDone;		//!< Signalled once the request is served.
+		IStream*		m_pStream;		//!< The marshalled interface.
+		Result<void>	m_oResult;		//!< The result of creating the object.
+	};
+
+	//! The apartments.
+	typedef std::vector<Apartment*> Apartments;
+
+	//
+	// Members.
+	//
+	Apartments		m_oApartments;	//!< The apartments.
+	DWORD			m_dwTlsIndex;	//!< The TLS slot holding the current apartment, shared by every pool.
+	LARGE_INTEGER	m_oFrequency;	//!< The performance counter frequency.
+
+	//
+	// Internal methods.
+	//
+
+	//! Start the apartment threads.
+	void Start(size_t nApartments); // throw(ComException)
+
+	//! Stop the apartment threads.
+	void Stop();
+
+	//! Select the least loaded apartment.
+	Apartment* SelectApartment();
+
+	//! Serve a request to create an object, on the apartment thread.
+	static void ServeRequest(CreateRequest& oRequest);
+
+	//! The apartment thread function.
+	static DWORD WINAPI ThreadProc(LPVOID pParam);
+
+	//! Convert performance counter ticks to microseconds.
+	ULONGLONG TicksToUs(ULONGLONG nTicks) const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of apartments.
+
+inline size_t ApartmentPool::Count() const
+{
+	return m_oApartments.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the calling thread is one of the pool's apartments.
+
+inline bool ApartmentPool::IsPoolThread() const
+{
+	return (::TlsGetValue(m_dwTlsIndex) != nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Account for the destruction of an object. The count is the one returned by
+//! OnCreateObject() when the object was created, if any.
+
+inline void ApartmentPool::OnDestroyObject(volatile LONG* pObjects)
+{
+	if (pObjects != nullptr)
+		::InterlockedDecrement(pObjects);
+}
+
+//namespace COM
+}
+
+#endif // COM_APARTMENTPOOL_HPP
@@ -0,0 +1,478 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   AsyncCall.hpp
+//! \brief  The AsyncCall and CallFactoryImpl class declarations.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_ASYNCCALL_HPP
+#define COM_ASYNCCALL_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <COM/Server.hpp>
+#include <COM/RefCount.hpp>
+#include <COM/WorkerPool.hpp>
+#include <objidl.h>
+#include <new>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The base class for the server-side call object of a COM asynchronous
+//! interface, i.e. the one MIDL generates from an [async_uuid] attribute. The
+//! call object is created by the object's ICallFactory and is aggregated by
+//! COM, which supplies the ISynchronize used to signal the caller.
+//!
+//! The derived class implements each Begin_ method by checking that no call is
+//! pending, storing the [in] arguments and then calling BeginCall(), which runs
+//! Execute() on the server's asynchronous worker pool. Each Finish_ method calls FinishCall(), which
+//! waits for Execute() to complete, and then returns the [out] arguments.
+//!
+//! The Object is the class which implements the synchronous interface and is
+//! kept alive whilst the call object exists. Each call object holds a server
+//! lock, so the server is not unloaded whilst a call is outstanding.
+//!
+//! Execute() runs on a worker thread, which calls the object directly and may
+//! drop the last reference to it. So the Object must be thread-safe, i.e. use
+//! the FREE_THREAD_APT, ANY_APARTMENT or NEUTRAL_APARTMENT model, and a class
+//! using one of the STA models fails to compile.
+
+template<typename Base, typename Object>
+class AsyncCall : public Base, private WorkItem
+{
+public:
+	//! Construction from the controlling unknown and the object being called.
+	AsyncCall(IUnknown* pOuter, const IID& rAsyncIID, Object& oObject);
+
+	//! Destructor.
+	virtual ~AsyncCall();
+
+	//
+	// Methods.
+	//
+
+	//! Get the non-delegating IUnknown, for the controlling unknown.
+	IUnknown* GetInnerUnknown();
+
+	//
+	// IUnknown methods.
+	//
+
+	//! Query the controlling unknown for a particular interface.
+	virtual HRESULT COMCALL QueryInterface(const IID& rIID, void** ppInterface);
+
+	//! Increment the controlling unknown's reference count.
+	virtual ULONG COMCALL AddRef();
+
+	//! Decrement the controlling unknown's reference count.
+	virtual ULONG COMCALL Release();
+
+protected:
+	//
+	// Internal methods.
+	//
+
+	//! Get the object being called.
+	Object& Target();
+
+	//! Query if a call has been started, but not yet finished.
+	bool IsCallPending() const;
+
+	//! Start the call, by queueing Execute() on the worker pool.
+	HRESULT BeginCall(); // throw()
+
+	//! Wait for the call to complete and return its result.
+	HRESULT FinishCall(); // throw()
+
+	//! Template Method used to perform the call, on a worker pool thread.
+	virtual Result<void> Execute() = 0;
+
+private:
+	//! The call states.
+	enum State
+	{
+		IDLE	= 0,	//!< No call is in progress.
+		PENDING	= 1,	//!< Begin_ has been called, but not Finish_.
+	};
+
+	////////////////////////////////////////////////////////////////////////////
+	//! The non-delegating IUnknown implementation, which owns the lifetime.
+
+	class InnerUnknown : public IUnknown
+	{
+	public:
+		//! Query the call object for a particular interface.
+		virtual HRESULT COMCALL QueryInterface(const IID& rIID, void** ppInterface);
+
+		//! Increment the call object's reference count.
+		virtual ULONG COMCALL AddRef();
+
+		//! Decrement the call object's reference count.
+		virtual ULONG COMCALL Release();
+
+		//
+		// Members.
+		//
+		AsyncCall*		m_pOwner;		//!< The call object.
+	};
+
+	//! The object smart-pointer type.
+	typedef WCL::IFacePtr<ICallFactory> ICallFactoryPtr;
+
+	//
+	// Members.
+	//
+	IUnknown*		m_pOuter;		//!< The controlling unknown.
+	IID				m_oAsyncIID;	//!< The asynchronous interface ID.
+	Object&			m_oObject;		//!< The object being called.
+	ICallFactoryPtr	m_pObject;		//!< The reference held on the object.
+	InnerUnknown	m_oInner;		//!< The non-delegating IUnknown.
+	AtomicRefCount	m_oRefCount;	//!< The call object reference count.
+	volatile LONG	m_eState;		//!< The call State.
+	Result<void>	m_oResult;		//!< The result of the last call.
+
+	//
+	// Internal methods.
+	//
+
+	//! Run the call on a worker pool thread and signal the caller.
+	virtual void Run(); // throw()
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the controlling unknown and the object being called. The
+//! controlling unknown is not AddRef'd, as it owns the call object.
+
+template<typename Base, typename Object>
+inline AsyncCall<Base, Object>::AsyncCall(IUnknown* pOuter, const IID& rAsyncIID, Object& oObject)
+	: m_pOuter(pOuter)
+	, m_oAsyncIID(rAsyncIID)
+	, m_oObject(oObject)
+	, m_pObject(static_cast<ICallFactory*>(&oObject), true)
+	, m_oInner()
+	, m_oRefCount()
+	, m_eState(IDLE)
+	, m_oResult()
+{
+	(void)sizeof(ThreadSafeModelCheck<Object::THREADING_MODEL>);
+
+	ASSERT(m_pOuter != nullptr);
+
+	m_oInner.m_pOwner = this;
+
+	Server::This().Lock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+template<typename Base, typename Object>
+inline AsyncCall<Base, Object>::~AsyncCall()
+{
+	Server::This().Unlock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the non-delegating IUnknown, for the controlling unknown.
+
+template<typename Base, typename Object>
+inline IUnknown* AsyncCall<Base, Object>::GetInnerUnknown()
+{
+	return &m_oInner;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query the controlling unknown for a particular interface.
+
+template<typename Base, typename Object>
+inline HRESULT COMCALL AsyncCall<Base, Object>::QueryInterface(const IID& rIID, void** ppInterface)
+{
+	return m_pOuter->QueryInterface(rIID, ppInterface);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the controlling unknown's reference count.
+
+template<typename Base, typename Object>
+inline ULONG COMCALL AsyncCall<Base, Object>::AddRef()
+{
+	return m_pOuter->AddRef();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the controlling unknown's reference count.
+
+template<typename Base, typename Object>
+inline ULONG COMCALL AsyncCall<Base, Object>::Release()
+{
+	return m_pOuter->Release();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the object being called.
+
+template<typename Base, typename Object>
+inline Object& AsyncCall<Base, Object>::Target()
+{
+	return m_oObject;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if a call has been started, but not yet finished. A Begin_ method
+//! should return RPC_E_CALL_PENDING, without touching the arguments of the
+//! outstanding call, if so.
+
+template<typename Base, typename Object>
+inline bool AsyncCall<Base, Object>::IsCallPending() const
+{
+	return (m_eState != IDLE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Start the call, by queueing Execute() on the worker pool. Only one call can
+//! be in progress at a time on a call object. The controlling unknown is kept
+//! alive until the caller has been signalled.
+
+template<typename Base, typename Object>
+inline HRESULT AsyncCall<Base, Object>::BeginCall()
+{
+	if (::InterlockedCompareExchange(&m_eState, PENDING, IDLE) != IDLE)
+		return RPC_E_CALL_PENDING;
+
+	try
+	{
+		m_pOuter->AddRef();
+
+		if (Server::This().AsyncWorkers().Submit(this))
+			return S_OK;
+
+		m_oResult = COM_FAILURE(CO_E_SERVER_STOPPING, TXT("The asynchronous call threads have been stopped"));
+	}
+	catch (const WCL::ComException& e)
+	{
+		m_oResult = COM::Failure(e.m_result, tstring(e.twhat()), __FUNCTION__);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_oResult = COM_FAILURE(E_OUTOFMEMORY, TXT("Out of memory"));
+	}
+
+	m_pOuter->Release();
+	::InterlockedExchange(&m_eState, IDLE);
+
+	return m_oResult.Report();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Wait for the call to complete and return its result. Any failure is reported
+//! on the calling thread, rather than the worker thread which raised it.
+
+template<typename Base, typename Object>
+inline HRESULT AsyncCall<Base, Object>::FinishCall()
+{
+	if (m_eState != PENDING)
+		return RPC_E_CALL_COMPLETE;
+
+	ISynchronize* pSync = nullptr;
+
+	HRESULT hr = m_pOuter->QueryInterface(IID_ISynchronize, reinterpret_cast<void**>(&pSync));
+
+	if (FAILED(hr))
+		return hr;
+
+	hr = pSync->Wait(0, INFINITE);
+
+	pSync->Release();
+
+	if (FAILED(hr))
+		return hr;
+
+	::InterlockedExchange(&m_eState, IDLE);
+
+	return m_oResult.Report();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the call on a worker pool thread and signal the caller. The result is
+//! kept so that the failure can be reported by FinishCall().
+
+template<typename Base, typename Object>
+void AsyncCall<Base, Object>::Run()
+{
+	m_oResult = Result<void>();
+
+	try
+	{
+		m_oResult = Execute();
+	}
+	catch (const WCL::ComException& e)
+	{
+		m_oResult = COM::Failure(e.m_result, tstring(e.twhat()), __FUNCTION__);
+	}
+	catch (const std::bad_alloc&)
+	{
+		m_oResult = COM_FAILURE(E_OUTOFMEMORY, TXT("Out of memory"));
+	}
+	catch (const Core::Exception& e)
+	{
+		m_oResult = COM::Failure(E_UNEXPECTED, tstring(e.twhat()), __FUNCTION__);
+	}
+	catch (...)
+	{
+		m_oResult = COM_FAILURE(E_UNEXPECTED, TXT("Unknown exception"));
+	}
+
+	ISynchronize* pSync = nullptr;
+
+	if (SUCCEEDED(m_pOuter->QueryInterface(IID_ISynchronize, reinterpret_cast<void**>(&pSync))))
+	{
+		pSync->Signal();
+		pSync->Release();
+	}
+
+	// Release the reference taken by BeginCall().
+	m_pOuter->Release();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query the call object for a particular interface. The asynchronous
+//! interface is returned AddRef'd through the controlling unknown.
+
+template<typename Base, typename Object>
+inline HRESULT COMCALL AsyncCall<Base, Object>::InnerUnknown::QueryInterface(const IID& rIID, void** ppInterface)
+{
+	// Check parameters.
+	if (ppInterface == nullptr)
+		return E_POINTER;
+
+	*ppInterface = nullptr;
+
+	if (IsEqualIID(rIID, IID_IUnknown))
+		*ppInterface = static_cast<IUnknown*>(this);
+	else if (IsEqualIID(rIID, m_pOwner->m_oAsyncIID))
+		*ppInterface = static_cast<Base*>(m_pOwner);
+	else
+		return E_NOINTERFACE;
+
+	static_cast<IUnknown*>(*ppInterface)->AddRef();
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the call object's reference count.
+
+template<typename Base, typename Object>
+inline ULONG COMCALL AsyncCall<Base, Object>::InnerUnknown::AddRef()
+{
+	return m_pOwner->m_oRefCount.Increment();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the call object's reference count.
+
+template<typename Base, typename Object>
+inline ULONG COMCALL AsyncCall<Base, Object>::InnerUnknown::Release()
+{
+	ASSERT(m_pOwner->m_oRefCount.Value() > 0);
+
+	LONG nRefCount = m_pOwner->m_oRefCount.Decrement();
+
+	if (nRefCount == 0)
+		delete m_pOwner;
+
+	return nRefCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The mix-in class used to opt an ObjectBase derived class into supporting an
+//! asynchronous interface, e.g.
+//!
+//! class MyClass : public COM::ObjectBase<IMyClass>, public COM::CallFactoryImpl<MyClass, MyCall>
+//!
+//! where MyCall derives from AsyncCall<AsyncIMyClass, MyClass> and has a
+//! constructor which takes the controlling unknown and a MyClass&. The class
+//! must also expose ICallFactory in its interface table.
+//!
+//! The calls are executed on the server's worker threads rather than in the
+//! object's apartment, so the class must not use the SINGLE_THREAD_APT or
+//! MAIN_THREAD_APT models; this is checked at compile time.
+
+template<typename T, typename CallType>
+class CallFactoryImpl : public ICallFactory
+{
+public:
+	//! Construction from the asynchronous interface ID.
+	CallFactoryImpl(const IID& rAsyncIID);
+
+	//! Destructor.
+	virtual ~CallFactoryImpl();
+
+	//
+	// ICallFactory methods.
+	//
+
+	//! Create a call object for the asynchronous interface.
+	virtual HRESULT COMCALL CreateCall(const IID& rAsyncIID, IUnknown* pOuter, const IID& rIID, IUnknown** ppUnknown);
+
+private:
+	//
+	// Members.
+	//
+	IID				m_oAsyncIID;	//!< The asynchronous interface ID.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the asynchronous interface ID.
+
+template<typename T, typename CallType>
+inline CallFactoryImpl<T, CallType>::CallFactoryImpl(const IID& rAsyncIID)
+	: m_oAsyncIID(rAsyncIID)
+{
+	(void)sizeof(ThreadSafeModelCheck<T::THREADING_MODEL>);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+template<typename T, typename CallType>
+inline CallFactoryImpl<T, CallType>::~CallFactoryImpl()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create a call object for the asynchronous interface. The call object is
+//! always aggregated, so the only interface that can be requested is IUnknown.
+
+template<typename T, typename CallType>
+inline HRESULT COMCALL CallFactoryImpl<T, CallType>::CreateCall(const IID& rAsyncIID, IUnknown* pOuter, const IID& rIID, IUnknown** ppUnknown)
+{
+	// Check parameters.
+	if (ppUnknown == nullptr)
+		return E_POINTER;
+
+	// Reset output parameters.
+	*ppUnknown = nullptr;
+
+	// Validate input parameters.
+	if (!IsEqualIID(rAsyncIID, m_oAsyncIID))
+		return E_NOINTERFACE;
+
+	if ( (pOuter == nullptr) || !IsEqualIID(rIID, IID_IUnknown) )
+		return CLASS_E_NOAGGREGATION;
+
+	CallType* pCall = new(std::nothrow) CallType(pOuter, static_cast<T&>(*this));
+
+	if (pCall == nullptr)
+		return E_OUTOFMEMORY;
+
+	return pCall->GetInnerUnknown()->QueryInterface(rIID, reinterpret_cast<void**>(ppUnknown));
+}
+
+//namespace COM
+}
+
+#endif // COM_ASYNCCALL_HPP
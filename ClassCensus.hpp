@@ -0,0 +1,252 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ClassCensus.hpp
+//! \brief  The ClassCounters and ClassStats type declarations.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_CLASSCENSUS_HPP
+#define COM_CLASSCENSUS_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "StripedCounter.hpp"
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The census of the objects of a single class. The values are assembled from
+//! counters which are updated without synchronising with the reader and so are
+//! approximate whilst objects are being created and destroyed.
+
+struct ClassStats
+{
+	long		m_nLive;		//!< The number of live objects.
+	long		m_nPeak;		//!< The highest number of live objects seen.
+	ULONGLONG	m_nCreated;		//!< The number of objects created.
+	ULONGLONG	m_nBytes;		//!< The memory used by the live objects.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The per-class object counters maintained by ObjectBase. An object is
+//! counted from its first AddRef() to its final Release(), i.e. for the same
+//! period that it holds a server lock.
+//!
+//! Like a StripedCounter the counts are split across cache-line sized stripes
+//! selected by the thread ID, so that creating objects on different threads
+//! does not cause contention. An object is taken off the live count of the
+//! stripe it was counted in, rather than that of the thread which destroys it,
+//! so that a stripe's live count is the number of live objects created by its
+//! threads. The stripes are only summed when read, except to maintain the peak,
+//! which is only checked when the creating thread's stripe reaches a new high.
+//! Once the population is stable that is rare, even when objects are created
+//! on one thread and released on another.
+//!
+//! The counters belong to the class which declares the interface table, so a
+//! class derived from a concrete class must declare its own to be counted
+//! separately. The type is a POD so that the per-class instance is
+//! zero-initialised by the compiler rather than relying on (thread unsafe)
+//! dynamic initialisation.
+
+struct ClassCounters
+{
+	//! The number of stripes.
+	static const size_t NUM_STRIPES = StripedCounter::NUM_STRIPES;
+
+	//! A single cache-line padded stripe.
+	struct Stripe
+	{
+		volatile LONGLONG	m_nCreated;		//!< The partial number of objects created.
+		volatile LONG		m_nLive;		//!< The partial number of live objects.
+		LONG				m_nHigh;		//!< The highest partial live count seen.
+		char				m_acPadding[CACHE_LINE_SIZE - sizeof(LONGLONG) - 2*sizeof(LONG)];	//!< The unused remainder.
+	};
+
+	//
+	// Properties.
+	//
+
+	//! Get the census for the class.
+	ClassStats Stats();
+
+	//
+	// Methods.
+	//
+
+	//! Account for an object being created.
+	Stripe& OnCreate();
+
+	//! Account for an object being destroyed.
+	void OnDestroy(Stripe& oStripe);
+
+	//! Get the counters for the class of an object.
+	template<typename T>
+	static ClassCounters& For(T* pObject);
+
+	//! Get the counters for a class.
+	template<typename T>
+	static ClassCounters& Of();
+
+	//
+	// Members.
+	//
+	size_t			m_nSize;							//!< The size of an object.
+	volatile LONG	m_nPeak;							//!< The highest live count seen.
+	char			m_acPadding[CACHE_LINE_SIZE];		//!< Isolates the stripes from the preceding data.
+	Stripe			m_aoStripes[NUM_STRIPES];			//!< The counter stripes.
+
+	//
+	// Internal methods.
+	//
+
+	//! Get the stripe for the calling thread.
+	Stripe& ThreadStripe();
+
+	//! Sum the live counts of the stripes.
+	long SumLive() const;
+
+	//! Raise the peak, if the live count is higher.
+	void UpdatePeak(long nLive);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The storage for the counters of a class. A class template static member of
+//! a POD type without an initialiser is zero-initialised.
+
+template<typename T>
+struct ClassCensus
+{
+	static ClassCounters s_oCounters;	//!< The class counters.
+};
+
+template<typename T>
+ClassCounters ClassCensus<T>::s_oCounters;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the census for the class. The current live count is also folded into
+//! the peak.
+
+inline ClassStats ClassCounters::Stats()
+{
+	ClassStats oStats;
+	ULONGLONG  nCreated = 0;
+
+	for (size_t i = 0; i != NUM_STRIPES; ++i)
+		nCreated += static_cast<ULONGLONG>(m_aoStripes[i].m_nCreated);
+
+	long nLive = SumLive();
+
+	UpdatePeak(nLive);
+
+	oStats.m_nLive    = nLive;
+	oStats.m_nPeak    = m_nPeak;
+	oStats.m_nCreated = nCreated;
+	oStats.m_nBytes   = static_cast<ULONGLONG>(nLive) * m_nSize;
+
+	return oStats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Account for an object being created. The returned stripe must be passed to
+//! OnDestroy() when the object is destroyed.
+
+inline ClassCounters::Stripe& ClassCounters::OnCreate()
+{
+	Stripe& oStripe = ThreadStripe();
+
+	::InterlockedIncrement64(&oStripe.m_nCreated);
+
+	LONG nLive = ::InterlockedIncrement(&oStripe.m_nLive);
+
+	// Only sum the stripes when this one reaches a new high.
+	if (nLive > oStripe.m_nHigh)
+	{
+		oStripe.m_nHigh = nLive;
+
+		UpdatePeak(SumLive());
+	}
+
+	return oStripe;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Account for an object being destroyed. The stripe is the one returned by
+//! OnCreate() for the object.
+
+inline void ClassCounters::OnDestroy(Stripe& oStripe)
+{
+	::InterlockedDecrement(&oStripe.m_nLive);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the counters for the class of an object. This is used by the interface
+//! table macro, where the class type is only known through 'this'.
+
+template<typename T>
+inline ClassCounters& ClassCounters::For(T* /*pObject*/)
+{
+	return Of<T>();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the counters for a class. The object size is recorded on first use;
+//! the size is the same whichever thread wins.
+
+template<typename T>
+inline ClassCounters& ClassCounters::Of()
+{
+	ClassCounters& oCounters = ClassCensus<T>::s_oCounters;
+
+	if (oCounters.m_nSize == 0)
+		oCounters.m_nSize = sizeof(T);
+
+	return oCounters;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the stripe for the calling thread. Thread IDs are multiples of 4 so the
+//! bottom bits are discarded before selecting the stripe.
+
+inline ClassCounters::Stripe& ClassCounters::ThreadStripe()
+{
+	return m_aoStripes[(::GetCurrentThreadId() >> 2) & (NUM_STRIPES - 1)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Sum the live counts of the stripes. The stripes are not read atomically, so
+//! a sum taken mid-update is only approximate; it's clamped at zero.
+
+inline long ClassCounters::SumLive() const
+{
+	long nLive = 0;
+
+	for (size_t i = 0; i != NUM_STRIPES; ++i)
+		nLive += m_aoStripes[i].m_nLive;
+
+	return (nLive > 0) ? nLive : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Raise the peak, if the live count is higher.
+
+inline void ClassCounters::UpdatePeak(long nLive)
+{
+	LONG nPeak = m_nPeak;
+
+	while (nLive > nPeak)
+	{
+		LONG nPrevious = ::InterlockedCompareExchange(&m_nPeak, nLive, nPeak);
+
+		if (nPrevious == nPeak)
+			break;
+
+		nPeak = nPrevious;
+	}
+}
+
+//namespace COM
+}
+
+#endif // COM_CLASSCENSUS_HPP
@@ -5,7 +5,8 @@
 
 #include "Common.hpp"
 #include "ClassFactory.hpp"
-#include "InprocServer.hpp"
+#include "Server.hpp"
+#include "ApartmentPool.hpp"
 
 #if (__GNUC__ >= 8) // GCC 8+
 // error: format '%hs' expects argument of type 'short int*', but argument 3 has type 'const char*' [-Werror=format=]
@@ -20,6 +21,7 @@ namespace COM
 
 ClassFactory::ClassFactory(const CLSID& rCLSID)
 	: m_oCLSID(rCLSID)
+	, m_eModel(Server::This().ClassThreadingModel(rCLSID))
 {
 }
 
@@ -32,7 +34,11 @@ ClassFactory::~ClassFactory()
 
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Create an instance object of the class.
+//! Create an instance object of the class. Only the creation of the object
+//! itself needs an exception handler, as that calls into the derived class.
+//! If the server has an apartment pool an apartment threaded object is
+//! created on one of the pool's apartments, unless the caller is already in
+//! one, and a marshalled pointer returned.
 
 HRESULT COMCALL ClassFactory::CreateInstance(IUnknown* pOuter, const IID& rIID, void** ppInterface)
 {
@@ -47,19 +53,30 @@ HRESULT COMCALL ClassFactory::CreateInstance(IUnknown* pOuter, const IID& rIID,
 	if (pOuter != nullptr)
 		return CLASS_E_NOAGGREGATION;
 
-	HRESULT hr = E_FAIL;
+	HRESULT        hr = S_OK;
+	IUnknownPtr    pUnknown;
+	ApartmentPool* pApartments = nullptr;
 
+	// Create the object, which runs the derived class code.
 	try
 	{
-		// Create the object.
-		IUnknownPtr pUnknown = InprocServer::This().CreateObject(m_oCLSID);
+		if (m_eModel == SINGLE_THREAD_APT)
+			pApartments = Server::This().Apartments();
 
-		if (pUnknown.get() != nullptr)
-			hr = pUnknown->QueryInterface(rIID, ppInterface);
+		if ( (pApartments != nullptr) && !pApartments->IsPoolThread() )
+			return pApartments->CreateInstance(m_oCLSID, rIID, ppInterface);
+
+		pUnknown = Server::This().CreateObject(m_oCLSID);
 	}
 	COM_CATCH(hr)
 
-	return hr;
+	if (FAILED(hr))
+		return hr;
+
+	if (pUnknown.get() == nullptr)
+		return COM_FAILURE(E_FAIL, TXT("The server does not implement the class")).Report();
+
+	return pUnknown->QueryInterface(rIID, ppInterface);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -69,12 +86,48 @@ HRESULT COMCALL ClassFactory::LockServer(BOOL fLock)
 {
 	HRESULT hr = S_OK;
 
-	InprocServer& oServer = InprocServer::This();
+	Server& oServer = Server::This();
 
 	(fLock) ? oServer.Lock() : oServer.Unlock();
 
 	return hr;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from a CLSID.
+
+CachedClassFactory::CachedClassFactory(const CLSID& rCLSID)
+	: ClassFactory(rCLSID)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the objects reference count. The first reference after the
+//! cache's is the first client reference.
+
+ULONG CachedClassFactory::AddRefImpl()
+{
+	ULONG nRefCount = ClassFactory::AddRefImpl();
+
+	if (nRefCount == 2)
+		Server::This().Lock();
+
+	return nRefCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the objects reference count. When only the cache's reference
+//! remains the last client reference has gone.
+
+ULONG CachedClassFactory::ReleaseImpl()
+{
+	ULONG nRefCount = ClassFactory::ReleaseImpl();
+
+	if (nRefCount == 1)
+		Server::This().Unlock();
+
+	return nRefCount;
+}
+
 //namespace COM
 }
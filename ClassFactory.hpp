@@ -45,7 +45,33 @@ private:
 	//
 	// Members.
 	//
-	CLSID	m_oCLSID;		//!< The CLSID to manufacture objects of.
+	CLSID			m_oCLSID;		//!< The CLSID to manufacture objects of.
+	ThreadingModel	m_eModel;		//!< The threading model of the class.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The class factory kept in the InprocServer cache. The reference held by the
+//! cache does not lock the server, otherwise it could never be unloaded, but a
+//! client reference does. The server is locked when the first client reference
+//! is taken and unlocked when the last one is released, as per ATL's
+//! CComObjectCached, so that DllCanUnloadNow() fails whilst a client holds the
+//! factory, even if it never calls LockServer().
+
+class CachedClassFactory : public ClassFactory
+{
+public:
+	//! Construction from a CLSID.
+	CachedClassFactory(const CLSID& rCLSID);
+
+	//
+	// IUnknown methods.
+	//
+
+	//! Increment the objects reference count.
+	virtual ULONG AddRefImpl();
+
+	//! Decrement the objects reference count.
+	virtual ULONG ReleaseImpl();
 };
 
 //namespace COM
@@ -95,3 +95,26 @@ STDAPI DllInstall(BOOL install, const tchar* cmdLine)
 
 	return hr;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//! Entry point for writing the registration-free COM manifest. The path is
+//! always Unicode, whatever the build, so that the export has one signature.
+
+STDAPI DllWriteManifest(LPCWSTR file)
+{
+	HRESULT hr = E_FAIL;
+
+	try
+	{
+		tstring strFile;
+
+		if (file != nullptr)
+			strFile = W2T(file);
+
+		// Forward to inproc server singleton.
+		hr = COM::InprocServer::This().DllWriteManifest(strFile.c_str());
+	}
+	COM_CATCH(hr)
+
+	return hr;
+}
@@ -33,4 +33,7 @@ STDAPI DllUnregisterServer(void);
 //! Newer entry point for registering and unregistering the inproc server.
 STDAPI DllInstall(BOOL install, const tchar* cmdLine);
 
+//! Entry point for writing the registration-free COM manifest.
+STDAPI DllWriteManifest(LPCWSTR file);
+
 #endif // COM_COMMAIN_HPP
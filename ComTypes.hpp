@@ -15,6 +15,8 @@
 #include <WCL/StrCvt.hpp>
 #include <WCL/ComException.hpp>
 #include <WCL/Win32Exception.hpp>
+#include "InterfaceTable.hpp"
+#include "TearOff.hpp"
 
 namespace COM
 {
@@ -49,6 +51,21 @@ enum ThreadingModel
 	NEUTRAL_APARTMENT	= 5,	//!< ThreadingModel=Neutral
 };
 
+//! The type used to reject, at compile time, a class which must be thread-safe
+//! but uses one of the STA threading models, whose objects have a plain
+//! reference count. The STA cases are declared but not defined, so taking
+//! their size fails to compile.
+template<ThreadingModel Model>
+struct ThreadSafeModelCheck
+{
+};
+
+template<>
+struct ThreadSafeModelCheck<MAIN_THREAD_APT>;
+
+template<>
+struct ThreadSafeModelCheck<SINGLE_THREAD_APT>;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Macros for defining the interface table and IUnknown methods.
 
@@ -64,22 +81,54 @@ enum ThreadingModel
 									{	return InterfaceSupportsErrorInfoImpl(rIID);	}
 
 //! Implements interface_cast to match and downcast to the required interface.
+//! The table is built once, on first use, and then searched with a binary chop.
+//! The entries are declared as an array so that a table with more than
+//! COM::MAX_INTERFACE_ENTRIES entries fails to compile.
+//! This also implements class_counters, which finds the census for the class.
 #define DEFINE_INTERFACE_TABLE(primary_iface)												\
+									virtual COM::ClassCounters& class_counters()			\
+									{	return COM::ClassCounters::For(this);	}			\
+																							\
 									virtual void* interface_cast(const IID& rIID)			\
 									{														\
-										if (IsEqualIID(rIID, IID_IUnknown))					\
-											return static_cast<primary_iface*>(this);		\
-										if (IsEqualIID(rIID, IID_ISupportErrorInfo))		\
-											return static_cast<ISupportErrorInfo*>(this);
+										static COM::InterfaceTable s_oTable;				\
+																							\
+										if (s_oTable.IsReady())								\
+											return s_oTable.Find(this, rIID);				\
+																							\
+										const COM::InterfaceMapping aoMappings[] =			\
+										{													\
+											{ &IID_IUnknown, static_cast<primary_iface*>(this), nullptr },				\
+											{ &IID_ISupportErrorInfo, static_cast<ISupportErrorInfo*>(this), nullptr },
 
 //! Adds a match for an interface.
 #define IMPLEMENT_INTERFACE(iid, iface_name)												\
-										if (IsEqualIID(rIID, iid))							\
-											return static_cast<iface_name*>(this);
+											{ &iid, static_cast<iface_name*>(this), nullptr },
+
+//! Adds a match for an interface implemented by a tear-off, which is created
+//! for each query. The tear-off class derives from COM::TearOff.
+#define IMPLEMENT_TEAROFF_INTERFACE(iid, tearoff_class)										\
+											{ &iid, nullptr, &COM::TearOffFactory<tearoff_class>::Create },
+
+//! Adds a match for an interface implemented by a tear-off, which is created
+//! on the first query and held by the COM::TearOffCache member until the object
+//! is destroyed.
+#define IMPLEMENT_CACHED_TEAROFF_INTERFACE(iid, tearoff_class, cache_member)					\
+											{ &iid, &cache_member, &COM::TearOffFactory<tearoff_class>::CreateCached },
 
-//! End of CastInterfaceImpl implementation.
+//! End of interface_cast implementation.
 #define END_INTERFACE_TABLE()																\
-										return nullptr;										\
+										};													\
+																							\
+										const size_t nMappings = sizeof(aoMappings) / sizeof(aoMappings[0]);			\
+																							\
+										(void)sizeof(COM::InterfaceTableSizeCheck<(nMappings <= COM::MAX_INTERFACE_ENTRIES)>);			\
+																							\
+										COM::InterfaceTableBuilder oBuilder(this);			\
+																							\
+										oBuilder.Add(aoMappings, nMappings);				\
+																							\
+										return oBuilder.Publish(s_oTable).Find(this, rIID);	\
 									}
 
 //namespace COM
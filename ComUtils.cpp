@@ -5,57 +5,555 @@
 
 #include "Common.hpp"
 #include "ComUtils.hpp"
+#include "CriticalSection.hpp"
+#include "InterfaceTable.hpp"
 #include <WCL/RegKey.hpp>
 #include <Core/AnsiWide.hpp>
-#include <Core/BadLogicException.hpp>
+#include <map>
+#include <set>
 
 namespace COM
 {
 
-//! The maximum length of a string GUID.
-const size_t MAX_GUID_CHARS = 38;
+////////////////////////////////////////////////////////////////////////////////
+// The helper functions for formatting and parsing GUIDs.
+
+namespace
+{
+
+//! The upper case hex digit pairs for every byte value.
+const char HEX_PAIRS[] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write the hex digits for a value, most significant byte first.
+
+inline tchar* WriteHex(tchar* pszBuffer, ulong nValue, size_t nBytes)
+{
+	for (size_t nShift = (nBytes - 1) * 8; nBytes != 0; --nBytes, nShift -= 8)
+	{
+		const char* pszPair = HEX_PAIRS + (((nValue >> nShift) & 0xFF) * 2);
+
+		*pszBuffer++ = pszPair[0];
+		*pszBuffer++ = pszPair[1];
+	}
+
+	return pszBuffer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write the hex digits for a sequence of bytes.
+
+inline tchar* WriteHex(tchar* pszBuffer, const byte* pbBytes, size_t nBytes)
+{
+	for (size_t i = 0; i != nBytes; ++i)
+	{
+		const char* pszPair = HEX_PAIRS + (pbBytes[i] * 2);
+
+		*pszBuffer++ = pszPair[0];
+		*pszBuffer++ = pszPair[1];
+	}
+
+	return pszBuffer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the value of a hex digit, or -1 if the character is not a hex digit.
+
+inline int HexValue(tchar cChar)
+{
+	if ( (cChar >= TXT('0')) && (cChar <= TXT('9')) )
+		return cChar - TXT('0');
+
+	if ( (cChar >= TXT('A')) && (cChar <= TXT('F')) )
+		return cChar - TXT('A') + 10;
+
+	if ( (cChar >= TXT('a')) && (cChar <= TXT('f')) )
+		return cChar - TXT('a') + 10;
+
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read a fixed number of hex digits. This stops at the first character that
+//! is not a hex digit, including the terminator, and so never reads past the
+//! end of the string.
+
+inline bool ReadHex(const tchar*& pszString, size_t nDigits, ulong& nValue)
+{
+	ulong nResult = 0;
+
+	for (size_t i = 0; i != nDigits; ++i)
+	{
+		int nDigit = HexValue(*pszString);
+
+		if (nDigit < 0)
+			return false;
+
+		nResult = (nResult << 4) | static_cast<ulong>(nDigit);
+		++pszString;
+	}
+
+	nValue = nResult;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the hex digits for a sequence of bytes.
+
+inline bool ReadHex(const tchar*& pszString, byte* pbBytes, size_t nBytes)
+{
+	for (size_t i = 0; i != nBytes; ++i)
+	{
+		ulong nValue;
+
+		if (!ReadHex(pszString, 2, nValue))
+			return false;
+
+		pbBytes[i] = static_cast<byte>(nValue);
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read an expected character.
+
+inline bool ReadChar(const tchar*& pszString, tchar cChar)
+{
+	if (*pszString != cChar)
+		return false;
+
+	++pszString;
+
+	return true;
+}
+
+//namespace
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Format the GUID as a string in Registry format.
 
 tstring FormatGUID(const GUID& rGUID)
 {
-	wchar_t szBuffer[MAX_GUID_CHARS+1];
+	tchar szBuffer[GUID_BUFFER_SIZE];
 
-	if (::StringFromGUID2(rGUID, szBuffer, MAX_GUID_CHARS+1) == 0)
-		throw Core::BadLogicException(TXT("Invalid buffer size passed to StringFromGUID2()"));
+	return tstring(FormatGUID(rGUID, szBuffer));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Format the GUID as a string in Registry format, into a fixed size buffer,
+//! i.e. {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}. The output is the same as
+//! ::StringFromGUID2() but needs no conversion or allocation. Each byte is
+//! encoded with a single lookup into a table of hex digit pairs. The buffer is
+//! returned for convenience.
 
-	return tstring(W2T(szBuffer));
+const tchar* FormatGUID(const GUID& rGUID, tchar (&szBuffer)[GUID_BUFFER_SIZE])
+{
+	tchar* pszBuffer = szBuffer;
+
+	*pszBuffer++ = TXT('{');
+	pszBuffer    = WriteHex(pszBuffer, rGUID.Data1, 4);
+	*pszBuffer++ = TXT('-');
+	pszBuffer    = WriteHex(pszBuffer, rGUID.Data2, 2);
+	*pszBuffer++ = TXT('-');
+	pszBuffer    = WriteHex(pszBuffer, rGUID.Data3, 2);
+	*pszBuffer++ = TXT('-');
+	pszBuffer    = WriteHex(pszBuffer, rGUID.Data4, 2);
+	*pszBuffer++ = TXT('-');
+	pszBuffer    = WriteHex(pszBuffer, rGUID.Data4+2, 6);
+	*pszBuffer++ = TXT('}');
+	*pszBuffer   = TXT('\0');
+
+	ASSERT(pszBuffer == (szBuffer + GUID_BUFFER_SIZE - 1));
+
+	return szBuffer;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Find the human readable name for the class ID.
+//! Parse a GUID from a string in Registry format. The string must match the
+//! format exactly, including the braces, but the hex digits may be in either
+//! case. Unlike ::CLSIDFromString() this does not accept a ProgID. This returns
+//! false if the string is not a valid GUID, in which case the GUID is not
+//! modified.
 
-tstring LookupCLSID(const CLSID& rCLSID)
+bool ParseGUID(const tchar* pszString, GUID& rGUID)
 {
+	if (pszString == nullptr)
+		return false;
+
+	GUID  oGUID;
+	ulong nData1, nData2, nData3;
+
+	bool bValid = ReadChar(pszString, TXT('{'))
+			   && ReadHex(pszString, 8, nData1)   && ReadChar(pszString, TXT('-'))
+			   && ReadHex(pszString, 4, nData2)   && ReadChar(pszString, TXT('-'))
+			   && ReadHex(pszString, 4, nData3)   && ReadChar(pszString, TXT('-'))
+			   && ReadHex(pszString, oGUID.Data4, 2) && ReadChar(pszString, TXT('-'))
+			   && ReadHex(pszString, oGUID.Data4+2, 6)
+			   && ReadChar(pszString, TXT('}'))
+			   && (*pszString == TXT('\0'));
+
+	if (!bValid)
+		return false;
+
+	oGUID.Data1 = nData1;
+	oGUID.Data2 = static_cast<ushort>(nData2);
+	oGUID.Data3 = static_cast<ushort>(nData3);
+
+	rGUID = oGUID;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The caches of class and interface names. Each name lookup costs a couple of
+// registry calls, which are even slower under the merged HKCR view, and the
+// same few GUIDs are looked up over and over again by diagnostic code.
+
+namespace
+{
+
+//! The maximum number of names held in each cache.
+const size_t MAX_CACHED_NAMES = 2048;
+
+//! The maximum number of names added to each cache by the preload. This leaves
+//! room for the names actually looked up.
+const size_t MAX_PRELOADED_NAMES = MAX_CACHED_NAMES / 2;
+
+//! The maximum number of unregistered GUIDs remembered by each cache.
+const size_t MAX_CACHED_MISSES = 256;
+
+//! The maximum length of a key name or name read by the preload.
+const size_t MAX_KEY_NAME_LEN = 255;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The ordering used for the cache keys.
+
+struct GUIDLess
+{
+	bool operator()(const GUID& rLHS, const GUID& rRHS) const
+	{
+		return (CompareGUID(rLHS, rRHS) < 0);
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! A thread-safe, bounded cache of GUID to name mappings. When the cache is
+//! full a single entry is evicted to make room, rather than tracking usage.
+//! The victim is the entry which follows the new GUID in the map and, as GUIDs
+//! are effectively random, this is a random choice; so a small set of GUIDs
+//! looked up repeatedly stays cached.
+//!
+//! GUIDs which aren't registered are remembered separately, and with a smaller
+//! bound, so that looking up lots of unknown GUIDs can't push out the names.
+
+class NameCache : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	NameCache();
+
+	//! Find the cached name for a GUID.
+	bool Find(const GUID& rGUID, tstring& strName);
+
+	//! Add the name for a GUID.
+	void Add(const GUID& rGUID, const tstring& strName);
+
+	//! Add a GUID which is not registered.
+	void AddMiss(const GUID& rGUID);
+
+	//! Get the number of cached names.
+	size_t Count();
+
+	//! Discard all the cached names and misses.
+	void Clear();
+
+private:
+	//! The map of GUID to name.
+	typedef std::map<GUID, tstring, GUIDLess> Names;
+	//! The set of unregistered GUIDs.
+	typedef std::set<GUID, GUIDLess> Misses;
+
+	//
+	// Members.
+	//
+	CriticalSection	m_oLock;	//!< The lock used to serialise access.
+	Names			m_oNames;	//!< The cached names.
+	Misses			m_oMisses;	//!< The cached misses.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+NameCache::NameCache()
+	: m_oLock()
+	, m_oNames()
+	, m_oMisses()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the cached name for a GUID. A GUID which is cached as not registered
+//! is found with an empty name.
+
+bool NameCache::Find(const GUID& rGUID, tstring& strName)
+{
+	CriticalSection::Lock oLock(m_oLock);
+
+	Names::const_iterator it = m_oNames.find(rGUID);
+
+	if (it != m_oNames.end())
+	{
+		strName = it->second;
+		return true;
+	}
+
+	if (m_oMisses.find(rGUID) != m_oMisses.end())
+	{
+		strName.clear();
+		return true;
+	}
+
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add the name for a GUID, evicting another entry first if the cache is full.
+
+void NameCache::Add(const GUID& rGUID, const tstring& strName)
+{
+	CriticalSection::Lock oLock(m_oLock);
+
+	Names::iterator it = m_oNames.lower_bound(rGUID);
+
+	if ( (it != m_oNames.end()) && !GUIDLess()(rGUID, it->first) )
+	{
+		it->second = strName;
+		return;
+	}
+
+	if (m_oNames.size() >= MAX_CACHED_NAMES)
+		m_oNames.erase((it != m_oNames.end()) ? it : m_oNames.begin());
+
+	m_oNames.insert(Names::value_type(rGUID, strName));
+	m_oMisses.erase(rGUID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add a GUID which is not registered, evicting another miss first if the set
+//! of misses is full.
+
+void NameCache::AddMiss(const GUID& rGUID)
+{
+	CriticalSection::Lock oLock(m_oLock);
+
+	Misses::iterator it = m_oMisses.lower_bound(rGUID);
+
+	if ( (it != m_oMisses.end()) && !GUIDLess()(rGUID, *it) )
+		return;
+
+	if (m_oMisses.size() >= MAX_CACHED_MISSES)
+		m_oMisses.erase((it != m_oMisses.end()) ? it : m_oMisses.begin());
+
+	m_oMisses.insert(rGUID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of cached names.
+
+size_t NameCache::Count()
+{
+	CriticalSection::Lock oLock(m_oLock);
+
+	return m_oNames.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Discard all the cached names and misses.
+
+void NameCache::Clear()
+{
+	CriticalSection::Lock oLock(m_oLock);
+
+	m_oNames.clear();
+	m_oMisses.clear();
+}
+
+//! The cache of class names.
+NameCache g_oCLSIDNames;
+
+//! The cache of interface names.
+NameCache g_oIIDNames;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the name for a GUID from the registry, i.e. the default value of the
+//! key HKCR\<root>\{GUID}. This returns false if the key does not exist.
+
+bool ReadName(const tchar* pszRoot, const GUID& rGUID, tstring& strName)
+{
+	tchar szGUID[GUID_BUFFER_SIZE];
+
 	// Format the key name.
-	tstring strKey = TXT("CLSID\\") + FormatGUID(rCLSID);
+	tstring strKey = pszRoot;
+
+	strKey += TXT("\\");
+	strKey += FormatGUID(rGUID, szGUID);
 
 	if (!WCL::RegKey::Exists(HKEY_CLASSES_ROOT, strKey.c_str()))
-		return TXT("");
+		return false;
+
+	// The key default value is the name.
+	strName = tstring(WCL::RegKey::ReadKeyDefaultValue(HKEY_CLASSES_ROOT, strKey.c_str()));
 
-	// The key default value is the class name.
-	return tstring(WCL::RegKey::ReadKeyDefaultValue(HKEY_CLASSES_ROOT, strKey.c_str()));
+	return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Find the human readable name for the interface ID.
+//! Find the name for a GUID, using the cache if possible. A GUID which isn't
+//! registered is cached as an empty name until the cache is flushed.
+
+tstring LookupName(NameCache& oCache, const tchar* pszRoot, const GUID& rGUID)
+{
+	tstring strName;
+
+	if (oCache.Find(rGUID, strName))
+		return strName;
+
+	if (ReadName(pszRoot, rGUID, strName))
+		oCache.Add(rGUID, strName);
+	else
+		oCache.AddMiss(rGUID);
+
+	return strName;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the default value of a subkey as a string. This returns false if the
+//! key can't be opened or the value is not a string or is too long.
+
+bool ReadDefaultValue(HKEY hParent, const tchar* pszSubKey, tstring& strValue)
+{
+	HKEY hKey = nullptr;
+
+	if (::RegOpenKeyEx(hParent, pszSubKey, 0, KEY_QUERY_VALUE, &hKey) != ERROR_SUCCESS)
+		return false;
+
+	tchar szValue[MAX_KEY_NAME_LEN+1];
+	DWORD dwType = REG_NONE;
+	DWORD dwSize = sizeof(szValue) - sizeof(tchar);
+
+	LONG lResult = ::RegQueryValueEx(hKey, nullptr, nullptr, &dwType, reinterpret_cast<BYTE*>(szValue), &dwSize);
+
+	::RegCloseKey(hKey);
+
+	if (lResult == ERROR_FILE_NOT_FOUND)
+	{
+		strValue.clear();
+		return true;
+	}
+
+	if ( (lResult != ERROR_SUCCESS) || (dwType != REG_SZ) )
+		return false;
+
+	szValue[dwSize / sizeof(tchar)] = TXT('\0');
+	strValue = szValue;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add the names of the GUID subkeys of a key to the cache, until the preload
+//! limit is reached.
+
+void PreloadNames(NameCache& oCache, const tchar* pszRoot)
+{
+	HKEY hKey = nullptr;
+
+	if (::RegOpenKeyEx(HKEY_CLASSES_ROOT, pszRoot, 0, KEY_READ, &hKey) != ERROR_SUCCESS)
+		return;
+
+	tchar szSubKey[MAX_KEY_NAME_LEN+1];
+
+	for (DWORD dwIndex = 0; oCache.Count() < MAX_PRELOADED_NAMES; ++dwIndex)
+	{
+		DWORD dwChars = MAX_KEY_NAME_LEN+1;
+		LONG  lResult = ::RegEnumKeyEx(hKey, dwIndex, szSubKey, &dwChars, nullptr, nullptr, nullptr, nullptr);
+
+		if (lResult == ERROR_NO_MORE_ITEMS)
+			break;
+
+		GUID    oGUID;
+		tstring strName;
+
+		// Skip anything which isn't a GUID or has a name the cache can't hold.
+		if ( (lResult == ERROR_SUCCESS) && ParseGUID(szSubKey, oGUID)
+		  && ReadDefaultValue(hKey, szSubKey, strName) )
+		{
+			oCache.Add(oGUID, strName);
+		}
+	}
+
+	::RegCloseKey(hKey);
+}
+
+//namespace
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the human readable name for the class ID. The name, or the lack of
+//! one, is cached.
+
+tstring LookupCLSID(const CLSID& rCLSID)
+{
+	return LookupName(g_oCLSIDNames, TXT("CLSID"), rCLSID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the human readable name for the interface ID. The name, or the lack of
+//! one, is cached.
 
 tstring LookupIID(const IID& rIID)
 {
-	// Format the key name.
-	tstring strKey = TXT("Interface\\") + FormatGUID(rIID);
+	return LookupName(g_oIIDNames, TXT("Interface"), rIID);
+}
 
-	if (!WCL::RegKey::Exists(HKEY_CLASSES_ROOT, strKey.c_str()))
-		return TXT("");
+////////////////////////////////////////////////////////////////////////////////
+//! Preload the class and interface name caches by enumerating the CLSID and
+//! Interface keys once, up to half the size of the caches. This is optional and
+//! is intended for processes which do a lot of tracing.
 
-	// The key default value is the interface name.
-	return tstring(WCL::RegKey::ReadKeyDefaultValue(HKEY_CLASSES_ROOT, strKey.c_str()));
+void PreloadLookupCache()
+{
+	PreloadNames(g_oCLSIDNames, TXT("CLSID"));
+	PreloadNames(g_oIIDNames, TXT("Interface"));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Discard the cached class and interface names. This must be called after any
+//! CLSID or Interface keys are changed, which the registration functions do.
+
+void FlushLookupCache()
+{
+	g_oCLSIDNames.Clear();
+	g_oIIDNames.Clear();
 }
 
 //namespace COM
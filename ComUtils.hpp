@@ -14,11 +14,24 @@
 namespace COM
 {
 
+//! The size of the buffer for a GUID in Registry format, including the null.
+const size_t GUID_BUFFER_SIZE = 39;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Format the GUID as a string in Registry format.
 
 tstring FormatGUID(const GUID& rGUID);
 
+////////////////////////////////////////////////////////////////////////////////
+// Format the GUID as a string in Registry format, into a fixed size buffer.
+
+const tchar* FormatGUID(const GUID& rGUID, tchar (&szBuffer)[GUID_BUFFER_SIZE]); // throw()
+
+////////////////////////////////////////////////////////////////////////////////
+// Parse a GUID from a string in Registry format.
+
+bool ParseGUID(const tchar* pszString, GUID& rGUID); // throw()
+
 ////////////////////////////////////////////////////////////////////////////////
 // Find the human readable name for the class ID.
 
@@ -29,6 +42,16 @@ tstring LookupCLSID(const CLSID& rCLSID);
 
 tstring LookupIID(const IID& rIID);
 
+////////////////////////////////////////////////////////////////////////////////
+// Preload the class and interface name caches from the registry.
+
+void PreloadLookupCache(); // throw()
+
+////////////////////////////////////////////////////////////////////////////////
+// Discard the cached class and interface names.
+
+void FlushLookupCache(); // throw()
+
 //namespace COM
 }
 
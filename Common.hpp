@@ -46,5 +46,6 @@
 #include <COM/ComTypes.hpp>		// Core types and macros.
 #include <COM/ObjectBase.hpp>	// Default IUnknown implementation.
 #include <COM/ErrorInfo.hpp>	// COM error handling macros and functions.
+#include <COM/Result.hpp>		// Exception-free error propagation.
 
 #endif // COM_COMMON_HPP
@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   CriticalSection.hpp
+//! \brief  The CriticalSection class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_CRITICALSECTION_HPP
+#define COM_CRITICALSECTION_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! A thin wrapper around the Win32 CRITICAL_SECTION used to serialise the
+//! (rare) slow paths of the server-wide caches.
+
+class CriticalSection : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	CriticalSection();
+
+	//! Destructor.
+	~CriticalSection();
+
+	//
+	// Methods.
+	//
+
+	//! Acquire the lock.
+	void Enter();
+
+	//! Release the lock.
+	void Leave();
+
+	////////////////////////////////////////////////////////////////////////////
+	//! The helper class used to hold the lock for the lifetime of a scope.
+
+	class Lock : private Core::NotCopyable
+	{
+	public:
+		//! Acquire the lock.
+		Lock(CriticalSection& oSection);
+
+		//! Release the lock.
+		~Lock();
+
+	private:
+		//
+		// Members.
+		//
+		CriticalSection&	m_oSection;		//!< The lock being held.
+	};
+
+private:
+	//
+	// Members.
+	//
+	CRITICAL_SECTION	m_oSection;		//!< The underlying Win32 object.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline CriticalSection::CriticalSection()
+{
+	::InitializeCriticalSection(&m_oSection);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+inline CriticalSection::~CriticalSection()
+{
+	::DeleteCriticalSection(&m_oSection);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Acquire the lock.
+
+inline void CriticalSection::Enter()
+{
+	::EnterCriticalSection(&m_oSection);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Release the lock.
+
+inline void CriticalSection::Leave()
+{
+	::LeaveCriticalSection(&m_oSection);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Acquire the lock.
+
+inline CriticalSection::Lock::Lock(CriticalSection& oSection)
+	: m_oSection(oSection)
+{
+	m_oSection.Enter();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Release the lock.
+
+inline CriticalSection::Lock::~Lock()
+{
+	m_oSection.Leave();
+}
+
+//namespace COM
+}
+
+#endif // COM_CRITICALSECTION_HPP
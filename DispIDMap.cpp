@@ -0,0 +1,255 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   DispIDMap.cpp
+//! \brief  The DispIDMap class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "DispIDMap.hpp"
+
+namespace COM
+{
+
+//! The maximum number of names fetched for a single method.
+static const UINT MAX_MEMBER_NAMES = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the interface type information.
+
+DispIDMap::DispIDMap(ITypeInfo* pTypeInfo)
+	: m_vecMembers()
+	, m_vecSlots()
+{
+	ASSERT(pTypeInfo != nullptr);
+
+	TYPEATTR* pTypeAttr = nullptr;
+
+	HRESULT hr = pTypeInfo->GetTypeAttr(&pTypeAttr);
+
+	if (FAILED(hr))
+		throw WCL::ComException(hr, TXT("Failed to get the type attributes"));
+
+	WORD nFuncs = pTypeAttr->cFuncs;
+	WORD nVars  = pTypeAttr->cVars;
+
+	pTypeInfo->ReleaseTypeAttr(pTypeAttr);
+
+	BSTR abstrNames[MAX_MEMBER_NAMES];
+
+	// Add the methods and properties.
+	for (WORD i = 0; i != nFuncs; ++i)
+	{
+		FUNCDESC* pFuncDesc = nullptr;
+
+		if (FAILED(pTypeInfo->GetFuncDesc(i, &pFuncDesc)))
+			continue;
+
+		DISPID lDispID = pFuncDesc->memid;
+		UINT   nMax    = pFuncDesc->cParams + 1;
+		UINT   nNames  = 0;
+
+		if (nMax > MAX_MEMBER_NAMES)
+			nMax = MAX_MEMBER_NAMES;
+
+		pTypeInfo->ReleaseFuncDesc(pFuncDesc);
+
+		if (SUCCEEDED(pTypeInfo->GetNames(lDispID, abstrNames, nMax, &nNames)))
+			AddMember(abstrNames, nNames, lDispID);
+	}
+
+	// Add the data members.
+	for (WORD i = 0; i != nVars; ++i)
+	{
+		VARDESC* pVarDesc = nullptr;
+
+		if (FAILED(pTypeInfo->GetVarDesc(i, &pVarDesc)))
+			continue;
+
+		DISPID lDispID = pVarDesc->memid;
+		UINT   nNames  = 0;
+
+		pTypeInfo->ReleaseVarDesc(pVarDesc);
+
+		if (SUCCEEDED(pTypeInfo->GetNames(lDispID, abstrNames, 1, &nNames)))
+			AddMember(abstrNames, nNames, lDispID);
+	}
+
+	BuildSlots();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+DispIDMap::~DispIDMap()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Map a member name, and any argument names, to their dispatch IDs. This
+//! returns false if the map cannot answer the query, i.e. the member is not in
+//! the map or one of the names is not plain ASCII, in which case the caller
+//! should fall back to the type information. Otherwise the result of the
+//! mapping, S_OK or DISP_E_UNKNOWNNAME, is returned via hrResult.
+
+bool DispIDMap::Find(LPOLESTR* aszNames, UINT nNames, DISPID* alMemberIDs, HRESULT& hrResult) const
+{
+	ASSERT(nNames != 0);
+
+	wchar_t szFolded[MAX_NAME_LEN+1];
+	ULONG   nHash;
+
+	if (!FoldName(aszNames[0], szFolded, nHash))
+		return false;
+
+	const Member* pMember = FindMember(szFolded, nHash);
+
+	if (pMember == nullptr)
+		return false;
+
+	alMemberIDs[0] = pMember->m_lDispID;
+	hrResult       = S_OK;
+
+	// Map the named arguments to their position.
+	for (UINT i = 1; i != nNames; ++i)
+	{
+		if (!FoldName(aszNames[i], szFolded, nHash))
+			return false;
+
+		alMemberIDs[i] = DISPID_UNKNOWN;
+
+		for (size_t j = 0; j != pMember->m_vecParams.size(); ++j)
+		{
+			if (pMember->m_vecParams[j] == szFolded)
+			{
+				alMemberIDs[i] = static_cast<DISPID>(j);
+				break;
+			}
+		}
+
+		if (alMemberIDs[i] == DISPID_UNKNOWN)
+			hrResult = DISP_E_UNKNOWNNAME;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add a member and its parameter names. The names are freed. Members which
+//! share a name, i.e. the get and put methods of a property, share a DISPID
+//! and so only the first one is kept.
+
+void DispIDMap::AddMember(BSTR* abstrNames, UINT nNames, DISPID lDispID)
+{
+	wchar_t szFolded[MAX_NAME_LEN+1];
+	ULONG   nHash;
+	bool    bValid = ( (nNames != 0) && FoldName(abstrNames[0], szFolded, nHash) );
+	Member  oMember;
+
+	if (bValid)
+	{
+		oMember.m_nHash   = nHash;
+		oMember.m_strName = szFolded;
+		oMember.m_lDispID = lDispID;
+
+		for (UINT i = 1; (i != nNames) && bValid; ++i)
+		{
+			ULONG nParamHash;
+
+			bValid = FoldName(abstrNames[i], szFolded, nParamHash);
+
+			if (bValid)
+				oMember.m_vecParams.push_back(szFolded);
+		}
+	}
+
+	for (UINT i = 0; i != nNames; ++i)
+		::SysFreeString(abstrNames[i]);
+
+	if (!bValid)
+		return;
+
+	for (Members::const_iterator it = m_vecMembers.begin(); it != m_vecMembers.end(); ++it)
+	{
+		if (it->m_strName == oMember.m_strName)
+			return;
+	}
+
+	m_vecMembers.push_back(oMember);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Build the hash table from the members. The table is at most half full and
+//! collisions are resolved with linear probing.
+
+void DispIDMap::BuildSlots()
+{
+	size_t nSlots = 8;
+
+	while (nSlots < (m_vecMembers.size() * 2))
+		nSlots *= 2;
+
+	m_vecSlots.assign(nSlots, 0);
+
+	for (size_t i = 0; i != m_vecMembers.size(); ++i)
+	{
+		size_t nSlot = m_vecMembers[i].m_nHash & (nSlots - 1);
+
+		while (m_vecSlots[nSlot] != 0)
+			nSlot = (nSlot + 1) & (nSlots - 1);
+
+		m_vecSlots[nSlot] = i + 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find a member by folded name.
+
+const DispIDMap::Member* DispIDMap::FindMember(const wchar_t* pszName, ULONG nHash) const
+{
+	const size_t nMask = m_vecSlots.size() - 1;
+
+	for (size_t nSlot = nHash & nMask; m_vecSlots[nSlot] != 0; nSlot = (nSlot + 1) & nMask)
+	{
+		const Member& oMember = m_vecMembers[m_vecSlots[nSlot] - 1];
+
+		if ( (oMember.m_nHash == nHash) && (oMember.m_strName == pszName) )
+			return &oMember;
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Fold a name to upper case and hash it (FNV-1a). This fails if the name is
+//! missing, too long or contains any non-ASCII characters.
+
+bool DispIDMap::FoldName(const OLECHAR* pszName, wchar_t* pszFolded, ULONG& nHash)
+{
+	if (pszName == nullptr)
+		return false;
+
+	ULONG  nValue = 2166136261u;
+	size_t i      = 0;
+
+	for (; pszName[i] != L'\0'; ++i)
+	{
+		wchar_t cChar = pszName[i];
+
+		if ( (i == MAX_NAME_LEN) || (cChar > 0x7F) )
+			return false;
+
+		if ( (cChar >= L'a') && (cChar <= L'z') )
+			cChar = static_cast<wchar_t>(cChar - (L'a' - L'A'));
+
+		pszFolded[i] = cChar;
+
+		nValue = (nValue ^ cChar) * 16777619u;
+	}
+
+	pszFolded[i] = L'\0';
+	nHash        = nValue;
+
+	return true;
+}
+
+//namespace COM
+}
@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   DispIDMap.hpp
+//! \brief  The DispIDMap class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_DISPIDMAP_HPP
+#define COM_DISPIDMAP_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <oaidl.h>
+#include <string>
+#include <vector>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! An immutable hash map from member name to DISPID for a single interface,
+//! built once from the FUNCDESC and VARDESC data in its type information. It
+//! also holds the parameter names of each method so that the named argument
+//! IDs can be mapped as well.
+//!
+//! Names are folded to upper case for hashing and comparison, but only when
+//! they are pure ASCII. OLE compares the rest using the rules for the type
+//! library locale and so any other name is left to ITypeInfo::GetIDsOfNames.
+
+class DispIDMap : private Core::NotCopyable
+{
+public:
+	//! Construction from the interface type information.
+	DispIDMap(ITypeInfo* pTypeInfo); // throw(ComException)
+
+	//! Destructor.
+	~DispIDMap();
+
+	//
+	// Properties.
+	//
+
+	//! Get the number of members in the map.
+	size_t Count() const;
+
+	//
+	// Methods.
+	//
+
+	//! Map a member name, and any argument names, to their dispatch IDs.
+	bool Find(LPOLESTR* aszNames, UINT nNames, DISPID* alMemberIDs, HRESULT& hrResult) const;
+
+	//! The longest name that the map handles.
+	static const size_t MAX_NAME_LEN = 255;
+
+private:
+	//! The names of the parameters of a method.
+	typedef std::vector<std::wstring> Params;
+
+	//! A member of the interface.
+	struct Member
+	{
+		ULONG			m_nHash;		//!< The hash of the folded name.
+		std::wstring	m_strName;		//!< The folded member name.
+		DISPID			m_lDispID;		//!< The member dispatch ID.
+		Params			m_vecParams;	//!< The folded parameter names.
+	};
+
+	//! The collection of members.
+	typedef std::vector<Member> Members;
+
+	//! The open-addressed hash table of member index + 1, where 0 is unused.
+	typedef std::vector<size_t> Slots;
+
+	//
+	// Members.
+	//
+	Members		m_vecMembers;	//!< The members.
+	Slots		m_vecSlots;		//!< The hash table.
+
+	//
+	// Internal methods.
+	//
+
+	//! Add a member and its parameter names.
+	void AddMember(BSTR* abstrNames, UINT nNames, DISPID lDispID);
+
+	//! Build the hash table from the members.
+	void BuildSlots();
+
+	//! Find a member by folded name.
+	const Member* FindMember(const wchar_t* pszName, ULONG nHash) const;
+
+	//! Fold a name to upper case and hash it.
+	static bool FoldName(const OLECHAR* pszName, wchar_t* pszFolded, ULONG& nHash);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of members in the map.
+
+inline size_t DispIDMap::Count() const
+{
+	return m_vecMembers.size();
+}
+
+//namespace COM
+}
+
+#endif // COM_DISPIDMAP_HPP
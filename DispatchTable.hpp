@@ -0,0 +1,842 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   DispatchTable.hpp
+//! \brief  The DispatchTable class declaration and the argument marshalling.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_DISPATCHTABLE_HPP
+#define COM_DISPATCHTABLE_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+// Forward declarations.
+template<typename T>
+class DispatchTableImpl;
+
+//! The maximum number of members that a single dispatch table can hold.
+const size_t MAX_DISPATCH_ENTRIES = 128;
+
+//! The type used by END_DISPATCH_TABLE to reject a table with more than
+//! MAX_DISPATCH_ENTRIES entries at compile time. Only the 'true' case is
+//! defined, so taking the size of the 'false' case fails to compile.
+template<bool bFits>
+struct DispatchTableSizeCheck;
+
+template<>
+struct DispatchTableSizeCheck<true>
+{
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The arguments of a single late-bound call, bundled together so that they can
+//! be passed to the generated invokers as one parameter.
+
+struct DispatchCall
+{
+	DISPPARAMS*	m_pParams;		//!< The call arguments, in reverse order.
+	VARIANT*	m_pResult;		//!< The return value, if required.
+	EXCEPINFO*	m_pExcepInfo;	//!< The exception details, if required.
+	UINT*		m_pnArgError;	//!< The index of the first bad argument.
+	LCID		m_dwLCID;		//!< The locale used to coerce the arguments.
+};
+
+//! The type of function generated to invoke a member on an object.
+typedef HRESULT (*DispatchFn)(void* pObject, const DispatchCall& oCall);
+
+////////////////////////////////////////////////////////////////////////////////
+//! An entry in the dispatch table which maps a DISPID and invocation kind onto
+//! the generated function that unpacks the arguments and calls the member.
+
+struct DispatchEntry
+{
+	LPCOLESTR	m_pszName;		//!< The member name.
+	DISPID		m_lDispID;		//!< The member dispatch ID.
+	WORD		m_wFlags;		//!< The DISPATCH_* kind of invocation.
+	DispatchFn	m_pfnInvoke;	//!< The invoker.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The per-class table of late-bound members, sorted by DISPID. Like the
+//! InterfaceTable this is a POD so that the function-local static used by the
+//! DEFINE_DISPATCH_TABLE macro is zero-initialised, and it is filled in once,
+//! on first use, by a DispatchTableBuilder.
+
+struct DispatchTable
+{
+	//! The table states.
+	enum State
+	{
+		EMPTY		= 0,		//!< The table has not been built yet.
+		BUILDING	= 1,		//!< The table is being published.
+		READY		= 2,		//!< The table is immutable and can be searched.
+	};
+
+	//! Query if the table has been published.
+	bool IsReady() const;
+
+	//! Find the member for a DISPID and kind of invocation.
+	const DispatchEntry* Find(DISPID lDispID, WORD wFlags) const;
+
+	//! Find the DISPID for a member name.
+	bool FindName(LPCOLESTR pszName, DISPID& lDispID) const;
+
+	//
+	// Members.
+	//
+	volatile LONG	m_eState;							//!< The table State.
+	size_t			m_nCount;							//!< The number of entries.
+	DispatchEntry	m_aoEntries[MAX_DISPATCH_ENTRIES];	//!< The sorted entries.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the table has been published.
+
+inline bool DispatchTable::IsReady() const
+{
+	return (m_eState == READY);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the member for a DISPID and kind of invocation. A property can have
+//! both a get and put entry with the same DISPID and so, after the binary chop,
+//! the neighbouring entries with the same DISPID are also considered.
+
+inline const DispatchEntry* DispatchTable::Find(DISPID lDispID, WORD wFlags) const
+{
+	size_t nBegin = 0;
+	size_t nEnd   = m_nCount;
+
+	// Find the first entry with the DISPID.
+	while (nBegin < nEnd)
+	{
+		size_t nMiddle = nBegin + ((nEnd - nBegin) / 2);
+
+		if (m_aoEntries[nMiddle].m_lDispID < lDispID)
+			nBegin = nMiddle + 1;
+		else
+			nEnd = nMiddle;
+	}
+
+	for (size_t i = nBegin; (i != m_nCount) && (m_aoEntries[i].m_lDispID == lDispID); ++i)
+	{
+		if ((m_aoEntries[i].m_wFlags & wFlags) != 0)
+			return &m_aoEntries[i];
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the DISPID for a member name. Names are matched case-insensitively, as
+//! required by the automation clients.
+
+inline bool DispatchTable::FindName(LPCOLESTR pszName, DISPID& lDispID) const
+{
+	for (size_t i = 0; i != m_nCount; ++i)
+	{
+		if (::lstrcmpiW(pszName, m_aoEntries[i].m_pszName) == 0)
+		{
+			lDispID = m_aoEntries[i].m_lDispID;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The helper class used to build a DispatchTable for a class the first time
+//! it is used. The table is built on the stack and then published to the shared
+//! static table. Unlike an InterfaceTable the shared table is always returned,
+//! so if two threads race on the first call the loser waits for the winner.
+
+class DispatchTableBuilder : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	DispatchTableBuilder();
+
+	//! Add the members.
+	void Add(const DispatchEntry* pEntries, size_t nCount);
+
+	//! Publish the table, if no other thread has already done so.
+	const DispatchTable& Publish(DispatchTable& oTable);
+
+private:
+	//
+	// Members.
+	//
+	DispatchTable	m_oTable;		//!< The table under construction.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline DispatchTableBuilder::DispatchTableBuilder()
+{
+	m_oTable.m_eState = DispatchTable::EMPTY;
+	m_oTable.m_nCount = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add the members. The entries are kept sorted by DISPID; entries with the
+//! same DISPID stay in the order they were declared. The size of the table is
+//! checked at compile time by END_DISPATCH_TABLE.
+
+inline void DispatchTableBuilder::Add(const DispatchEntry* pEntries, size_t nCount)
+{
+	ASSERT(m_oTable.m_nCount + nCount <= MAX_DISPATCH_ENTRIES);
+
+	for (size_t i = 0; i != nCount; ++i)
+	{
+		size_t nPos = m_oTable.m_nCount;
+
+		// Find the insertion point.
+		for (; (nPos != 0) && (m_oTable.m_aoEntries[nPos-1].m_lDispID > pEntries[i].m_lDispID); --nPos)
+			m_oTable.m_aoEntries[nPos] = m_oTable.m_aoEntries[nPos-1];
+
+		m_oTable.m_aoEntries[nPos] = pEntries[i];
+
+		++m_oTable.m_nCount;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Publish the table, if no other thread has already done so. The returned
+//! table is the shared one.
+
+inline const DispatchTable& DispatchTableBuilder::Publish(DispatchTable& oTable)
+{
+	if (::InterlockedCompareExchange(&oTable.m_eState, DispatchTable::BUILDING, DispatchTable::EMPTY) == DispatchTable::EMPTY)
+	{
+		oTable.m_nCount = m_oTable.m_nCount;
+
+		for (size_t i = 0; i != m_oTable.m_nCount; ++i)
+			oTable.m_aoEntries[i] = m_oTable.m_aoEntries[i];
+
+		::InterlockedExchange(&oTable.m_eState, DispatchTable::READY);
+	}
+
+	// Wait for the winner to finish.
+	while (oTable.m_eState != DispatchTable::READY)
+		::Sleep(0);
+
+	return oTable;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The traits class used to move a C++ argument type into and out of a VARIANT.
+//! Each specialisation provides the VARTYPE the argument is coerced to, a Get()
+//! that reads a coerced VARIANT, a Set() that moves a value into a VARIANT and
+//! a Release() for a result value that the caller doesn't want.
+//!
+//! Note that VARIANT_BOOL and DATE are typedefs of short and double and so, by
+//! default, are passed as VT_I2 and VT_R8 respectively. A property can select
+//! the VT_BOOL or VT_DATE traits instead, via the VariantBool and VariantDate
+//! tags, with IMPLEMENT_DISP_PROPGET_AS and IMPLEMENT_DISP_PROPPUT_AS.
+
+template<typename T>
+struct VariantTraits;
+
+//! The tag used to select the traits for a VARIANT_BOOL.
+struct VariantBool;
+
+//! The tag used to select the traits for a DATE.
+struct VariantDate;
+
+//! The traits for a 16-bit integer.
+template<>
+struct VariantTraits<short>
+{
+	static const VARTYPE TYPE = VT_I2;
+	static short Get(const VARIANT& vtValue)		{ return V_I2(&vtValue); }
+	static void Set(VARIANT& vtValue, short nValue)	{ V_VT(&vtValue) = VT_I2; V_I2(&vtValue) = nValue; }
+	static void Release(short& /*nValue*/)			{ }
+};
+
+//! The traits for a 32-bit integer.
+template<>
+struct VariantTraits<long>
+{
+	static const VARTYPE TYPE = VT_I4;
+	static long Get(const VARIANT& vtValue)			{ return V_I4(&vtValue); }
+	static void Set(VARIANT& vtValue, long nValue)	{ V_VT(&vtValue) = VT_I4; V_I4(&vtValue) = nValue; }
+	static void Release(long& /*nValue*/)			{ }
+};
+
+//! The traits for an int, which scripting clients see as a 32-bit integer.
+template<>
+struct VariantTraits<int>
+{
+	static const VARTYPE TYPE = VT_I4;
+	static int Get(const VARIANT& vtValue)			{ return V_I4(&vtValue); }
+	static void Set(VARIANT& vtValue, int nValue)	{ V_VT(&vtValue) = VT_I4; V_I4(&vtValue) = nValue; }
+	static void Release(int& /*nValue*/)			{ }
+};
+
+//! The traits for an automation boolean.
+template<>
+struct VariantTraits<VariantBool>
+{
+	static const VARTYPE TYPE = VT_BOOL;
+	static VARIANT_BOOL Get(const VARIANT& vtValue)		{ return V_BOOL(&vtValue); }
+	static void Set(VARIANT& vtValue, VARIANT_BOOL bValue)	{ V_VT(&vtValue) = VT_BOOL; V_BOOL(&vtValue) = bValue; }
+	static void Release(VARIANT_BOOL& /*bValue*/)		{ }
+};
+
+//! The traits for a single precision float.
+template<>
+struct VariantTraits<float>
+{
+	static const VARTYPE TYPE = VT_R4;
+	static float Get(const VARIANT& vtValue)		{ return V_R4(&vtValue); }
+	static void Set(VARIANT& vtValue, float fValue)	{ V_VT(&vtValue) = VT_R4; V_R4(&vtValue) = fValue; }
+	static void Release(float& /*fValue*/)			{ }
+};
+
+//! The traits for a double precision float.
+template<>
+struct VariantTraits<double>
+{
+	static const VARTYPE TYPE = VT_R8;
+	static double Get(const VARIANT& vtValue)			{ return V_R8(&vtValue); }
+	static void Set(VARIANT& vtValue, double dValue)	{ V_VT(&vtValue) = VT_R8; V_R8(&vtValue) = dValue; }
+	static void Release(double& /*dValue*/)				{ }
+};
+
+//! The traits for an automation date.
+template<>
+struct VariantTraits<VariantDate>
+{
+	static const VARTYPE TYPE = VT_DATE;
+	static DATE Get(const VARIANT& vtValue)			{ return V_DATE(&vtValue); }
+	static void Set(VARIANT& vtValue, DATE dtValue)	{ V_VT(&vtValue) = VT_DATE; V_DATE(&vtValue) = dtValue; }
+	static void Release(DATE& /*dtValue*/)			{ }
+};
+
+//! The traits for a string.
+template<>
+struct VariantTraits<BSTR>
+{
+	static const VARTYPE TYPE = VT_BSTR;
+	static BSTR Get(const VARIANT& vtValue)			{ return V_BSTR(&vtValue); }
+	static void Set(VARIANT& vtValue, BSTR bstrValue)	{ V_VT(&vtValue) = VT_BSTR; V_BSTR(&vtValue) = bstrValue; }
+	static void Release(BSTR& bstrValue)			{ ::SysFreeString(bstrValue); }
+};
+
+//! The traits for an automation object.
+template<>
+struct VariantTraits<IDispatch*>
+{
+	static const VARTYPE TYPE = VT_DISPATCH;
+	static IDispatch* Get(const VARIANT& vtValue)	{ return V_DISPATCH(&vtValue); }
+	static void Set(VARIANT& vtValue, IDispatch* pValue)	{ V_VT(&vtValue) = VT_DISPATCH; V_DISPATCH(&vtValue) = pValue; }
+	static void Release(IDispatch*& pValue)			{ if (pValue != nullptr) pValue->Release(); }
+};
+
+//! The traits for any object.
+template<>
+struct VariantTraits<IUnknown*>
+{
+	static const VARTYPE TYPE = VT_UNKNOWN;
+	static IUnknown* Get(const VARIANT& vtValue)	{ return V_UNKNOWN(&vtValue); }
+	static void Set(VARIANT& vtValue, IUnknown* pValue)	{ V_VT(&vtValue) = VT_UNKNOWN; V_UNKNOWN(&vtValue) = pValue; }
+	static void Release(IUnknown*& pValue)			{ if (pValue != nullptr) pValue->Release(); }
+};
+
+//! The traits for a VARIANT, which is passed through as is.
+template<>
+struct VariantTraits<VARIANT>
+{
+	static const VARTYPE TYPE = VT_VARIANT;
+	static VARIANT Get(const VARIANT& vtValue)		{ return vtValue; }
+	static void Set(VARIANT& vtValue, VARIANT vtNew)	{ vtValue = vtNew; }
+	static void Release(VARIANT& vtValue)			{ ::VariantClear(&vtValue); }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! A single call argument, coerced to the type of the C++ parameter. When the
+//! caller has already passed the exact type, which is the common case, the
+//! argument is borrowed rather than copied.
+
+class DispatchArg : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	DispatchArg();
+
+	//! Destructor.
+	~DispatchArg();
+
+	//! Get the coerced value.
+	const VARIANT& Value() const;
+
+	//! Coerce an argument to the required type.
+	HRESULT Coerce(const DispatchCall& oCall, UINT nArg, VARTYPE eType);
+
+private:
+	//
+	// Members.
+	//
+	VARIANT		m_vtValue;		//!< The coerced value.
+	bool		m_bOwned;		//!< Does the value need clearing?
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline DispatchArg::DispatchArg()
+	: m_bOwned(false)
+{
+	::VariantInit(&m_vtValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+inline DispatchArg::~DispatchArg()
+{
+	if (m_bOwned)
+		::VariantClear(&m_vtValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the coerced value.
+
+inline const VARIANT& DispatchArg::Value() const
+{
+	return m_vtValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Coerce an argument to the required type. The arguments in DISPPARAMS are
+//! stored in reverse order and so nArg is the position in the C++ signature.
+//! Strings are converted using the caller's locale, e.g. for dates.
+
+inline HRESULT DispatchArg::Coerce(const DispatchCall& oCall, UINT nArg, VARTYPE eType)
+{
+	UINT           nIndex  = oCall.m_pParams->cArgs - 1 - nArg;
+	const VARIANT& vtParam = oCall.m_pParams->rgvarg[nIndex];
+
+	// Borrow an exact match.
+	if ( (V_VT(&vtParam) == eType) || ((eType == VT_VARIANT) && ((V_VT(&vtParam) & VT_BYREF) == 0)) )
+	{
+		m_vtValue = vtParam;
+		return S_OK;
+	}
+
+	HRESULT hr = (eType == VT_VARIANT) ? ::VariantCopyInd(&m_vtValue, const_cast<VARIANT*>(&vtParam))
+	                                   : ::VariantChangeTypeEx(&m_vtValue, const_cast<VARIANT*>(&vtParam), oCall.m_dwLCID, 0, eType);
+
+	if (FAILED(hr))
+	{
+		if (oCall.m_pnArgError != nullptr)
+			*oCall.m_pnArgError = nIndex;
+
+		return (hr == E_OUTOFMEMORY) ? hr : DISP_E_TYPEMISMATCH;
+	}
+
+	m_bOwned = true;
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Check the result of calling a member. A failure is turned into an exception
+//! for the caller, using the error object set by the member, if any.
+
+inline HRESULT CheckDispatchResult(HRESULT hrCall, const DispatchCall& oCall)
+{
+	if (SUCCEEDED(hrCall) || (oCall.m_pExcepInfo == nullptr))
+		return hrCall;
+
+	EXCEPINFO* pExcepInfo = oCall.m_pExcepInfo;
+
+	memset(pExcepInfo, 0, sizeof(EXCEPINFO));
+
+	pExcepInfo->scode = hrCall;
+
+	IErrorInfo* pErrorInfo = nullptr;
+
+	if (::GetErrorInfo(0, &pErrorInfo) == S_OK)
+	{
+		pErrorInfo->GetSource(&pExcepInfo->bstrSource);
+		pErrorInfo->GetDescription(&pExcepInfo->bstrDescription);
+		pErrorInfo->GetHelpFile(&pExcepInfo->bstrHelpFile);
+		pErrorInfo->GetHelpContext(&pExcepInfo->dwHelpContext);
+		pErrorInfo->Release();
+	}
+
+	return DISP_E_EXCEPTION;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Store the return value of a member, or release it if the caller doesn't
+//! want it. The traits are normally those of the value type.
+
+template<typename Traits, typename R>
+inline void StoreDispatchResult(R& oValue, const DispatchCall& oCall)
+{
+	if (oCall.m_pResult != nullptr)
+		Traits::Set(*oCall.m_pResult, oValue);
+	else
+		Traits::Release(oValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The invokers for members which have no return value. Each class generates
+// the DispatchFn for a specific member via its Bind<> member template. The
+// class is only used to deduce the member signature; see IMPLEMENT_DISP_METHOD.
+// The VariantTraits used for each parameter default to those of its type.
+
+//! The invoker for a member with no arguments.
+template<typename T>
+struct DispatchMethod0
+{
+	template<HRESULT (COMCALL T::*Member)()>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 0)
+			return DISP_E_BADPARAMCOUNT;
+
+		return CheckDispatchResult((static_cast<T*>(pObject)->*Member)(), oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)()>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+//! The invoker for a member with one argument.
+template<typename T, typename A1, typename X1 = VariantTraits<A1> >
+struct DispatchMethod1
+{
+	template<HRESULT (COMCALL T::*Member)(A1)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 1)
+			return DISP_E_BADPARAMCOUNT;
+
+		HRESULT     hr;
+		DispatchArg oArg1;
+
+		if (FAILED(hr = oArg1.Coerce(oCall, 0, X1::TYPE)))
+			return hr;
+
+		return CheckDispatchResult((static_cast<T*>(pObject)->*Member)(X1::Get(oArg1.Value())), oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(A1)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+//! The invoker for a member with two arguments.
+template<typename T, typename A1, typename A2, typename X1 = VariantTraits<A1>, typename X2 = VariantTraits<A2> >
+struct DispatchMethod2
+{
+	template<HRESULT (COMCALL T::*Member)(A1, A2)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 2)
+			return DISP_E_BADPARAMCOUNT;
+
+		HRESULT     hr;
+		DispatchArg oArg1, oArg2;
+
+		if ( FAILED(hr = oArg1.Coerce(oCall, 0, X1::TYPE))
+		  || FAILED(hr = oArg2.Coerce(oCall, 1, X2::TYPE)) )
+			return hr;
+
+		return CheckDispatchResult((static_cast<T*>(pObject)->*Member)(X1::Get(oArg1.Value()),
+																	   X2::Get(oArg2.Value())), oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(A1, A2)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+//! The invoker for a member with three arguments.
+template<typename T, typename A1, typename A2, typename A3,
+		 typename X1 = VariantTraits<A1>, typename X2 = VariantTraits<A2>, typename X3 = VariantTraits<A3> >
+struct DispatchMethod3
+{
+	template<HRESULT (COMCALL T::*Member)(A1, A2, A3)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 3)
+			return DISP_E_BADPARAMCOUNT;
+
+		HRESULT     hr;
+		DispatchArg oArg1, oArg2, oArg3;
+
+		if ( FAILED(hr = oArg1.Coerce(oCall, 0, X1::TYPE))
+		  || FAILED(hr = oArg2.Coerce(oCall, 1, X2::TYPE))
+		  || FAILED(hr = oArg3.Coerce(oCall, 2, X3::TYPE)) )
+			return hr;
+
+		return CheckDispatchResult((static_cast<T*>(pObject)->*Member)(X1::Get(oArg1.Value()),
+																	   X2::Get(oArg2.Value()),
+																	   X3::Get(oArg3.Value())), oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(A1, A2, A3)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// The invokers for members whose last parameter is an [out, retval].
+
+//! The invoker for a member with no arguments and a return value.
+template<typename T, typename R, typename XR = VariantTraits<R> >
+struct DispatchRetVal0
+{
+	template<HRESULT (COMCALL T::*Member)(R*)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 0)
+			return DISP_E_BADPARAMCOUNT;
+
+		R       oValue = R();
+		HRESULT hr     = (static_cast<T*>(pObject)->*Member)(&oValue);
+
+		if (SUCCEEDED(hr))
+			StoreDispatchResult<XR>(oValue, oCall);
+
+		return CheckDispatchResult(hr, oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(R*)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+//! The invoker for a member with one argument and a return value.
+template<typename T, typename A1, typename R, typename X1 = VariantTraits<A1>, typename XR = VariantTraits<R> >
+struct DispatchRetVal1
+{
+	template<HRESULT (COMCALL T::*Member)(A1, R*)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 1)
+			return DISP_E_BADPARAMCOUNT;
+
+		HRESULT     hr;
+		DispatchArg oArg1;
+
+		if (FAILED(hr = oArg1.Coerce(oCall, 0, X1::TYPE)))
+			return hr;
+
+		R oValue = R();
+
+		hr = (static_cast<T*>(pObject)->*Member)(X1::Get(oArg1.Value()), &oValue);
+
+		if (SUCCEEDED(hr))
+			StoreDispatchResult<XR>(oValue, oCall);
+
+		return CheckDispatchResult(hr, oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(A1, R*)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+//! The invoker for a member with two arguments and a return value.
+template<typename T, typename A1, typename A2, typename R,
+		 typename X1 = VariantTraits<A1>, typename X2 = VariantTraits<A2>, typename XR = VariantTraits<R> >
+struct DispatchRetVal2
+{
+	template<HRESULT (COMCALL T::*Member)(A1, A2, R*)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 2)
+			return DISP_E_BADPARAMCOUNT;
+
+		HRESULT     hr;
+		DispatchArg oArg1, oArg2;
+
+		if ( FAILED(hr = oArg1.Coerce(oCall, 0, X1::TYPE))
+		  || FAILED(hr = oArg2.Coerce(oCall, 1, X2::TYPE)) )
+			return hr;
+
+		R oValue = R();
+
+		hr = (static_cast<T*>(pObject)->*Member)(X1::Get(oArg1.Value()),
+												 X2::Get(oArg2.Value()), &oValue);
+
+		if (SUCCEEDED(hr))
+			StoreDispatchResult<XR>(oValue, oCall);
+
+		return CheckDispatchResult(hr, oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(A1, A2, R*)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+//! The invoker for a member with three arguments and a return value.
+template<typename T, typename A1, typename A2, typename A3, typename R,
+		 typename X1 = VariantTraits<A1>, typename X2 = VariantTraits<A2>, typename X3 = VariantTraits<A3>, typename XR = VariantTraits<R> >
+struct DispatchRetVal3
+{
+	template<HRESULT (COMCALL T::*Member)(A1, A2, A3, R*)>
+	static HRESULT Invoke(void* pObject, const DispatchCall& oCall)
+	{
+		if (oCall.m_pParams->cArgs != 3)
+			return DISP_E_BADPARAMCOUNT;
+
+		HRESULT     hr;
+		DispatchArg oArg1, oArg2, oArg3;
+
+		if ( FAILED(hr = oArg1.Coerce(oCall, 0, X1::TYPE))
+		  || FAILED(hr = oArg2.Coerce(oCall, 1, X2::TYPE))
+		  || FAILED(hr = oArg3.Coerce(oCall, 2, X3::TYPE)) )
+			return hr;
+
+		R oValue = R();
+
+		hr = (static_cast<T*>(pObject)->*Member)(X1::Get(oArg1.Value()),
+												 X2::Get(oArg2.Value()),
+												 X3::Get(oArg3.Value()), &oValue);
+
+		if (SUCCEEDED(hr))
+			StoreDispatchResult<XR>(oValue, oCall);
+
+		return CheckDispatchResult(hr, oCall);
+	}
+
+	template<HRESULT (COMCALL T::*Member)(A1, A2, A3, R*)>
+	static DispatchFn Bind()
+	{ return &Invoke<Member>; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// The functions used to deduce the invoker type from a member signature.
+
+template<typename T>
+inline DispatchMethod0<T> DeduceDispatchMethod(HRESULT (COMCALL T::*)())
+{ return DispatchMethod0<T>(); }
+
+template<typename T, typename A1>
+inline DispatchMethod1<T, A1> DeduceDispatchMethod(HRESULT (COMCALL T::*)(A1))
+{ return DispatchMethod1<T, A1>(); }
+
+template<typename T, typename A1, typename A2>
+inline DispatchMethod2<T, A1, A2> DeduceDispatchMethod(HRESULT (COMCALL T::*)(A1, A2))
+{ return DispatchMethod2<T, A1, A2>(); }
+
+template<typename T, typename A1, typename A2, typename A3>
+inline DispatchMethod3<T, A1, A2, A3> DeduceDispatchMethod(HRESULT (COMCALL T::*)(A1, A2, A3))
+{ return DispatchMethod3<T, A1, A2, A3>(); }
+
+template<typename T, typename R>
+inline DispatchRetVal0<T, R> DeduceDispatchRetVal(HRESULT (COMCALL T::*)(R*))
+{ return DispatchRetVal0<T, R>(); }
+
+template<typename T, typename A1, typename R>
+inline DispatchRetVal1<T, A1, R> DeduceDispatchRetVal(HRESULT (COMCALL T::*)(A1, R*))
+{ return DispatchRetVal1<T, A1, R>(); }
+
+template<typename T, typename A1, typename A2, typename R>
+inline DispatchRetVal2<T, A1, A2, R> DeduceDispatchRetVal(HRESULT (COMCALL T::*)(A1, A2, R*))
+{ return DispatchRetVal2<T, A1, A2, R>(); }
+
+template<typename T, typename A1, typename A2, typename A3, typename R>
+inline DispatchRetVal3<T, A1, A2, A3, R> DeduceDispatchRetVal(HRESULT (COMCALL T::*)(A1, A2, A3, R*))
+{ return DispatchRetVal3<T, A1, A2, A3, R>(); }
+
+// The functions used to deduce the invoker type for a property accessor whose
+// value uses the traits selected by the tag X, e.g. VariantBool.
+
+template<typename X, typename T, typename A1>
+inline DispatchMethod1<T, A1, VariantTraits<X> > DeduceDispatchMethodAs(HRESULT (COMCALL T::*)(A1))
+{ return DispatchMethod1<T, A1, VariantTraits<X> >(); }
+
+template<typename X, typename T, typename R>
+inline DispatchRetVal0<T, R, VariantTraits<X> > DeduceDispatchRetValAs(HRESULT (COMCALL T::*)(R*))
+{ return DispatchRetVal0<T, R, VariantTraits<X> >(); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Macros for defining the dispatch table. The members are identified by name
+// and so a property 'Name' binds to the get_Name and put_Name methods, e.g.
+//
+// DEFINE_DISPATCH_TABLE(MyClass)
+//     IMPLEMENT_DISP_PROPGET(Name, 1)
+//     IMPLEMENT_DISP_METHOD_RETVAL(Add, 2)
+// END_DISPATCH_TABLE()
+
+//! Implements GetDispatchTable() to build the table once, on first use.
+//! The entries are declared as an array so that a table with more than
+//! COM::MAX_DISPATCH_ENTRIES entries fails to compile.
+#define DEFINE_DISPATCH_TABLE(class_name)													\
+									friend class COM::DispatchTableImpl<class_name>;		\
+																							\
+									static const COM::DispatchTable& GetDispatchTable()		\
+									{														\
+										typedef class_name DispatchClass;					\
+										static COM::DispatchTable s_oTable;					\
+																							\
+										if (s_oTable.IsReady())								\
+											return s_oTable;								\
+																							\
+										const COM::DispatchEntry aoEntries[] =				\
+										{
+
+//! Adds a method which has no return value.
+#define IMPLEMENT_DISP_METHOD(name, dispid)														\
+											{ OLESTR(#name), dispid, DISPATCH_METHOD,			\
+											  COM::DeduceDispatchMethod(&DispatchClass::name).template Bind<&DispatchClass::name>() },
+
+//! Adds a method whose last parameter is the [out, retval].
+#define IMPLEMENT_DISP_METHOD_RETVAL(name, dispid)												\
+											{ OLESTR(#name), dispid, DISPATCH_METHOD,			\
+											  COM::DeduceDispatchRetVal(&DispatchClass::name).template Bind<&DispatchClass::name>() },
+
+//! Adds a property getter. Scripting clients may also call this as a method.
+#define IMPLEMENT_DISP_PROPGET(name, dispid)														\
+											{ OLESTR(#name), dispid, DISPATCH_PROPERTYGET|DISPATCH_METHOD,	\
+											  COM::DeduceDispatchRetVal(&DispatchClass::get_##name).template Bind<&DispatchClass::get_##name>() },
+
+//! Adds a property setter.
+#define IMPLEMENT_DISP_PROPPUT(name, dispid)														\
+											{ OLESTR(#name), dispid, DISPATCH_PROPERTYPUT,		\
+											  COM::DeduceDispatchMethod(&DispatchClass::put_##name).template Bind<&DispatchClass::put_##name>() },
+
+//! Adds a property getter whose value uses the traits for the tag, e.g. VariantBool.
+#define IMPLEMENT_DISP_PROPGET_AS(name, dispid, tag)												\
+											{ OLESTR(#name), dispid, DISPATCH_PROPERTYGET|DISPATCH_METHOD,	\
+											  COM::DeduceDispatchRetValAs<tag>(&DispatchClass::get_##name).template Bind<&DispatchClass::get_##name>() },
+
+//! Adds a property setter whose value uses the traits for the tag, e.g. VariantDate.
+#define IMPLEMENT_DISP_PROPPUT_AS(name, dispid, tag)												\
+											{ OLESTR(#name), dispid, DISPATCH_PROPERTYPUT,		\
+											  COM::DeduceDispatchMethodAs<tag>(&DispatchClass::put_##name).template Bind<&DispatchClass::put_##name>() },
+
+//! End of GetDispatchTable() implementation.
+#define END_DISPATCH_TABLE()																\
+										};													\
+																							\
+										const size_t nEntries = sizeof(aoEntries) / sizeof(aoEntries[0]);				\
+																							\
+										(void)sizeof(COM::DispatchTableSizeCheck<(nEntries <= COM::MAX_DISPATCH_ENTRIES)>);			\
+																							\
+										COM::DispatchTableBuilder oBuilder;					\
+																							\
+										oBuilder.Add(aoEntries, nEntries);					\
+																							\
+										return oBuilder.Publish(s_oTable);					\
+									}
+
+//namespace COM
+}
+
+#endif // COM_DISPATCHTABLE_HPP
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   DispatchTableImpl.hpp
+//! \brief  The DispatchTableImpl class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_DISPATCHTABLEIMPL_HPP
+#define COM_DISPATCHTABLEIMPL_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "IDispatchImpl.hpp"
+#include "DispatchTable.hpp"
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! An implementation of IDispatch which dispatches late-bound calls through a
+//! table generated at compile time, rather than via ITypeInfo::Invoke. The
+//! arguments are unpacked straight from the DISPPARAMS into the typed C++
+//! parameters and so the type library is never touched on a call. It is only
+//! loaded if a client explicitly asks for the type information.
+//!
+//! The class T must define its members with the DEFINE_DISPATCH_TABLE macros,
+//! and use IMPLEMENT_IDISPATCH_TABLE to forward the IDispatch methods, e.g.
+//!
+//! class MyClass : public COM::ObjectBase<IMyClass>, public COM::DispatchTableImpl<MyClass>
+//! {
+//!     DEFINE_DISPATCH_TABLE(MyClass)
+//!         IMPLEMENT_DISP_PROPGET(Name, 1)
+//!     END_DISPATCH_TABLE()
+//!     IMPLEMENT_IDISPATCH_TABLE(MyClass)
+//! };
+
+template<typename T>
+class DispatchTableImpl : public IDispatchImpl<T>
+{
+public:
+	//! Full constructor.
+	DispatchTableImpl(const IID& oDIID);
+
+	//! Destructor.
+	virtual ~DispatchTableImpl();
+
+	//
+	// IDispatch methods.
+	//
+
+	//! Map a number of names to their dispatch IDs.
+	virtual HRESULT COMCALL GetIDsOfNames(REFIID rIID, LPOLESTR* aszNames, UINT nNames, LCID dwLCID, DISPID* alMemberIDs);
+
+	//! Invoke a method or access a property.
+	virtual HRESULT COMCALL Invoke(DISPID lMemberID, REFIID rIID, LCID dwLCID, WORD wFlags, DISPPARAMS* pParams, VARIANT* pResult, EXCEPINFO* pExcepInfo, UINT* pnArgError);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Full constructor.
+
+template<typename T>
+DispatchTableImpl<T>::DispatchTableImpl(const IID& oDIID)
+	: IDispatchImpl<T>(oDIID)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+template<typename T>
+DispatchTableImpl<T>::~DispatchTableImpl()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Map a number of names to their dispatch IDs. The table doesn't hold the
+//! parameter names and so any after the member name are reported as unknown.
+
+template<typename T>
+HRESULT COMCALL DispatchTableImpl<T>::GetIDsOfNames(REFIID rIID, LPOLESTR* aszNames, UINT nNames, LCID /*dwLCID*/, DISPID* alMemberIDs)
+{
+	// Validate parameters.
+	if ( (aszNames == nullptr) || (alMemberIDs == nullptr) )
+		return E_POINTER;
+
+	if (rIID != IID_NULL)
+		return DISP_E_UNKNOWNINTERFACE;
+
+	if (nNames == 0)
+		return E_INVALIDARG;
+
+	const DispatchTable& oTable = T::GetDispatchTable();
+
+	for (UINT i = 1; i != nNames; ++i)
+		alMemberIDs[i] = DISPID_UNKNOWN;
+
+	if (!oTable.FindName(aszNames[0], alMemberIDs[0]))
+	{
+		alMemberIDs[0] = DISPID_UNKNOWN;
+		return DISP_E_UNKNOWNNAME;
+	}
+
+	return (nNames == 1) ? S_OK : DISP_E_UNKNOWNNAME;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Invoke a method or access a property. Named arguments are not supported,
+//! except for the one required when assigning a property.
+
+template<typename T>
+HRESULT COMCALL DispatchTableImpl<T>::Invoke(DISPID lMemberID, REFIID rIID, LCID dwLCID, WORD wFlags, DISPPARAMS* pParams, VARIANT* pResult, EXCEPINFO* pExcepInfo, UINT* pnArgError)
+{
+	// Validate parameters.
+	if (pParams == nullptr)
+		return E_POINTER;
+
+	if (rIID != IID_NULL)
+		return DISP_E_UNKNOWNINTERFACE;
+
+	const DispatchEntry* pEntry = T::GetDispatchTable().Find(lMemberID, wFlags);
+
+	if (pEntry == nullptr)
+		return DISP_E_MEMBERNOTFOUND;
+
+	if ((pEntry->m_wFlags & DISPATCH_PROPERTYPUT) != 0)
+	{
+		if ( (pParams->cNamedArgs != 1) || (pParams->rgdispidNamedArgs[0] != DISPID_PROPERTYPUT) )
+			return DISP_E_PARAMNOTOPTIONAL;
+	}
+	else if (pParams->cNamedArgs != 0)
+	{
+		return DISP_E_NONAMEDARGS;
+	}
+
+	// Clear the last exception.
+	::SetErrorInfo(0, nullptr);
+
+	DispatchCall oCall = { pParams, pResult, pExcepInfo, pnArgError, dwLCID };
+
+	return pEntry->m_pfnInvoke(static_cast<T*>(this), oCall);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Macros for defining the IDispatch methods.
+
+//! Implements IDispatch via the dispatch table.
+#define IMPLEMENT_IDISPATCH_TABLE(T)															\
+	virtual HRESULT COMCALL GetTypeInfoCount(UINT* pnInfo)										\
+	{ return COM::IDispatchImpl<T>::GetTypeInfoCount(pnInfo); }									\
+	virtual HRESULT COMCALL GetTypeInfo(UINT nInfo, LCID dwLCID, ITypeInfo** ppTypeInfo)		\
+	{ return COM::IDispatchImpl<T>::GetTypeInfo(nInfo, dwLCID, ppTypeInfo); }					\
+	virtual HRESULT COMCALL GetIDsOfNames(REFIID rIID, LPOLESTR* aszNames, UINT nNames, LCID dwLCID, DISPID* alMemberIDs)														\
+	{ return COM::DispatchTableImpl<T>::GetIDsOfNames(rIID, aszNames, nNames, dwLCID, alMemberIDs); }																			\
+	virtual HRESULT COMCALL Invoke(DISPID lMemberID, REFIID rIID, LCID dwLCID, WORD wFlags, DISPPARAMS* pParams, VARIANT* pResult, EXCEPINFO* pExcepInfo, UINT* pnArgError)		\
+	{ return COM::DispatchTableImpl<T>::Invoke(lMemberID, rIID, dwLCID, wFlags, pParams, pResult, pExcepInfo, pnArgError); }
+
+//namespace COM
+}
+
+#endif // COM_DISPATCHTABLEIMPL_HPP
@@ -5,6 +5,7 @@
 
 #include "Common.hpp"
 #include "ErrorInfo.hpp"
+#include "ErrorObject.hpp"
 #include <WCL/ComPtr.hpp>
 
 #ifndef _MSC_VER
@@ -20,34 +21,27 @@ namespace COM
 
 bool SetComErrorInfo(const char* pszSource, const tchar* pszDescription)
 {
-	// Type short-hands
-	typedef WCL::ComPtr<ICreateErrorInfo> ICreateErrorInfoPtr;
-	typedef WCL::ComPtr<IErrorInfo>       IErrorInfoPtr;
-
-	ICreateErrorInfoPtr pCreateErrorInfo;
-
-	// Allocate the exception object.
-	HRESULT hr = ::CreateErrorInfo(AttachTo(pCreateErrorInfo));
-
-	if (FAILED(hr))
-		return false;
-
-	// Fill in the exception details.
-//	pCreateErrorInfo->SetGUID();
-	pCreateErrorInfo->SetSource(const_cast<wchar_t*>(A2W(pszSource)));
-	pCreateErrorInfo->SetDescription(const_cast<wchar_t*>(T2W(pszDescription)));
-//	pCreateErrorInfo->SetHelpFile();
-//	pCreateErrorInfo->SetHelpContext();
+	return SetComErrorInfo(GUID_NULL, pszSource, pszDescription, nullptr, 0);
+}
 
-	IErrorInfoPtr pErrorInfo;
+////////////////////////////////////////////////////////////////////////////////
+//! Set the COM ErrorInfo object for the thread, including the interface and
+//! help details. The error object is recycled from a pool and so, unless the
+//! pool needs to grow, this does not allocate. The return value indicates if
+//! the "throw" was successful or not.
 
-	hr = QueryInterface(pCreateErrorInfo, pErrorInfo);
+bool SetComErrorInfo(const GUID& rGUID, const char* pszSource, const tchar* pszDescription,
+						const tchar* pszHelpFile, DWORD dwHelpContext)
+{
+	IErrorInfo* pErrorInfo = ErrorObject::Create(rGUID, pszSource, pszDescription, pszHelpFile, dwHelpContext);
 
-	if (FAILED(hr))
+	if (pErrorInfo == nullptr)
 		return false;
 
 	// Throw it.
-	hr = ::SetErrorInfo(0, pErrorInfo.get());
+	HRESULT hr = ::SetErrorInfo(0, pErrorInfo);
+
+	pErrorInfo->Release();
 
 	if (FAILED(hr))
 		return false;
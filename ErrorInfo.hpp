@@ -17,6 +17,11 @@ namespace COM
 // Set the COM ErrorInfo object for the logical thread.
 bool SetComErrorInfo(const char* pszSource, const tchar* pszDescription); // throw()
 
+// Set the COM ErrorInfo object for the logical thread, including the interface
+// and help details.
+bool SetComErrorInfo(const GUID& rGUID, const char* pszSource, const tchar* pszDescription,
+						const tchar* pszHelpFile, DWORD dwHelpContext); // throw()
+
 ////////////////////////////////////////////////////////////////////////////////
 // Macro for catching and handling exceptions at module boundaries.
 
@@ -0,0 +1,647 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ErrorObject.cpp
+//! \brief  The ErrorObject class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "ErrorObject.hpp"
+#include "Server.hpp"
+
+namespace COM
+{
+
+//! The number of live objects.
+volatile LONG ErrorObject::s_nOutstanding = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The buffer used to hold the strings of an error object. A buffer is only
+//! replaced when a new error needs more space than it has and so the number of
+//! buffers, and their size, is bounded by the peak number of live objects and
+//! their longest strings.
+
+struct ErrorText
+{
+	SLIST_ENTRY		m_oEntry;		//!< The link to the next free buffer.
+	wchar_t*		m_pszBuffer;	//!< The buffer.
+	size_t			m_nCapacity;	//!< The size of the buffer in characters.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// The table of interned source strings. Each call site passes the same string
+// literal (__FUNCTION__) every time and so the table is keyed on the address.
+// As the address could also be a buffer that is reused the narrow string is
+// kept as well and compared, and on a mismatch the source is just converted
+// into the error object instead. Entries are published with a single pointer
+// swap and never modified or removed until the module is unloaded.
+
+namespace
+{
+
+//! The number of slots in the intern table. This must be a power of 2.
+const size_t MAX_INTERNED_SOURCES = 256;
+
+//! An interned source string.
+struct InternedSource
+{
+	const char*		m_pszKey;		//!< The address of the source string.
+	char*			m_pszNarrow;	//!< A copy of the source string.
+	wchar_t*		m_pszWide;		//!< The converted source string.
+};
+
+//! The intern table. This is a POD so that it's zero-initialised.
+InternedSource* volatile g_apSources[MAX_INTERNED_SOURCES];
+
+////////////////////////////////////////////////////////////////////////////////
+//! The helper class used to release the intern table when the module unloads.
+
+class SourceTableCleanup
+{
+public:
+	//! Destructor.
+	~SourceTableCleanup()
+	{
+		for (size_t i = 0; i != MAX_INTERNED_SOURCES; ++i)
+		{
+			InternedSource* pEntry = g_apSources[i];
+
+			if (pEntry != nullptr)
+				::HeapFree(::GetProcessHeap(), 0, pEntry);
+		}
+	}
+};
+
+//! The module unload hook.
+SourceTableCleanup g_oSourceTableCleanup;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert an ANSI string to Unicode. The buffer must be large enough.
+
+void ConvertToWide(const char* pszString, size_t nLength, wchar_t* pszBuffer)
+{
+	int nChars = ::MultiByteToWideChar(CP_ACP, 0, pszString, static_cast<int>(nLength), pszBuffer, static_cast<int>(nLength));
+
+	pszBuffer[nChars] = L'\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of characters needed to hold an ANSI string as Unicode,
+//! including the terminator. This returns 0 if the string can't be converted.
+
+size_t WideLength(const char* pszString)
+{
+	return ::MultiByteToWideChar(CP_ACP, 0, pszString, -1, nullptr, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of characters needed to hold a Unicode string, including the
+//! terminator.
+
+size_t WideLength(const wchar_t* pszString)
+{
+	return wcslen(pszString) + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Copy an ANSI string into a buffer as Unicode. The buffer must be the size
+//! returned by WideLength().
+
+void CopyWide(const char* pszString, wchar_t* pszBuffer, size_t nChars)
+{
+	::MultiByteToWideChar(CP_ACP, 0, pszString, -1, pszBuffer, static_cast<int>(nChars));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Copy a Unicode string into a buffer. The buffer must be the size returned
+//! by WideLength().
+
+void CopyWide(const wchar_t* pszString, wchar_t* pszBuffer, size_t nChars)
+{
+	memcpy(pszBuffer, pszString, nChars * sizeof(wchar_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// The list of text buffers which are not currently used by an error object.
+// The list is a POD so that it's zero-initialised and the buffers are only
+// released when the module is unloaded.
+
+//! The free text buffers.
+SLIST_HEADER g_oFreeText;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The helper class used to release the text buffers when the module unloads.
+
+class TextBufferCleanup
+{
+public:
+	//! Destructor.
+	~TextBufferCleanup()
+	{
+		PSLIST_ENTRY pEntry = ::InterlockedFlushSList(&g_oFreeText);
+
+		while (pEntry != nullptr)
+		{
+			ErrorText* pText = reinterpret_cast<ErrorText*>(pEntry);
+
+			pEntry = pEntry->Next;
+
+			::HeapFree(::GetProcessHeap(), 0, pText->m_pszBuffer);
+			::HeapFree(::GetProcessHeap(), 0, pText);
+		}
+	}
+};
+
+//! The module unload hook.
+TextBufferCleanup g_oTextBufferCleanup;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Borrow a text buffer with space for at least the number of characters. The
+//! buffer is only reallocated if it's too small, and its contents are not
+//! preserved. This returns nullptr if a buffer can't be allocated.
+
+ErrorText* AcquireText(size_t nChars)
+{
+	ErrorText* pText = reinterpret_cast<ErrorText*>(::InterlockedPopEntrySList(&g_oFreeText));
+
+	if (pText == nullptr)
+	{
+		pText = static_cast<ErrorText*>(::HeapAlloc(::GetProcessHeap(), 0, sizeof(ErrorText)));
+
+		if (pText == nullptr)
+			return nullptr;
+
+		pText->m_pszBuffer = nullptr;
+		pText->m_nCapacity = 0;
+	}
+
+	if (pText->m_nCapacity < nChars)
+	{
+		wchar_t* pszBuffer = static_cast<wchar_t*>(::HeapAlloc(::GetProcessHeap(), 0, nChars * sizeof(wchar_t)));
+
+		if (pszBuffer == nullptr)
+		{
+			::InterlockedPushEntrySList(&g_oFreeText, &pText->m_oEntry);
+			return nullptr;
+		}
+
+		::HeapFree(::GetProcessHeap(), 0, pText->m_pszBuffer);
+
+		pText->m_pszBuffer = pszBuffer;
+		pText->m_nCapacity = nChars;
+	}
+
+	return pText;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Hand a text buffer back for the next error object to use.
+
+void ReleaseText(ErrorText* pText)
+{
+	::InterlockedPushEntrySList(&g_oFreeText, &pText->m_oEntry);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create an entry for the intern table as a single block.
+
+InternedSource* CreateInternedSource(const char* pszSource)
+{
+	size_t nLength = strlen(pszSource);
+	size_t nBytes  = sizeof(InternedSource) + (nLength+1) + ((nLength+1) * sizeof(wchar_t));
+
+	InternedSource* pEntry = static_cast<InternedSource*>(::HeapAlloc(::GetProcessHeap(), 0, nBytes));
+
+	if (pEntry == nullptr)
+		return nullptr;
+
+	pEntry->m_pszKey    = pszSource;
+	pEntry->m_pszWide   = reinterpret_cast<wchar_t*>(pEntry + 1);
+	pEntry->m_pszNarrow = reinterpret_cast<char*>(pEntry->m_pszWide + (nLength+1));
+
+	memcpy(pEntry->m_pszNarrow, pszSource, nLength+1);
+	ConvertToWide(pszSource, nLength, pEntry->m_pszWide);
+
+	return pEntry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find or add the interned Unicode version of a source string. This returns
+//! nullptr if the string can't be interned.
+
+const wchar_t* InternSource(const char* pszSource)
+{
+	const size_t    nMask = MAX_INTERNED_SOURCES - 1;
+	size_t          nSlot = (reinterpret_cast<size_t>(pszSource) >> 3) & nMask;
+	InternedSource* pNew  = nullptr;
+
+	for (size_t nProbes = 0; nProbes != MAX_INTERNED_SOURCES; ++nProbes, nSlot = (nSlot + 1) & nMask)
+	{
+		InternedSource* pEntry = g_apSources[nSlot];
+
+		// Try and claim an empty slot.
+		if (pEntry == nullptr)
+		{
+			if ( (pNew == nullptr) && ((pNew = CreateInternedSource(pszSource)) == nullptr) )
+				return nullptr;
+
+			pEntry = static_cast<InternedSource*>(::InterlockedCompareExchangePointer(reinterpret_cast<void* volatile*>(&g_apSources[nSlot]), pNew, nullptr));
+
+			if (pEntry == nullptr)
+				return pNew->m_pszWide;
+		}
+
+		if (pEntry->m_pszKey == pszSource)
+		{
+			if (pNew != nullptr)
+				::HeapFree(::GetProcessHeap(), 0, pNew);
+
+			return (strcmp(pEntry->m_pszNarrow, pszSource) == 0) ? pEntry->m_pszWide : nullptr;
+		}
+	}
+
+	// Table full.
+	if (pNew != nullptr)
+		::HeapFree(::GetProcessHeap(), 0, pNew);
+
+	return nullptr;
+}
+
+//namespace
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor. The server, if there is one, is locked until the object
+//! is destroyed, so that the module can't be unloaded whilst it's referenced.
+
+ErrorObject::ErrorObject()
+	: m_nRefCount(0)
+	, m_pServer(Server::Instance())
+	, m_oGUID(GUID_NULL)
+	, m_pText(nullptr)
+	, m_pszSource(nullptr)
+	, m_pszDescription(nullptr)
+	, m_pszHelpFile(nullptr)
+	, m_dwHelpContext(0)
+	, m_pMarshal(nullptr)
+{
+	if (m_pServer != nullptr)
+		m_pServer->Lock();
+
+	::InterlockedIncrement(&s_nOutstanding);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+ErrorObject::~ErrorObject()
+{
+	if (m_pMarshal != nullptr)
+		m_pMarshal->Release();
+
+	if (m_pText != nullptr)
+		ReleaseText(m_pText);
+
+	::InterlockedDecrement(&s_nOutstanding);
+
+	if (m_pServer != nullptr)
+		m_pServer->Unlock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create an error object. The returned interface has been AddRef'd. This
+//! returns nullptr if the object or its strings can't be allocated.
+
+IErrorInfo* ErrorObject::Create(const GUID& rGUID, const char* pszSource, const tchar* pszDescription,
+								const tchar* pszHelpFile, DWORD dwHelpContext)
+{
+	ErrorObject* pObject = nullptr;
+
+	try
+	{
+		pObject = new ErrorObject;
+	}
+	catch (const std::bad_alloc&)
+	{
+		return nullptr;
+	}
+
+	pObject->AddRef();
+
+	pObject->m_oGUID         = rGUID;
+	pObject->m_dwHelpContext = dwHelpContext;
+
+	const char* pszUninterned = nullptr;
+
+	if (pszSource != nullptr)
+	{
+		pObject->m_pszSource = InternSource(pszSource);
+
+		if (pObject->m_pszSource == nullptr)
+			pszUninterned = pszSource;
+	}
+
+	if ( (pszHelpFile != nullptr) && (*pszHelpFile == TXT('\0')) )
+		pszHelpFile = nullptr;
+
+	// Size the strings to copy into the text buffer.
+	size_t nSource      = (pszUninterned  != nullptr) ? WideLength(pszUninterned)  : 0;
+	size_t nDescription = (pszDescription != nullptr) ? WideLength(pszDescription) : 0;
+	size_t nHelpFile    = (pszHelpFile    != nullptr) ? WideLength(pszHelpFile)    : 0;
+	size_t nTotal       = nSource + nDescription + nHelpFile;
+
+	if (nTotal != 0)
+	{
+		pObject->m_pText = AcquireText(nTotal);
+
+		if (pObject->m_pText == nullptr)
+		{
+			pObject->Release();
+			return nullptr;
+		}
+
+		wchar_t* pszNext = pObject->m_pText->m_pszBuffer;
+
+		if (nSource != 0)
+		{
+			CopyWide(pszUninterned, pszNext, nSource);
+			pObject->m_pszSource = pszNext;
+			pszNext += nSource;
+		}
+
+		if (nDescription != 0)
+		{
+			CopyWide(pszDescription, pszNext, nDescription);
+			pObject->m_pszDescription = pszNext;
+			pszNext += nDescription;
+		}
+
+		if (nHelpFile != 0)
+		{
+			CopyWide(pszHelpFile, pszNext, nHelpFile);
+			pObject->m_pszHelpFile = pszNext;
+		}
+	}
+
+	return pObject;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of error objects which are still alive.
+
+long ErrorObject::Outstanding()
+{
+	return s_nOutstanding;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query the object for a particular interface.
+
+HRESULT COMCALL ErrorObject::QueryInterface(const IID& rIID, void** ppInterface)
+{
+	// Check parameters.
+	if (ppInterface == nullptr)
+		return E_POINTER;
+
+	*ppInterface = nullptr;
+
+	if ( (rIID == IID_IUnknown) || (rIID == IID_IErrorInfo) )
+		*ppInterface = static_cast<IErrorInfo*>(this);
+	else if (rIID == IID_IMarshal)
+		*ppInterface = static_cast<IMarshal*>(this);
+
+	if (*ppInterface == nullptr)
+		return E_NOINTERFACE;
+
+	AddRef();
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the objects reference count.
+
+ULONG COMCALL ErrorObject::AddRef()
+{
+	return ::InterlockedIncrement(&m_nRefCount);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the objects reference count. The object is returned to the pool
+//! when the count reaches zero.
+
+ULONG COMCALL ErrorObject::Release()
+{
+	ASSERT(m_nRefCount > 0);
+
+	LONG nRefCount = ::InterlockedDecrement(&m_nRefCount);
+
+	if (nRefCount == 0)
+		delete this;
+
+	return nRefCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the GUID of the interface that defined the error.
+
+HRESULT COMCALL ErrorObject::GetGUID(GUID* pGUID)
+{
+	if (pGUID == nullptr)
+		return E_POINTER;
+
+	*pGUID = m_oGUID;
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the name of the component that raised the error. This returns an empty
+//! string if there is no source.
+
+HRESULT COMCALL ErrorObject::GetSource(BSTR* pbstrSource)
+{
+	if (pbstrSource == nullptr)
+		return E_POINTER;
+
+	*pbstrSource = ::SysAllocString((m_pszSource != nullptr) ? m_pszSource : L"");
+
+	return (*pbstrSource != nullptr) ? S_OK : E_OUTOFMEMORY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the description of the error. This returns an empty string if there is
+//! no description.
+
+HRESULT COMCALL ErrorObject::GetDescription(BSTR* pbstrDescription)
+{
+	if (pbstrDescription == nullptr)
+		return E_POINTER;
+
+	*pbstrDescription = ::SysAllocString((m_pszDescription != nullptr) ? m_pszDescription : L"");
+
+	return (*pbstrDescription != nullptr) ? S_OK : E_OUTOFMEMORY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the path of the help file that describes the error. This returns a
+//! NULL string if there is no help file.
+
+HRESULT COMCALL ErrorObject::GetHelpFile(BSTR* pbstrHelpFile)
+{
+	if (pbstrHelpFile == nullptr)
+		return E_POINTER;
+
+	*pbstrHelpFile = nullptr;
+
+	if (m_pszHelpFile == nullptr)
+		return S_OK;
+
+	*pbstrHelpFile = ::SysAllocString(m_pszHelpFile);
+
+	return (*pbstrHelpFile != nullptr) ? S_OK : E_OUTOFMEMORY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the help context ID for the error.
+
+HRESULT COMCALL ErrorObject::GetHelpContext(DWORD* pdwHelpContext)
+{
+	if (pdwHelpContext == nullptr)
+		return E_POINTER;
+
+	*pdwHelpContext = m_dwHelpContext;
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the CLSID of the object used to unmarshal the error. This is the one
+//! used by the system error object.
+
+HRESULT COMCALL ErrorObject::GetUnmarshalClass(const IID& rIID, void* /*pInterface*/, DWORD dwDestContext,
+												void* pvDestContext, DWORD dwFlags, CLSID* pCLSID)
+{
+	IMarshal* pMarshal = nullptr;
+	HRESULT   hr       = SystemMarshaller(pMarshal);
+
+	if (FAILED(hr))
+		return hr;
+
+	return pMarshal->GetUnmarshalClass(rIID, nullptr, dwDestContext, pvDestContext, dwFlags, pCLSID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the maximum size of the marshalled error.
+
+HRESULT COMCALL ErrorObject::GetMarshalSizeMax(const IID& rIID, void* /*pInterface*/, DWORD dwDestContext,
+												void* pvDestContext, DWORD dwFlags, DWORD* pdwSize)
+{
+	IMarshal* pMarshal = nullptr;
+	HRESULT   hr       = SystemMarshaller(pMarshal);
+
+	if (FAILED(hr))
+		return hr;
+
+	return pMarshal->GetMarshalSizeMax(rIID, nullptr, dwDestContext, pvDestContext, dwFlags, pdwSize);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write the error to a stream, as the system error object would.
+
+HRESULT COMCALL ErrorObject::MarshalInterface(IStream* pStream, const IID& rIID, void* /*pInterface*/, DWORD dwDestContext,
+												void* pvDestContext, DWORD dwFlags)
+{
+	IMarshal* pMarshal = nullptr;
+	HRESULT   hr       = SystemMarshaller(pMarshal);
+
+	if (FAILED(hr))
+		return hr;
+
+	return pMarshal->MarshalInterface(pStream, rIID, nullptr, dwDestContext, pvDestContext, dwFlags);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read an error from a stream. The error is always unmarshalled by the system
+//! error object and so this is never called.
+
+HRESULT COMCALL ErrorObject::UnmarshalInterface(IStream* /*pStream*/, const IID& /*rIID*/, void** ppInterface)
+{
+	if (ppInterface != nullptr)
+		*ppInterface = nullptr;
+
+	return E_NOTIMPL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Release the error written to a stream. The data is only a copy of the error
+//! and so there is nothing of ours to release.
+
+HRESULT COMCALL ErrorObject::ReleaseMarshalData(IStream* pStream)
+{
+	IMarshal* pMarshal = nullptr;
+	HRESULT   hr       = SystemMarshaller(pMarshal);
+
+	if (FAILED(hr))
+		return hr;
+
+	return pMarshal->ReleaseMarshalData(pStream);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Disconnect any remote clients. Remote clients hold copies of the error and
+//! so there are none.
+
+HRESULT COMCALL ErrorObject::DisconnectObject(DWORD /*dwReserved*/)
+{
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the marshaller of the system copy of the error. The copy is created the
+//! first time the error is marshalled and then kept with the object. The
+//! returned interface is owned by the object and is not AddRef'd.
+
+HRESULT ErrorObject::SystemMarshaller(IMarshal*& pMarshal)
+{
+	pMarshal = m_pMarshal;
+
+	if (pMarshal != nullptr)
+		return S_OK;
+
+	ICreateErrorInfo* pCreateErrorInfo = nullptr;
+
+	HRESULT hr = ::CreateErrorInfo(&pCreateErrorInfo);
+
+	if (FAILED(hr))
+		return hr;
+
+	pCreateErrorInfo->SetGUID(m_oGUID);
+	pCreateErrorInfo->SetSource(const_cast<wchar_t*>((m_pszSource != nullptr) ? m_pszSource : L""));
+	pCreateErrorInfo->SetDescription(const_cast<wchar_t*>((m_pszDescription != nullptr) ? m_pszDescription : L""));
+	pCreateErrorInfo->SetHelpFile(const_cast<wchar_t*>(m_pszHelpFile));
+	pCreateErrorInfo->SetHelpContext(m_dwHelpContext);
+
+	IMarshal* pNew = nullptr;
+
+	hr = pCreateErrorInfo->QueryInterface(IID_IMarshal, reinterpret_cast<void**>(&pNew));
+
+	pCreateErrorInfo->Release();
+
+	if (FAILED(hr))
+		return hr;
+
+	// Publish the copy, unless another thread beat us to it.
+	pMarshal = static_cast<IMarshal*>(::InterlockedCompareExchangePointer(reinterpret_cast<void* volatile*>(&m_pMarshal), pNew, nullptr));
+
+	if (pMarshal != nullptr)
+	{
+		pNew->Release();
+		return S_OK;
+	}
+
+	pMarshal = pNew;
+
+	return S_OK;
+}
+
+//namespace COM
+}
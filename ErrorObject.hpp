@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ErrorObject.hpp
+//! \brief  The ErrorObject class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_ERROROBJECT_HPP
+#define COM_ERROROBJECT_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "ObjectPool.hpp"
+#include <oaidl.h>
+
+namespace COM
+{
+
+// Forward declarations.
+class Server;
+struct ErrorText;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The library implementation of IErrorInfo used by SetComErrorInfo(). It
+//! replaces the object from ::CreateErrorInfo() so that reporting an error
+//! avoids creating and filling in the system object through ICreateErrorInfo.
+//! Instances come from an ObjectPool, which recycles them through a per-thread
+//! cache. The description and help file are copied into a text buffer which
+//! is borrowed from a shared list when the object is created and handed back
+//! when it's destroyed. The buffers only ever grow and so, once warmed up,
+//! creating an error allocates nothing. The source is normally a __FUNCTION__
+//! string literal and so is converted once per call site and interned.
+//!
+//! Like any other object an ErrorObject holds a lock on the server, if there
+//! is one, whilst it's alive, as its code lives in the module. When marshalled
+//! it is passed by value, as the system error object is, by copying it into a
+//! system error object and marshalling that instead. So a client in another
+//! apartment or process never holds a reference to it.
+
+class ErrorObject : public IErrorInfo, public IMarshal, public PooledObject<ErrorObject>
+{
+public:
+	//! Create an error object.
+	static IErrorInfo* Create(const GUID& rGUID, const char* pszSource, const tchar* pszDescription,
+								const tchar* pszHelpFile, DWORD dwHelpContext); // throw()
+
+	//! Get the number of error objects which are still alive.
+	static long Outstanding();
+
+	//
+	// IUnknown methods.
+	//
+
+	//! Query the object for a particular interface.
+	virtual HRESULT COMCALL QueryInterface(const IID& rIID, void** ppInterface);
+
+	//! Increment the objects reference count.
+	virtual ULONG COMCALL AddRef();
+
+	//! Decrement the objects reference count.
+	virtual ULONG COMCALL Release();
+
+	//
+	// IErrorInfo methods.
+	//
+
+	//! Get the GUID of the interface that defined the error.
+	virtual HRESULT COMCALL GetGUID(GUID* pGUID);
+
+	//! Get the name of the component that raised the error.
+	virtual HRESULT COMCALL GetSource(BSTR* pbstrSource);
+
+	//! Get the description of the error.
+	virtual HRESULT COMCALL GetDescription(BSTR* pbstrDescription);
+
+	//! Get the path of the help file that describes the error.
+	virtual HRESULT COMCALL GetHelpFile(BSTR* pbstrHelpFile);
+
+	//! Get the help context ID for the error.
+	virtual HRESULT COMCALL GetHelpContext(DWORD* pdwHelpContext);
+
+	//
+	// IMarshal methods.
+	//
+
+	//! Get the CLSID of the object used to unmarshal the error.
+	virtual HRESULT COMCALL GetUnmarshalClass(const IID& rIID, void* pInterface, DWORD dwDestContext,
+												void* pvDestContext, DWORD dwFlags, CLSID* pCLSID);
+
+	//! Get the maximum size of the marshalled error.
+	virtual HRESULT COMCALL GetMarshalSizeMax(const IID& rIID, void* pInterface, DWORD dwDestContext,
+												void* pvDestContext, DWORD dwFlags, DWORD* pdwSize);
+
+	//! Write the error to a stream.
+	virtual HRESULT COMCALL MarshalInterface(IStream* pStream, const IID& rIID, void* pInterface, DWORD dwDestContext,
+												void* pvDestContext, DWORD dwFlags);
+
+	//! Read an error from a stream.
+	virtual HRESULT COMCALL UnmarshalInterface(IStream* pStream, const IID& rIID, void** ppInterface);
+
+	//! Release the error written to a stream.
+	virtual HRESULT COMCALL ReleaseMarshalData(IStream* pStream);
+
+	//! Disconnect any remote clients.
+	virtual HRESULT COMCALL DisconnectObject(DWORD dwReserved);
+
+private:
+	//
+	// Members.
+	//
+	volatile LONG		m_nRefCount;		//!< The reference count.
+	Server*				m_pServer;			//!< The server locked, if any.
+	GUID				m_oGUID;			//!< The interface ID.
+	ErrorText*			m_pText;			//!< The buffer for the strings, if any.
+	const wchar_t*		m_pszSource;		//!< The source, interned or in m_pText.
+	const wchar_t*		m_pszDescription;	//!< The description, in m_pText.
+	const wchar_t*		m_pszHelpFile;		//!< The help file, in m_pText, if any.
+	DWORD				m_dwHelpContext;	//!< The help context ID.
+	IMarshal* volatile	m_pMarshal;			//!< The system copy used to marshal, if needed.
+
+	//
+	// Class members.
+	//
+	static volatile LONG	s_nOutstanding;	//!< The number of live objects.
+
+	//! Default constructor.
+	ErrorObject();
+
+	//! Destructor.
+	~ErrorObject();
+
+	//
+	// Internal methods.
+	//
+
+	//! Get the marshaller of the system copy of the error.
+	HRESULT SystemMarshaller(IMarshal*& pMarshal);
+};
+
+//namespace COM
+}
+
+#endif // COM_ERROROBJECT_HPP
@@ -17,7 +17,9 @@ namespace COM
 {
 
 ////////////////////////////////////////////////////////////////////////////////
-//! The implementation of IDispatch.
+//! The implementation of IDispatch. The type information is shared by all
+//! instances via the server-wide cache and so the only per-object state is the
+//! dual interface ID.
 
 template<typename T>
 class IDispatchImpl
@@ -46,23 +48,10 @@ public:
 	virtual HRESULT COMCALL Invoke(DISPID lMemberID, REFIID rIID, LCID dwLCID, WORD wFlags, DISPPARAMS* pParams, VARIANT* pResult, EXCEPINFO* pExcepInfo, UINT* pnArgError);
 
 private:
-	// Type short-hands.
-	typedef WCL::IFacePtr<ITypeLib>  ITypeLibPtr;
-	typedef WCL::IFacePtr<ITypeInfo> ITypeInfoPtr;
-
 	//
 	// Members.
 	//
 	IID				m_oDIID;		//!< The dual interface ID.
-	ITypeLibPtr		m_pTypeLib;		//!< The type library.
-	ITypeInfoPtr	m_pTypeInfo;	//!< The interface type information.
-
-	//
-	// Internal methods.
-	//
-
-	//! Load the type information.
-	void LoadTypeInfo();	// throw(ComException)
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -88,19 +77,13 @@ IDispatchImpl<T>::~IDispatchImpl()
 template<typename T>
 HRESULT COMCALL IDispatchImpl<T>::GetTypeInfoCount(UINT* pnInfo)
 {
-	HRESULT hr = S_OK;
+	// Check output parameters.
+	if (pnInfo == nullptr)
+		return COM_FAILURE(E_POINTER, TXT("pnInfo is NULL")).Report();
 
-	try
-	{
-		// Check output parameters.
-		if (pnInfo == nullptr)
-			throw WCL::ComException(E_POINTER, TXT("pnInfo is NULL"));
-
-		*pnInfo = 1;
-	}
-	COM_CATCH(hr)
+	*pnInfo = 1;
 
-	return hr;
+	return S_OK;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -109,104 +92,86 @@ HRESULT COMCALL IDispatchImpl<T>::GetTypeInfoCount(UINT* pnInfo)
 template<typename T>
 HRESULT COMCALL IDispatchImpl<T>::GetTypeInfo(UINT nInfo, LCID /*dwLCID*/, ITypeInfo** ppTypeInfo)
 {
-	HRESULT hr = S_OK;
+	// Check output parameters.
+	if (ppTypeInfo == nullptr)
+		return COM_FAILURE(E_POINTER, TXT("ppTypeInfo is NULL")).Report();
 
-	try
-	{
-		// Check output parameters.
-		if (ppTypeInfo == nullptr)
-			throw WCL::ComException(E_POINTER, TXT("ppTypeInfo is NULL"));
+	// Reset output parameters.
+	*ppTypeInfo = nullptr;
 
-		// Reset output parameters.
-		*ppTypeInfo = nullptr;
+	// Validate parameters.
+	if (nInfo != 0)
+		return COM_FAILURE(DISP_E_BADINDEX, TXT("nInfo must be 0")).Report();
 
-		// Validate parameters.
-		if (nInfo != 0)
-			throw WCL::ComException(DISP_E_BADINDEX, TXT("nInfo must be 0"));
+	Result<ITypeInfo*> oTypeInfo = COM::Server::This().QueryTypeInfo(m_oDIID);
 
-		// Load on first request.
-		if (m_pTypeLib.get() == nullptr || m_pTypeInfo.get() == nullptr)
-			LoadTypeInfo();
+	COM_REPORT_IF_FAILED(oTypeInfo);
 
-		m_pTypeInfo->AddRef();
+	ITypeInfo* pTypeInfo = oTypeInfo.Value();
 
-		*ppTypeInfo = m_pTypeInfo.get();
-	}
-	COM_CATCH(hr)
+	pTypeInfo->AddRef();
 
-	return hr;
+	*ppTypeInfo = pTypeInfo;
+
+	return S_OK;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Map a number of names to their dispatch IDs.
+//! Map a number of names to their dispatch IDs. The names are looked up in the
+//! shared map built from the type information; only those names which it
+//! cannot answer are passed on to the type information.
 
 template<typename T>
 HRESULT COMCALL IDispatchImpl<T>::GetIDsOfNames(REFIID /*rIID*/, LPOLESTR* aszNames, UINT nNames, LCID /*dwLCID*/, DISPID* alMemberIDs)
 {
+	// Validate parameters.
+	if ( (aszNames == nullptr) || (alMemberIDs == nullptr) )
+		return COM_FAILURE(E_POINTER, TXT("aszNames or alMemberIDs is NULL")).Report();
+
+	if (nNames == 0)
+		return COM_FAILURE(E_INVALIDARG, TXT("nNames must be at least 1")).Report();
+
+	Result<const DispIDMap*> oMap = COM::Server::This().QueryDispIDMap(m_oDIID);
+
+	COM_REPORT_IF_FAILED(oMap);
+
 	HRESULT hr = S_OK;
 
-	try
-	{
-		// Load on first request.
-		if (m_pTypeLib.get() == nullptr || m_pTypeInfo.get() == nullptr)
-			LoadTypeInfo();
+	if (oMap.Value()->Find(aszNames, nNames, alMemberIDs, hr))
+		return hr;
 
-		hr = m_pTypeInfo->GetIDsOfNames(aszNames, nNames, alMemberIDs);
-	}
-	COM_CATCH(hr)
+	Result<ITypeInfo*> oTypeInfo = COM::Server::This().QueryTypeInfo(m_oDIID);
 
-	return hr;
+	COM_REPORT_IF_FAILED(oTypeInfo);
+
+	return oTypeInfo.Value()->GetIDsOfNames(aszNames, nNames, alMemberIDs);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Invoke a method or access a property.
+//! Invoke a method or access a property. The call is still wrapped in an
+//! exception handler as ITypeInfo::Invoke() calls into the derived class.
 
 template<typename T>
 HRESULT COMCALL IDispatchImpl<T>::Invoke(DISPID lMemberID, REFIID /*rIID*/, LCID /*dwLCID*/, WORD wFlags, DISPPARAMS* pParams, VARIANT* pResult, EXCEPINFO* pExcepInfo, UINT* pnArgError)
 {
+	Result<ITypeInfo*> oTypeInfo = COM::Server::This().QueryTypeInfo(m_oDIID);
+
+	COM_REPORT_IF_FAILED(oTypeInfo);
+
 	HRESULT hr = S_OK;
 
 	try
 	{
-		// Load on first request.
-		if (m_pTypeLib.get() == nullptr || m_pTypeInfo.get() == nullptr)
-			LoadTypeInfo();
-
 		// Clear the last exception.
 		::SetErrorInfo(0, nullptr);
 
-		hr = m_pTypeInfo->Invoke(static_cast<T*>(this), lMemberID, wFlags, pParams, pResult, pExcepInfo, pnArgError);
+		hr = oTypeInfo.Value()->Invoke(static_cast<T*>(this), lMemberID, wFlags, pParams, pResult, pExcepInfo, pnArgError);
 	}
 	COM_CATCH(hr)
 
 	return hr;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-//! Load the type information.
-
-template<typename T>
-void IDispatchImpl<T>::LoadTypeInfo()
-{
-	// Load the type library..
-	if (m_pTypeLib.get() == nullptr)
-		m_pTypeLib = COM::Server::This().LoadTypeLibrary();
-
-	// Retrieve the type info for the interface.
-	if (m_pTypeInfo.get() == nullptr)
-	{
-		HRESULT hr = m_pTypeLib->GetTypeInfoOfGuid(m_oDIID, AttachTo(m_pTypeInfo));
-
-		if (FAILED(hr))
-		{
-			tstring strGUID = FormatGUID(m_oDIID);
-			tstring strName = LookupIID(m_oDIID);
-
-			throw WCL::ComException(hr, CString::Fmt(TXT("Failed to get the type information for %s [%s]"), strGUID.c_str(), strName.c_str()));
-		}
-	}
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 // Macros for defining the IDispatch methods.
 
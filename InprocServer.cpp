@@ -6,7 +6,7 @@
 #include "Common.hpp"
 #include "InprocServer.hpp"
 #include "ServerRegInfo.hpp"
-#include "RegUtils.hpp"
+#include "Manifest.hpp"
 #include "ClassFactory.hpp"
 
 #ifdef _MSC_VER
@@ -30,6 +30,8 @@ InprocServer* InprocServer::g_pThis = NULL;
 //! Default constructor.
 
 InprocServer::InprocServer()
+	: m_oFactoryLock()
+	, m_pFactories(nullptr)
 {
 	ASSERT(g_pThis == nullptr);
 
@@ -43,6 +45,20 @@ InprocServer::~InprocServer()
 {
 	ASSERT(g_pThis == this);
 
+	// Release the class factory cache.
+	while (m_pFactories != nullptr)
+	{
+		FactoryEntry* pEntry = m_pFactories;
+
+		m_pFactories = pEntry->m_pNext;
+
+		// Restore the lock that the cache gave up.
+		Lock();
+
+		pEntry->m_pFactory->Release();
+		delete pEntry;
+	}
+
 	g_pThis = nullptr;
 }
 
@@ -68,27 +84,33 @@ HRESULT InprocServer::DllGetClassObject(REFCLSID roCLSID, REFIID roIID, LPVOID*
 	// Reset output parameters.
 	*ppFactory = nullptr;
 
-	HRESULT hr = CLASS_E_CLASSNOTAVAILABLE;
+	// Get the shared class factory.
+	Result<IClassFactory*> oFactory = GetClassFactory(roCLSID);
 
-	try
-	{
-		// Create the class factory.
-		IClassFactoryPtr pFactory = CreateClassFactory(roCLSID);
+	COM_REPORT_IF_FAILED(oFactory);
 
-		if (pFactory.get() != nullptr)
-			hr = pFactory->QueryInterface(roIID, ppFactory);
-	}
-	COM_CATCH(hr)
+	// Reject unknown classes.
+	if (oFactory.Value() == nullptr)
+		return CLASS_E_CLASSNOTAVAILABLE;
 
-	return hr;
+	return oFactory.Value()->QueryInterface(roIID, ppFactory);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Query if the server can be unloaded.
+//! Query if the server can be unloaded. The type library and the asynchronous
+//! call and apartment threads are released before allowing the unload, rather
+//! than later under the loader lock.
 
 HRESULT InprocServer::DllCanUnloadNow()
 {
-	return (LockCount() == 0) ? S_OK : S_FALSE;
+	if (!CanUnload())
+		return S_FALSE;
+
+	StopAsyncWorkers();
+	StopApartments();
+	ReleaseTypeLibrary();
+
+	return S_OK;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -96,7 +118,7 @@ HRESULT InprocServer::DllCanUnloadNow()
 
 HRESULT InprocServer::DllRegisterServer()
 {
-	return RegisterServer(false);
+	return RegisterServer(INPROC_SERVER, m_Module.Path().c_str(), false);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -104,7 +126,7 @@ HRESULT InprocServer::DllRegisterServer()
 
 HRESULT InprocServer::DllUnregisterServer()
 {
-	return UnregisterServer(false);
+	return UnregisterServer(INPROC_SERVER, m_Module.Path().c_str(), false);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -114,25 +136,18 @@ HRESULT InprocServer::DllInstall(bool install, const tchar* cmdLine)
 {
 	bool perUser = ( (cmdLine != nullptr) && (tstricmp(cmdLine, TXT("user")) == 0) );
 
-	return (install) ? RegisterServer(perUser)
-		             : UnregisterServer(perUser);
+	return (install) ? RegisterServer(INPROC_SERVER, m_Module.Path().c_str(), perUser)
+		             : UnregisterServer(INPROC_SERVER, m_Module.Path().c_str(), perUser);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Template Method to get the servers class factory.
+//! Write the registration-free COM manifest for the server. The manifest is
+//! generated from the registration table and the registry is not touched. If
+//! no file is specified it is written next to the server and named after the
+//! type library, which is where the loader probes for the assembly.
 
-COM::IClassFactoryPtr InprocServer::CreateClassFactory(const CLSID& oCLSID)
+HRESULT InprocServer::DllWriteManifest(const tchar* pszFile)
 {
-	return IClassFactoryPtr(new ClassFactory(oCLSID), true);
-}
-
-////////////////////////////////////////////////////////////////////////////////
-//! Register the server in the registry.
-
-HRESULT InprocServer::RegisterServer(bool perUser)
-{
-	Scope scope = (perUser) ? USER : MACHINE;
-
 	COM::ServerRegInfo oServerInfo;
 
 	// Fill in the known server info.
@@ -143,41 +158,127 @@ HRESULT InprocServer::RegisterServer(bool perUser)
 	GetServerRegInfo(oServerInfo);
 	const ClassRegInfo* pClassInfo = GetClassRegInfo();
 
-	// Register the coclasses.
-	for (; pClassInfo->m_pCLSID != nullptr; ++pClassInfo)
-		RegisterCLSID(scope, oServerInfo, *pClassInfo->m_pCLSID, pClassInfo->m_pszName, pClassInfo->m_pszVersion, pClassInfo->m_eModel);
+	tstring strManifest;
+
+	if ( (pszFile != nullptr) && (*pszFile != TXT('\0')) )
+	{
+		strManifest = pszFile;
+	}
+	else
+	{
+		size_t nSeparator = oServerInfo.m_strFile.find_last_of(TXT("\\/"));
+
+		if (nSeparator != tstring::npos)
+			strManifest = oServerInfo.m_strFile.substr(0, nSeparator+1);
+
+		strManifest += oServerInfo.m_strLibrary + TXT(".manifest");
+	}
 
-	// Register the type library.
-	RegisterTypeLib(scope, oServerInfo.m_strFile);
+	WriteManifest(strManifest, oServerInfo, pClassInfo);
 
 	return S_OK;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Unregister the server from the registry.
+//! Get the cached class factory for the class. The factory is created on first
+//! request and then kept for the lifetime of the module. The reference held by
+//! the cache does not lock the server, otherwise the module could never be
+//! unloaded, but any client reference does (see CachedClassFactory). The
+//! returned interface is owned by the cache and is not AddRef'd. The value is nullptr
+//! if the server does not implement the class. Only the first request for a
+//! class can throw and so any exception is caught there and returned as a
+//! failure.
+
+Result<IClassFactory*> InprocServer::GetClassFactory(const CLSID& oCLSID)
+{
+	// Fast path, lock-free lookup.
+	IClassFactory* pFactory = FindClassFactory(oCLSID);
+
+	if (pFactory != nullptr)
+		return pFactory;
+
+	try
+	{
+		// Reject unknown classes up front.
+		if (FindClass(oCLSID) == nullptr)
+			return static_cast<IClassFactory*>(nullptr);
+
+		return LoadClassFactory(oCLSID);
+	}
+	COM_CATCH_RESULT(IClassFactory*)
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create the class factory for the class. The factory is cached and so locks
+//! the server only whilst a client holds it. A derived class which creates its
+//! own factory must do the same, or its clients must call LockServer().
 
-HRESULT InprocServer::UnregisterServer(bool perUser)
+COM::IClassFactoryPtr InprocServer::CreateClassFactory(const CLSID& oCLSID)
 {
-	Scope scope = (perUser) ? USER : MACHINE;
+	return IClassFactoryPtr(new CachedClassFactory(oCLSID), true);
+}
 
-	COM::ServerRegInfo oServerInfo;
+////////////////////////////////////////////////////////////////////////////////
+//! Create the class factory for the class and add it to the cache. This
+//! returns nullptr if the class factory could not be created.
 
-	// Fill in the known server info.
-	oServerInfo.m_eType   = INPROC_SERVER;
-	oServerInfo.m_strFile = m_Module.Path();
+IClassFactory* InprocServer::LoadClassFactory(const CLSID& oCLSID)
+{
+	CriticalSection::Lock oLock(m_oFactoryLock);
 
-	// Get the server and coclass details.
-	GetServerRegInfo(oServerInfo);
-	const ClassRegInfo* pClassInfo = GetClassRegInfo();
+	// Check again, now that we're serialised.
+	IClassFactory* pFactory = FindClassFactory(oCLSID);
 
-	// Unregister the coclasses.
-	for (; pClassInfo->m_pCLSID != nullptr; ++pClassInfo)
-		UnregisterCLSID(scope, oServerInfo, *pClassInfo->m_pCLSID, pClassInfo->m_pszName, pClassInfo->m_pszVersion);
+	if (pFactory != nullptr)
+		return pFactory;
 
-	// Unregister the type library.
-	UnregisterTypeLib(scope, oServerInfo.m_oLIBID, oServerInfo.m_nMajor, oServerInfo.m_nMinor);
+	FactoryEntry*    pEntry = new FactoryEntry;
+	IClassFactoryPtr pNewFactory;
 
-	return S_OK;
+	try
+	{
+		pNewFactory = CreateClassFactory(oCLSID);
+	}
+	catch (...)
+	{
+		delete pEntry;
+		throw;
+	}
+
+	if (pNewFactory.get() == nullptr)
+	{
+		delete pEntry;
+		return nullptr;
+	}
+
+	// Take the cache's reference, without pinning the server.
+	pFactory = pNewFactory.get();
+	pFactory->AddRef();
+	Unlock();
+
+	pEntry->m_oCLSID   = oCLSID;
+	pEntry->m_pFactory = pFactory;
+	pEntry->m_pNext    = m_pFactories;
+
+	// Publish the fully constructed entry.
+	::InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_pFactories), pEntry);
+
+	return pFactory;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the cached class factory for the class. Entries are never modified once
+//! published and so the list can be walked without the lock.
+
+IClassFactory* InprocServer::FindClassFactory(const CLSID& oCLSID) const
+{
+	for (const FactoryEntry* pEntry = m_pFactories; pEntry != nullptr; pEntry = pEntry->m_pNext)
+	{
+		if (IsEqualCLSID(pEntry->m_oCLSID, oCLSID))
+			return pEntry->m_pFactory;
+	}
+
+	return nullptr;
 }
 
 //namespace COM
@@ -14,16 +14,6 @@
 namespace COM
 {
 
-// Forward declarations.
-class ServerRegInfo;
-struct ClassRegInfo;
-
-//! The class factory smart-pointer type.
-typedef WCL::IFacePtr<IClassFactory> IClassFactoryPtr;
-
-//! The IUnknown smart-pointer type.
-typedef WCL::IFacePtr<IUnknown> IUnknownPtr;
-
 ////////////////////////////////////////////////////////////////////////////////
 //! The base class for In-process (DLL based) servers.
 
@@ -59,23 +49,31 @@ protected:
 	//! Register or unregister the server to/from the registry.
 	virtual HRESULT DllInstall(bool install, const tchar* cmdLine);
 
+	//! Write the registration-free COM manifest for the server.
+	virtual HRESULT DllWriteManifest(const tchar* pszFile);
+
 	//
 	// Internal methods.
 	//
 
-	//! Template Method used to obtain the server type information.
-	virtual void GetServerRegInfo(ServerRegInfo& oInfo) const = 0;
-
-	//! Template Method used to obtain the server coclasses information.
-	virtual const ClassRegInfo* GetClassRegInfo() const = 0;
-
-	//! Template Method to get the servers class factory.
+	//! Template Method to create the servers class factory.
 	virtual COM::IClassFactoryPtr CreateClassFactory(const CLSID& oCLSID);
 
-	//! Template Method to allocate an object for the class factory.
-	virtual COM::IUnknownPtr CreateObject(const CLSID& oCLSID) = 0;
-
 private:
+	//! An entry in the cache of class factories.
+	struct FactoryEntry
+	{
+		CLSID			m_oCLSID;		//!< The class ID.
+		IClassFactory*	m_pFactory;		//!< The class factory.
+		FactoryEntry*	m_pNext;		//!< The next entry in the list.
+	};
+
+	//
+	// Members.
+	//
+	CriticalSection			m_oFactoryLock;	//!< The lock used to populate the cache.
+	FactoryEntry* volatile	m_pFactories;	//!< The class factory cache.
+
 	//
 	// Class members.
 	//
@@ -92,30 +90,18 @@ private:
 	friend HRESULT STDAPICALLTYPE ::DllRegisterServer(void);
 	friend HRESULT STDAPICALLTYPE ::DllUnregisterServer(void);
 	friend HRESULT STDAPICALLTYPE ::DllInstall(BOOL, const tchar*);
-	friend class ClassFactory;
+	friend HRESULT STDAPICALLTYPE ::DllWriteManifest(LPCWSTR);
 
-	//! Register the server in the registry.
-	HRESULT RegisterServer(bool perUser);
+	//! Get the cached class factory for the class.
+	Result<IClassFactory*> GetClassFactory(const CLSID& oCLSID);	// throw()
 
-	//! Unregister the server from the registry.
-	HRESULT UnregisterServer(bool perUser);
-};
+	//! Create the class factory for the class and add it to the cache.
+	IClassFactory* LoadClassFactory(const CLSID& oCLSID);	// throw(ComException)
 
-////////////////////////////////////////////////////////////////////////////////
-// Macros for defining the class factory table.
-
-#define DEFINE_CLASS_FACTORY_TABLE()																\
-									virtual COM::IUnknownPtr CreateObject(const CLSID& oCLSID)		\
-									{																\
-										COM::IUnknownPtr pUnknown;
-
-#define DEFINE_CLASS(clsid, type, primary_iface)													\
-										if (oCLSID == clsid)										\
-											pUnknown = COM::IUnknownPtr(static_cast<primary_iface*>(new type), true);
+	//! Find the cached class factory for the class.
+	IClassFactory* FindClassFactory(const CLSID& oCLSID) const;
+};
 
-#define END_CLASS_FACTORY_TABLE()																	\
-										return pUnknown;											\
-									}
 //namespace COM
 }
 
@@ -0,0 +1,306 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   InterfaceTable.hpp
+//! \brief  The InterfaceTable class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_INTERFACETABLE_HPP
+#define COM_INTERFACETABLE_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+//! The maximum number of interfaces that a single class can expose.
+const size_t MAX_INTERFACE_ENTRIES = 64;
+
+//! The type used by END_INTERFACE_TABLE to reject a table with more than
+//! MAX_INTERFACE_ENTRIES entries at compile time. Only the 'true' case is
+//! defined, so taking the size of the 'false' case fails to compile.
+template<bool bFits>
+struct InterfaceTableSizeCheck;
+
+template<>
+struct InterfaceTableSizeCheck<true>
+{
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Compare two GUIDs as a pair of 64-bit values. The ordering has no meaning
+//! other than providing a total order for sorting and searching.
+
+inline int CompareGUID(const GUID& rLHS, const GUID& rRHS)
+{
+	// Copy the halves out, rather than cast, to respect the aliasing rules;
+	// the copies compile down to the same 64-bit loads.
+	ULONGLONG aLHS[2];
+	ULONGLONG aRHS[2];
+
+	memcpy(aLHS, &rLHS, sizeof(aLHS));
+	memcpy(aRHS, &rRHS, sizeof(aRHS));
+
+	if (aLHS[0] != aRHS[0])
+		return (aLHS[0] < aRHS[0]) ? -1 : +1;
+
+	if (aLHS[1] != aRHS[1])
+		return (aLHS[1] < aRHS[1]) ? -1 : +1;
+
+	return 0;
+}
+
+//! The function used to create a tear-off interface for an object. It is passed
+//! the object and the entry offset and returns the interface, or nullptr.
+typedef void* (*TearOffFn)(void* pObject, ptrdiff_t nOffset);
+
+////////////////////////////////////////////////////////////////////////////////
+//! A mapping declared by one of the interface table macros. The macros build
+//! an array of these so that the number of entries is known at compile time.
+//! For a tear-off interface the target is the cache member, if any.
+
+struct InterfaceMapping
+{
+	const IID*	m_pIID;			//!< The interface ID.
+	const void*	m_pTarget;		//!< The interface, or the tear-off cache.
+	TearOffFn	m_pfnTearOff;	//!< The tear-off creation function, if a tear-off.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! An entry in the interface table which maps an interface ID onto the offset
+//! of the interface from the start of the object. For a tear-off interface the
+//! entry has a creation function instead, and the offset is that of the cache
+//! member, if any.
+
+struct InterfaceEntry
+{
+	IID			m_oIID;			//!< The interface ID.
+	ptrdiff_t	m_nOffset;		//!< The 'this' adjustment for the interface.
+	TearOffFn	m_pfnTearOff;	//!< The tear-off creation function, if a tear-off.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The per-class table of interfaces, sorted by IID so that a lookup is a
+//! binary search. The type is a POD so that the function-local static used by
+//! the DEFINE_INTERFACE_TABLE macro is zero-initialised by the compiler rather
+//! than relying on (thread unsafe) dynamic initialisation. It is filled in
+//! once, on first use, by an InterfaceTableBuilder.
+
+struct InterfaceTable
+{
+	//! The table states.
+	enum State
+	{
+		EMPTY		= 0,		//!< The table has not been built yet.
+		BUILDING	= 1,		//!< The table is being published.
+		READY		= 2,		//!< The table is immutable and can be searched.
+	};
+
+	//! Query if the table has been published.
+	bool IsReady() const;
+
+	//! Find the interface on the object, if supported.
+	void* Find(void* pObject, const IID& rIID) const;
+
+	//
+	// Members.
+	//
+	volatile LONG	m_eState;							//!< The table State.
+	size_t			m_nCount;							//!< The number of entries.
+	InterfaceEntry	m_aoEntries[MAX_INTERFACE_ENTRIES];	//!< The sorted entries.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the table has been published.
+
+inline bool InterfaceTable::IsReady() const
+{
+	return (m_eState == READY);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the interface on the object, if supported. This returns the adjusted
+//! object pointer or nullptr if the interface is not in the table. A tear-off
+//! interface is created (or fetched from its cache) by the entry's function.
+
+inline void* InterfaceTable::Find(void* pObject, const IID& rIID) const
+{
+	size_t nBegin = 0;
+	size_t nEnd   = m_nCount;
+
+	while (nBegin < nEnd)
+	{
+		size_t nMiddle = nBegin + ((nEnd - nBegin) / 2);
+		int    nResult = CompareGUID(rIID, m_aoEntries[nMiddle].m_oIID);
+
+		if (nResult == 0)
+		{
+			const InterfaceEntry& oEntry = m_aoEntries[nMiddle];
+
+			if (oEntry.m_pfnTearOff != nullptr)
+				return oEntry.m_pfnTearOff(pObject, oEntry.m_nOffset);
+
+			return static_cast<char*>(pObject) + oEntry.m_nOffset;
+		}
+
+		if (nResult < 0)
+			nEnd = nMiddle;
+		else
+			nBegin = nMiddle + 1;
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The helper class used to build an InterfaceTable for a class the first time
+//! it is queried. The table is built on the stack and then published to the
+//! shared static table. If two threads race on the first query the loser just
+//! uses its private copy for that one lookup.
+
+class InterfaceTableBuilder : private Core::NotCopyable
+{
+public:
+	//! Construction from the object that the offsets are relative to.
+	InterfaceTableBuilder(const void* pObject);
+
+	//! Add a mapping for an interface.
+	void Add(const IID& rIID, const void* pInterface);
+
+	//! Add a mapping for a tear-off interface.
+	void AddTearOff(const IID& rIID, TearOffFn pfnTearOff, const void* pCache);
+
+	//! Add the mappings declared by the interface table macros.
+	void Add(const InterfaceMapping* pMappings, size_t nCount);
+
+	//! Publish the table, if no other thread has already done so.
+	const InterfaceTable& Publish(InterfaceTable& oTable);
+
+private:
+	//
+	// Members.
+	//
+	const char*		m_pObject;		//!< The object base address.
+	InterfaceTable	m_oTable;		//!< The table under construction.
+
+	//
+	// Internal methods.
+	//
+
+	//! Insert an entry in sorted order.
+	void Insert(const InterfaceEntry& oEntry);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the object that the offsets are relative to.
+
+inline InterfaceTableBuilder::InterfaceTableBuilder(const void* pObject)
+	: m_pObject(static_cast<const char*>(pObject))
+{
+	m_oTable.m_eState = InterfaceTable::EMPTY;
+	m_oTable.m_nCount = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add a mapping for an interface.
+
+inline void InterfaceTableBuilder::Add(const IID& rIID, const void* pInterface)
+{
+	InterfaceEntry oEntry = { rIID, static_cast<const char*>(pInterface) - m_pObject, nullptr };
+
+	Insert(oEntry);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add a mapping for a tear-off interface. The cache is the member which holds
+//! a cached tear-off, or nullptr if a new one is created for every query.
+
+inline void InterfaceTableBuilder::AddTearOff(const IID& rIID, TearOffFn pfnTearOff, const void* pCache)
+{
+	ASSERT(pfnTearOff != nullptr);
+
+	ptrdiff_t      nOffset = (pCache != nullptr) ? (static_cast<const char*>(pCache) - m_pObject) : 0;
+	InterfaceEntry oEntry  = { rIID, nOffset, pfnTearOff };
+
+	Insert(oEntry);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Add the mappings declared by the interface table macros. The macros check
+//! that the number of mappings fits the table at compile time.
+
+inline void InterfaceTableBuilder::Add(const InterfaceMapping* pMappings, size_t nCount)
+{
+	ASSERT(nCount <= MAX_INTERFACE_ENTRIES);
+
+	for (size_t i = 0; i != nCount; ++i)
+	{
+		const InterfaceMapping& oMapping = pMappings[i];
+
+		if (oMapping.m_pfnTearOff != nullptr)
+			AddTearOff(*oMapping.m_pIID, oMapping.m_pfnTearOff, oMapping.m_pTarget);
+		else
+			Add(*oMapping.m_pIID, oMapping.m_pTarget);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Insert an entry in sorted order. If the IID is already present the first
+//! mapping wins, which matches the behaviour of the original sequential chain
+//! of tests. The table size is checked at compile time by the macros, so the
+//! guard only protects a builder used directly.
+
+inline void InterfaceTableBuilder::Insert(const InterfaceEntry& oEntry)
+{
+	ASSERT(m_oTable.m_nCount < MAX_INTERFACE_ENTRIES);
+
+	if (m_oTable.m_nCount == MAX_INTERFACE_ENTRIES)
+		return;
+
+	size_t nPos = m_oTable.m_nCount;
+
+	// Find the insertion point.
+	for (; nPos != 0; --nPos)
+	{
+		int nResult = CompareGUID(oEntry.m_oIID, m_oTable.m_aoEntries[nPos-1].m_oIID);
+
+		if (nResult == 0)
+			return;
+
+		if (nResult > 0)
+			break;
+	}
+
+	// Make room for the new entry.
+	for (size_t i = m_oTable.m_nCount; i != nPos; --i)
+		m_oTable.m_aoEntries[i] = m_oTable.m_aoEntries[i-1];
+
+	m_oTable.m_aoEntries[nPos] = oEntry;
+
+	++m_oTable.m_nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Publish the table, if no other thread has already done so. The returned
+//! table is the private copy and is only valid for the lifetime of the builder.
+
+inline const InterfaceTable& InterfaceTableBuilder::Publish(InterfaceTable& oTable)
+{
+	if (::InterlockedCompareExchange(&oTable.m_eState, InterfaceTable::BUILDING, InterfaceTable::EMPTY) == InterfaceTable::EMPTY)
+	{
+		oTable.m_nCount = m_oTable.m_nCount;
+
+		for (size_t i = 0; i != m_oTable.m_nCount; ++i)
+			oTable.m_aoEntries[i] = m_oTable.m_aoEntries[i];
+
+		::InterlockedExchange(&oTable.m_eState, InterfaceTable::READY);
+	}
+
+	return m_oTable;
+}
+
+//namespace COM
+}
+
+#endif // COM_INTERFACETABLE_HPP
@@ -0,0 +1,223 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   LocalServer.cpp
+//! \brief  The LocalServer class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "LocalServer.hpp"
+#include "ComUtils.hpp"
+#include <WCL/Module.hpp>
+
+#ifdef _MSC_VER
+// Linker directives.
+#pragma comment(lib, "ole32")
+#pragma comment(lib, "oleaut32")
+#endif
+
+namespace COM
+{
+
+//! The singleton local server.
+LocalServer* LocalServer::g_pThis = NULL;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+LocalServer::LocalServer()
+	: m_hShutdown(::CreateEvent(nullptr, TRUE, FALSE, nullptr))
+	, m_bRunning(FALSE)
+	, m_oCookies()
+{
+	ASSERT(g_pThis == nullptr);
+
+	if (m_hShutdown == nullptr)
+		throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to create the server shutdown event"));
+
+	g_pThis = this;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+LocalServer::~LocalServer()
+{
+	ASSERT(g_pThis == this);
+	ASSERT(m_oCookies.empty());
+
+	::CloseHandle(m_hShutdown);
+
+	g_pThis = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Singleton accessor.
+
+LocalServer& LocalServer::This()
+{
+	ASSERT(g_pThis != nullptr);
+
+	return *g_pThis;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if a command line argument is the one COM uses to launch the server.
+
+bool LocalServer::IsEmbedding(const tchar* pszArg)
+{
+	ASSERT(pszArg != nullptr);
+
+	return ( (tstricmp(pszArg, TXT("-Embedding")) == 0) || (tstricmp(pszArg, TXT("/Embedding")) == 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register the server in the registry.
+
+HRESULT LocalServer::RegisterServer(bool perUser)
+{
+	return Server::RegisterServer(LOCAL_SERVER, CModule::This().Path().c_str(), perUser);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Unregister the server from the registry.
+
+HRESULT LocalServer::UnregisterServer(bool perUser)
+{
+	return Server::UnregisterServer(LOCAL_SERVER, CModule::This().Path().c_str(), perUser);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register the class objects and serve calls until the server is released.
+//! The calling thread joins the MTA, so calls are dispatched concurrently on
+//! the COM runtime's own RPC threads and this thread only waits. The class
+//! objects are registered suspended and then resumed together, so a client
+//! can't activate one class before the others are available. The asynchronous
+//! call and apartment threads are stopped once the class objects are revoked.
+
+void LocalServer::Run()
+{
+	HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	if (FAILED(hr))
+		throw WCL::ComException(hr, TXT("Failed to initialise COM"));
+
+	try
+	{
+		::ResetEvent(m_hShutdown);
+
+		RegisterClassObjects();
+
+		::InterlockedExchange(&m_bRunning, TRUE);
+
+		hr = ::CoResumeClassObjects();
+
+		if (FAILED(hr))
+			throw WCL::ComException(hr, TXT("Failed to resume the class objects"));
+
+		TRACE1(TXT("Local server running with %lu class objects\n"), static_cast<ulong>(m_oCookies.size()));
+
+		::WaitForSingleObject(m_hShutdown, INFINITE);
+
+		TRACE(TXT("Local server shutting down\n"));
+	}
+	catch (...)
+	{
+		::InterlockedExchange(&m_bRunning, FALSE);
+		RevokeClassObjects();
+		StopAsyncWorkers();
+		StopApartments();
+		::CoUninitialize();
+		throw;
+	}
+
+	::InterlockedExchange(&m_bRunning, FALSE);
+	RevokeClassObjects();
+	StopAsyncWorkers();
+	StopApartments();
+	::CoUninitialize();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Ask the server to stop serving calls. Run() then revokes the class objects
+//! and returns.
+
+void LocalServer::Shutdown()
+{
+	::SetEvent(m_hShutdown);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Lock the server. The COM server process reference is also taken, as that
+//! is what COM uses to decide when to stop activating new objects.
+
+void LocalServer::Lock()
+{
+	Server::Lock();
+
+	::CoAddRefServerProcess();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Unlock the server. When the last lock is released COM suspends the class
+//! objects, in the same call, so no new object can be created on the way out,
+//! and the server is shut down. This is only done once the server is running,
+//! as the class objects are created, and their locks given up, beforehand.
+
+void LocalServer::Unlock()
+{
+	Server::Unlock();
+
+	if ( (::CoReleaseServerProcess() == 0) && IsRunning() )
+		Shutdown();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register a class object for every class in the factory table. The COM
+//! registration holds a reference to each class factory, which does not lock
+//! the server, otherwise it could never shut down.
+
+void LocalServer::RegisterClassObjects()
+{
+	for (const ClassFactoryEntry* pEntry = GetClassFactoryTable(); pEntry->m_pCLSID != nullptr; ++pEntry)
+	{
+		IClassFactoryPtr pFactory = CreateClassFactory(*pEntry->m_pCLSID);
+
+		if (pFactory.get() == nullptr)
+			continue;
+
+		DWORD dwCookie = 0;
+
+		HRESULT hr = ::CoRegisterClassObject(*pEntry->m_pCLSID, pFactory.get(), CLSCTX_LOCAL_SERVER,
+												REGCLS_MULTIPLEUSE | REGCLS_SUSPENDED, &dwCookie);
+
+		if (FAILED(hr))
+		{
+			tchar szGUID[GUID_BUFFER_SIZE];
+
+			throw WCL::ComException(hr, CString::Fmt(TXT("Failed to register the class object for %s"), FormatGUID(*pEntry->m_pCLSID, szGUID)));
+		}
+
+		m_oCookies.push_back(dwCookie);
+
+		// Give up the lock held for the registration's reference.
+		Unlock();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Revoke the class object registrations.
+
+void LocalServer::RevokeClassObjects()
+{
+	for (Cookies::const_iterator it = m_oCookies.begin(); it != m_oCookies.end(); ++it)
+	{
+		// Restore the lock that the registration gave up.
+		Lock();
+
+		::CoRevokeClassObject(*it);
+	}
+
+	m_oCookies.clear();
+}
+
+//namespace COM
+}
@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   LocalServer.hpp
+//! \brief  The LocalServer class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_LOCALSERVER_HPP
+#define COM_LOCALSERVER_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "Server.hpp"
+#include <vector>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The base class for Out-of-process (EXE based) servers. The server uses the
+//! same registration and class factory tables as an InprocServer. Run() joins
+//! the MTA, registers a multi-use class object for every class in the table
+//! and then serves calls until the last client reference is released.
+
+class LocalServer : public Server
+{
+public:
+	//! Default constructor.
+	LocalServer(); // throw(ComException)
+
+	//! Destructor.
+	virtual ~LocalServer();
+
+	//! Singleton accessor.
+	static LocalServer& This();
+
+	//
+	// Properties.
+	//
+
+	//! Query if the server is serving calls.
+	bool IsRunning() const;
+
+	//
+	// Methods.
+	//
+
+	//! Query if a command line argument is the one COM uses to launch the server.
+	static bool IsEmbedding(const tchar* pszArg);
+
+	//! Register the server in the registry.
+	HRESULT RegisterServer(bool perUser); // throw(ComException)
+
+	//! Unregister the server from the registry.
+	HRESULT UnregisterServer(bool perUser); // throw(ComException)
+
+	//! Register the class objects and serve calls until the server is released.
+	void Run(); // throw(ComException)
+
+	//! Ask the server to stop serving calls.
+	void Shutdown();
+
+	//! Lock the server.
+	virtual void Lock();
+
+	//! Unlock the server.
+	virtual void Unlock();
+
+private:
+	//! The registration cookies for the class objects.
+	typedef std::vector<DWORD> Cookies;
+
+	//
+	// Members.
+	//
+	HANDLE			m_hShutdown;	//!< The event signalled to stop the server.
+	volatile LONG	m_bRunning;		//!< Is the server serving calls?
+	Cookies			m_oCookies;		//!< The class object registrations.
+
+	//
+	// Internal methods.
+	//
+
+	//! Register a class object for every class in the factory table.
+	void RegisterClassObjects(); // throw(ComException)
+
+	//! Revoke the class object registrations.
+	void RevokeClassObjects();
+
+	//
+	// Class members.
+	//
+
+	//! The singleton local server.
+	static LocalServer* g_pThis;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the server is serving calls.
+
+inline bool LocalServer::IsRunning() const
+{
+	return (m_bRunning != FALSE);
+}
+
+//namespace COM
+}
+
+#endif // COM_LOCALSERVER_HPP
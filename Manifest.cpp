@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Manifest.cpp
+//! \brief  Functions for generating registration-free COM manifests.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "Manifest.hpp"
+#include "ServerRegInfo.hpp"
+#include "RegUtils.hpp"
+#include "ComUtils.hpp"
+#include <vector>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! Append a string to the XML document, escaping the characters which are not
+//! allowed in an attribute value.
+
+static void AppendEscaped(tstring& strXML, const tstring& strText)
+{
+	for (tstring::const_iterator it = strText.begin(); it != strText.end(); ++it)
+	{
+		switch (*it)
+		{
+			case TXT('&'):	strXML += TXT("&amp;");		break;
+			case TXT('<'):	strXML += TXT("&lt;");		break;
+			case TXT('>'):	strXML += TXT("&gt;");		break;
+			case TXT('"'):	strXML += TXT("&quot;");	break;
+			default:		strXML += *it;				break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Append an attribute to the XML document.
+
+static void AppendAttribute(tstring& strXML, const tchar* pszName, const tstring& strValue)
+{
+	strXML += TXT(" ");
+	strXML += pszName;
+	strXML += TXT("=\"");
+	AppendEscaped(strXML, strValue);
+	strXML += TXT("\"");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the file name part of a path, as the manifest is always in the same
+//! folder as the server.
+
+static tstring GetFileName(const tstring& strPath)
+{
+	size_t nSeparator = strPath.find_last_of(TXT("\\/"));
+
+	if (nSeparator == tstring::npos)
+		return strPath;
+
+	return strPath.substr(nSeparator+1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Convert a string to UTF-8.
+
+static std::string ToUTF8(const wchar_t* pszText)
+{
+	int nChars = ::WideCharToMultiByte(CP_UTF8, 0, pszText, -1, nullptr, 0, nullptr, nullptr);
+
+	if (nChars == 0)
+		throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to convert the manifest to UTF-8"));
+
+	std::vector<char> vecBuffer(nChars);
+
+	::WideCharToMultiByte(CP_UTF8, 0, pszText, -1, &vecBuffer[0], nChars, nullptr, nullptr);
+
+	return std::string(&vecBuffer[0]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Format the assembly manifest for a server from its registration table. The
+//! assembly has the same name as the type library and describes the server
+//! file, its coclasses and the type library, with the ProgIDs and threading
+//! models that would be written to the registry by RegisterCLSID().
+
+tstring FormatManifest(const ServerRegInfo& rSvrInfo, const ClassRegInfo* pClasses)
+{
+	ASSERT(rSvrInfo.m_eType == INPROC_SERVER);
+	ASSERT(pClasses != nullptr);
+
+	tchar szGUID[GUID_BUFFER_SIZE];
+
+	tstring strLIBID   = FormatGUID(rSvrInfo.m_oLIBID, szGUID);
+	tstring strVersion = CString::Fmt(TXT("%u.%u"), rSvrInfo.m_nMajor, rSvrInfo.m_nMinor).c_str();
+	tstring strXML;
+
+	strXML += TXT("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\r\n");
+	strXML += TXT("<assembly xmlns=\"urn:schemas-microsoft-com:asm.v1\" manifestVersion=\"1.0\">\r\n");
+
+	// Write the assembly identity.
+	strXML += TXT("\t<assemblyIdentity type=\"win32\"");
+	AppendAttribute(strXML, TXT("name"), rSvrInfo.m_strLibrary);
+	AppendAttribute(strXML, TXT("version"), strVersion + TXT(".0.0"));
+	strXML += TXT("/>\r\n");
+
+	// Write the server file.
+	strXML += TXT("\t<file");
+	AppendAttribute(strXML, TXT("name"), GetFileName(rSvrInfo.m_strFile));
+	strXML += TXT(">\r\n");
+
+	// Write the coclasses.
+	for (; pClasses->m_pCLSID != nullptr; ++pClasses)
+	{
+		tstring strClass       = pClasses->m_pszName;
+		tstring strProgID      = rSvrInfo.m_strLibrary + TXT(".") + strClass;
+		tstring strVerProgID   = strProgID + TXT(".") + pClasses->m_pszVersion;
+		tstring strThreadModel = GetThreadModelKey(pClasses->m_eModel);
+
+		strXML += TXT("\t\t<comClass");
+		AppendAttribute(strXML, TXT("clsid"), FormatGUID(*pClasses->m_pCLSID, szGUID));
+
+		// The main STA is the default, as it is in the registry.
+		if (!strThreadModel.empty())
+			AppendAttribute(strXML, TXT("threadingModel"), strThreadModel);
+
+		AppendAttribute(strXML, TXT("progid"), strVerProgID);
+		AppendAttribute(strXML, TXT("tlbid"), strLIBID);
+		AppendAttribute(strXML, TXT("description"), strClass + TXT(" Class"));
+		strXML += TXT(">\r\n");
+
+		strXML += TXT("\t\t\t<progid>");
+		AppendEscaped(strXML, strProgID);
+		strXML += TXT("</progid>\r\n");
+
+		strXML += TXT("\t\t</comClass>\r\n");
+	}
+
+	// Write the type library.
+	strXML += TXT("\t\t<typelib");
+	AppendAttribute(strXML, TXT("tlbid"), strLIBID);
+	AppendAttribute(strXML, TXT("version"), strVersion);
+	strXML += TXT(" helpdir=\"\"/>\r\n");
+
+	strXML += TXT("\t</file>\r\n");
+	strXML += TXT("</assembly>\r\n");
+
+	return strXML;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write the assembly manifest for a server to a file, encoded as UTF-8. The
+//! registry is not used or changed.
+
+void WriteManifest(const tstring& strFile, const ServerRegInfo& rSvrInfo, const ClassRegInfo* pClasses)
+{
+	std::string strText = ToUTF8(T2W(FormatManifest(rSvrInfo, pClasses)));
+
+	HANDLE hFile = ::CreateFile(strFile.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+		throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), CString::Fmt(TXT("Failed to create the manifest '%s'"), strFile.c_str()));
+
+	DWORD   dwSize    = static_cast<DWORD>(strText.length());
+	DWORD   dwWritten = 0;
+	HRESULT hr        = S_OK;
+
+	if (!::WriteFile(hFile, strText.data(), dwSize, &dwWritten, nullptr))
+		hr = HRESULT_FROM_WIN32(::GetLastError());
+	else if (dwWritten != dwSize)
+		hr = E_FAIL;
+
+	::CloseHandle(hFile);
+
+	if (FAILED(hr))
+		throw WCL::ComException(hr, CString::Fmt(TXT("Failed to write the manifest '%s'"), strFile.c_str()));
+}
+
+//namespace COM
+}
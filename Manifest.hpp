@@ -0,0 +1,34 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Manifest.hpp
+//! \brief  Functions for generating registration-free COM manifests.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_MANIFEST_HPP
+#define COM_MANIFEST_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+// Forward declarations.
+class ServerRegInfo;
+struct ClassRegInfo;
+
+////////////////////////////////////////////////////////////////////////////////
+// Format the assembly manifest for a server from its registration table.
+
+tstring FormatManifest(const ServerRegInfo& rSvrInfo, const ClassRegInfo* pClasses);
+
+////////////////////////////////////////////////////////////////////////////////
+// Write the assembly manifest for a server to a file, encoded as UTF-8.
+
+void WriteManifest(const tstring& strFile, const ServerRegInfo& rSvrInfo, const ClassRegInfo* pClasses); // throw(ComException)
+
+//namespace COM
+}
+
+#endif // COM_MANIFEST_HPP
@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   MarshalPolicy.hpp
+//! \brief  The marshalling policies used by ObjectBase.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_MARSHALPOLICY_HPP
+#define COM_MARSHALPOLICY_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <objbase.h>
+
+namespace COM
+{
+
+//! The IID of the IAgileObject marker interface. This is defined here as older
+//! SDKs do not declare it.
+static const IID IID_IAgileObject = { 0x94EA2B94, 0xE9CC, 0x49E0, { 0xC0, 0xFF, 0xEE, 0x64, 0xCA, 0x8F, 0x5B, 0x90 } };
+
+////////////////////////////////////////////////////////////////////////////////
+//! The default marshalling policy, which exposes no extra interfaces and so
+//! leaves COM to build a proxy whenever the object leaves its apartment.
+
+class StandardMarshalling
+{
+protected:
+	//! Query for an interface the object does not implement itself.
+	HRESULT QueryMarshaler(IUnknown* pOuter, const IID& rIID, void** ppInterface);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query for an interface the object does not implement itself.
+
+inline HRESULT StandardMarshalling::QueryMarshaler(IUnknown* /*pOuter*/, const IID& /*rIID*/, void** ppInterface)
+{
+	*ppInterface = nullptr;
+
+	return E_NOINTERFACE;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The marshalling policy for objects which can be called directly from any
+//! apartment. This aggregates the free-threaded marshaler to provide IMarshal,
+//! so that a pointer passed to another apartment in the same process is the
+//! object itself rather than a proxy, and answers IAgileObject to say so.
+//!
+//! The object must be thread-safe and must not hold raw pointers to objects in
+//! other apartments, so this is only suitable for the FREE_THREAD_APT,
+//! ANY_APARTMENT and NEUTRAL_APARTMENT models; ObjectBase rejects the others
+//! at compile time. The marshaler is only created the first time COM asks for
+//! IMarshal.
+
+class FreeThreadedMarshalling
+{
+protected:
+	//! Default constructor.
+	FreeThreadedMarshalling();
+
+	//! Destructor.
+	~FreeThreadedMarshalling();
+
+	//! Query for an interface the object does not implement itself.
+	HRESULT QueryMarshaler(IUnknown* pOuter, const IID& rIID, void** ppInterface);
+
+private:
+	//
+	// Members.
+	//
+	IUnknown* volatile	m_pMarshaler;	//!< The inner unknown of the marshaler.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline FreeThreadedMarshalling::FreeThreadedMarshalling()
+	: m_pMarshaler(nullptr)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+inline FreeThreadedMarshalling::~FreeThreadedMarshalling()
+{
+	if (m_pMarshaler != nullptr)
+		m_pMarshaler->Release();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query for an interface the object does not implement itself. IAgileObject
+//! has no methods of its own and so is answered with the outer unknown. Any
+//! other interface is forwarded to the marshaler, which is created on first
+//! use. If two threads race to create it the loser releases its copy.
+
+inline HRESULT FreeThreadedMarshalling::QueryMarshaler(IUnknown* pOuter, const IID& rIID, void** ppInterface)
+{
+	*ppInterface = nullptr;
+
+	if (IsEqualIID(rIID, IID_IAgileObject))
+	{
+		pOuter->AddRef();
+		*ppInterface = pOuter;
+		return S_OK;
+	}
+
+	if (!IsEqualIID(rIID, IID_IMarshal))
+		return E_NOINTERFACE;
+
+	IUnknown* pMarshaler = m_pMarshaler;
+
+	if (pMarshaler == nullptr)
+	{
+		HRESULT hr = ::CoCreateFreeThreadedMarshaler(pOuter, &pMarshaler);
+
+		if (FAILED(hr))
+			return hr;
+
+		IUnknown* pExisting = static_cast<IUnknown*>(::InterlockedCompareExchangePointer(reinterpret_cast<void* volatile*>(&m_pMarshaler), pMarshaler, nullptr));
+
+		if (pExisting != nullptr)
+		{
+			pMarshaler->Release();
+			pMarshaler = pExisting;
+		}
+	}
+
+	return pMarshaler->QueryInterface(rIID, ppInterface);
+}
+
+//namespace COM
+}
+
+#endif // COM_MARSHALPOLICY_HPP
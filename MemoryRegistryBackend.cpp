@@ -0,0 +1,236 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   MemoryRegistryBackend.cpp
+//! \brief  The MemoryRegistryBackend class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "MemoryRegistryBackend.hpp"
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the next name from a key path, starting at the offset. The offset is
+//! moved past the name and its separator. Returns false if there are no more.
+
+static bool NextName(const tstring& strPath, size_t& nOffset, tstring& strName)
+{
+	while ( (nOffset < strPath.length()) && (strPath[nOffset] == TXT('\\')) )
+		++nOffset;
+
+	if (nOffset >= strPath.length())
+		return false;
+
+	size_t nEnd = strPath.find(TXT('\\'), nOffset);
+
+	if (nEnd == tstring::npos)
+		nEnd = strPath.length();
+
+	strName = strPath.substr(nOffset, nEnd-nOffset);
+	nOffset = nEnd;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the name used to store a value, where null is the default value.
+
+static tstring ValueName(const tchar* pszName)
+{
+	return (pszName != nullptr) ? pszName : TXT("");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+MemoryRegistryBackend::MemoryRegistryBackend()
+	: m_oRoot()
+	, m_nKeys(0)
+	, m_nValues(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+MemoryRegistryBackend::~MemoryRegistryBackend()
+{
+	for (Nodes::const_iterator it = m_oRoot.m_oKeys.begin(); it != m_oRoot.m_oKeys.end(); ++it)
+		DeleteTree(it->second);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if a key exists.
+
+bool MemoryRegistryBackend::KeyExists(const tstring& strSubKey) const
+{
+	return (FindKey(strSubKey) != nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get a value, if it exists.
+
+bool MemoryRegistryBackend::GetValue(const tstring& strSubKey, const tchar* pszName, tstring& strValue) const
+{
+	const Node* pNode = FindKey(strSubKey);
+
+	if (pNode == nullptr)
+		return false;
+
+	Values::const_iterator it = pNode->m_oValues.find(ValueName(pszName));
+
+	if (it == pNode->m_oValues.end())
+		return false;
+
+	strValue = it->second;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Open a key, creating it and any missing parent keys if required.
+
+RegistryBackend::Key MemoryRegistryBackend::CreateKey(const tstring& strSubKey)
+{
+	Node*   pNode = &m_oRoot;
+	size_t  nOffset = 0;
+	tstring strName;
+
+	while (NextName(strSubKey, nOffset, strName))
+	{
+		Nodes::iterator it = pNode->m_oKeys.find(strName);
+
+		if (it == pNode->m_oKeys.end())
+		{
+			Node* pChild = new Node;
+
+			try
+			{
+				it = pNode->m_oKeys.insert(Nodes::value_type(strName, pChild)).first;
+			}
+			catch (...)
+			{
+				delete pChild;
+				throw;
+			}
+
+			++m_nKeys;
+		}
+
+		pNode = it->second;
+	}
+
+	return pNode;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Close a key opened by CreateKey(). The keys are not reference counted, so
+//! this does nothing.
+
+void MemoryRegistryBackend::CloseKey(Key /*hKey*/)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if a value exists and is already set to the string.
+
+bool MemoryRegistryBackend::HasValue(Key hKey, const tchar* pszName, const tstring& strValue)
+{
+	const Node* pNode = static_cast<const Node*>(hKey);
+
+	Values::const_iterator it = pNode->m_oValues.find(ValueName(pszName));
+
+	return ( (it != pNode->m_oValues.end()) && (it->second == strValue) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set a string value.
+
+void MemoryRegistryBackend::SetValue(Key hKey, const tstring& /*strSubKey*/, const tchar* pszName, const tstring& strValue)
+{
+	Node*   pNode = static_cast<Node*>(hKey);
+	tstring strName = ValueName(pszName);
+
+	Values::iterator it = pNode->m_oValues.find(strName);
+
+	if (it != pNode->m_oValues.end())
+	{
+		it->second = strValue;
+	}
+	else
+	{
+		pNode->m_oValues.insert(Values::value_type(strName, strValue));
+		++m_nValues;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Delete a key, which must have no subkeys, as with RegDeleteKey().
+
+bool MemoryRegistryBackend::DeleteKey(const tstring& strSubKey)
+{
+	Node*   pParent = nullptr;
+	Node*   pNode = &m_oRoot;
+	size_t  nOffset = 0;
+	tstring strName;
+	tstring strLeaf;
+
+	while (NextName(strSubKey, nOffset, strName))
+	{
+		Nodes::iterator it = pNode->m_oKeys.find(strName);
+
+		if (it == pNode->m_oKeys.end())
+			return false;
+
+		pParent = pNode;
+		pNode   = it->second;
+		strLeaf = strName;
+	}
+
+	if ( (pParent == nullptr) || !pNode->m_oKeys.empty() )
+		return false;
+
+	m_nValues -= pNode->m_oValues.size();
+	--m_nKeys;
+
+	pParent->m_oKeys.erase(strLeaf);
+	delete pNode;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find a key. Returns nullptr if it does not exist.
+
+const MemoryRegistryBackend::Node* MemoryRegistryBackend::FindKey(const tstring& strSubKey) const
+{
+	const Node* pNode = &m_oRoot;
+	size_t      nOffset = 0;
+	tstring     strName;
+
+	while (NextName(strSubKey, nOffset, strName))
+	{
+		Nodes::const_iterator it = pNode->m_oKeys.find(strName);
+
+		if (it == pNode->m_oKeys.end())
+			return nullptr;
+
+		pNode = it->second;
+	}
+
+	return pNode;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Delete a key and all its subkeys.
+
+void MemoryRegistryBackend::DeleteTree(Node* pNode)
+{
+	for (Nodes::const_iterator it = pNode->m_oKeys.begin(); it != pNode->m_oKeys.end(); ++it)
+		DeleteTree(it->second);
+
+	delete pNode;
+}
+
+//namespace COM
+}
@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   MemoryRegistryBackend.hpp
+//! \brief  The MemoryRegistryBackend class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_MEMORYREGISTRYBACKEND_HPP
+#define COM_MEMORYREGISTRYBACKEND_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "RegistryBackend.hpp"
+#include <map>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! A registry backend which holds a tree of keys in memory. Key and value
+//! names are compared without regard to case, as the registry does. This is
+//! used to test and measure registration without touching the registry.
+
+class MemoryRegistryBackend : public RegistryBackend, private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	MemoryRegistryBackend();
+
+	//! Destructor.
+	virtual ~MemoryRegistryBackend();
+
+	//
+	// Properties.
+	//
+
+	//! Get the number of keys in the store, excluding the root.
+	size_t KeyCount() const;
+
+	//! Get the number of values in the store.
+	size_t ValueCount() const;
+
+	//
+	// Methods.
+	//
+
+	//! Query if a key exists.
+	bool KeyExists(const tstring& strSubKey) const;
+
+	//! Get a value, if it exists.
+	bool GetValue(const tstring& strSubKey, const tchar* pszName, tstring& strValue) const;
+
+	//
+	// RegistryBackend methods.
+	//
+
+	//! Open a key, creating it and any missing parent keys if required.
+	virtual Key CreateKey(const tstring& strSubKey); // throw(ComException)
+
+	//! Close a key opened by CreateKey().
+	virtual void CloseKey(Key hKey);
+
+	//! Query if a value exists and is already set to the string.
+	virtual bool HasValue(Key hKey, const tchar* pszName, const tstring& strValue);
+
+	//! Set a string value.
+	virtual void SetValue(Key hKey, const tstring& strSubKey, const tchar* pszName, const tstring& strValue);
+
+	//! Delete a key, which must have no subkeys.
+	virtual bool DeleteKey(const tstring& strSubKey);
+
+private:
+	//! The case insensitive ordering used for key and value names.
+	struct NameLess
+	{
+		bool operator()(const tstring& strLHS, const tstring& strRHS) const
+		{
+			return (tstricmp(strLHS.c_str(), strRHS.c_str()) < 0);
+		}
+	};
+
+	// Forward declarations.
+	struct Node;
+
+	//! The subkeys of a key.
+	typedef std::map<tstring, Node*, NameLess> Nodes;
+
+	//! The values of a key.
+	typedef std::map<tstring, tstring, NameLess> Values;
+
+	//! A key in the tree.
+	struct Node
+	{
+		Nodes	m_oKeys;		//!< The subkeys.
+		Values	m_oValues;		//!< The values.
+	};
+
+	//
+	// Members.
+	//
+	Node		m_oRoot;		//!< The root of the tree.
+	size_t		m_nKeys;		//!< The number of keys, excluding the root.
+	size_t		m_nValues;		//!< The number of values.
+
+	//
+	// Internal methods.
+	//
+
+	//! Find a key.
+	const Node* FindKey(const tstring& strSubKey) const;
+
+	//! Delete a key and all its subkeys.
+	static void DeleteTree(Node* pNode);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of keys in the store, excluding the root.
+
+inline size_t MemoryRegistryBackend::KeyCount() const
+{
+	return m_nKeys;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of values in the store.
+
+inline size_t MemoryRegistryBackend::ValueCount() const
+{
+	return m_nValues;
+}
+
+//namespace COM
+}
+
+#endif // COM_MEMORYREGISTRYBACKEND_HPP
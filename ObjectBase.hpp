@@ -8,6 +8,11 @@
 #define COM_OBJECTBASE_HPP
 
 #include <COM/Server.hpp>
+#include <COM/ApartmentPool.hpp>
+#include <COM/RefCount.hpp>
+#include <COM/MarshalPolicy.hpp>
+#include <COM/ClassCensus.hpp>
+#include <COM/QIProfiler.hpp>
 #include <unknwn.h>
 
 #if _MSC_VER > 1000
@@ -17,16 +22,44 @@
 namespace COM
 {
 
+//! The type used by ObjectBase to reject, at compile time, a marshalling policy
+//! which needs a thread-safe object, i.e. FreeThreadedMarshalling, with one of
+//! the STA threading models, whose objects have a plain reference count.
+template<ThreadingModel Model, typename Marshalling>
+struct MarshallingModelCheck
+{
+};
+
+template<ThreadingModel Model>
+struct MarshallingModelCheck<Model, FreeThreadedMarshalling> : public ThreadSafeModelCheck<Model>
+{
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 //! The base class for all COM objects. This provides an implementation of
 //! IUnknown for dynamically allocated objects. It also marks the interface as
 //! supporting COM exceptions which are handled automatically by the macro
 //! COM_CATCH_* in ErrorInfo.hpp.
-
-template<typename Base = IUnknown>
-class ObjectBase : public Base, public ISupportErrorInfo
+//!
+//! The threading model should match the one the class is registered with via
+//! DEFINE_CLASS_REG_INFO as it selects the reference counting policy. Objects
+//! which live in an STA use a plain integer, all others use interlocked
+//! instructions.
+//!
+//! The marshalling policy is consulted for any interface not in the interface
+//! table. The default leaves marshalling to COM, whereas FreeThreadedMarshalling
+//! lets a thread-safe object be called directly from any apartment.
+//!
+//! The objects of each class are counted in a census, which the Server exposes
+//! for each class in its class factory table.
+
+template<typename Base = IUnknown, ThreadingModel Model = ANY_APARTMENT, typename Marshalling = StandardMarshalling>
+class ObjectBase : public Base, public ISupportErrorInfo, private Marshalling
 {
 public:
+	//! The threading model of the class.
+	static const ThreadingModel THREADING_MODEL = Model;
+
 	//! Default constructor.
 	ObjectBase();
 
@@ -68,87 +101,115 @@ protected:
 	//! Template Method used to obtain the requested interface, if supported.
 	virtual void* interface_cast(const IID& rIID) = 0;
 
+	//! Template Method used to obtain the object counters for the class.
+	virtual ClassCounters& class_counters() = 0;
+
 private:
+	//! The reference counting policy type.
+	typedef typename RefCountPolicy<Model>::Type RefCount;
+
 	//
 	// Members.
 	//
-	LONG	m_nRefCount;	//!< The object reference count.
+	RefCount				m_oRefCount;	//!< The object reference count.
+	volatile LONG*			m_pApartment;	//!< The object count of the pooled apartment it was created in, if any.
+	ClassCounters::Stripe*	m_pCensus;		//!< The class census stripe it was counted in.
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Default constructor.
 
-template<typename Base>
-inline ObjectBase<Base>::ObjectBase()
-	: m_nRefCount(0)
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline ObjectBase<Base, Model, Marshalling>::ObjectBase()
+	: m_oRefCount()
+	, m_pApartment(nullptr)
+	, m_pCensus(nullptr)
 {
+	(void)sizeof(MarshallingModelCheck<Model, Marshalling>);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Destructor.
 
-template<typename Base>
-inline ObjectBase<Base>::~ObjectBase()
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline ObjectBase<Base, Model, Marshalling>::~ObjectBase()
 {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Get the object reference count.
 
-template<typename Base>
-inline ULONG ObjectBase<Base>::GetRefCount() const
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline ULONG ObjectBase<Base, Model, Marshalling>::GetRefCount() const
 {
-	return m_nRefCount;
+	return m_oRefCount.Value();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Query the object for a particular interface.
+//! Query the object for a particular interface. Any interface which is not in
+//! the interface table is offered to the marshalling policy, with the primary
+//! interface acting as the controlling unknown. If the QIProfiler is enabled
+//! the result is recorded against the class.
 
-template<typename Base>
-inline HRESULT ObjectBase<Base>::QueryInterfaceImpl(const IID& rIID, void** ppInterface)
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline HRESULT ObjectBase<Base, Model, Marshalling>::QueryInterfaceImpl(const IID& rIID, void** ppInterface)
 {
 	// Check parameters.
 	if (ppInterface == nullptr)
 		return E_POINTER;
 
+	HRESULT hr = S_OK;
+
 	// Acquire interface pointer.
 	*ppInterface = interface_cast(rIID);
 
 	if (*ppInterface != nullptr)
 		AddRefImpl();
+	else // Fall back to the marshalling policy.
+		hr = Marshalling::QueryMarshaler(static_cast<Base*>(this), rIID, ppInterface);
+
+	if (QIProfiler::IsEnabled())
+		QIProfiler::Record(&class_counters(), rIID, SUCCEEDED(hr));
 
-	return (*ppInterface != nullptr) ? S_OK : E_NOINTERFACE;
+	return hr;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Increment the objects reference count.
 
-template<typename Base>
-inline ULONG ObjectBase<Base>::AddRefImpl()
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline ULONG ObjectBase<Base, Model, Marshalling>::AddRefImpl()
 {
-	LONG nRefCount = ::InterlockedIncrement(&m_nRefCount);
+	LONG nRefCount = m_oRefCount.Increment();
 
 	if (nRefCount == 1)
+	{
 		Server::This().Lock();
+		m_pApartment = ApartmentPool::OnCreateObject();
+		m_pCensus = &class_counters().OnCreate();
+	}
 
-	return m_nRefCount;
+	return nRefCount;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //! Decrement the objects reference count.
 
-template<typename Base>
-inline ULONG ObjectBase<Base>::ReleaseImpl()
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline ULONG ObjectBase<Base, Model, Marshalling>::ReleaseImpl()
 {
-	ASSERT(m_nRefCount > 0);
+	ASSERT(m_oRefCount.Value() > 0);
 
-	LONG nRefCount = ::InterlockedDecrement(&m_nRefCount);
+	LONG nRefCount = m_oRefCount.Decrement();
 
-	if (m_nRefCount == 0)
+	if (nRefCount == 0)
+	{
+		class_counters().OnDestroy(*m_pCensus);
+		ApartmentPool::OnDestroyObject(m_pApartment);
 		Server::This().Unlock();
 
-	if (m_nRefCount == 0)
 		delete this;
+	}
 
 	return nRefCount;
 }
@@ -156,8 +217,8 @@ inline ULONG ObjectBase<Base>::ReleaseImpl()
 ////////////////////////////////////////////////////////////////////////////////
 //! Queries if the interface supports COM exceptions.
 
-template<typename Base>
-inline HRESULT ObjectBase<Base>::InterfaceSupportsErrorInfoImpl(const IID& /*rIID*/)
+template<typename Base, ThreadingModel Model, typename Marshalling>
+inline HRESULT ObjectBase<Base, Model, Marshalling>::InterfaceSupportsErrorInfoImpl(const IID& /*rIID*/)
 {
 	return S_OK;
 }
@@ -0,0 +1,361 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ObjectPool.hpp
+//! \brief  The ObjectPool and PooledObject class declarations.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_OBJECTPOOL_HPP
+#define COM_OBJECTPOOL_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <new>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! A per-class pool of fixed-size memory blocks. Blocks are carved out of slabs
+//! which are never returned to the heap until the module is unloaded. Freed
+//! blocks go to a small per-thread cache first, which requires no interlocked
+//! operations, and then to a shared lock-free list (a Win32 SList).
+
+template<typename T>
+class ObjectPool
+{
+public:
+	//
+	// Properties.
+	//
+
+	//! Get the size of a single block.
+	static size_t BlockSize();
+
+	//! Get the high-water mark, i.e. the number of blocks carved from slabs.
+	static long HighWaterMark();
+
+	//! Get the number of slabs allocated.
+	static long SlabCount();
+
+	//
+	// Methods.
+	//
+
+	//! Allocate a single block.
+	static void* Allocate(); // throw(std::bad_alloc)
+
+	//! Return a block to the pool.
+	static void Free(void* pBlock); // throw()
+
+private:
+	//! The number of blocks carved from a single slab.
+	static const size_t SLAB_BLOCKS = 64;
+
+	//! The maximum number of blocks cached by a single thread.
+	static const size_t MAX_CACHED_BLOCKS = 64;
+
+	//! The states of the thread cache TLS slot.
+	enum TlsState
+	{
+		TLS_NONE	= 0,	//!< The slot has not been allocated.
+		TLS_PENDING	= 1,	//!< The slot is being allocated.
+		TLS_READY	= 2,	//!< The slot is available.
+		TLS_FAILED	= 3,	//!< The slot could not be allocated.
+	};
+
+	//! The layout of a block when on a free list.
+	struct FreeBlock
+	{
+		SLIST_ENTRY	m_oEntry;		//!< The link to the next free block.
+		size_t		m_nDepth;		//!< The depth of the thread cache list.
+	};
+
+	//! The shared pool state. This is a POD so that it's zero-initialised.
+	struct State
+	{
+		SLIST_HEADER	m_oFreeList;	//!< The shared list of free blocks.
+		SLIST_HEADER	m_oSlabs;		//!< The list of allocated slabs.
+		volatile LONG	m_eTlsState;	//!< The TlsState of the cache slot.
+		DWORD			m_dwTlsIndex;	//!< The thread cache TLS slot.
+		volatile LONG	m_nBlocks;		//!< The number of blocks carved.
+		volatile LONG	m_nSlabs;		//!< The number of slabs allocated.
+	};
+
+	//! The helper class used to release the slabs when the module unloads.
+	class Cleanup
+	{
+	public:
+		//! Destructor.
+		~Cleanup();
+	};
+
+	//
+	// Class members.
+	//
+	static State	s_oState;		//!< The shared pool state.
+	static Cleanup	s_oCleanup;		//!< The module unload hook.
+
+	//
+	// Internal methods.
+	//
+
+	//! Get the TLS slot for the thread cache, if available.
+	static bool GetTlsIndex(DWORD& dwIndex);
+
+	//! Allocate a new slab and return one block from it.
+	static void* Grow(); // throw(std::bad_alloc)
+};
+
+template<typename T>
+typename ObjectPool<T>::State ObjectPool<T>::s_oState;
+
+template<typename T>
+typename ObjectPool<T>::Cleanup ObjectPool<T>::s_oCleanup;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the size of a single block. This is the object size rounded up to the
+//! alignment required by the SList functions.
+
+template<typename T>
+inline size_t ObjectPool<T>::BlockSize()
+{
+	const size_t nSize  = (sizeof(T) > sizeof(FreeBlock)) ? sizeof(T) : sizeof(FreeBlock);
+	const size_t nAlign = MEMORY_ALLOCATION_ALIGNMENT;
+
+	return (nSize + nAlign - 1) & ~(nAlign - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the high-water mark, i.e. the number of blocks carved from slabs. As
+//! blocks are recycled this is the peak number of objects that were alive at
+//! once, plus any blocks stranded in the caches of threads that have exited.
+
+template<typename T>
+inline long ObjectPool<T>::HighWaterMark()
+{
+	return s_oState.m_nBlocks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of slabs allocated.
+
+template<typename T>
+inline long ObjectPool<T>::SlabCount()
+{
+	return s_oState.m_nSlabs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Allocate a single block.
+
+template<typename T>
+inline void* ObjectPool<T>::Allocate()
+{
+	DWORD dwIndex;
+
+	// Try the thread cache first.
+	if (GetTlsIndex(dwIndex))
+	{
+		FreeBlock* pHead = static_cast<FreeBlock*>(::TlsGetValue(dwIndex));
+
+		if (pHead != nullptr)
+		{
+			::TlsSetValue(dwIndex, pHead->m_oEntry.Next);
+			return pHead;
+		}
+	}
+
+	// Then the shared list.
+	PSLIST_ENTRY pEntry = ::InterlockedPopEntrySList(&s_oState.m_oFreeList);
+
+	if (pEntry != nullptr)
+		return pEntry;
+
+	return Grow();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Return a block to the pool.
+
+template<typename T>
+inline void ObjectPool<T>::Free(void* pBlock)
+{
+	ASSERT(pBlock != nullptr);
+
+	FreeBlock* pFree = static_cast<FreeBlock*>(pBlock);
+	DWORD      dwIndex;
+
+	// Try the thread cache first.
+	if (GetTlsIndex(dwIndex))
+	{
+		FreeBlock* pHead  = static_cast<FreeBlock*>(::TlsGetValue(dwIndex));
+		size_t     nDepth = (pHead != nullptr) ? pHead->m_nDepth : 0;
+
+		if (nDepth < MAX_CACHED_BLOCKS)
+		{
+			pFree->m_oEntry.Next = (pHead != nullptr) ? &pHead->m_oEntry : nullptr;
+			pFree->m_nDepth      = nDepth + 1;
+
+			::TlsSetValue(dwIndex, pFree);
+			return;
+		}
+	}
+
+	// Cache full, so share it.
+	::InterlockedPushEntrySList(&s_oState.m_oFreeList, &pFree->m_oEntry);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the TLS slot for the thread cache, if available. The slot is allocated
+//! on first use; if the process has run out of slots the pool just falls back
+//! to the shared list.
+
+template<typename T>
+inline bool ObjectPool<T>::GetTlsIndex(DWORD& dwIndex)
+{
+	LONG eState = s_oState.m_eTlsState;
+
+	if ( (eState == TLS_NONE) || (eState == TLS_PENDING) )
+	{
+		if (::InterlockedCompareExchange(&s_oState.m_eTlsState, TLS_PENDING, TLS_NONE) == TLS_NONE)
+		{
+			DWORD dwNewIndex = ::TlsAlloc();
+
+			s_oState.m_dwTlsIndex = dwNewIndex;
+
+			::InterlockedExchange(&s_oState.m_eTlsState, (dwNewIndex != TLS_OUT_OF_INDEXES) ? TLS_READY : TLS_FAILED);
+		}
+
+		// Wait for the winner to finish.
+		while ((eState = s_oState.m_eTlsState) == TLS_PENDING)
+			::Sleep(0);
+	}
+
+	if (eState != TLS_READY)
+		return false;
+
+	dwIndex = s_oState.m_dwTlsIndex;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Allocate a new slab and return one block from it. The remaining blocks are
+//! placed on the shared list. The first block of the slab is reserved to link
+//! it into the list of slabs.
+
+template<typename T>
+void* ObjectPool<T>::Grow()
+{
+	// Ensure the slabs are released on unload.
+	(void)&s_oCleanup;
+
+	const size_t nBlockSize = BlockSize();
+	const size_t nSlabSize  = nBlockSize * (SLAB_BLOCKS + 1);
+
+	char* pSlab = static_cast<char*>(::HeapAlloc(::GetProcessHeap(), 0, nSlabSize));
+
+	if (pSlab == nullptr)
+		throw std::bad_alloc();
+
+	::InterlockedPushEntrySList(&s_oState.m_oSlabs, reinterpret_cast<PSLIST_ENTRY>(pSlab));
+	::InterlockedIncrement(&s_oState.m_nSlabs);
+	::InterlockedExchangeAdd(&s_oState.m_nBlocks, static_cast<LONG>(SLAB_BLOCKS));
+
+	char* pFirst = pSlab + nBlockSize;
+
+	for (size_t i = 1; i != SLAB_BLOCKS; ++i)
+		::InterlockedPushEntrySList(&s_oState.m_oFreeList, reinterpret_cast<PSLIST_ENTRY>(pFirst + (i * nBlockSize)));
+
+	return pFirst;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor. Releases the slabs and TLS slot when the module is unloaded.
+
+template<typename T>
+ObjectPool<T>::Cleanup::~Cleanup()
+{
+	PSLIST_ENTRY pSlab = ::InterlockedFlushSList(&s_oState.m_oSlabs);
+
+	while (pSlab != nullptr)
+	{
+		PSLIST_ENTRY pNext = pSlab->Next;
+
+		::HeapFree(::GetProcessHeap(), 0, pSlab);
+
+		pSlab = pNext;
+	}
+
+	if (s_oState.m_eTlsState == TLS_READY)
+		::TlsFree(s_oState.m_dwTlsIndex);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The mix-in class used to opt a COM class into allocating its instances from
+//! an ObjectPool instead of the general purpose heap, e.g.
+//!
+//! class MyClass : public COM::ObjectBase<IMyClass>, public COM::PooledObject<MyClass>
+//!
+//! Because ObjectBase has a virtual destructor, the 'delete this' in
+//! ReleaseImpl() resolves to the class-specific operator delete. Requests for
+//! any other size (i.e. a further derived class) are passed on to the heap.
+
+template<typename T>
+class PooledObject
+{
+public:
+	//! Allocate an object from the pool.
+	static void* operator new(size_t nSize); // throw(std::bad_alloc)
+
+	//! Return an object to the pool.
+	static void operator delete(void* pObject, size_t nSize); // throw()
+
+	//! Get the high-water mark for the class pool.
+	static long PoolHighWaterMark();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Allocate an object from the pool.
+
+template<typename T>
+inline void* PooledObject<T>::operator new(size_t nSize)
+{
+	if (nSize != sizeof(T))
+		return ::operator new(nSize);
+
+	return ObjectPool<T>::Allocate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Return an object to the pool.
+
+template<typename T>
+inline void PooledObject<T>::operator delete(void* pObject, size_t nSize)
+{
+	if (pObject == nullptr)
+		return;
+
+	if (nSize != sizeof(T))
+	{
+		::operator delete(pObject);
+		return;
+	}
+
+	ObjectPool<T>::Free(pObject);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the high-water mark for the class pool.
+
+template<typename T>
+inline long PooledObject<T>::PoolHighWaterMark()
+{
+	return ObjectPool<T>::HighWaterMark();
+}
+
+//namespace COM
+}
+
+#endif // COM_OBJECTPOOL_HPP
@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   QIProfiler.cpp
+//! \brief  The QIProfiler class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "QIProfiler.hpp"
+
+namespace COM
+{
+
+//! The states of a table slot.
+enum SlotState
+{
+	SLOT_EMPTY		= 0,	//!< The slot is unused.
+	SLOT_CLAIMED	= 1,	//!< The slot key is being written.
+	SLOT_READY		= 2,	//!< The slot key is published.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! A slot in the profiler table. This is a POD so that the table is
+//! zero-initialised, i.e. every slot starts empty.
+
+struct QIProfileSlot
+{
+	volatile LONG			m_eState;		//!< The SlotState.
+	const ClassCounters*	m_pClass;		//!< The class queried.
+	IID						m_oIID;			//!< The interface requested.
+	volatile LONG			m_nHits;		//!< The number of successful queries.
+	volatile LONG			m_nMisses;		//!< The number of failed queries.
+};
+
+//! The profiler table.
+static QIProfileSlot g_aoSlots[QIProfiler::MAX_ENTRIES];
+
+//! The number of queries which could not be recorded.
+static volatile LONG g_nDropped = 0;
+
+volatile LONG QIProfiler::s_bEnabled = false;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Calculate the starting slot for a class and interface.
+
+static size_t HashEntry(const ClassCounters* pClass, const IID& rIID)
+{
+	size_t nHash = (reinterpret_cast<size_t>(pClass) >> 4) * 2654435761u;
+
+	nHash ^= rIID.Data1;
+	nHash ^= (static_cast<size_t>(rIID.Data2) << 16) | rIID.Data3;
+
+	return nHash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Count the result of a query against a slot.
+
+static void CountQuery(QIProfileSlot& oSlot, bool bHit)
+{
+	if (bHit)
+		::InterlockedIncrement(&oSlot.m_nHits);
+	else
+		::InterlockedIncrement(&oSlot.m_nMisses);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of queries which could not be recorded because the table
+//! was full.
+
+long QIProfiler::Dropped()
+{
+	return g_nDropped;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Enable or disable the profiler. Queries already in progress may still be
+//! recorded after it's disabled.
+
+void QIProfiler::Enable(bool bEnable)
+{
+	::InterlockedExchange(&s_bEnabled, bEnable);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Record the result of a query. The table is probed linearly from the hash of
+//! the class and interface. A slot which is being claimed by another thread
+//! may be for the same key, so we wait for it to be published before checking.
+
+void QIProfiler::Record(const ClassCounters* pClass, const IID& rIID, bool bHit)
+{
+	size_t nHash = HashEntry(pClass, rIID);
+
+	for (size_t nProbe = 0; nProbe != MAX_ENTRIES; ++nProbe)
+	{
+		QIProfileSlot& oSlot  = g_aoSlots[(nHash + nProbe) & (MAX_ENTRIES - 1)];
+		LONG           eState = oSlot.m_eState;
+
+		if (eState == SLOT_EMPTY)
+		{
+			eState = ::InterlockedCompareExchange(&oSlot.m_eState, SLOT_CLAIMED, SLOT_EMPTY);
+
+			if (eState == SLOT_EMPTY)
+			{
+				oSlot.m_pClass = pClass;
+				oSlot.m_oIID   = rIID;
+
+				::InterlockedExchange(&oSlot.m_eState, SLOT_READY);
+
+				CountQuery(oSlot, bHit);
+				return;
+			}
+		}
+
+		while (eState == SLOT_CLAIMED)
+		{
+			::Sleep(0);
+			eState = oSlot.m_eState;
+		}
+
+		if ( (oSlot.m_pClass == pClass) && IsEqualIID(oSlot.m_oIID, rIID) )
+		{
+			CountQuery(oSlot, bHit);
+			return;
+		}
+	}
+
+	::InterlockedIncrement(&g_nDropped);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the statistics recorded so far. Only the entries with a non-zero count
+//! are returned. The counts are read without stopping the recording threads.
+
+void QIProfiler::Snapshot(QIProfileEntries& vecEntries)
+{
+	vecEntries.clear();
+
+	for (size_t i = 0; i != MAX_ENTRIES; ++i)
+	{
+		const QIProfileSlot& oSlot = g_aoSlots[i];
+
+		if (oSlot.m_eState != SLOT_READY)
+			continue;
+
+		QIProfileEntry oEntry;
+
+		oEntry.m_pClass  = oSlot.m_pClass;
+		oEntry.m_oIID    = oSlot.m_oIID;
+		oEntry.m_nHits   = oSlot.m_nHits;
+		oEntry.m_nMisses = oSlot.m_nMisses;
+
+		if ( (oEntry.m_nHits != 0) || (oEntry.m_nMisses != 0) )
+			vecEntries.push_back(oEntry);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Reset the statistics. The slots keep their keys, as a recording thread may
+//! be using one, and so only the counts are cleared. Any query recorded during
+//! the reset may be lost.
+
+void QIProfiler::Reset()
+{
+	for (size_t i = 0; i != MAX_ENTRIES; ++i)
+	{
+		::InterlockedExchange(&g_aoSlots[i].m_nHits, 0);
+		::InterlockedExchange(&g_aoSlots[i].m_nMisses, 0);
+	}
+
+	::InterlockedExchange(&g_nDropped, 0);
+}
+
+//namespace COM
+}
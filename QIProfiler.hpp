@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   QIProfiler.hpp
+//! \brief  The QIProfiler class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_QIPROFILER_HPP
+#define COM_QIPROFILER_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <vector>
+
+namespace COM
+{
+
+// Forward declarations.
+struct ClassCounters;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The QueryInterface() statistics for one interface on one class. The class
+//! is identified by its census counters, as they are unique to the class.
+
+struct QIProfileEntry
+{
+	const ClassCounters*	m_pClass;		//!< The class queried.
+	IID						m_oIID;			//!< The interface requested.
+	long					m_nHits;		//!< The number of successful queries.
+	long					m_nMisses;		//!< The number of failed queries.
+};
+
+//! A collection of QueryInterface() statistics.
+typedef std::vector<QIProfileEntry> QIProfileEntries;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The optional profiler for ObjectBase::QueryInterfaceImpl(). When enabled
+//! every query is counted, as a hit or a miss, against the class and the
+//! requested interface. This shows which interfaces clients actually ask for,
+//! e.g. the failing queries made by the marshalling layers and script engines.
+//!
+//! The counts are kept in a fixed-size, process-wide, open-addressed table. An
+//! entry is claimed with a compare-and-swap the first time a class is queried
+//! for an interface, and is never released, so recording needs no locks. If
+//! the table is full the query is just counted as dropped. When disabled the
+//! cost to a query is a single test of a global flag.
+
+class QIProfiler
+{
+public:
+	//! The number of entries in the table. This must be a power of 2.
+	static const size_t MAX_ENTRIES = 1024;
+
+	//
+	// Properties.
+	//
+
+	//! Query if the profiler is enabled.
+	static bool IsEnabled();
+
+	//! Get the number of queries which could not be recorded.
+	static long Dropped();
+
+	//
+	// Methods.
+	//
+
+	//! Enable or disable the profiler.
+	static void Enable(bool bEnable);
+
+	//! Record the result of a query.
+	static void Record(const ClassCounters* pClass, const IID& rIID, bool bHit); // throw()
+
+	//! Get the statistics recorded so far.
+	static void Snapshot(QIProfileEntries& vecEntries);
+
+	//! Reset the statistics.
+	static void Reset();
+
+private:
+	//
+	// Class members.
+	//
+	static volatile LONG s_bEnabled;	//!< Is the profiler enabled?
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the profiler is enabled.
+
+inline bool QIProfiler::IsEnabled()
+{
+	return (s_bEnabled != 0);
+}
+
+//namespace COM
+}
+
+#endif // COM_QIPROFILER_HPP
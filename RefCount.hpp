@@ -0,0 +1,196 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   RefCount.hpp
+//! \brief  The reference counting policies used by ObjectBase.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_REFCOUNT_HPP
+#define COM_REFCOUNT_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The reference count used by objects which can be called on any thread. The
+//! count is maintained with interlocked (i.e. locked) instructions.
+
+class AtomicRefCount
+{
+public:
+	//! Default constructor.
+	AtomicRefCount();
+
+	//! Get the current count.
+	LONG Value() const;
+
+	//! Increment the count, returning the new value.
+	LONG Increment();
+
+	//! Decrement the count, returning the new value.
+	LONG Decrement();
+
+private:
+	//
+	// Members.
+	//
+	volatile LONG	m_nCount;		//!< The reference count.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline AtomicRefCount::AtomicRefCount()
+	: m_nCount(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the current count.
+
+inline LONG AtomicRefCount::Value() const
+{
+	return m_nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the count, returning the new value.
+
+inline LONG AtomicRefCount::Increment()
+{
+	return ::InterlockedIncrement(&m_nCount);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the count, returning the new value.
+
+inline LONG AtomicRefCount::Decrement()
+{
+	return ::InterlockedDecrement(&m_nCount);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The reference count used by objects which live in a single-threaded
+//! apartment. COM guarantees that these are only called on the apartment's
+//! thread and so a plain integer is sufficient. Debug builds verify that the
+//! object is only ever touched by the thread which first acquired it.
+
+class ApartmentRefCount
+{
+public:
+	//! Default constructor.
+	ApartmentRefCount();
+
+	//! Get the current count.
+	LONG Value() const;
+
+	//! Increment the count, returning the new value.
+	LONG Increment();
+
+	//! Decrement the count, returning the new value.
+	LONG Decrement();
+
+private:
+	//
+	// Members.
+	//
+	LONG	m_nCount;		//!< The reference count.
+#ifdef _DEBUG
+	DWORD	m_dwThreadID;	//!< The thread the object is bound to.
+#endif
+
+	//
+	// Internal methods.
+	//
+
+	//! Verify the caller is on the owning thread.
+	void CheckThreadAffinity();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline ApartmentRefCount::ApartmentRefCount()
+	: m_nCount(0)
+#ifdef _DEBUG
+	, m_dwThreadID(0)
+#endif
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the current count.
+
+inline LONG ApartmentRefCount::Value() const
+{
+	return m_nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the count, returning the new value.
+
+inline LONG ApartmentRefCount::Increment()
+{
+	CheckThreadAffinity();
+
+	return ++m_nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the count, returning the new value.
+
+inline LONG ApartmentRefCount::Decrement()
+{
+	CheckThreadAffinity();
+
+	return --m_nCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Verify the caller is on the owning thread. The object is bound to the thread
+//! that first acquires a reference to it.
+
+inline void ApartmentRefCount::CheckThreadAffinity()
+{
+#ifdef _DEBUG
+	DWORD dwThreadID = ::GetCurrentThreadId();
+
+	if (m_dwThreadID == 0)
+		m_dwThreadID = dwThreadID;
+
+	ASSERT(m_dwThreadID == dwThreadID);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The traits class used to select the reference counting policy from the
+//! threading model the class is registered with. Only the models that bind an
+//! object to a single thread can avoid the interlocked instructions.
+
+template<ThreadingModel Model>
+struct RefCountPolicy
+{
+	typedef AtomicRefCount Type;	//!< The policy type.
+};
+
+//! The policy for objects that live in the main STA.
+template<>
+struct RefCountPolicy<MAIN_THREAD_APT>
+{
+	typedef ApartmentRefCount Type;	//!< The policy type.
+};
+
+//! The policy for objects that live in an STA.
+template<>
+struct RefCountPolicy<SINGLE_THREAD_APT>
+{
+	typedef ApartmentRefCount Type;	//!< The policy type.
+};
+
+//namespace COM
+}
+
+#endif // COM_REFCOUNT_HPP
@@ -7,85 +7,13 @@
 #include "RegUtils.hpp"
 #include "ServerRegInfo.hpp"
 #include "ComUtils.hpp"
-#include <WCL/RegKey.hpp>
+#include "RegistrationBatch.hpp"
+#include "Win32RegistryBackend.hpp"
 #include <Core/NotImplException.hpp>
 
 namespace COM
 {
 
-////////////////////////////////////////////////////////////////////////////////
-//! Creates or updates the default value for a registry key under the HKCR tree.
-
-static void SetRegistryValue(Scope scope, const tstring& strSubKey, const tstring& strValue)
-{
-	ASSERT((scope == MACHINE) || (scope == USER));
-
-	if (scope == MACHINE)
-	{
-		WCL::RegKey::WriteKeyDefaultValue(HKEY_CLASSES_ROOT, strSubKey.c_str(), strValue.c_str());
-	}
-	else // (scope == USER)
-	{
-		WCL::RegKey root;
-
-		root.Open(HKEY_CURRENT_USER, TXT("Software\\Classes"), KEY_WRITE);
-
-		WCL::RegKey::WriteKeyDefaultValue(root.Handle(), strSubKey.c_str(), strValue.c_str());
-	}
-}
-
-////////////////////////////////////////////////////////////////////////////////
-//! Creates or updates a named value for a registry key under the HKCR tree.
-
-static void SetRegistryValue(Scope scope, const tstring& strSubKey, const tstring& strName, const tstring& strValue)
-{
-	ASSERT((scope == MACHINE) || (scope == USER));
-
-	if (scope == MACHINE)
-	{
-		WCL::RegKey::WriteKeyStringValue(HKEY_CLASSES_ROOT, strSubKey.c_str(), strName.c_str(), strValue.c_str());
-	}
-	else // (scope == USER)
-	{
-		WCL::RegKey root;
-
-		root.Open(HKEY_CURRENT_USER, TXT("Software\\Classes"), KEY_WRITE);
-
-		WCL::RegKey::WriteKeyStringValue(root.Handle(), strSubKey.c_str(), strName.c_str(), strValue.c_str());
-	}
-}
-
-////////////////////////////////////////////////////////////////////////////////
-//! Deletes the key from under the HKCR tree.
-
-static void DeleteKey(Scope scope, const tstring& strSubKey)
-{
-	ASSERT((scope == MACHINE) || (scope == USER));
-
-	bool bDeleted = false;
-
-	if (scope == MACHINE)
-	{
-		bDeleted = WCL::RegKey::Delete(HKEY_CLASSES_ROOT, strSubKey.c_str());
-	}
-	else // (scope == USER)
-	{
-		WCL::RegKey root;
-
-		root.Open(HKEY_CURRENT_USER, TXT("Software\\Classes"), KEY_WRITE);
-
-		bDeleted = WCL::RegKey::Delete(root.Handle(), strSubKey.c_str());
-	}
-
-#ifdef _DEBUG
-	if (!bDeleted)
-	{
-		DWORD dwError = ::GetLastError();
-		TRACE3(TXT("Failed to delete the key '<root>\\%s' [0x%08lX - %s]\n"), strSubKey.c_str(), dwError, CStrCvt::FormatError(dwError).c_str());
-	}
-#endif
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 //! Get the registry key name used for configuring the server type.
 
@@ -104,9 +32,10 @@ static const tchar* GetServerTypeKey(ServerType eType)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Get the registry key name used for configuring the threading model.
+//! Get the registry value used for configuring the threading model. This is
+//! also the attribute value used in a registration-free COM manifest.
 
-static const tchar* GetThreadModelKey(ThreadingModel eModel)
+const tchar* GetThreadModelKey(ThreadingModel eModel)
 {
 	const tchar* pszModel = TXT("");
 
@@ -130,32 +59,50 @@ void RegisterCLSID(Scope scope, const ServerRegInfo& rSvrInfo, const CLSID& rCLS
 					const tstring& strClass, const tstring& strVersion,
 					ThreadingModel eModel)
 {
+	Win32RegistryBackend oRegistry(scope);
+	RegistrationBatch    oBatch(oRegistry);
+
+	RegisterCLSID(oBatch, rSvrInfo, rCLSID, strClass, strVersion, eModel);
+
+	oBatch.Commit();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register a CLSID as part of a larger batch of changes.
+
+void RegisterCLSID(RegistrationBatch& oBatch, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
+					const tstring& strClass, const tstring& strVersion,
+					ThreadingModel eModel)
+{
+	tchar szCLSID[GUID_BUFFER_SIZE];
+	tchar szLIBID[GUID_BUFFER_SIZE];
+
 	// Create key names.
-	tstring strCLSID       = FormatGUID(rCLSID);
-	tstring strLIBID       = FormatGUID(rSvrInfo.m_oLIBID);
+	tstring strCLSID       = FormatGUID(rCLSID, szCLSID);
+	tstring strLIBID       = FormatGUID(rSvrInfo.m_oLIBID, szLIBID);
 	tstring strProgID      = rSvrInfo.m_strLibrary + TXT(".") + strClass;
 	tstring strVerProgID   = strProgID + TXT(".") + strVersion;
 	tstring strDescription = strClass + TXT(" Class");
 	tstring strCLSIDKey    = TXT("CLSID\\") + strCLSID;
-	tstring strServerType  = GetServerTypeKey(rSvrInfo.m_eType);
+	tstring strServerKey   = strCLSIDKey + TXT("\\") + GetServerTypeKey(rSvrInfo.m_eType);
 	tstring strThreadModel = GetThreadModelKey(eModel);
 
 	// Create the version independent prog ID section.
-	SetRegistryValue(scope, strProgID,                   strDescription);
-	SetRegistryValue(scope, strProgID + TXT("\\CLSID"),  strCLSID);
-	SetRegistryValue(scope, strProgID + TXT("\\CurVer"), strVerProgID);
+	oBatch.SetValue(strProgID,                   strDescription);
+	oBatch.SetValue(strProgID + TXT("\\CLSID"),  strCLSID);
+	oBatch.SetValue(strProgID + TXT("\\CurVer"), strVerProgID);
 
 	// Create the version dependent prog ID section.
-	SetRegistryValue(scope, strVerProgID,                  strDescription);
-	SetRegistryValue(scope, strVerProgID + TXT("\\CLSID"), strCLSID);
+	oBatch.SetValue(strVerProgID,                  strDescription);
+	oBatch.SetValue(strVerProgID + TXT("\\CLSID"), strCLSID);
 
 	// Create the CLSID section.
-	SetRegistryValue(scope, strCLSIDKey,                                     strClass);
-	SetRegistryValue(scope, strCLSIDKey + TXT("\\") + strServerType,         rSvrInfo.m_strFile);
-	SetRegistryValue(scope, strCLSIDKey + TXT("\\") + strServerType,         TXT("ThreadingModel"), strThreadModel);
-	SetRegistryValue(scope, strCLSIDKey + TXT("\\ProgID"),                   strVerProgID);
-	SetRegistryValue(scope, strCLSIDKey + TXT("\\VersionIndependentProgID"), strProgID);
-	SetRegistryValue(scope, strCLSIDKey + TXT("\\TypeLib"),                  strLIBID);
+	oBatch.SetValue(strCLSIDKey,                                     strClass);
+	oBatch.SetValue(strServerKey,                                    rSvrInfo.m_strFile);
+	oBatch.SetValue(strServerKey,                                    TXT("ThreadingModel"), strThreadModel);
+	oBatch.SetValue(strCLSIDKey + TXT("\\ProgID"),                   strVerProgID);
+	oBatch.SetValue(strCLSIDKey + TXT("\\VersionIndependentProgID"), strProgID);
+	oBatch.SetValue(strCLSIDKey + TXT("\\TypeLib"),                  strLIBID);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -164,28 +111,43 @@ void RegisterCLSID(Scope scope, const ServerRegInfo& rSvrInfo, const CLSID& rCLS
 void UnregisterCLSID(Scope scope, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
 					const tstring& strClass, const tstring& strVersion)
 {
+	Win32RegistryBackend oRegistry(scope);
+	RegistrationBatch    oBatch(oRegistry);
+
+	UnregisterCLSID(oBatch, rSvrInfo, rCLSID, strClass, strVersion);
+
+	oBatch.Commit();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Unregister a CLSID as part of a larger batch of changes.
+
+void UnregisterCLSID(RegistrationBatch& oBatch, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
+					const tstring& strClass, const tstring& strVersion)
+{
+	tchar szCLSID[GUID_BUFFER_SIZE];
+
 	// Create key names.
-	tstring strCLSID     = FormatGUID(rCLSID);
 	tstring strProgID    = rSvrInfo.m_strLibrary + TXT(".") + strClass;
 	tstring strVerProgID = strProgID + TXT(".") + strVersion;
-	tstring strCLSIDKey  = TXT("CLSID\\") + strCLSID;
-	tstring strServerType  = GetServerTypeKey(rSvrInfo.m_eType);
+	tstring strCLSIDKey  = tstring(TXT("CLSID\\")) + FormatGUID(rCLSID, szCLSID);
+	tstring strServerKey = strCLSIDKey + TXT("\\") + GetServerTypeKey(rSvrInfo.m_eType);
 
 	// Delete the version independent prog ID section.
-	DeleteKey(scope, strProgID + TXT("\\CLSID"));
-	DeleteKey(scope, strProgID + TXT("\\CurVer"));
-	DeleteKey(scope, strProgID);
+	oBatch.DeleteKey(strProgID + TXT("\\CLSID"));
+	oBatch.DeleteKey(strProgID + TXT("\\CurVer"));
+	oBatch.DeleteKey(strProgID);
 
 	// Delete the version dependent prog ID section.
-	DeleteKey(scope, strVerProgID + TXT("\\CLSID"));
-	DeleteKey(scope, strVerProgID);
+	oBatch.DeleteKey(strVerProgID + TXT("\\CLSID"));
+	oBatch.DeleteKey(strVerProgID);
 
 	// Delete the CLSID section.
-	DeleteKey(scope, strCLSIDKey + TXT("\\") + strServerType);
-	DeleteKey(scope, strCLSIDKey + TXT("\\ProgID"));
-	DeleteKey(scope, strCLSIDKey + TXT("\\VersionIndependentProgID"));
-	DeleteKey(scope, strCLSIDKey + TXT("\\TypeLib"));
-	DeleteKey(scope, strCLSIDKey);
+	oBatch.DeleteKey(strServerKey);
+	oBatch.DeleteKey(strCLSIDKey + TXT("\\ProgID"));
+	oBatch.DeleteKey(strCLSIDKey + TXT("\\VersionIndependentProgID"));
+	oBatch.DeleteKey(strCLSIDKey + TXT("\\TypeLib"));
+	oBatch.DeleteKey(strCLSIDKey);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -193,32 +155,47 @@ void UnregisterCLSID(Scope scope, const ServerRegInfo& rSvrInfo, const CLSID& rC
 
 void RegisterTypeLib(Scope scope, const tstring& strFile)
 {
-	ASSERT((scope == MACHINE) || (scope == USER));
-
-	wchar_t     szFile[MAX_PATH+1] = {0};
 	ITypeLibPtr pTypeLib;
 
-	// Need non-const string for ::RegisterTypeLib().
-	wcsncpy(szFile, T2W(strFile.c_str()), MAX_PATH);
-
 	// Load the type library.
-	HRESULT hr = ::LoadTypeLib(szFile, AttachTo(pTypeLib));
+	HRESULT hr = ::LoadTypeLibEx(T2W(strFile.c_str()), REGKIND_NONE, AttachTo(pTypeLib));
 
 	if (FAILED(hr))
 		throw WCL::ComException(hr, CString::Fmt(TXT("Failed to load the type library '%s'"), strFile.c_str()));
 
+	RegisterTypeLib(scope, pTypeLib.get(), strFile);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register a type library which has already been loaded from the file. This
+//! allows a server to register the library it has cached.
+
+void RegisterTypeLib(Scope scope, ITypeLib* pTypeLib, const tstring& strFile)
+{
+	ASSERT((scope == MACHINE) || (scope == USER));
+	ASSERT(pTypeLib != nullptr);
+
+	wchar_t szFile[MAX_PATH+1] = {0};
+	HRESULT hr = S_OK;
+
+	// Need non-const string for ::RegisterTypeLib().
+	wcsncpy(szFile, T2W(strFile.c_str()), MAX_PATH);
+
 	// Register it.
 	if (scope == MACHINE)
-		hr = ::RegisterTypeLib(pTypeLib.get(), szFile, nullptr);
+		hr = ::RegisterTypeLib(pTypeLib, szFile, nullptr);
 	else
 #ifndef __GNUC__
-		hr = ::RegisterTypeLibForUser(pTypeLib.get(), szFile, nullptr);
+		hr = ::RegisterTypeLibForUser(pTypeLib, szFile, nullptr);
 #else
 		throw Core::NotImplException(TXT("RegisterTypeLibForUser() not supported"));
 #endif
 
 	if (FAILED(hr))
 		throw WCL::ComException(hr, CString::Fmt(TXT("Failed to register the type library '%s'"), strFile.c_str()));
+
+	// The interface names may have changed.
+	FlushLookupCache();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -246,6 +223,9 @@ void UnregisterTypeLib(Scope scope, const GUID& rLIBID, ushort nMajor, ushort nM
 		TRACE2(TXT("Failed to unregister the type library [0x%08lX - %s]"), hr, CStrCvt::FormatError(hr).c_str());
 	}
 #endif
+
+	// The interface names have gone.
+	FlushLookupCache();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -254,12 +234,17 @@ void UnregisterTypeLib(Scope scope, const GUID& rLIBID, ushort nMajor, ushort nM
 
 void RegisterMonikerPrefix(Scope scope, const tstring& strPrefix, const tstring& strClass, const CLSID& rCLSID)
 {
+	Win32RegistryBackend oRegistry(scope);
+	RegistrationBatch    oBatch(oRegistry);
+
 	// Create key names.
 	tstring strCLSID       = FormatGUID(rCLSID);
 	tstring strDescription = strClass + TXT(" Class");
 
-	SetRegistryValue(scope, strPrefix,                  strDescription);
-	SetRegistryValue(scope, strPrefix + TXT("\\CLSID"), strCLSID);
+	oBatch.SetValue(strPrefix,                  strDescription);
+	oBatch.SetValue(strPrefix + TXT("\\CLSID"), strCLSID);
+
+	oBatch.Commit();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -267,8 +252,13 @@ void RegisterMonikerPrefix(Scope scope, const tstring& strPrefix, const tstring&
 
 void UnregisterMonikerPrefix(Scope scope, const tstring& strPrefix)
 {
-	DeleteKey(scope, strPrefix + TXT("\\CLSID"));
-	DeleteKey(scope, strPrefix);
+	Win32RegistryBackend oRegistry(scope);
+	RegistrationBatch    oBatch(oRegistry);
+
+	oBatch.DeleteKey(strPrefix + TXT("\\CLSID"));
+	oBatch.DeleteKey(strPrefix);
+
+	oBatch.Commit();
 }
 
 //namespace COM
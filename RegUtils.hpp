@@ -16,6 +16,7 @@ namespace COM
 
 // Forward declarations.
 class ServerRegInfo;
+class RegistrationBatch;
 
 ////////////////////////////////////////////////////////////////////////////////
 //! The scope used for registration.
@@ -26,24 +27,47 @@ enum Scope
 	USER = 2,		//!< Register in HKEY_CURRENT_USER\Software\Classes.
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// Get the registry value used for configuring the threading model.
+
+const tchar* GetThreadModelKey(ThreadingModel eModel);
+
 ////////////////////////////////////////////////////////////////////////////////
 // Register a CLSID.
 
 void RegisterCLSID(Scope scope, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
 					const tstring& strClass, const tstring& strVersion,
-					ThreadingModel eModel); // throw(RegistryException, ComException)
+					ThreadingModel eModel); // throw(ComException)
+
+////////////////////////////////////////////////////////////////////////////////
+// Register a CLSID as part of a larger batch of changes.
+
+void RegisterCLSID(RegistrationBatch& oBatch, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
+					const tstring& strClass, const tstring& strVersion,
+					ThreadingModel eModel); // throw(ComException)
 
 ////////////////////////////////////////////////////////////////////////////////
 // Unregister a CLSID.
 
 void UnregisterCLSID(Scope scope, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
-					const tstring& strClass, const tstring& strVersion); // throw(RegistryException, ComException)
+					const tstring& strClass, const tstring& strVersion); // throw(ComException)
+
+////////////////////////////////////////////////////////////////////////////////
+// Unregister a CLSID as part of a larger batch of changes.
+
+void UnregisterCLSID(RegistrationBatch& oBatch, const ServerRegInfo& rSvrInfo, const CLSID& rCLSID,
+					const tstring& strClass, const tstring& strVersion);
 
 ////////////////////////////////////////////////////////////////////////////////
 // Register a type library.
 
 void RegisterTypeLib(Scope scope, const tstring& strFile); // throw(ComException)
 
+////////////////////////////////////////////////////////////////////////////////
+// Register a type library which has already been loaded from the file.
+
+void RegisterTypeLib(Scope scope, ITypeLib* pTypeLib, const tstring& strFile); // throw(ComException)
+
 ////////////////////////////////////////////////////////////////////////////////
 // Unregister a type library.
 
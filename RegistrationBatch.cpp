@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   RegistrationBatch.cpp
+//! \brief  The RegistrationBatch class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "RegistrationBatch.hpp"
+#include "ComUtils.hpp"
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the backend to write to. The backend must outlive the
+//! batch.
+
+RegistrationBatch::RegistrationBatch(RegistryBackend& oBackend)
+	: m_oBackend(oBackend)
+	, m_oKeys()
+	, m_bCommitted(false)
+	, m_nKeysOpened(0)
+	, m_nValuesWritten(0)
+	, m_nValuesSkipped(0)
+	, m_nKeysDeleted(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor. This commits the batch if that hasn't been done already.
+
+RegistrationBatch::~RegistrationBatch()
+{
+	Commit();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the default value of a key, creating the key if required.
+
+void RegistrationBatch::SetValue(const tstring& strSubKey, const tstring& strValue)
+{
+	WriteValue(strSubKey, nullptr, strValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set a named value of a key, creating the key if required.
+
+void RegistrationBatch::SetValue(const tstring& strSubKey, const tchar* pszName, const tstring& strValue)
+{
+	ASSERT(pszName != nullptr);
+
+	WriteValue(strSubKey, pszName, strValue);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Delete a key, which must have no subkeys. Any cached handles to the key, or
+//! a key below it, are closed first, whatever the case of their names. A
+//! failure is not treated as an error, as the key may never have been
+//! registered.
+
+void RegistrationBatch::DeleteKey(const tstring& strSubKey)
+{
+	tstring strPrefix = strSubKey + TXT("\\");
+
+	for (Keys::iterator it = m_oKeys.begin(); it != m_oKeys.end(); )
+	{
+		if ( (tstricmp(it->first.c_str(), strSubKey.c_str()) == 0)
+		  || (tstricmp(it->first.substr(0, strPrefix.length()).c_str(), strPrefix.c_str()) == 0) )
+		{
+			m_oBackend.CloseKey(it->second);
+			m_oKeys.erase(it++);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	if (m_oBackend.DeleteKey(strSubKey))
+	{
+		++m_nKeysDeleted;
+		m_bCommitted = false;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Finish the batch. This releases the cached subkey handles and, if anything
+//! was changed, flushes the class and interface name caches. The batch can
+//! still be used afterwards.
+
+void RegistrationBatch::Commit()
+{
+	CloseKeys();
+
+	if (!m_bCommitted && ((m_nValuesWritten != 0) || (m_nKeysDeleted != 0)))
+		FlushLookupCache();
+
+	m_bCommitted = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the open handle for a subkey, creating the key if required. The handle
+//! is owned by the batch.
+
+RegistryBackend::Key RegistrationBatch::OpenKey(const tstring& strSubKey)
+{
+	Keys::const_iterator it = m_oKeys.find(strSubKey);
+
+	if (it != m_oKeys.end())
+		return it->second;
+
+	RegistryBackend::Key hKey = m_oBackend.CreateKey(strSubKey);
+
+	try
+	{
+		m_oKeys.insert(Keys::value_type(strSubKey, hKey));
+	}
+	catch (...)
+	{
+		m_oBackend.CloseKey(hKey);
+		throw;
+	}
+
+	++m_nKeysOpened;
+
+	return hKey;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write a string value, unless it already has that value.
+
+void RegistrationBatch::WriteValue(const tstring& strSubKey, const tchar* pszName, const tstring& strValue)
+{
+	RegistryBackend::Key hKey = OpenKey(strSubKey);
+
+	if (m_oBackend.HasValue(hKey, pszName, strValue))
+	{
+		++m_nValuesSkipped;
+		return;
+	}
+
+	m_oBackend.SetValue(hKey, strSubKey, pszName, strValue);
+
+	++m_nValuesWritten;
+	m_bCommitted = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Close all the cached subkey handles.
+
+void RegistrationBatch::CloseKeys()
+{
+	for (Keys::const_iterator it = m_oKeys.begin(); it != m_oKeys.end(); ++it)
+		m_oBackend.CloseKey(it->second);
+
+	m_oKeys.clear();
+}
+
+//namespace COM
+}
@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   RegistrationBatch.hpp
+//! \brief  The RegistrationBatch class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_REGISTRATIONBATCH_HPP
+#define COM_REGISTRATIONBATCH_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "RegUtils.hpp"
+#include "RegistryBackend.hpp"
+#include <map>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! A batch of registry changes under the HKCR tree, for either scope. The root
+//! key is opened once and every subkey which is written to is opened once and
+//! then cached until the batch is committed. A value is only written if it is
+//! missing or different, so re-registering a server makes few changes.
+//!
+//! The registry has no transactions on all the platforms the library supports,
+//! so each change is applied immediately. Commit() then releases the handles
+//! and flushes the class and interface name caches once for the whole batch.
+//!
+//! The keys are written to the RegistryBackend supplied by the caller, e.g. a
+//! Win32RegistryBackend for the Windows registry or a MemoryRegistryBackend.
+//! Key names are compared case insensitively, as they are by the registry.
+
+class RegistrationBatch : private Core::NotCopyable
+{
+public:
+	//! Construction from the backend to write to.
+	RegistrationBatch(RegistryBackend& oBackend);
+
+	//! Destructor.
+	~RegistrationBatch();
+
+	//
+	// Properties.
+	//
+
+	//! Get the number of keys which were opened or created.
+	size_t KeysOpened() const;
+
+	//! Get the number of values which were written.
+	size_t ValuesWritten() const;
+
+	//! Get the number of values which were already correct.
+	size_t ValuesSkipped() const;
+
+	//! Get the number of keys which were deleted.
+	size_t KeysDeleted() const;
+
+	//
+	// Methods.
+	//
+
+	//! Set the default value of a key, creating the key if required.
+	void SetValue(const tstring& strSubKey, const tstring& strValue); // throw(ComException)
+
+	//! Set a named value of a key, creating the key if required.
+	void SetValue(const tstring& strSubKey, const tchar* pszName, const tstring& strValue); // throw(ComException)
+
+	//! Delete a key, which must have no subkeys.
+	void DeleteKey(const tstring& strSubKey);
+
+	//! Finish the batch.
+	void Commit();
+
+private:
+	//! The case insensitive ordering used for key names.
+	struct NameLess
+	{
+		bool operator()(const tstring& strLHS, const tstring& strRHS) const
+		{
+			return (tstricmp(strLHS.c_str(), strRHS.c_str()) < 0);
+		}
+	};
+
+	//! The cache of open subkeys.
+	typedef std::map<tstring, RegistryBackend::Key, NameLess> Keys;
+
+	//
+	// Members.
+	//
+	RegistryBackend&	m_oBackend;			//!< The key store.
+	Keys				m_oKeys;			//!< The open subkeys.
+	bool				m_bCommitted;		//!< Has the batch been committed?
+	size_t				m_nKeysOpened;		//!< The number of keys opened or created.
+	size_t				m_nValuesWritten;	//!< The number of values written.
+	size_t				m_nValuesSkipped;	//!< The number of values already correct.
+	size_t				m_nKeysDeleted;		//!< The number of keys deleted.
+
+	//
+	// Internal methods.
+	//
+
+	//! Get the open handle for a subkey, creating the key if required.
+	RegistryBackend::Key OpenKey(const tstring& strSubKey); // throw(ComException)
+
+	//! Write a string value, unless it already has that value.
+	void WriteValue(const tstring& strSubKey, const tchar* pszName, const tstring& strValue); // throw(ComException)
+
+	//! Close all the cached subkey handles.
+	void CloseKeys();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of keys which were opened or created.
+
+inline size_t RegistrationBatch::KeysOpened() const
+{
+	return m_nKeysOpened;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of values which were written.
+
+inline size_t RegistrationBatch::ValuesWritten() const
+{
+	return m_nValuesWritten;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of values which were already correct.
+
+inline size_t RegistrationBatch::ValuesSkipped() const
+{
+	return m_nValuesSkipped;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of keys which were deleted.
+
+inline size_t RegistrationBatch::KeysDeleted() const
+{
+	return m_nKeysDeleted;
+}
+
+//namespace COM
+}
+
+#endif // COM_REGISTRATIONBATCH_HPP
@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   RegistryBackend.hpp
+//! \brief  The RegistryBackend interface declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_REGISTRYBACKEND_HPP
+#define COM_REGISTRYBACKEND_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The interface to the key store used to register servers. All key paths are
+//! relative to the HKCR root of the store and a null value name refers to the
+//! default value of a key. Only string values are supported, as that is all
+//! that registration needs.
+
+class RegistryBackend
+{
+public:
+	//! The handle to an open key.
+	typedef void* Key;
+
+	//! Destructor.
+	virtual ~RegistryBackend() {}
+
+	//! Open a key, creating it and any missing parent keys if required.
+	virtual Key CreateKey(const tstring& strSubKey) = 0; // throw(ComException)
+
+	//! Close a key opened by CreateKey().
+	virtual void CloseKey(Key hKey) = 0;
+
+	//! Query if a value exists and is already set to the string.
+	virtual bool HasValue(Key hKey, const tchar* pszName, const tstring& strValue) = 0;
+
+	//! Set a string value. The key name is only used to report a failure.
+	virtual void SetValue(Key hKey, const tstring& strSubKey, const tchar* pszName, const tstring& strValue) = 0; // throw(ComException)
+
+	//! Delete a key, which must have no subkeys. Returns false if it could not be deleted.
+	virtual bool DeleteKey(const tstring& strSubKey) = 0;
+};
+
+//namespace COM
+}
+
+#endif // COM_REGISTRYBACKEND_HPP
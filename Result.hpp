@@ -0,0 +1,474 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Result.hpp
+//! \brief  The Failure class and Result class template declarations.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_RESULT_HPP
+#define COM_RESULT_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+// Forward declarations.
+template<typename T>
+class Result;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The details of a failed operation: the HRESULT, the error message and the
+//! function that raised it. The message is normally a string literal, which is
+//! only referenced, but can be a formatted string, which is copied.
+
+class Failure
+{
+public:
+	//! Construction from a code and a string literal.
+	Failure(HRESULT hrResult, const tchar* pszText, const char* pszSource);
+
+	//! Construction from a code and a formatted string.
+	Failure(HRESULT hrResult, const tstring& strText, const char* pszSource);
+
+	//
+	// Properties.
+	//
+
+	//! Get the error code.
+	HRESULT Code() const;
+
+	//! Get the error message.
+	const tchar* Text() const;
+
+	//! Get the function that raised the error.
+	const char* Source() const;
+
+	//
+	// Methods.
+	//
+
+	//! Set the COM ErrorInfo object for the thread and return the error code.
+	HRESULT Report() const; // throw()
+
+	//! Throw the failure as a ComException.
+	void Throw() const; // throw(ComException)
+
+private:
+	//
+	// Members.
+	//
+	HRESULT			m_hrResult;		//!< The error code.
+	const tchar*	m_pszText;		//!< The error message, if a literal.
+	tstring			m_strText;		//!< The error message, if formatted.
+	const char*		m_pszSource;	//!< The function that raised the error.
+
+	//! Default constructor, for the success state of a Result.
+	Failure();
+
+	//
+	// Friends.
+	//
+	template<typename T>
+	friend class Result;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The result of an operation which can fail without throwing an exception. It
+//! holds either a value or the Failure which describes why there isn't one.
+//! Both conversions are implicit so that a function can simply return either.
+//! Nothing is allocated unless the failure message is a formatted string.
+
+template<typename T>
+class Result
+{
+public:
+	//! Construction from a value.
+	Result(const T& oValue);
+
+	//! Construction from a failure.
+	Result(const Failure& oFailure);
+
+	//
+	// Properties.
+	//
+
+	//! Query if the operation succeeded.
+	bool Succeeded() const;
+
+	//! Query if the operation failed.
+	bool Failed() const;
+
+	//! Get the result code.
+	HRESULT Code() const;
+
+	//! Get the value.
+	const T& Value() const;
+
+	//! Get the failure details.
+	const Failure& GetFailure() const;
+
+	//
+	// Methods.
+	//
+
+	//! Set the COM ErrorInfo object, if a failure, and return the result code.
+	HRESULT Report() const; // throw()
+
+	//! Get the value or throw the failure as a ComException.
+	const T& ValueOrThrow() const; // throw(ComException)
+
+private:
+	//
+	// Members.
+	//
+	T			m_oValue;		//!< The value, if successful.
+	Failure		m_oFailure;		//!< The failure, if unsuccessful.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The result of an operation which can fail, but has no value.
+
+template<>
+class Result<void>
+{
+public:
+	//! Default constructor, for success.
+	Result();
+
+	//! Construction from a failure.
+	Result(const Failure& oFailure);
+
+	//
+	// Properties.
+	//
+
+	//! Query if the operation succeeded.
+	bool Succeeded() const;
+
+	//! Query if the operation failed.
+	bool Failed() const;
+
+	//! Get the result code.
+	HRESULT Code() const;
+
+	//! Get the failure details.
+	const Failure& GetFailure() const;
+
+	//
+	// Methods.
+	//
+
+	//! Set the COM ErrorInfo object, if a failure, and return the result code.
+	HRESULT Report() const; // throw()
+
+	//! Throw the failure, if there is one, as a ComException.
+	void ThrowIfFailed() const; // throw(ComException)
+
+private:
+	//
+	// Members.
+	//
+	Failure		m_oFailure;		//!< The failure, if unsuccessful.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor, for the success state of a Result.
+
+inline Failure::Failure()
+	: m_hrResult(S_OK)
+	, m_pszText(nullptr)
+	, m_strText()
+	, m_pszSource(nullptr)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from a code and a string literal. The string is not copied.
+
+inline Failure::Failure(HRESULT hrResult, const tchar* pszText, const char* pszSource)
+	: m_hrResult(hrResult)
+	, m_pszText(pszText)
+	, m_strText()
+	, m_pszSource(pszSource)
+{
+	ASSERT(FAILED(hrResult));
+	ASSERT(pszText != nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from a code and a formatted string.
+
+inline Failure::Failure(HRESULT hrResult, const tstring& strText, const char* pszSource)
+	: m_hrResult(hrResult)
+	, m_pszText(nullptr)
+	, m_strText(strText)
+	, m_pszSource(pszSource)
+{
+	ASSERT(FAILED(hrResult));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the error code.
+
+inline HRESULT Failure::Code() const
+{
+	return m_hrResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the error message.
+
+inline const tchar* Failure::Text() const
+{
+	return (m_pszText != nullptr) ? m_pszText : m_strText.c_str();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the function that raised the error.
+
+inline const char* Failure::Source() const
+{
+	return m_pszSource;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the COM ErrorInfo object for the thread and return the error code. This
+//! is the point where a failure crosses the COM boundary.
+
+inline HRESULT Failure::Report() const
+{
+	ASSERT(FAILED(m_hrResult));
+
+	TRACE2(TXT("Failure reported by '%hs' - %s\n"), m_pszSource, Text());
+
+	COM::SetComErrorInfo(m_pszSource, Text());
+
+	return m_hrResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Throw the failure as a ComException. This is for callers which still use
+//! exceptions to report errors.
+
+inline void Failure::Throw() const
+{
+	ASSERT(FAILED(m_hrResult));
+
+	throw WCL::ComException(m_hrResult, Text());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from a value.
+
+template<typename T>
+inline Result<T>::Result(const T& oValue)
+	: m_oValue(oValue)
+	, m_oFailure()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from a failure.
+
+template<typename T>
+inline Result<T>::Result(const Failure& oFailure)
+	: m_oValue()
+	, m_oFailure(oFailure)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the operation succeeded.
+
+template<typename T>
+inline bool Result<T>::Succeeded() const
+{
+	return SUCCEEDED(m_oFailure.m_hrResult);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the operation failed.
+
+template<typename T>
+inline bool Result<T>::Failed() const
+{
+	return FAILED(m_oFailure.m_hrResult);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the result code.
+
+template<typename T>
+inline HRESULT Result<T>::Code() const
+{
+	return m_oFailure.m_hrResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the value. The operation must have succeeded.
+
+template<typename T>
+inline const T& Result<T>::Value() const
+{
+	ASSERT(Succeeded());
+
+	return m_oValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the failure details. The operation must have failed.
+
+template<typename T>
+inline const Failure& Result<T>::GetFailure() const
+{
+	ASSERT(Failed());
+
+	return m_oFailure;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the COM ErrorInfo object, if a failure, and return the result code.
+
+template<typename T>
+inline HRESULT Result<T>::Report() const
+{
+	if (Failed())
+		return m_oFailure.Report();
+
+	return m_oFailure.m_hrResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the value or throw the failure as a ComException.
+
+template<typename T>
+inline const T& Result<T>::ValueOrThrow() const
+{
+	if (Failed())
+		m_oFailure.Throw();
+
+	return m_oValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor, for success.
+
+inline Result<void>::Result()
+	: m_oFailure()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from a failure.
+
+inline Result<void>::Result(const Failure& oFailure)
+	: m_oFailure(oFailure)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the operation succeeded.
+
+inline bool Result<void>::Succeeded() const
+{
+	return SUCCEEDED(m_oFailure.m_hrResult);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the operation failed.
+
+inline bool Result<void>::Failed() const
+{
+	return FAILED(m_oFailure.m_hrResult);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the result code.
+
+inline HRESULT Result<void>::Code() const
+{
+	return m_oFailure.m_hrResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the failure details. The operation must have failed.
+
+inline const Failure& Result<void>::GetFailure() const
+{
+	ASSERT(Failed());
+
+	return m_oFailure;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the COM ErrorInfo object, if a failure, and return the result code.
+
+inline HRESULT Result<void>::Report() const
+{
+	if (Failed())
+		return m_oFailure.Report();
+
+	return m_oFailure.m_hrResult;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Throw the failure, if there is one, as a ComException.
+
+inline void Result<void>::ThrowIfFailed() const
+{
+	if (Failed())
+		m_oFailure.Throw();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Macros for creating and propagating failures.
+
+//! Create a failure raised by the current function.
+#define COM_FAILURE(hr, text)		COM::Failure(hr, text, __FUNCTION__)
+
+//! Return the failure, if the result is a failure. The result is evaluated twice.
+#define COM_PROPAGATE(result)		do {													\
+										if ((result).Failed())								\
+											return (result).GetFailure();					\
+									} while (false)
+
+//! Report the failure at the COM boundary and return the error code, if the
+//! result is a failure. The result is evaluated twice.
+#define COM_REPORT_IF_FAILED(result)	do {												\
+										if ((result).Failed())								\
+											return (result).GetFailure().Report();			\
+									} while (false)
+
+//! Catch any exceptions from a slow path and return them as a failure.
+#define COM_CATCH_RESULT(type)														\
+									catch (const WCL::ComException& e)						\
+									{														\
+										return COM::Result<type>(COM::Failure(e.m_result, tstring(e.twhat()), __FUNCTION__));	\
+									}														\
+									catch (const WCL::Win32Exception& e)					\
+									{														\
+										return COM::Result<type>(COM::Failure(HRESULT_FROM_WIN32(e.m_dwError), tstring(e.twhat()), __FUNCTION__));	\
+									}														\
+									catch (const std::bad_alloc&)							\
+									{														\
+										return COM::Result<type>(COM_FAILURE(E_OUTOFMEMORY, TXT("Out of memory")));	\
+									}														\
+									catch (const Core::Exception& e)						\
+									{														\
+										return COM::Result<type>(COM::Failure(E_UNEXPECTED, tstring(e.twhat()), __FUNCTION__));	\
+									}														\
+									catch (const std::exception& e)							\
+									{														\
+										return COM::Result<type>(COM::Failure(E_UNEXPECTED, tstring(A2T(e.what())), __FUNCTION__));	\
+									}														\
+									catch (...)												\
+									{														\
+										return COM::Result<type>(COM_FAILURE(E_UNEXPECTED, TXT("Unknown exception")));	\
+									}
+
+//namespace COM
+}
+
+#endif // COM_RESULT_HPP
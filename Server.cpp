@@ -5,8 +5,19 @@
 
 #include "Common.hpp"
 #include "Server.hpp"
+#include "ComUtils.hpp"
+#include "ClassFactory.hpp"
+#include "ServerRegInfo.hpp"
+#include "RegUtils.hpp"
+#include "RegistrationBatch.hpp"
+#include "Win32RegistryBackend.hpp"
+#include "WorkerPool.hpp"
+#include "ApartmentPool.hpp"
+#include "QIProfiler.hpp"
 #include <WCL/Path.hpp>
 #include <WCL/Module.hpp>
+#include <tchar.h>
+#include <algorithm>
 
 namespace COM
 {
@@ -18,7 +29,26 @@ Server* Server::g_pThis = NULL;
 //! Default constructor.
 
 Server::Server()
-	: m_nLockCount(0)
+	: m_oLockCount()
+	, m_oCacheLock()
+	, m_pTypeLib(nullptr)
+	, m_nTypeLibTime(0)
+	, m_pTypeInfos(nullptr)
+	, m_oUnloadLock()
+	, m_dwIdleTimeout(0)
+	, m_nMaxLoads(0)
+	, m_dwLoadWindow(0)
+	, m_dwIdleSince(0)
+	, m_nLockVersion(0)
+	, m_nRecentLoads(0)
+	, m_bUnloadDeferred(false)
+	, m_nDeferred(0)
+	, m_bIndexBuilt(false)
+	, m_oClassIndex()
+	, m_nAsyncWorkers(0)
+	, m_pAsyncWorkers(nullptr)
+	, m_nApartments(0)
+	, m_pApartments(nullptr)
 {
 	ASSERT(g_pThis == nullptr);
 
@@ -30,9 +60,27 @@ Server::Server()
 
 Server::~Server()
 {
-	ASSERT(m_nLockCount == 0);
+	// The threads must already be stopped, e.g. by DllCanUnloadNow(), as this
+	// may run under the loader lock.
+	ASSERT(m_pAsyncWorkers == nullptr);
+	ASSERT(m_pApartments == nullptr);
+	ASSERT(LockCount() == 0);
 	ASSERT(g_pThis == this);
 
+	// Release the type information cache.
+	while (m_pTypeInfos != nullptr)
+	{
+		TypeInfoEntry* pEntry = m_pTypeInfos;
+
+		m_pTypeInfos = pEntry->m_pNext;
+
+		delete pEntry->m_pDispIDs;
+		pEntry->m_pTypeInfo->Release();
+		delete pEntry;
+	}
+
+	ReleaseTypeLibrary();
+
 	g_pThis = nullptr;
 }
 
@@ -46,13 +94,23 @@ Server& Server::This()
 	return *g_pThis;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Get the singleton, if one exists. This is for library code which may also
+//! be used outside a server, e.g. error reporting. The value is nullptr if
+//! there is no server.
+
+Server* Server::Instance()
+{
+	return g_pThis;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //! Lock the server. This is used to ensure that the server is not unloaded
 //! whilst it still has objects alive.
 
 void Server::Lock()
 {
-	::InterlockedIncrement(&m_nLockCount);
+	m_oLockCount.Increment();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -60,27 +118,765 @@ void Server::Lock()
 
 void Server::Unlock()
 {
-	ASSERT(m_nLockCount > 0);
+	m_oLockCount.Decrement();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the type library, loading it on first request. The library is then
+//! cached for the process, so that IDispatch support and registration don't
+//! each reopen the module and parse the TYPELIB resource again. The lock is
+//! always taken, so that the reference is added before the cache can be
+//! released; the library is only requested on the slow paths.
+
+ITypeLibPtr Server::LoadTypeLibrary()
+{
+	CriticalSection::Lock oLock(m_oCacheLock);
+
+	if (m_pTypeLib == nullptr)
+		m_pTypeLib = LoadTypeLibraryFile();
+
+	return ITypeLibPtr(m_pTypeLib, true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Release the server's reference to the cached type library. This is for use
+//! when the server is about to be unloaded, as releasing it later, during
+//! DLL_PROCESS_DETACH, happens under the loader lock. The library is reloaded
+//! if it is requested again. The cached type information is kept, as it's read
+//! without locking, and it also references the library, so if any has been
+//! loaded the library is only freed when the server is destroyed.
+
+void Server::ReleaseTypeLibrary()
+{
+	CriticalSection::Lock oLock(m_oCacheLock);
 
-	::InterlockedDecrement(&m_nLockCount);
+	if (m_pTypeLib != nullptr)
+	{
+		m_pTypeLib->Release();
+		m_pTypeLib = nullptr;
+	}
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Load the type library.
+//! Load the type library from the module. The library is not registered, as
+//! LoadTypeLib() would do for a library that isn't. The time taken by the
+//! first load is recorded, as this is a noticeable part of the start-up cost.
 
-ITypeLibPtr Server::LoadTypeLibrary() const
+ITypeLib* Server::LoadTypeLibraryFile()
 {
-	CPath       strFile = CModule::This().Path();
-	ITypeLibPtr pTypeLib;
+	CPath         strFile  = CModule::This().Path();
+	ITypeLib*     pTypeLib = nullptr;
+	LARGE_INTEGER oFrequency;
+	LARGE_INTEGER oStart;
+	LARGE_INTEGER oEnd;
 
-	// Load the type library.
-	HRESULT hr = ::LoadTypeLib(T2W(strFile), AttachTo(pTypeLib));
+	::QueryPerformanceFrequency(&oFrequency);
+	::QueryPerformanceCounter(&oStart);
+
+	HRESULT hr = ::LoadTypeLibEx(T2W(strFile), REGKIND_NONE, &pTypeLib);
 
 	if (FAILED(hr))
 		throw WCL::ComException(hr, CString::Fmt(TXT("Failed to load the type library '%s'"), strFile.c_str()));
 
+	::QueryPerformanceCounter(&oEnd);
+
+	if (m_nTypeLibTime == 0)
+	{
+		m_nTypeLibTime = static_cast<ulong>((oEnd.QuadPart - oStart.QuadPart) * 1000000 / oFrequency.QuadPart);
+
+		TRACE1(TXT("Loaded the type library in %lu us\n"), m_nTypeLibTime);
+	}
+
 	return pTypeLib;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Get the shared type information for a dual interface. The type information
+//! is loaded on first request and then cached for the lifetime of the server.
+//! The returned interface is owned by the server and is not AddRef'd.
+
+ITypeInfo* Server::GetTypeInfo(const IID& rDIID)
+{
+	return QueryTypeInfo(rDIID).ValueOrThrow();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the shared name to DISPID map for a dual interface. The map is built
+//! along with the cached type information and is immutable, so it can be used
+//! from any thread without locking.
+
+const DispIDMap& Server::GetDispIDMap(const IID& rDIID)
+{
+	return *QueryDispIDMap(rDIID).ValueOrThrow();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the shared type information for a dual interface, without throwing.
+//! This is the version used by the library's own COM methods.
+
+Result<ITypeInfo*> Server::QueryTypeInfo(const IID& rDIID)
+{
+	Result<const TypeInfoEntry*> oEntry = QueryTypeInfoEntry(rDIID);
+
+	COM_PROPAGATE(oEntry);
+
+	return oEntry.Value()->m_pTypeInfo;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the shared name to DISPID map for a dual interface, without throwing.
+//! This is the version used by the library's own COM methods.
+
+Result<const DispIDMap*> Server::QueryDispIDMap(const IID& rDIID)
+{
+	Result<const TypeInfoEntry*> oEntry = QueryTypeInfoEntry(rDIID);
+
+	COM_PROPAGATE(oEntry);
+
+	return oEntry.Value()->m_pDispIDs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the type information cache entry for a dual interface, loading it on
+//! first request. Only the first request for an interface can throw and so any
+//! exception is caught there and returned as a failure.
+
+Result<const Server::TypeInfoEntry*> Server::QueryTypeInfoEntry(const IID& rDIID)
+{
+	// Fast path, lock-free lookup.
+	const TypeInfoEntry* pCached = FindTypeInfo(rDIID);
+
+	if (pCached != nullptr)
+		return pCached;
+
+	try
+	{
+		return LoadTypeInfoEntry(rDIID);
+	}
+	COM_CATCH_RESULT(const TypeInfoEntry*)
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Load the type information cache entry for a dual interface.
+
+const Server::TypeInfoEntry* Server::LoadTypeInfoEntry(const IID& rDIID)
+{
+	CriticalSection::Lock oLock(m_oCacheLock);
+
+	// Check again, now that we're serialised.
+	const TypeInfoEntry* pCached = FindTypeInfo(rDIID);
+
+	if (pCached != nullptr)
+		return pCached;
+
+	// Retrieve the type info for the interface.
+	ITypeLibPtr pTypeLib  = LoadTypeLibrary();
+	ITypeInfo*  pTypeInfo = nullptr;
+
+	HRESULT hr = pTypeLib->GetTypeInfoOfGuid(rDIID, &pTypeInfo);
+
+	if (FAILED(hr))
+	{
+		tchar   szGUID[GUID_BUFFER_SIZE];
+		tstring strName = LookupIID(rDIID);
+
+		throw WCL::ComException(hr, CString::Fmt(TXT("Failed to get the type information for %s [%s]"), FormatGUID(rDIID, szGUID), strName.c_str()));
+	}
+
+	TypeInfoEntry* pEntry = nullptr;
+
+	try
+	{
+		pEntry = new TypeInfoEntry;
+
+		pEntry->m_oDIID     = rDIID;
+		pEntry->m_pTypeInfo = pTypeInfo;
+		pEntry->m_pDispIDs  = new DispIDMap(pTypeInfo);
+		pEntry->m_pNext     = m_pTypeInfos;
+	}
+	catch (...)
+	{
+		delete pEntry;
+		pTypeInfo->Release();
+		throw;
+	}
+
+	// Publish the fully constructed entry.
+	::InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_pTypeInfos), pEntry);
+
+	return pEntry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the cached type information for a dual interface. Entries are never
+//! modified once published and so the list can be walked without the lock.
+
+const Server::TypeInfoEntry* Server::FindTypeInfo(const IID& rDIID) const
+{
+	for (const TypeInfoEntry* pEntry = m_pTypeInfos; pEntry != nullptr; pEntry = pEntry->m_pNext)
+	{
+		if (IsEqualIID(pEntry->m_oDIID, rDIID))
+			return pEntry;
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the policy used to decide when an idle server can be unloaded. The
+//! server is kept resident until it has been idle (no locks and no lock
+//! activity) for the idle timeout. If a load limit is set the server is also
+//! kept resident, for the life of the process, once it has been loaded that
+//! many times within the load window. The default policy (all zeroes) allows
+//! the server to unload as soon as it is idle.
+
+void Server::SetUnloadPolicy(DWORD dwIdleTimeout, long nMaxLoads, DWORD dwLoadWindow)
+{
+	CriticalSection::Lock oLock(m_oUnloadLock);
+
+	m_dwIdleTimeout = dwIdleTimeout;
+	m_nMaxLoads     = nMaxLoads;
+	m_dwLoadWindow  = dwLoadWindow;
+	m_dwIdleSince   = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the server can be unloaded, according to the unload policy. This
+//! is designed to be polled, as COM does via DllCanUnloadNow().
+
+bool Server::CanUnload()
+{
+	CriticalSection::Lock oLock(m_oUnloadLock);
+
+	long      nLocks;
+	ULONGLONG nVersion;
+
+	// A count that won't settle is in use, whatever its value.
+	bool bSettled = m_oLockCount.Snapshot(nLocks, nVersion);
+
+	ASSERT(!bSettled || (nLocks >= 0));
+
+	bool bBusy = ( !bSettled || (nLocks != 0) );
+
+	// A deferred unload only avoided a reload if the server was used again.
+	if ( m_bUnloadDeferred && (bBusy || (nVersion != m_nLockVersion)) )
+	{
+		::InterlockedIncrement(&m_nDeferred);
+		m_bUnloadDeferred = false;
+	}
+
+	if (bBusy)
+	{
+		m_dwIdleSince = 0;
+		return false;
+	}
+
+	DWORD dwNow = ::GetTickCount();
+
+	// Restart the idle period if there has been any activity since the last poll.
+	if ( (m_dwIdleSince == 0) || (nVersion != m_nLockVersion) )
+	{
+		m_dwIdleSince  = (dwNow != 0) ? dwNow : 1;
+		m_nLockVersion = nVersion;
+	}
+
+	bool bIdle = ((dwNow - m_dwIdleSince) >= m_dwIdleTimeout);
+
+	// Check for repeated unload/reload cycles.
+	if ( (m_nMaxLoads != 0) && (m_nRecentLoads == 0) )
+		m_nRecentLoads = RecordLoad();
+
+	bool bPinned = ( (m_nMaxLoads != 0) && (m_nRecentLoads >= m_nMaxLoads) );
+
+	m_bUnloadDeferred = !(bIdle && !bPinned);
+
+	return !m_bUnloadDeferred;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the number of threads used to run asynchronous calls. This only has an
+//! effect if set before the first asynchronous call is made. The default (0)
+//! is one thread per processor.
+
+void Server::SetAsyncWorkerCount(size_t nThreads)
+{
+	CriticalSection::Lock oLock(m_oCacheLock);
+
+	m_nAsyncWorkers = nThreads;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the pool used to run asynchronous calls, creating it on first request.
+//! The pool is shared by every class in the server so that the total number of
+//! threads is bounded, however many calls are outstanding.
+
+WorkerPool& Server::AsyncWorkers()
+{
+	// Fast path, lock-free lookup.
+	WorkerPool* pPool = m_pAsyncWorkers;
+
+	if (pPool == nullptr)
+	{
+		CriticalSection::Lock oLock(m_oCacheLock);
+
+		// Check again, now that we're serialised.
+		pPool = m_pAsyncWorkers;
+
+		if (pPool == nullptr)
+		{
+			size_t nThreads = m_nAsyncWorkers;
+
+			if (nThreads == 0)
+			{
+				SYSTEM_INFO oInfo;
+
+				::GetSystemInfo(&oInfo);
+
+				nThreads = oInfo.dwNumberOfProcessors;
+			}
+
+			pPool = new WorkerPool(nThreads);
+
+			// Publish the started pool.
+			::InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_pAsyncWorkers), pPool);
+		}
+	}
+
+	return *pPool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Stop the pool used to run asynchronous calls. This waits for the threads
+//! to exit and so must be called when the server is about to be unloaded, or
+//! is shutting down, as the server destructor runs under the loader lock. The
+//! server must be idle, which means no calls are outstanding, as each
+//! asynchronous call holds a server lock. The pool is restarted if it is
+//! requested again.
+
+void Server::StopAsyncWorkers()
+{
+	WorkerPool* pPool = nullptr;
+
+	{
+		CriticalSection::Lock oLock(m_oCacheLock);
+
+		pPool = static_cast<WorkerPool*>(::InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_pAsyncWorkers), nullptr));
+	}
+
+	// Join the threads outside the lock, in case the work needs it.
+	delete pPool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set the number of apartments used to host apartment threaded objects. This
+//! only has an effect if set before the first apartment threaded object is
+//! created. The default (0) disables the pool, so objects are created in the
+//! caller's apartment.
+
+void Server::SetApartmentCount(size_t nApartments)
+{
+	CriticalSection::Lock oLock(m_oCacheLock);
+
+	m_nApartments = nApartments;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the pool used to host apartment threaded objects, creating it on first
+//! request. This returns nullptr if the pool is not enabled.
+
+ApartmentPool* Server::Apartments()
+{
+	// Fast path, lock-free lookup.
+	ApartmentPool* pPool = m_pApartments;
+
+	if ( (pPool == nullptr) && (m_nApartments != 0) )
+	{
+		CriticalSection::Lock oLock(m_oCacheLock);
+
+		// Check again, now that we're serialised.
+		pPool = m_pApartments;
+
+		if (pPool == nullptr)
+		{
+			pPool = new ApartmentPool(m_nApartments);
+
+			// Publish the started pool.
+			::InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_pApartments), pPool);
+		}
+	}
+
+	return pPool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Stop the pool used to host apartment threaded objects. Like the worker pool
+//! this must be called when the server is idle and about to be unloaded, or is
+//! shutting down. The pool can be destroyed whilst the server is locked by
+//! another thread, as Lock() and Unlock() never touch it. The pool is
+//! restarted if it is requested again.
+
+void Server::StopApartments()
+{
+	ApartmentPool* pPool = nullptr;
+
+	{
+		CriticalSection::Lock oLock(m_oCacheLock);
+
+		pPool = static_cast<ApartmentPool*>(::InterlockedExchangePointer(reinterpret_cast<void* volatile*>(&m_pApartments), nullptr));
+	}
+
+	// Join the threads outside the lock, in case they need it.
+	delete pPool;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the census of the objects of a class. This returns false if the server
+//! does not implement the class.
+
+bool Server::GetClassStats(const CLSID& rCLSID, ClassStats& oStats)
+{
+	const ClassFactoryEntry* pEntry = FindClass(rCLSID);
+
+	if (pEntry == nullptr)
+		return false;
+
+	oStats = (*pEntry->m_pfnCounters)().Stats();
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Format the census of the objects of every class as a report, with one line
+//! per class factory table entry. A class is named by its registration table
+//! entry, if it has one, or otherwise by its CLSID.
+
+tstring Server::FormatClassCensus()
+{
+	tstring strReport;
+
+	for (const ClassFactoryEntry* pEntry = GetClassFactoryTable(); pEntry->m_pCLSID != nullptr; ++pEntry)
+	{
+		tstring    strName = ClassName(*pEntry->m_pCLSID);
+		ClassStats oStats  = (*pEntry->m_pfnCounters)().Stats();
+
+		strReport += CString::Fmt(TXT("%s: live=%ld peak=%ld created=%I64u bytes=%I64u\r\n"),
+									strName.c_str(), oStats.m_nLive, oStats.m_nPeak,
+									oStats.m_nCreated, oStats.m_nBytes).c_str();
+	}
+
+	return strReport;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Order profile entries by the number of queries, busiest first.
+
+static bool MoreQueries(const QIProfileEntry& oLHS, const QIProfileEntry& oRHS)
+{
+	return ((oLHS.m_nHits + oLHS.m_nMisses) > (oRHS.m_nHits + oRHS.m_nMisses));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Format the QueryInterface() statistics recorded by the QIProfiler as a
+//! report, with one line per class and interface. The classes are listed in
+//! class factory table order, and named as in the census, followed by any
+//! objects which are not created by the class factory. The interfaces of each
+//! class are listed busiest first and named by LookupIID(), if registered.
+
+tstring Server::FormatQIProfile()
+{
+	QIProfileEntries vecEntries;
+
+	QIProfiler::Snapshot(vecEntries);
+
+	std::stable_sort(vecEntries.begin(), vecEntries.end(), MoreQueries);
+
+	// Pair each entry with its class factory table entry, if any.
+	typedef std::vector<const ClassFactoryEntry*> EntryClasses;
+
+	const ClassFactoryEntry* pTable = GetClassFactoryTable();
+	EntryClasses             vecClasses(vecEntries.size(), nullptr);
+
+	for (size_t i = 0; i != vecEntries.size(); ++i)
+	{
+		for (const ClassFactoryEntry* pEntry = pTable; pEntry->m_pCLSID != nullptr; ++pEntry)
+		{
+			if (&(*pEntry->m_pfnCounters)() == vecEntries[i].m_pClass)
+			{
+				vecClasses[i] = pEntry;
+				break;
+			}
+		}
+	}
+
+	tstring strReport;
+
+	for (const ClassFactoryEntry* pClass = pTable; ; ++pClass)
+	{
+		const bool               bUnregistered = (pClass->m_pCLSID == nullptr);
+		const ClassFactoryEntry* pMatch        = (bUnregistered) ? nullptr : pClass;
+		tstring                  strClass      = (bUnregistered) ? TXT("(unregistered class)") : ClassName(*pClass->m_pCLSID);
+
+		for (size_t i = 0; i != vecEntries.size(); ++i)
+		{
+			if (vecClasses[i] != pMatch)
+				continue;
+
+			const QIProfileEntry& oEntry   = vecEntries[i];
+			tstring               strIFace = LookupIID(oEntry.m_oIID);
+
+			if (strIFace.empty())
+				strIFace = FormatGUID(oEntry.m_oIID);
+
+			strReport += CString::Fmt(TXT("%s: %s hits=%ld misses=%ld\r\n"),
+										strClass.c_str(), strIFace.c_str(),
+										oEntry.m_nHits, oEntry.m_nMisses).c_str();
+		}
+
+		if (bUnregistered)
+			break;
+	}
+
+	long nDropped = QIProfiler::Dropped();
+
+	if (nDropped != 0)
+		strReport += CString::Fmt(TXT("(table full): dropped=%ld\r\n"), nDropped).c_str();
+
+	return strReport;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Record this load of the module in the process-wide load history and return
+//! the number of loads within the current window. The history has to survive
+//! the module being unloaded and so is kept in an environment variable named
+//! after the module path. The environment block is private to the process, so
+//! unlike a named kernel object no other process can open, pre-create or tamper
+//! with it. A child process inherits a copy of the variable, so the history
+//! also records the process ID and a history from another process is ignored.
+
+long Server::RecordLoad() const
+{
+	// Create the variable name from a hash of the module path.
+	tstring strPath = CModule::This().Path().c_str();
+	DWORD   dwHash  = 2166136261u;
+
+	for (tstring::const_iterator it = strPath.begin(); it != strPath.end(); ++it)
+		dwHash = (dwHash ^ static_cast<DWORD>(_totupper(*it))) * 16777619u;
+
+	tstring strName = CString::Fmt(TXT("COM_SERVER_LOADS_%08lX"), dwHash).c_str();
+
+	const DWORD MAX_VALUE_LEN = 64;
+
+	tchar szValue[MAX_VALUE_LEN+1] = { 0 };
+	DWORD dwProcessID = 0;
+	ulong nLoads = 0;
+	DWORD dwStart = 0;
+	DWORD dwNow = ::GetTickCount();
+
+	// Read the history of an earlier load, if there was one in this process.
+	DWORD dwLength = ::GetEnvironmentVariable(strName.c_str(), szValue, MAX_VALUE_LEN+1);
+	bool  bValid   = ( (dwLength != 0) && (dwLength <= MAX_VALUE_LEN)
+					&& (_stscanf(szValue, TXT("%lX %lu %lX"), &dwProcessID, &nLoads, &dwStart) == 3)
+					&& (dwProcessID == ::GetCurrentProcessId()) );
+
+	// Start a new window, if there is no history or the last one has expired.
+	if ( !bValid || (nLoads == 0) || ((dwNow - dwStart) > m_dwLoadWindow) )
+	{
+		nLoads  = 0;
+		dwStart = dwNow;
+	}
+
+	++nLoads;
+
+	tstring strValue = CString::Fmt(TXT("%08lX %lu %08lX"), ::GetCurrentProcessId(), nLoads, dwStart).c_str();
+
+	if (!::SetEnvironmentVariable(strName.c_str(), strValue.c_str()))
+		throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to save the module load history"));
+
+	return static_cast<long>(nLoads);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Template Method to create the servers class factory. This is called once per
+//! class, when the class object is first needed. The factory must hold a server
+//! lock whilst it is referenced, as any ObjectBase derived class does, because
+//! the server gives up the lock taken for its own reference. InprocServer
+//! overrides this so that client references to its cached factories still lock
+//! the server.
+
+COM::IClassFactoryPtr Server::CreateClassFactory(const CLSID& oCLSID)
+{
+	return IClassFactoryPtr(new ClassFactory(oCLSID), true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Template Method to allocate an object for the class factory.
+
+COM::IUnknownPtr Server::CreateObject(const CLSID& oCLSID)
+{
+	const ClassFactoryEntry* pEntry = FindClass(oCLSID);
+
+	if (pEntry == nullptr)
+		return IUnknownPtr();
+
+	return (*pEntry->m_pfnCreate)();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the class factory table entry for the class. This returns nullptr if
+//! the server does not implement the class.
+
+const ClassFactoryEntry* Server::FindClass(const CLSID& oCLSID)
+{
+	if (!m_bIndexBuilt)
+		BuildClassIndex();
+
+	size_t nBegin = 0;
+	size_t nEnd   = m_oClassIndex.size();
+
+	while (nBegin < nEnd)
+	{
+		size_t nMiddle = nBegin + ((nEnd - nBegin) / 2);
+		int    nResult = CompareGUID(oCLSID, *m_oClassIndex[nMiddle]->m_pCLSID);
+
+		if (nResult == 0)
+			return m_oClassIndex[nMiddle];
+
+		if (nResult < 0)
+			nEnd = nMiddle;
+		else
+			nBegin = nMiddle + 1;
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the threading model the class is registered with. A class which is not
+//! in the registration table is treated as ANY_APARTMENT.
+
+ThreadingModel Server::ClassThreadingModel(const CLSID& oCLSID) const
+{
+	for (const ClassRegInfo* pClassInfo = GetClassRegInfo(); pClassInfo->m_pCLSID != nullptr; ++pClassInfo)
+	{
+		if (IsEqualCLSID(*pClassInfo->m_pCLSID, oCLSID))
+			return pClassInfo->m_eModel;
+	}
+
+	return ANY_APARTMENT;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the display name for a class. This is the name in its registration table
+//! entry, if it has one, or otherwise its CLSID.
+
+tstring Server::ClassName(const CLSID& rCLSID) const
+{
+	for (const ClassRegInfo* pClassInfo = GetClassRegInfo(); pClassInfo->m_pCLSID != nullptr; ++pClassInfo)
+	{
+		if (IsEqualCLSID(*pClassInfo->m_pCLSID, rCLSID))
+			return pClassInfo->m_pszName;
+	}
+
+	return FormatGUID(rCLSID);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The ordering used to sort the class factory table.
+
+static bool CompareEntries(const ClassFactoryEntry* pLHS, const ClassFactoryEntry* pRHS)
+{
+	return (CompareGUID(*pLHS->m_pCLSID, *pRHS->m_pCLSID) < 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Build the sorted index of the class factory table. This happens once, on
+//! first use, as a Template Method cannot be called from the constructor. Once
+//! the index is published it is never modified.
+
+void Server::BuildClassIndex()
+{
+	CriticalSection::Lock oLock(m_oCacheLock);
+
+	if (m_bIndexBuilt)
+		return;
+
+	for (const ClassFactoryEntry* pEntry = GetClassFactoryTable(); pEntry->m_pCLSID != nullptr; ++pEntry)
+		m_oClassIndex.push_back(pEntry);
+
+	std::sort(m_oClassIndex.begin(), m_oClassIndex.end(), CompareEntries);
+
+	::InterlockedExchange(&m_bIndexBuilt, true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register the server in the registry. The file is the server module, which
+//! also contains the type library.
+
+HRESULT Server::RegisterServer(ServerType eType, const tstring& strFile, bool perUser)
+{
+	Scope scope = (perUser) ? USER : MACHINE;
+
+	COM::ServerRegInfo oServerInfo;
+
+	// Fill in the known server info.
+	oServerInfo.m_eType   = eType;
+	oServerInfo.m_strFile = strFile;
+
+	// Get the server and coclass details.
+	GetServerRegInfo(oServerInfo);
+	const ClassRegInfo* pClassInfo = GetClassRegInfo();
+
+	Win32RegistryBackend oRegistry(scope);
+	RegistrationBatch    oBatch(oRegistry);
+
+	// Register the coclasses.
+	for (; pClassInfo->m_pCLSID != nullptr; ++pClassInfo)
+		RegisterCLSID(oBatch, oServerInfo, *pClassInfo->m_pCLSID, pClassInfo->m_pszName, pClassInfo->m_pszVersion, pClassInfo->m_eModel);
+
+	oBatch.Commit();
+
+	TRACE3(TXT("Registered the coclasses - %lu keys opened, %lu values written, %lu values unchanged\n"),
+			static_cast<ulong>(oBatch.KeysOpened()), static_cast<ulong>(oBatch.ValuesWritten()), static_cast<ulong>(oBatch.ValuesSkipped()));
+
+	// Register the type library.
+	RegisterTypeLib(scope, LoadTypeLibrary().get(), oServerInfo.m_strFile);
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Unregister the server from the registry.
+
+HRESULT Server::UnregisterServer(ServerType eType, const tstring& strFile, bool perUser)
+{
+	Scope scope = (perUser) ? USER : MACHINE;
+
+	COM::ServerRegInfo oServerInfo;
+
+	// Fill in the known server info.
+	oServerInfo.m_eType   = eType;
+	oServerInfo.m_strFile = strFile;
+
+	// Get the server and coclass details.
+	GetServerRegInfo(oServerInfo);
+	const ClassRegInfo* pClassInfo = GetClassRegInfo();
+
+	Win32RegistryBackend oRegistry(scope);
+	RegistrationBatch    oBatch(oRegistry);
+
+	// Unregister the coclasses.
+	for (; pClassInfo->m_pCLSID != nullptr; ++pClassInfo)
+		UnregisterCLSID(oBatch, oServerInfo, *pClassInfo->m_pCLSID, pClassInfo->m_pszName, pClassInfo->m_pszVersion);
+
+	oBatch.Commit();
+
+	TRACE1(TXT("Unregistered the coclasses - %lu keys deleted\n"), static_cast<ulong>(oBatch.KeysDeleted()));
+
+	// Unregister the type library.
+	UnregisterTypeLib(scope, oServerInfo.m_oLIBID, oServerInfo.m_nMajor, oServerInfo.m_nMinor);
+
+	return S_OK;
+}
+
 //namespace COM
 }
@@ -13,6 +13,12 @@
 
 #include <WCL/IFacePtr.hpp>
 #include <oaidl.h>
+#include "CriticalSection.hpp"
+#include "StripedCounter.hpp"
+#include "ClassCensus.hpp"
+#include "DispIDMap.hpp"
+#include "Result.hpp"
+#include <vector>
 
 namespace COM
 {
@@ -20,6 +26,47 @@ namespace COM
 //! The Type Library smart-pointer type.
 typedef WCL::IFacePtr<ITypeLib> ITypeLibPtr;
 
+//! The Type Information smart-pointer type.
+typedef WCL::IFacePtr<ITypeInfo> ITypeInfoPtr;
+
+// Forward declarations.
+class ServerRegInfo;
+struct ClassRegInfo;
+class WorkerPool;
+class ApartmentPool;
+
+//! The class factory smart-pointer type.
+typedef WCL::IFacePtr<IClassFactory> IClassFactoryPtr;
+
+//! The IUnknown smart-pointer type.
+typedef WCL::IFacePtr<IUnknown> IUnknownPtr;
+
+//! The function used to create an instance of a coclass.
+typedef IUnknownPtr (*CreateInstanceFn)();
+
+//! The function used to get the object counters for a coclass.
+typedef ClassCounters& (*ClassCountersFn)();
+
+////////////////////////////////////////////////////////////////////////////////
+//! An entry in the class factory table which maps a class ID onto the function
+//! used to create an instance of it and the function to get its census.
+
+struct ClassFactoryEntry
+{
+	const CLSID*		m_pCLSID;		//!< The coclass GUID.
+	CreateInstanceFn	m_pfnCreate;	//!< The instance creation function.
+	ClassCountersFn		m_pfnCounters;	//!< The object counters function.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create an instance of a coclass. This is used by the DEFINE_CLASS macro.
+
+template<typename T, typename I>
+inline IUnknownPtr CreateClassInstance()
+{
+	return IUnknownPtr(static_cast<I*>(new T), true);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //! The mix-in class used for the common (DLL/EXE) COM server behaviour.
 
@@ -33,6 +80,15 @@ public:
 	//! Query the lock count.
 	long LockCount() const;
 
+	//! Get the number of unloads deferred by the unload policy.
+	long DeferredUnloads() const;
+
+	//! Get the number of recent times the module was loaded in this process.
+	long RecentLoads() const;
+
+	//! Get the time taken by the first load of the type library, in microseconds.
+	ulong TypeLibLoadTime() const;
+
 	//
 	// Methods.
 	//
@@ -40,14 +96,65 @@ public:
 	//! Singleton accessor.
 	static Server& This();
 
+	//! Get the singleton, if one exists.
+	static Server* Instance();
+
 	//! Lock the server.
 	virtual void Lock();
 
 	//! Unlock the server.
 	virtual void Unlock();
 
-	//! Load the type library.
-	ITypeLibPtr LoadTypeLibrary() const;	// throw(ComException)
+	//! Get the type library, loading it on first request.
+	ITypeLibPtr LoadTypeLibrary();	// throw(ComException)
+
+	//! Release the cached type library.
+	void ReleaseTypeLibrary();
+
+	//! Get the shared type information for a dual interface.
+	ITypeInfo* GetTypeInfo(const IID& rDIID);	// throw(ComException)
+
+	//! Get the shared name to DISPID map for a dual interface.
+	const DispIDMap& GetDispIDMap(const IID& rDIID);	// throw(ComException)
+
+	//! Get the shared type information for a dual interface, without throwing.
+	Result<ITypeInfo*> QueryTypeInfo(const IID& rDIID);	// throw()
+
+	//! Get the shared name to DISPID map for a dual interface, without throwing.
+	Result<const DispIDMap*> QueryDispIDMap(const IID& rDIID);	// throw()
+
+	//! Set the policy used to decide when an idle server can be unloaded.
+	void SetUnloadPolicy(DWORD dwIdleTimeout, long nMaxLoads, DWORD dwLoadWindow);
+
+	//! Query if the server can be unloaded, according to the unload policy.
+	bool CanUnload();
+
+	//! Set the number of threads used to run asynchronous calls.
+	void SetAsyncWorkerCount(size_t nThreads);
+
+	//! Get the pool used to run asynchronous calls, creating it on first request.
+	WorkerPool& AsyncWorkers();	// throw(ComException)
+
+	//! Stop the pool used to run asynchronous calls.
+	void StopAsyncWorkers();
+
+	//! Set the number of apartments used to host apartment threaded objects.
+	void SetApartmentCount(size_t nApartments);
+
+	//! Get the pool used to host apartment threaded objects, if enabled.
+	ApartmentPool* Apartments();	// throw(ComException)
+
+	//! Stop the pool used to host apartment threaded objects.
+	void StopApartments();
+
+	//! Get the census of the objects of a class.
+	bool GetClassStats(const CLSID& rCLSID, ClassStats& oStats);
+
+	//! Format the census of the objects of every class as a report.
+	tstring FormatClassCensus();
+
+	//! Format the QueryInterface() statistics recorded by the QIProfiler.
+	tstring FormatQIProfile();
 
 protected:
 	//! Default constructor.
@@ -56,11 +163,98 @@ protected:
 	//! Destructor.
 	virtual ~Server();
 
+	//
+	// Internal methods.
+	//
+
+	//! Template Method used to obtain the server type information.
+	virtual void GetServerRegInfo(ServerRegInfo& oInfo) const = 0;
+
+	//! Template Method used to obtain the server coclasses information.
+	virtual const ClassRegInfo* GetClassRegInfo() const = 0;
+
+	//! Template Method to create the servers class factory.
+	virtual COM::IClassFactoryPtr CreateClassFactory(const CLSID& oCLSID);
+
+	//! Template Method used to obtain the server class factory table.
+	virtual const ClassFactoryEntry* GetClassFactoryTable() const = 0;
+
+	//! Template Method to allocate an object for the class factory.
+	virtual COM::IUnknownPtr CreateObject(const CLSID& oCLSID);
+
+	//! Find the class factory table entry for the class.
+	const ClassFactoryEntry* FindClass(const CLSID& oCLSID);
+
+	//! Get the threading model the class is registered with.
+	ThreadingModel ClassThreadingModel(const CLSID& oCLSID) const;
+
+	//! Register the server in the registry.
+	HRESULT RegisterServer(ServerType eType, const tstring& strFile, bool perUser);
+
+	//! Unregister the server from the registry.
+	HRESULT UnregisterServer(ServerType eType, const tstring& strFile, bool perUser);
+
 private:
+	//! An entry in the cache of interface type information.
+	struct TypeInfoEntry
+	{
+		IID				m_oDIID;		//!< The dual interface ID.
+		ITypeInfo*		m_pTypeInfo;	//!< The interface type information.
+		DispIDMap*		m_pDispIDs;		//!< The interface member names.
+		TypeInfoEntry*	m_pNext;		//!< The next entry in the list.
+	};
+
+	//! The class factory table entries, sorted by CLSID.
+	typedef std::vector<const ClassFactoryEntry*> ClassIndex;
+
 	//
 	// Members.
 	//
-	long	m_nLockCount;	//!< The lock count.
+	StripedCounter			m_oLockCount;	//!< The lock count.
+	CriticalSection			m_oCacheLock;	//!< The lock used to populate the caches.
+	ITypeLib*				m_pTypeLib;		//!< The type library, if loaded.
+	ulong					m_nTypeLibTime;	//!< The time taken to load the type library (us).
+	TypeInfoEntry* volatile	m_pTypeInfos;	//!< The type information cache.
+	CriticalSection			m_oUnloadLock;	//!< The lock used to serialise unload queries.
+	DWORD					m_dwIdleTimeout;//!< The time the server must be idle for (ms).
+	long					m_nMaxLoads;	//!< The number of loads which pin the server.
+	DWORD					m_dwLoadWindow;	//!< The window for counting loads (ms).
+	DWORD					m_dwIdleSince;	//!< The time the server was seen idle.
+	ULONGLONG				m_nLockVersion;	//!< The lock count version when seen idle.
+	long					m_nRecentLoads;	//!< The loads within the window, if known.
+	bool					m_bUnloadDeferred;//!< Was the last unload deferred?
+	volatile LONG			m_nDeferred;	//!< The number of deferred unloads followed by reuse.
+	volatile LONG			m_bIndexBuilt;	//!< Has the class index been built?
+	ClassIndex				m_oClassIndex;	//!< The sorted class factory table.
+	size_t					m_nAsyncWorkers;//!< The number of asynchronous call threads.
+	WorkerPool* volatile	m_pAsyncWorkers;//!< The asynchronous call threads, if started.
+	size_t					m_nApartments;	//!< The number of pooled apartments.
+	ApartmentPool* volatile	m_pApartments;	//!< The pooled apartments, if started.
+
+	//
+	// Internal methods.
+	//
+
+	//! Get the type information cache entry for a dual interface.
+	Result<const TypeInfoEntry*> QueryTypeInfoEntry(const IID& rDIID);	// throw()
+
+	//! Load the type information cache entry for a dual interface.
+	const TypeInfoEntry* LoadTypeInfoEntry(const IID& rDIID);	// throw(ComException)
+
+	//! Load the type library from the module.
+	ITypeLib* LoadTypeLibraryFile();	// throw(ComException)
+
+	//! Find the cached type information for a dual interface.
+	const TypeInfoEntry* FindTypeInfo(const IID& rDIID) const;
+
+	//! Get the display name for a class.
+	tstring ClassName(const CLSID& rCLSID) const;
+
+	//! Record this load of the module in the process-wide load history.
+	long RecordLoad() const;
+
+	//! Build the sorted index of the class factory table.
+	void BuildClassIndex();
 
 	//
 	// Class members.
@@ -68,16 +262,72 @@ private:
 
 	//! The singleton COM server.
 	static Server* g_pThis;
+
+	//
+	// Friends.
+	//
+
+	friend class ClassFactory;
+	friend class ApartmentPool;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
-//! Query the lock count.
+//! Query the lock count. The count is striped to avoid contention between
+//! threads and so this has to sum the stripes.
 
 inline long Server::LockCount() const
 {
-	return m_nLockCount;
+	return m_oLockCount.Sum();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of unloads deferred by the unload policy, i.e. the number of
+//! unload/reload cycles avoided. A deferral is only counted once the server is
+//! used again, as until then unloading would have cost nothing.
+
+inline long Server::DeferredUnloads() const
+{
+	return m_nDeferred;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of recent times the module was loaded in this process. This
+//! is only tracked when the unload policy has a load limit, otherwise it is 0.
+
+inline long Server::RecentLoads() const
+{
+	return m_nRecentLoads;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//! Get the time taken by the first load of the type library, in microseconds.
+//! This is 0 if the type library has not been loaded.
+
+inline ulong Server::TypeLibLoadTime() const
+{
+	return m_nTypeLibTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Macros for defining the class factory table. The table is a static array of
+// {CLSID, creation function} pairs; the server sorts an index over it the first
+// time it is used so that a class is found with a binary search.
+
+#define DEFINE_CLASS_FACTORY_TABLE()																\
+									virtual const COM::ClassFactoryEntry* GetClassFactoryTable() const	\
+									{																\
+										static const COM::ClassFactoryEntry s_aoClasses[] =		\
+										{
+
+#define DEFINE_CLASS(clsid, type, primary_iface)													\
+											{ &clsid, &COM::CreateClassInstance<type, primary_iface>, &COM::ClassCounters::Of<type> },
+
+#define END_CLASS_FACTORY_TABLE()																	\
+											{ nullptr, nullptr, nullptr }							\
+										};															\
+										return s_aoClasses;											\
+									}
+
 //namespace COM
 }
 
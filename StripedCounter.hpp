@@ -0,0 +1,211 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   StripedCounter.hpp
+//! \brief  The StripedCounter class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_STRIPEDCOUNTER_HPP
+#define COM_STRIPEDCOUNTER_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+namespace COM
+{
+
+//! The assumed size of a CPU cache line.
+const size_t CACHE_LINE_SIZE = 64;
+
+////////////////////////////////////////////////////////////////////////////////
+//! A counter which is split across a number of cache-line sized stripes so
+//! that threads updating it concurrently do not contend for the same line. A
+//! thread always updates the stripe selected by its thread ID; the value is
+//! only assembled, by summing the stripes, when it is read. Because a value
+//! can be incremented on one thread and decremented on another an individual
+//! stripe may go negative, but the sum is always exact.
+//!
+//! Each stripe holds the partial count in its low 32 bits and every update
+//! adds 2^32 as well, so a stripe's raw value only ever moves forward. That
+//! allows the reader to take a consistent snapshot by collecting the stripes
+//! twice until nothing has changed in between. Without it a reader could see
+//! the decrement for an object but not its increment and so under-count,
+//! which matters when the count is used to decide if the server can unload.
+//! The number of attempts is bounded so that a reader cannot be starved by a
+//! steady stream of updates; the caller is told when the snapshot failed.
+
+class StripedCounter : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	StripedCounter();
+
+	//
+	// Properties.
+	//
+
+	//! Get the counter value.
+	long Sum() const;
+
+	//! Try to get a consistent counter value and version.
+	bool Snapshot(long& nValue, ULONGLONG& nVersion) const;
+
+	//
+	// Methods.
+	//
+
+	//! Increment the counter.
+	void Increment();
+
+	//! Decrement the counter.
+	void Decrement();
+
+	//! The number of stripes. This must be a power of 2.
+	static const size_t NUM_STRIPES = 32;
+
+	//! The number of times the stripes are re-collected by a snapshot.
+	static const size_t MAX_RETRIES = 8;
+
+private:
+	//! The raw value added to a stripe by an increment.
+	static const ULONGLONG INCREMENT = 0x0000000100000001ULL;
+
+	//! The raw value added to a stripe by a decrement.
+	static const ULONGLONG DECREMENT = 0x00000000FFFFFFFFULL;
+
+	//! A single cache-line padded stripe.
+	struct Stripe
+	{
+		volatile LONGLONG	m_nValue;										//!< The version and partial count.
+		char				m_acPadding[CACHE_LINE_SIZE - sizeof(LONGLONG)];	//!< The unused remainder.
+	};
+
+	//
+	// Members.
+	//
+	char	m_acPadding[CACHE_LINE_SIZE];	//!< Isolates the stripes from the preceding data.
+	Stripe	m_aoStripes[NUM_STRIPES];		//!< The counter stripes.
+
+	//
+	// Internal methods.
+	//
+
+	//! Get the stripe for the calling thread.
+	Stripe& ThreadStripe();
+
+	//! Read the raw value of a stripe atomically.
+	ULONGLONG ReadStripe(size_t nStripe) const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline StripedCounter::StripedCounter()
+{
+	for (size_t i = 0; i != NUM_STRIPES; ++i)
+		m_aoStripes[i].m_nValue = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the counter value. The value is normally a consistent snapshot, i.e. it
+//! was the exact count at some instant during the call. If the stripes never
+//! stopped changing the value from the last collection is returned, which is
+//! only approximate.
+
+inline long StripedCounter::Sum() const
+{
+	long      nValue;
+	ULONGLONG nVersion;
+
+	Snapshot(nValue, nVersion);
+
+	return nValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Try to get a consistent counter value and a version which changes on every
+//! update. This allows a caller to detect activity between two reads, even if
+//! the value is the same, e.g. the count went from 0 to 1 and back again. The
+//! stripes are re-collected at most MAX_RETRIES times; if they were still
+//! changing false is returned and the outputs are only approximate, so the
+//! caller should treat the counter as busy.
+
+inline bool StripedCounter::Snapshot(long& nValue, ULONGLONG& nVersion) const
+{
+	ULONGLONG anFirst[NUM_STRIPES];
+
+	for (size_t i = 0; i != NUM_STRIPES; ++i)
+		anFirst[i] = ReadStripe(i);
+
+	for (size_t nRetry = 0; nRetry != MAX_RETRIES; ++nRetry)
+	{
+		bool      bChanged = false;
+		long      nSum     = 0;
+		ULONGLONG nTotal   = 0;
+
+		for (size_t i = 0; i != NUM_STRIPES; ++i)
+		{
+			ULONGLONG nStripe = ReadStripe(i);
+
+			if (nStripe != anFirst[i])
+			{
+				anFirst[i] = nStripe;
+				bChanged = true;
+			}
+
+			nSum   += static_cast<LONG>(static_cast<ULONG>(nStripe));
+			nTotal += nStripe;
+		}
+
+		nValue   = nSum;
+		nVersion = nTotal;
+
+		if (!bChanged)
+			return true;
+	}
+
+	return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the counter.
+
+inline void StripedCounter::Increment()
+{
+	::InterlockedExchangeAdd64(&ThreadStripe().m_nValue, static_cast<LONGLONG>(INCREMENT));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the counter.
+
+inline void StripedCounter::Decrement()
+{
+	::InterlockedExchangeAdd64(&ThreadStripe().m_nValue, static_cast<LONGLONG>(DECREMENT));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the stripe for the calling thread. Thread IDs are multiples of 4 so the
+//! bottom bits are discarded before selecting the stripe.
+
+inline StripedCounter::Stripe& StripedCounter::ThreadStripe()
+{
+	return m_aoStripes[(::GetCurrentThreadId() >> 2) & (NUM_STRIPES - 1)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the raw value of a stripe atomically. A 64-bit read is only atomic on
+//! a 64-bit platform.
+
+inline ULONGLONG StripedCounter::ReadStripe(size_t nStripe) const
+{
+#ifdef _WIN64
+	return static_cast<ULONGLONG>(m_aoStripes[nStripe].m_nValue);
+#else
+	return static_cast<ULONGLONG>(::InterlockedCompareExchange64(const_cast<volatile LONGLONG*>(&m_aoStripes[nStripe].m_nValue), 0, 0));
+#endif
+}
+
+//namespace COM
+}
+
+#endif // COM_STRIPEDCOUNTER_HPP
@@ -0,0 +1,295 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   TearOff.hpp
+//! \brief  The TearOff, TearOffCache and TearOffFactory class declarations.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_TEAROFF_HPP
+#define COM_TEAROFF_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include <new>
+
+namespace COM
+{
+
+template<typename T>
+class TearOffCache;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The base class for a tear-off interface. A tear-off is a small object which
+//! implements a rarely used interface on behalf of its owner, so that the owner
+//! doesn't carry a vtable pointer for it. It's created when the interface is
+//! queried for via an IMPLEMENT_TEAROFF_INTERFACE or
+//! IMPLEMENT_CACHED_TEAROFF_INTERFACE entry in the owner's interface table.
+//!
+//! The tear-off holds a reference on the owner for every reference on itself
+//! and forwards any QueryInterface() call to the owner, so it shares the
+//! owner's identity. An uncached tear-off is destroyed when its last reference
+//! is released. A cached one lives as long as its owner, and so just forwards
+//! AddRef() and Release() too.
+//!
+//! The owner type T must be the ObjectBase derived class which declares the
+//! interface table, e.g.
+//!
+//! class MyPersist : public COM::TearOff<MyClass, IPersist>
+//! {
+//! public:
+//!     MyPersist(MyClass& oOwner) : COM::TearOff<MyClass, IPersist>(oOwner) { }
+//!     virtual HRESULT COMCALL GetClassID(CLSID* pCLSID);
+//! };
+
+template<typename T, typename Base>
+class TearOff : public Base
+{
+public:
+	//! The owner type.
+	typedef T OwnerType;
+
+	//! The interface type.
+	typedef Base InterfaceType;
+
+	//
+	// IUnknown methods.
+	//
+
+	//! Query the owner for a particular interface.
+	virtual HRESULT COMCALL QueryInterface(const IID& rIID, void** ppInterface);
+
+	//! Increment the reference count.
+	virtual ULONG COMCALL AddRef();
+
+	//! Decrement the reference count.
+	virtual ULONG COMCALL Release();
+
+protected:
+	//! Construction from the owning object.
+	TearOff(T& oOwner);
+
+	//! Destructor.
+	virtual ~TearOff();
+
+	//
+	// Properties.
+	//
+
+	//! Get the owning object.
+	T& Owner();
+
+private:
+	//
+	// Members.
+	//
+	T&				m_oOwner;		//!< The owning object.
+	bool			m_bCached;		//!< Whether the tear-off is owned by a cache.
+	volatile LONG	m_nRefCount;	//!< The tear-off reference count, if uncached.
+
+	// Friends.
+	template<typename U> friend class TearOffCache;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the owning object. The tear-off starts with the reference
+//! that is returned by the owner's QueryInterface(), which also takes the
+//! matching reference on the owner.
+
+template<typename T, typename Base>
+inline TearOff<T, Base>::TearOff(T& oOwner)
+	: m_oOwner(oOwner)
+	, m_bCached(false)
+	, m_nRefCount(1)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+template<typename T, typename Base>
+inline TearOff<T, Base>::~TearOff()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the owning object.
+
+template<typename T, typename Base>
+inline T& TearOff<T, Base>::Owner()
+{
+	return m_oOwner;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query the owner for a particular interface. Asking for the tear-off
+//! interface again may return a different tear-off, which COM permits for any
+//! interface other than IUnknown.
+
+template<typename T, typename Base>
+inline HRESULT TearOff<T, Base>::QueryInterface(const IID& rIID, void** ppInterface)
+{
+	return m_oOwner.QueryInterfaceImpl(rIID, ppInterface);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment the reference count.
+
+template<typename T, typename Base>
+inline ULONG TearOff<T, Base>::AddRef()
+{
+	ULONG nOwnerCount = m_oOwner.AddRefImpl();
+
+	if (m_bCached)
+		return nOwnerCount;
+
+	return ::InterlockedIncrement(&m_nRefCount);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Decrement the reference count. The owner is released last, as that may be
+//! the final reference on it.
+
+template<typename T, typename Base>
+inline ULONG TearOff<T, Base>::Release()
+{
+	T& oOwner = m_oOwner;
+
+	if (m_bCached)
+		return oOwner.ReleaseImpl();
+
+	LONG nRefCount = ::InterlockedDecrement(&m_nRefCount);
+
+	if (nRefCount == 0)
+		delete this;
+
+	oOwner.ReleaseImpl();
+
+	return nRefCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The member used by an owner to hold a cached tear-off. The tear-off is
+//! created the first time it is queried for and destroyed with the owner.
+
+template<typename T>
+class TearOffCache : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	TearOffCache();
+
+	//! Destructor.
+	~TearOffCache();
+
+	//! Get the tear-off, creating it if required.
+	template<typename Owner>
+	T* Get(Owner& oOwner); // throw()
+
+private:
+	//
+	// Members.
+	//
+	T* volatile	m_pTearOff;		//!< The cached tear-off.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+template<typename T>
+inline TearOffCache<T>::TearOffCache()
+	: m_pTearOff(nullptr)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+template<typename T>
+inline TearOffCache<T>::~TearOffCache()
+{
+	delete m_pTearOff;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the tear-off, creating it if required. If two threads race to create it
+//! the loser deletes its copy. This returns nullptr if the allocation fails.
+
+template<typename T>
+template<typename Owner>
+inline T* TearOffCache<T>::Get(Owner& oOwner)
+{
+	T* pTearOff = m_pTearOff;
+
+	if (pTearOff != nullptr)
+		return pTearOff;
+
+	pTearOff = new(std::nothrow) T(oOwner);
+
+	if (pTearOff == nullptr)
+		return nullptr;
+
+	pTearOff->m_bCached = true;
+
+	T* pExisting = static_cast<T*>(::InterlockedCompareExchangePointer(reinterpret_cast<void* volatile*>(&m_pTearOff), pTearOff, nullptr));
+
+	if (pExisting != nullptr)
+	{
+		delete pTearOff;
+		pTearOff = pExisting;
+	}
+
+	return pTearOff;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The functions stored in the interface table to create a tear-off. These
+//! follow the interface_cast() convention of returning an interface which the
+//! owner's QueryInterface() then takes a reference on. The tear-off class is
+//! only used inside the functions, so that it can be defined after its owner.
+
+template<typename T>
+struct TearOffFactory
+{
+	//! Create a new tear-off for the object.
+	static void* Create(void* pObject, ptrdiff_t nOffset);
+
+	//! Get the cached tear-off for the object, creating it if required.
+	static void* CreateCached(void* pObject, ptrdiff_t nOffset);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create a new tear-off for the object. This returns nullptr if the
+//! allocation fails, which the caller reports as the interface not being
+//! supported.
+
+template<typename T>
+inline void* TearOffFactory<T>::Create(void* pObject, ptrdiff_t /*nOffset*/)
+{
+	typedef typename T::OwnerType Owner;
+	typedef typename T::InterfaceType Interface;
+
+	T* pTearOff = new(std::nothrow) T(*static_cast<Owner*>(pObject));
+
+	return static_cast<Interface*>(pTearOff);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the cached tear-off for the object, creating it if required. The offset
+//! is that of the TearOffCache member within the object.
+
+template<typename T>
+inline void* TearOffFactory<T>::CreateCached(void* pObject, ptrdiff_t nOffset)
+{
+	typedef typename T::OwnerType Owner;
+	typedef typename T::InterfaceType Interface;
+
+	TearOffCache<T>* pCache = reinterpret_cast<TearOffCache<T>*>(static_cast<char*>(pObject) + nOffset);
+
+	return static_cast<Interface*>(pCache->Get(*static_cast<Owner*>(pObject)));
+}
+
+//namespace COM
+}
+
+#endif // COM_TEAROFF_HPP
@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ApartmentPoolTests.cpp
+//! \brief  The unit tests for the ApartmentPool class.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include <WCL/ComPtr.hpp>
+#include <COM/ClassFactory.hpp>
+#include <COM/ApartmentPool.hpp>
+#include "Benchmark.hpp"
+
+TEST_SET(ApartmentPool)
+{
+	typedef WCL::ComPtr<IClassFactory> IClassFactoryPtr;
+	typedef WCL::ComPtr<IDispatch> IDispatchPtr;
+
+	const size_t OBJECTS = 4;
+
+TEST_CASE("the server has no apartment pool by default")
+{
+	TestServer server;
+
+	TEST_TRUE(server.Apartments() == nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("the apartment pool size is the configured apartment count")
+{
+	TestServer server;
+
+	server.SetApartmentCount(3);
+
+	TEST_TRUE(server.Apartments() != nullptr);
+	TEST_TRUE(server.Apartments()->Count() == 3);
+	TEST_TRUE(!server.Apartments()->IsPoolThread());
+
+	server.StopApartments();
+}
+TEST_CASE_END
+
+TEST_CASE("apartment threaded objects are spread across the pool and are callable")
+{
+	HRESULT init = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	{
+		TestServer server;
+
+		server.SetApartmentCount(2);
+
+		IClassFactoryPtr factory(new COM::ClassFactory(CLSID_TestApartmentClass), true);
+		IDispatchPtr     objects[OBJECTS];
+		bool             allCreated = true;
+
+		for (size_t i = 0; i != OBJECTS; ++i)
+			allCreated &= (factory->CreateInstance(nullptr, IID_IDispatch, reinterpret_cast<void**>(AttachTo(objects[i]))) == S_OK);
+
+		TEST_TRUE(allCreated);
+		TEST_TRUE(server.Apartments()->GetStats(0).m_nObjects == 2);
+		TEST_TRUE(server.Apartments()->GetStats(1).m_nObjects == 2);
+		TEST_TRUE(server.Apartments()->GetStats(0).m_nQueued == 0);
+
+		long result = 0;
+
+		TEST_TRUE(InvokeAdd(objects[0].get(), 1, 2, result) == S_OK);
+		TEST_TRUE(result == 3);
+		TEST_TRUE(server.Apartments()->GetStats(0).m_nCalls + server.Apartments()->GetStats(1).m_nCalls != 0);
+
+		for (size_t i = 0; i != OBJECTS; ++i)
+			objects[i].Release();
+
+		TEST_TRUE(server.Apartments()->GetStats(0).m_nObjects == 0);
+		TEST_TRUE(server.Apartments()->GetStats(1).m_nObjects == 0);
+
+		factory.Release();
+		server.StopApartments();
+	}
+
+	if (SUCCEEDED(init))
+		::CoUninitialize();
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Round trips to apartment threaded objects spread across the pool.
+
+BENCHMARK(ApartmentPoolRoundTrips)
+{
+	typedef WCL::ComPtr<IClassFactory> IClassFactoryPtr;
+	typedef WCL::ComPtr<IDispatch> IDispatchPtr;
+
+	const size_t OBJECTS    = 4;
+	const size_t iterations = 1000;
+
+	HRESULT init = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	{
+		TestServer server;
+
+		server.SetApartmentCount(OBJECTS);
+
+		IClassFactoryPtr factory(new COM::ClassFactory(CLSID_TestApartmentClass), true);
+		IDispatchPtr     objects[OBJECTS];
+
+		for (size_t i = 0; i != OBJECTS; ++i)
+			factory->CreateInstance(nullptr, IID_IDispatch, reinterpret_cast<void**>(AttachTo(objects[i])));
+
+		long      result = 0;
+		Stopwatch timer;
+
+		for (size_t i = 0; i != iterations; ++i)
+			InvokeAdd(objects[i % OBJECTS].get(), 1, 2, result);
+
+		ReportBenchmark("ITestDispatch::Add (pooled STA)", iterations, timer.ElapsedMs());
+
+		for (size_t i = 0; i != OBJECTS; ++i)
+			objects[i].Release();
+
+		factory.Release();
+		server.StopApartments();
+	}
+
+	if (SUCCEEDED(init))
+		::CoUninitialize();
+}
@@ -0,0 +1,258 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   AsyncCallTests.cpp
+//! \brief  The unit tests for the AsyncCall and CallFactoryImpl classes.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include <COM/WorkerPool.hpp>
+#include "Benchmark.hpp"
+
+namespace
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The controlling unknown for a call object, which plays the part of the COM
+//! stub (or a client-side call manager) by aggregating the call object and
+//! providing the ISynchronize used to signal completion.
+
+class CallManager : public ISynchronize
+{
+public:
+	//! Create a call object for the asynchronous test interface.
+	static CallManager* Create(ICallFactory* pFactory)
+	{
+		CallManager* pManager = new CallManager;
+
+		if (FAILED(pFactory->CreateCall(IID_AsyncITestAsync, pManager, IID_IUnknown, &pManager->m_pInner)))
+		{
+			pManager->Release();
+			return nullptr;
+		}
+
+		return pManager;
+	}
+
+	//! Get the asynchronous interface of the call object. The interface is
+	//! only valid whilst the manager is alive, as that owns the call object.
+	AsyncITestAsync* Call()
+	{
+		AsyncITestAsync* pCall = nullptr;
+
+		if (SUCCEEDED(m_pInner->QueryInterface(IID_AsyncITestAsync, reinterpret_cast<void**>(&pCall))))
+			pCall->Release();
+
+		return pCall;
+	}
+
+	virtual HRESULT COMCALL QueryInterface(const IID& rIID, void** ppInterface)
+	{
+		if (ppInterface == nullptr)
+			return E_POINTER;
+
+		if (IsEqualIID(rIID, IID_IUnknown) || IsEqualIID(rIID, IID_ISynchronize))
+		{
+			*ppInterface = static_cast<ISynchronize*>(this);
+			AddRef();
+			return S_OK;
+		}
+
+		if (m_pInner != nullptr)
+			return m_pInner->QueryInterface(rIID, ppInterface);
+
+		*ppInterface = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	virtual ULONG COMCALL AddRef()
+	{
+		return ::InterlockedIncrement(&m_nRefCount);
+	}
+
+	virtual ULONG COMCALL Release()
+	{
+		LONG nRefCount = ::InterlockedDecrement(&m_nRefCount);
+
+		if (nRefCount == 0)
+			delete this;
+
+		return nRefCount;
+	}
+
+	virtual HRESULT COMCALL Wait(DWORD /*dwFlags*/, DWORD dwMilliseconds)
+	{
+		return (::WaitForSingleObject(m_hEvent, dwMilliseconds) == WAIT_OBJECT_0) ? S_OK : RPC_S_CALLPENDING;
+	}
+
+	virtual HRESULT COMCALL Signal()
+	{
+		::SetEvent(m_hEvent);
+		return S_OK;
+	}
+
+	virtual HRESULT COMCALL Reset()
+	{
+		::ResetEvent(m_hEvent);
+		return S_OK;
+	}
+
+private:
+	CallManager()
+		: m_nRefCount(1)
+		, m_hEvent(::CreateEvent(nullptr, FALSE, FALSE, nullptr))
+		, m_pInner(nullptr)
+	{
+	}
+
+	virtual ~CallManager()
+	{
+		if (m_pInner != nullptr)
+			m_pInner->Release();
+
+		::CloseHandle(m_hEvent);
+	}
+
+	volatile LONG	m_nRefCount;
+	HANDLE			m_hEvent;
+	IUnknown*		m_pInner;
+};
+
+//namespace
+}
+
+TEST_SET(AsyncCall)
+{
+
+TEST_CASE("the call factory only creates aggregated call objects for the asynchronous interface")
+{
+	TestServer  server;
+	TestAsync*  object  = new TestAsync;
+	IUnknown*   call    = nullptr;
+
+	object->AddRef();
+
+	TEST_TRUE(object->CreateCall(IID_ITestAsync, nullptr, IID_IUnknown, &call) == E_NOINTERFACE);
+	TEST_TRUE(object->CreateCall(IID_AsyncITestAsync, nullptr, IID_IUnknown, &call) == CLASS_E_NOAGGREGATION);
+	TEST_TRUE(call == nullptr);
+
+	object->Release();
+}
+TEST_CASE_END
+
+TEST_CASE("a call begun on the worker pool can be finished and returns the result")
+{
+	TestServer  server;
+	TestAsync*  object = new TestAsync;
+
+	object->AddRef();
+
+	CallManager* manager = CallManager::Create(object);
+
+	TEST_TRUE(manager != nullptr);
+
+	long result = 0;
+
+	TEST_TRUE(manager->Call()->Begin_Process(1) == S_OK);
+	TEST_TRUE(manager->Call()->Begin_Process(2) == RPC_E_CALL_PENDING);
+	TEST_TRUE(manager->Call()->Finish_Process(&result) == S_OK);
+	TEST_TRUE(result == 1);
+	TEST_TRUE(manager->Call()->Finish_Process(&result) == RPC_E_CALL_COMPLETE);
+
+	// Call objects are reusable.
+	TEST_TRUE(manager->Call()->Begin_Process(2) == S_OK);
+	TEST_TRUE(manager->Call()->Finish_Process(&result) == S_OK);
+	TEST_TRUE(result == 2);
+
+	manager->Release();
+	object->Release();
+
+	// A worker releases its reference just after signalling the caller.
+	server.StopAsyncWorkers();
+
+	TEST_TRUE(server.LockCount() == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("a failed call is reported by the finish method")
+{
+	TestServer  server;
+	TestAsync*  object = new TestAsync;
+
+	object->AddRef();
+
+	CallManager* manager = CallManager::Create(object);
+	long         result  = 0;
+
+	TEST_TRUE(manager->Call()->Begin_Process(-1) == S_OK);
+	TEST_TRUE(manager->Call()->Finish_Process(&result) == E_INVALIDARG);
+
+	::SetErrorInfo(0, nullptr);
+
+	manager->Release();
+	object->Release();
+}
+TEST_CASE_END
+
+TEST_CASE("the worker pool size is bounded by the configured thread count")
+{
+	TestServer server;
+
+	server.SetAsyncWorkerCount(3);
+
+	TEST_TRUE(server.AsyncWorkers().ThreadCount() == 3);
+
+	server.StopAsyncWorkers();
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Overlapped asynchronous calls compared to sequential synchronous calls.
+
+BENCHMARK(AsyncCallOverlap)
+{
+	const size_t calls    = 32;
+	const long   duration = 20;
+
+	TestServer server;
+
+	server.SetAsyncWorkerCount(8);
+
+	TestAsync* object = new TestAsync;
+
+	object->AddRef();
+
+	long result = 0;
+
+	Stopwatch syncTimer;
+
+	for (size_t i = 0; i != calls; ++i)
+		object->Process(duration, &result);
+
+	ReportBenchmark("ITestAsync::Process (synchronous)", calls, syncTimer.ElapsedMs());
+
+	CallManager* managers[calls];
+
+	for (size_t i = 0; i != calls; ++i)
+		managers[i] = CallManager::Create(object);
+
+	Stopwatch asyncTimer;
+
+	for (size_t i = 0; i != calls; ++i)
+		managers[i]->Call()->Begin_Process(duration);
+
+	for (size_t i = 0; i != calls; ++i)
+		managers[i]->Call()->Finish_Process(&result);
+
+	ReportBenchmark("AsyncITestAsync::Begin/Finish_Process (8 workers)", calls, asyncTimer.ElapsedMs());
+
+	for (size_t i = 0; i != calls; ++i)
+		managers[i]->Release();
+
+	object->Release();
+
+	server.StopAsyncWorkers();
+}
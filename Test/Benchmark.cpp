@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Benchmark.cpp
+//! \brief  The benchmark registration and runner.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "Benchmark.hpp"
+#include <vector>
+
+namespace
+{
+
+//! A registered benchmark.
+struct Benchmark
+{
+	const char*	m_pszName;		//!< The benchmark name.
+	BenchmarkFn	m_pfnRun;		//!< The benchmark function.
+};
+
+//! The collection of registered benchmarks.
+typedef std::vector<Benchmark> Benchmarks;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the registered benchmarks. The collection is a function-local static as
+//! the benchmarks are registered during static initialisation.
+
+Benchmarks& RegisteredBenchmarks()
+{
+	static Benchmarks s_vecBenchmarks;
+
+	return s_vecBenchmarks;
+}
+
+//namespace
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Register a benchmark to be run by RunBenchmarks(). The return value allows
+//! the BENCHMARK macro to register the function via a static initialiser.
+
+bool RegisterBenchmark(const char* pszName, BenchmarkFn pfnBenchmark)
+{
+	Benchmark oBenchmark = { pszName, pfnBenchmark };
+
+	RegisteredBenchmarks().push_back(oBenchmark);
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the command line argument is the switch to run the benchmarks.
+
+bool IsBenchmarkSwitch(const tchar* pszArg)
+{
+	ASSERT(pszArg != nullptr);
+
+	return ( (tstricmp(pszArg, TXT("-Benchmark")) == 0) || (tstricmp(pszArg, TXT("/Benchmark")) == 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the registered benchmarks, in registration order. Any exception stops
+//! the run.
+
+int RunBenchmarks()
+{
+	const Benchmarks& vecBenchmarks = RegisteredBenchmarks();
+
+	try
+	{
+		for (Benchmarks::const_iterator it = vecBenchmarks.begin(); it != vecBenchmarks.end(); ++it)
+		{
+			std::cout << it->m_pszName << std::endl;
+
+			it->m_pfnRun();
+		}
+	}
+	catch (const Core::Exception& e)
+	{
+		TRACE1(TXT("Benchmark failed - %s\n"), e.twhat());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
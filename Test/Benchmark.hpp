@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Benchmark.hpp
+//! \brief  Helpers for the throughput comparisons run by the -Benchmark switch.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+//! The signature of a benchmark.
+typedef void (*BenchmarkFn)();
+
+//! Register a benchmark to be run by RunBenchmarks().
+bool RegisterBenchmark(const char* pszName, BenchmarkFn pfnBenchmark);
+
+//! Query if the command line argument is the switch to run the benchmarks.
+bool IsBenchmarkSwitch(const tchar* pszArg);
+
+//! Run the registered benchmarks.
+int RunBenchmarks();
+
+//! Define a benchmark. Benchmarks are not part of the unit tests and are only
+//! run when the harness is invoked with the -Benchmark switch.
+#define BENCHMARK(name)																\
+	static void name();																\
+	static const bool name##Registered = RegisterBenchmark(#name, name);			\
+	static void name()
+
+////////////////////////////////////////////////////////////////////////////////
+//! A high resolution timer based on the performance counter.
+
+class Stopwatch
+{
+public:
+	//! Default constructor. Starts the timer.
+	Stopwatch()
+	{
+		::QueryPerformanceFrequency(&m_oFrequency);
+		::QueryPerformanceCounter(&m_oStart);
+	}
+
+	//! Get the elapsed time in milliseconds.
+	double ElapsedMs() const
+	{
+		LARGE_INTEGER oNow;
+
+		::QueryPerformanceCounter(&oNow);
+
+		return static_cast<double>(oNow.QuadPart - m_oStart.QuadPart) * 1000.0 / static_cast<double>(m_oFrequency.QuadPart);
+	}
+
+private:
+	//
+	// Members.
+	//
+	LARGE_INTEGER	m_oFrequency;	//!< The counter frequency.
+	LARGE_INTEGER	m_oStart;		//!< The counter start value.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write the result of a benchmark to stdout.
+
+inline void ReportBenchmark(const char* pszName, size_t nIterations, double dElapsedMs)
+{
+	double dNsPerOp = (nIterations != 0) ? (dElapsedMs * 1000000.0 / static_cast<double>(nIterations)) : 0.0;
+
+	std::cout << pszName << ": " << nIterations << " iterations in " << dElapsedMs << " ms ("
+	          << dNsPerOp << " ns/op)" << std::endl;
+}
+
+#endif // BENCHMARK_HPP
@@ -60,5 +60,54 @@ TEST_CASE("creating an instance returns S_OK and a new object")
 }
 TEST_CASE_END
 
+TEST_CASE("getting the class object returns the same factory on every call")
+{
+	TestServer       server;
+	IClassFactoryPtr first;
+	IClassFactoryPtr second;
+
+	TEST_TRUE(::DllGetClassObject(CLSID_TestClass, IID_IClassFactory, reinterpret_cast<void**>(AttachTo(first))) == S_OK);
+	TEST_TRUE(::DllGetClassObject(CLSID_TestClass, IID_IClassFactory, reinterpret_cast<void**>(AttachTo(second))) == S_OK);
+
+	TEST_TRUE(first.get() != nullptr);
+	TEST_TRUE(first.get() == second.get());
+}
+TEST_CASE_END
+
+TEST_CASE("getting the class object for an unknown class returns CLASS_E_CLASSNOTAVAILABLE")
+{
+	TestServer       server;
+	IClassFactoryPtr factory;
+
+	const CLSID CLSID_Unknown = { 0x87654321, 0x4321, 0x4321, { 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01 } };
+
+	TEST_TRUE(::DllGetClassObject(CLSID_Unknown, IID_IClassFactory, reinterpret_cast<void**>(AttachTo(factory))) == CLASS_E_CLASSNOTAVAILABLE);
+	TEST_TRUE(factory.get() == nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("a client holding the cached class object prevents the server unloading")
+{
+	TestServer       server;
+	IClassFactoryPtr factory;
+
+	long count = server.LockCount();
+
+	TEST_TRUE(::DllGetClassObject(CLSID_TestClass, IID_IClassFactory, reinterpret_cast<void**>(AttachTo(factory))) == S_OK);
+
+	TEST_TRUE(server.LockCount() == count+1);
+	TEST_TRUE(::DllCanUnloadNow() == S_FALSE);
+
+	IClassFactoryPtr copy(factory);
+
+	TEST_TRUE(server.LockCount() == count+1);
+
+	copy.Release();
+	factory.Release();
+
+	TEST_TRUE(server.LockCount() == count);
+}
+TEST_CASE_END
+
 }
 TEST_SET_END
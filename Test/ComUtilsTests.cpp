@@ -6,6 +6,7 @@
 #include "Common.hpp"
 #include <Core/UnitTest.hpp>
 #include <COM/ComUtils.hpp>
+#include "Benchmark.hpp"
 
 TEST_SET(ComUtils)
 {
@@ -18,6 +19,118 @@ TEST_CASE("conversion of a GUID to string returns a 5-part number enclosed in br
 }
 TEST_CASE_END
 
+TEST_CASE("formatting a GUID into a buffer returns the buffer")
+{
+	GUID  oGUID  = { 0x12345678, 0x1234, 0x1234, { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } };
+	tchar buffer[COM::GUID_BUFFER_SIZE];
+
+	const tchar* result = COM::FormatGUID(oGUID, buffer);
+
+	TEST_TRUE(result == buffer);
+	TEST_TRUE(tstring(buffer) == TXT("{12345678-1234-1234-0102-030405060708}"));
+}
+TEST_CASE_END
+
+TEST_CASE("formatting a GUID matches StringFromGUID2 for every byte value in every position")
+{
+	bool matches = true;
+
+	for (size_t position = 0; position != sizeof(GUID); ++position)
+	{
+		for (size_t value = 0; value != 256; ++value)
+		{
+			GUID oGUID = GUID_NULL;
+
+			reinterpret_cast<byte*>(&oGUID)[position] = static_cast<byte>(value);
+
+			wchar_t expected[COM::GUID_BUFFER_SIZE];
+			tchar   actual[COM::GUID_BUFFER_SIZE];
+			GUID    parsed;
+
+			::StringFromGUID2(oGUID, expected, COM::GUID_BUFFER_SIZE);
+			COM::FormatGUID(oGUID, actual);
+
+			if ( (wcscmp(T2W(actual), expected) != 0)
+			  || !COM::ParseGUID(actual, parsed) || (parsed != oGUID) )
+				matches = false;
+		}
+	}
+
+	TEST_TRUE(matches);
+}
+TEST_CASE_END
+
+TEST_CASE("parsing a formatted GUID returns the same GUID as CLSIDFromString")
+{
+	bool matches = true;
+
+	for (size_t i = 0; i != 10000; ++i)
+	{
+		GUID oGUID;
+
+		::CoCreateGuid(&oGUID);
+
+		wchar_t string[COM::GUID_BUFFER_SIZE];
+		GUID    expected;
+		GUID    actual;
+
+		::StringFromGUID2(oGUID, string, COM::GUID_BUFFER_SIZE);
+		::CLSIDFromString(string, &expected);
+
+		if (!COM::ParseGUID(W2T(string), actual) || (actual != expected) || (actual != oGUID))
+			matches = false;
+	}
+
+	TEST_TRUE(matches);
+}
+TEST_CASE_END
+
+TEST_CASE("parsing a GUID accepts lower case hex digits")
+{
+	GUID expected = { 0xABCDEF01, 0xABCD, 0xEF01, { 0xAB, 0xCD, 0xEF, 0x01, 0x23, 0x45, 0x67, 0x89 } };
+	GUID actual;
+
+	TEST_TRUE(COM::ParseGUID(TXT("{abcdef01-abcd-ef01-abcd-ef0123456789}"), actual));
+	TEST_TRUE(actual == expected);
+}
+TEST_CASE_END
+
+TEST_CASE("parsing an invalid GUID fails and leaves the output unchanged")
+{
+	const tchar* invalid[] =
+	{
+		TXT(""),
+		TXT("{"),
+		TXT("12345678-1234-1234-0102-030405060708"),
+		TXT("{12345678-1234-1234-0102-030405060708"),
+		TXT("{12345678-1234-1234-0102-030405060708}x"),
+		TXT("{12345678-1234-1234-0102-03040506070}"),
+		TXT("{12345678-1234-1234-0102-0304050607080}"),
+		TXT("{12345678+1234-1234-0102-030405060708}"),
+		TXT("{1234567G-1234-1234-0102-030405060708}"),
+		TXT("{12345678-1234-1234-01020-30405060708}"),
+		TXT("{ 2345678-1234-1234-0102-030405060708}"),
+		TXT("ProgID.Name"),
+	};
+
+	bool rejected = true;
+
+	for (size_t i = 0; i != (sizeof(invalid)/sizeof(invalid[0])); ++i)
+	{
+		GUID oGUID = GUID_NULL;
+
+		if (COM::ParseGUID(invalid[i], oGUID) || (oGUID != GUID_NULL))
+			rejected = false;
+	}
+
+	TEST_TRUE(rejected);
+
+	GUID oGUID = GUID_NULL;
+
+	TEST_TRUE(COM::ParseGUID(nullptr, oGUID) == false);
+}
+TEST_CASE_END
+
 TEST_CASE("looking up a CLSID returns the default value associated with the CLSID registry key")
 {
 	CLSID oCLSID = { 0x0000031A, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
@@ -34,5 +147,156 @@ TEST_CASE("looking up an IID returns the default value associated with the IID r
 }
 TEST_CASE_END
 
+TEST_CASE("the result of looking up a name is cached until the cache is flushed")
+{
+	const IID    TEST_IID  = { 0x9A3C5E71, 0x2B4D, 0x4F60, { 0x81, 0x92, 0xA3, 0xB4, 0xC5, 0xD6, 0xE7, 0xF8 } };
+	const tchar* TEST_KEY  = TXT("Software\\Classes\\Interface\\{9A3C5E71-2B4D-4F60-8192-A3B4C5D6E7F8}");
+	const tchar* TEST_NAME = TXT("ITestCachedName");
+
+	COM::FlushLookupCache();
+
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TXT(""));
+
+	::RegSetValue(HKEY_CURRENT_USER, TEST_KEY, REG_SZ, TEST_NAME, 0);
+
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TXT(""));
+
+	COM::FlushLookupCache();
+
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TEST_NAME);
+
+	::RegDeleteKey(HKEY_CURRENT_USER, TEST_KEY);
+
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TEST_NAME);
+
+	COM::FlushLookupCache();
+
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TXT(""));
+}
+TEST_CASE_END
+
+TEST_CASE("looking up many unregistered GUIDs does not evict a cached name")
+{
+	const IID    TEST_IID  = { 0x9A3C5E71, 0x2B4D, 0x4F60, { 0x81, 0x92, 0xA3, 0xB4, 0xC5, 0xD6, 0xE7, 0xF8 } };
+	const tchar* TEST_KEY  = TXT("Software\\Classes\\Interface\\{9A3C5E71-2B4D-4F60-8192-A3B4C5D6E7F8}");
+	const tchar* TEST_NAME = TXT("ITestCachedName");
+
+	COM::FlushLookupCache();
+
+	::RegSetValue(HKEY_CURRENT_USER, TEST_KEY, REG_SZ, TEST_NAME, 0);
+
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TEST_NAME);
+
+	::RegDeleteKey(HKEY_CURRENT_USER, TEST_KEY);
+
+	IID unknownIID = { 0x5E0C1A22, 0x7D3B, 0x4C19, { 0x9F, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+
+	size_t unknownNames = 0;
+
+	for (size_t i = 0; i != 4096; ++i)
+	{
+		unknownIID.Data1 = static_cast<unsigned long>(0x5E0C1A22 + i);
+
+		if (COM::LookupIID(unknownIID).empty())
+			++unknownNames;
+	}
+
+	TEST_TRUE(unknownNames == 4096);
+	TEST_TRUE(COM::LookupIID(TEST_IID) == TEST_NAME);
+
+	COM::FlushLookupCache();
+}
+TEST_CASE_END
+
+TEST_CASE("preloading the cache returns the same names as the registry")
+{
+	CLSID oCLSID = { 0x0000031A, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+	IID   oIID   = { 0x00000000, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+	COM::FlushLookupCache();
+	COM::PreloadLookupCache();
+
+	TEST_TRUE(COM::LookupCLSID(oCLSID) == TXT("ClassMoniker"));
+	TEST_TRUE(COM::LookupIID(oIID) == TXT("IUnknown"));
+
+	COM::FlushLookupCache();
+}
+TEST_CASE_END
+
 }
 TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! GUID formatting and parsing throughput compared to the Win32 functions.
+
+BENCHMARK(GUIDFormatting)
+{
+	const size_t iterations = 100000;
+
+	GUID    oGUID  = { 0x12345678, 0x1234, 0x1234, { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } };
+	wchar_t wide[COM::GUID_BUFFER_SIZE];
+	tchar   buffer[COM::GUID_BUFFER_SIZE];
+	GUID    parsed;
+
+	Stopwatch formatTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		COM::FormatGUID(oGUID, buffer);
+
+	ReportBenchmark("COM::FormatGUID(buffer)", iterations, formatTimer.ElapsedMs());
+
+	Stopwatch stringTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		COM::FormatGUID(oGUID);
+
+	ReportBenchmark("COM::FormatGUID(tstring)", iterations, stringTimer.ElapsedMs());
+
+	Stopwatch win32FormatTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		::StringFromGUID2(oGUID, wide, COM::GUID_BUFFER_SIZE);
+
+	ReportBenchmark("StringFromGUID2", iterations, win32FormatTimer.ElapsedMs());
+
+	Stopwatch parseTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		COM::ParseGUID(buffer, parsed);
+
+	ReportBenchmark("COM::ParseGUID", iterations, parseTimer.ElapsedMs());
+
+	Stopwatch win32ParseTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		::CLSIDFromString(wide, &parsed);
+
+	ReportBenchmark("CLSIDFromString", iterations, win32ParseTimer.ElapsedMs());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Name lookup throughput with and without the cache.
+
+BENCHMARK(NameLookup)
+{
+	const size_t iterations = 10000;
+
+	IID oIID = { 0x00000000, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+	Stopwatch uncachedTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+	{
+		COM::FlushLookupCache();
+		COM::LookupIID(oIID);
+	}
+
+	ReportBenchmark("COM::LookupIID (uncached)", iterations, uncachedTimer.ElapsedMs());
+
+	Stopwatch cachedTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		COM::LookupIID(oIID);
+
+	ReportBenchmark("COM::LookupIID (cached)", iterations, cachedTimer.ElapsedMs());
+}
@@ -0,0 +1,175 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   DispIDMapTests.cpp
+//! \brief  The unit tests for the DispIDMap class.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include "Benchmark.hpp"
+#include <COM/IDispatchImpl.hpp>
+#include <WCL/ComPtr.hpp>
+
+////////////////////////////////////////////////////////////////////////////////
+//! The dual interface test class which uses the type library.
+
+class TypeLibTestDispatch : public COM::ObjectBase<ITestDispatch>, public COM::IDispatchImpl<TypeLibTestDispatch>
+{
+public:
+	TypeLibTestDispatch()
+		: COM::IDispatchImpl<TypeLibTestDispatch>(IID_ITestDispatch)
+	{
+	}
+
+	virtual HRESULT COMCALL get_Name(BSTR* pbstrName)
+	{
+		*pbstrName = ::SysAllocString(OLESTR("TypeLibTestDispatch"));
+		return S_OK;
+	}
+
+	virtual HRESULT COMCALL Add(long nLHS, long nRHS, long* pnResult)
+	{
+		*pnResult = nLHS + nRHS;
+		return S_OK;
+	}
+
+	DEFINE_INTERFACE_TABLE(ITestDispatch)
+		IMPLEMENT_INTERFACE(IID_ITestDispatch, ITestDispatch)
+		IMPLEMENT_INTERFACE(IID_IDispatch, ITestDispatch)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+	IMPLEMENT_IDISPATCH(TypeLibTestDispatch)
+};
+
+TEST_SET(DispIDMap)
+{
+	typedef WCL::ComPtr<ITestDispatch> ITestDispatchPtr;
+
+TEST_CASE("the map contains the members of the interface")
+{
+	TestServer server;
+
+	const COM::DispIDMap& map = server.GetDispIDMap(IID_ITestDispatch);
+
+	TEST_TRUE(map.Count() >= 2);
+	TEST_TRUE(&server.GetDispIDMap(IID_ITestDispatch) == &map);
+}
+TEST_CASE_END
+
+TEST_CASE("member names are matched case-insensitively")
+{
+	TestServer server;
+
+	const COM::DispIDMap& map = server.GetDispIDMap(IID_ITestDispatch);
+
+	LPOLESTR names[] = { OLESTR("nAmE") };
+	DISPID   ids[]   = { DISPID_UNKNOWN };
+	HRESULT  result  = E_FAIL;
+
+	TEST_TRUE(map.Find(names, 1, ids, result) == true);
+	TEST_TRUE(result == S_OK);
+	TEST_TRUE(ids[0] == 1);
+}
+TEST_CASE_END
+
+TEST_CASE("argument names are mapped to their position")
+{
+	TestServer server;
+
+	const COM::DispIDMap& map = server.GetDispIDMap(IID_ITestDispatch);
+
+	LPOLESTR names[] = { OLESTR("Add"), OLESTR("NRHS"), OLESTR("nLHS") };
+	DISPID   ids[]   = { DISPID_UNKNOWN, DISPID_UNKNOWN, DISPID_UNKNOWN };
+	HRESULT  result  = E_FAIL;
+
+	TEST_TRUE(map.Find(names, 3, ids, result) == true);
+	TEST_TRUE(result == S_OK);
+	TEST_TRUE(ids[0] == 2);
+	TEST_TRUE(ids[1] == 1);
+	TEST_TRUE(ids[2] == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("an unknown argument name is reported but the others are still mapped")
+{
+	TestServer server;
+
+	const COM::DispIDMap& map = server.GetDispIDMap(IID_ITestDispatch);
+
+	LPOLESTR names[] = { OLESTR("Add"), OLESTR("nMiddle") };
+	DISPID   ids[]   = { DISPID_UNKNOWN, 0 };
+	HRESULT  result  = S_OK;
+
+	TEST_TRUE(map.Find(names, 2, ids, result) == true);
+	TEST_TRUE(result == DISP_E_UNKNOWNNAME);
+	TEST_TRUE(ids[0] == 2);
+	TEST_TRUE(ids[1] == DISPID_UNKNOWN);
+}
+TEST_CASE_END
+
+TEST_CASE("names the map cannot answer are left to the type information")
+{
+	TestServer server;
+
+	const COM::DispIDMap& map = server.GetDispIDMap(IID_ITestDispatch);
+
+	LPOLESTR unknown[]  = { OLESTR("Subtract") };
+	LPOLESTR nonAscii[] = { L"N\x00E4me" };
+	DISPID   ids[]      = { DISPID_UNKNOWN };
+	HRESULT  result     = S_OK;
+
+	TEST_TRUE(map.Find(unknown, 1, ids, result) == false);
+	TEST_TRUE(map.Find(nonAscii, 1, ids, result) == false);
+}
+TEST_CASE_END
+
+TEST_CASE("IDispatchImpl maps names through the map and falls back for unknown names")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TypeLibTestDispatch, true);
+
+	LPOLESTR name = OLESTR("ADD");
+	DISPID   id   = DISPID_UNKNOWN;
+
+	TEST_TRUE(object->GetIDsOfNames(IID_NULL, &name, 1, 0, &id) == S_OK);
+	TEST_TRUE(id == 2);
+
+	LPOLESTR unknown = OLESTR("Subtract");
+
+	TEST_TRUE(object->GetIDsOfNames(IID_NULL, &unknown, 1, 0, &id) == DISP_E_UNKNOWNNAME);
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Name map throughput compared to the type information.
+
+BENCHMARK(DispIDMapLookup)
+{
+	typedef WCL::ComPtr<ITestDispatch> ITestDispatchPtr;
+
+	TestServer       server;
+	ITestDispatchPtr object(new TypeLibTestDispatch, true);
+	ITypeInfo*       typeInfo = server.GetTypeInfo(IID_ITestDispatch);
+
+	const size_t iterations = 100000;
+
+	LPOLESTR names[] = { OLESTR("add"), OLESTR("nRHS") };
+	DISPID   ids[2];
+
+	Stopwatch mapTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		object->GetIDsOfNames(IID_NULL, names, 2, 0, ids);
+
+	ReportBenchmark("IDispatchImpl::GetIDsOfNames", iterations, mapTimer.ElapsedMs());
+
+	Stopwatch typeInfoTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		typeInfo->GetIDsOfNames(names, 2, ids);
+
+	ReportBenchmark("ITypeInfo::GetIDsOfNames", iterations, typeInfoTimer.ElapsedMs());
+}
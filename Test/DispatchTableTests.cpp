@@ -0,0 +1,253 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   DispatchTableTests.cpp
+//! \brief  The unit tests for the DispatchTable and DispatchTableImpl classes.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include "Benchmark.hpp"
+#include <WCL/ComPtr.hpp>
+
+//! The DISPID of the ITestDispatch Name property.
+static const DISPID DISPID_NAME = 1;
+
+//! The DISPID of the ITestDispatch Add method.
+static const DISPID DISPID_ADD = 2;
+
+TEST_SET(DispatchTable)
+{
+	typedef WCL::ComPtr<ITestDispatch> ITestDispatchPtr;
+
+TEST_CASE("a method is invoked with its arguments unpacked in declaration order")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	VARIANT args[2];
+
+	// Arguments are passed in reverse order.
+	V_VT(&args[1]) = VT_I4; V_I4(&args[1]) = 40;
+	V_VT(&args[0]) = VT_I4; V_I4(&args[0]) = 2;
+
+	DISPPARAMS params = { args, nullptr, 2, 0 };
+	VARIANT    result;
+
+	::VariantInit(&result);
+
+	TEST_TRUE(object->Invoke(DISPID_ADD, IID_NULL, 0, DISPATCH_METHOD, &params, &result, nullptr, nullptr) == S_OK);
+	TEST_TRUE(V_VT(&result) == VT_I4);
+	TEST_TRUE(V_I4(&result) == 42);
+}
+TEST_CASE_END
+
+TEST_CASE("arguments of a different type are coerced to the parameter type")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	VARIANT args[2];
+
+	V_VT(&args[1]) = VT_BSTR; V_BSTR(&args[1]) = ::SysAllocString(OLESTR("40"));
+	V_VT(&args[0]) = VT_I2;   V_I2(&args[0])   = 2;
+
+	DISPPARAMS params = { args, nullptr, 2, 0 };
+	VARIANT    result;
+
+	::VariantInit(&result);
+
+	TEST_TRUE(object->Invoke(DISPID_ADD, IID_NULL, 0, DISPATCH_METHOD, &params, &result, nullptr, nullptr) == S_OK);
+	TEST_TRUE(V_I4(&result) == 42);
+
+	::VariantClear(&args[1]);
+}
+TEST_CASE_END
+
+TEST_CASE("an argument that cannot be coerced is reported as a type mismatch")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	VARIANT args[2];
+
+	V_VT(&args[1]) = VT_I4;   V_I4(&args[1])   = 40;
+	V_VT(&args[0]) = VT_BSTR; V_BSTR(&args[0]) = ::SysAllocString(OLESTR("not a number"));
+
+	DISPPARAMS params = { args, nullptr, 2, 0 };
+	VARIANT    result;
+	UINT       argError = UINT_MAX;
+
+	::VariantInit(&result);
+
+	TEST_TRUE(object->Invoke(DISPID_ADD, IID_NULL, 0, DISPATCH_METHOD, &params, &result, nullptr, &argError) == DISP_E_TYPEMISMATCH);
+	TEST_TRUE(argError == 0);
+
+	::VariantClear(&args[0]);
+}
+TEST_CASE_END
+
+TEST_CASE("invoking a member with the wrong number of arguments fails")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	VARIANT args[1];
+
+	V_VT(&args[0]) = VT_I4; V_I4(&args[0]) = 2;
+
+	DISPPARAMS params = { args, nullptr, 1, 0 };
+
+	TEST_TRUE(object->Invoke(DISPID_ADD, IID_NULL, 0, DISPATCH_METHOD, &params, nullptr, nullptr, nullptr) == DISP_E_BADPARAMCOUNT);
+}
+TEST_CASE_END
+
+TEST_CASE("a property getter returns its value")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	DISPPARAMS params = { nullptr, nullptr, 0, 0 };
+	VARIANT    result;
+
+	::VariantInit(&result);
+
+	TEST_TRUE(object->Invoke(DISPID_NAME, IID_NULL, 0, DISPATCH_PROPERTYGET, &params, &result, nullptr, nullptr) == S_OK);
+	TEST_TRUE(V_VT(&result) == VT_BSTR);
+	TEST_TRUE(wcscmp(V_BSTR(&result), L"TestDispatch") == 0);
+
+	::VariantClear(&result);
+}
+TEST_CASE_END
+
+TEST_CASE("invoking an unknown member or an unsupported kind of access fails")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	DISPPARAMS params = { nullptr, nullptr, 0, 0 };
+
+	TEST_TRUE(object->Invoke(99, IID_NULL, 0, DISPATCH_METHOD, &params, nullptr, nullptr, nullptr) == DISP_E_MEMBERNOTFOUND);
+	TEST_TRUE(object->Invoke(DISPID_NAME, IID_NULL, 0, DISPATCH_PROPERTYPUT, &params, nullptr, nullptr, nullptr) == DISP_E_MEMBERNOTFOUND);
+}
+TEST_CASE_END
+
+TEST_CASE("names are mapped to their dispatch IDs case-insensitively")
+{
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+
+	LPOLESTR name = OLESTR("aDD");
+	DISPID   id   = DISPID_UNKNOWN;
+
+	TEST_TRUE(object->GetIDsOfNames(IID_NULL, &name, 1, 0, &id) == S_OK);
+	TEST_TRUE(id == DISPID_ADD);
+
+	LPOLESTR unknown = OLESTR("Subtract");
+
+	TEST_TRUE(object->GetIDsOfNames(IID_NULL, &unknown, 1, 0, &id) == DISP_E_UNKNOWNNAME);
+	TEST_TRUE(id == DISPID_UNKNOWN);
+}
+TEST_CASE_END
+
+TEST_CASE("boolean and date properties are passed as VT_BOOL and VT_DATE")
+{
+	typedef WCL::ComPtr<IDispatch> IDispatchPtr;
+
+	TestServer   server;
+	IDispatchPtr object(new TestProperties, true);
+
+	VARIANT args[1];
+	DISPID  named = DISPID_PROPERTYPUT;
+
+	V_VT(&args[0]) = VT_I4; V_I4(&args[0]) = 1;
+
+	DISPPARAMS putParams = { args, &named, 1, 1 };
+	DISPPARAMS getParams = { nullptr, nullptr, 0, 0 };
+	VARIANT    result;
+
+	::VariantInit(&result);
+
+	TEST_TRUE(object->Invoke(1, IID_NULL, 0, DISPATCH_PROPERTYPUT, &putParams, nullptr, nullptr, nullptr) == S_OK);
+	TEST_TRUE(object->Invoke(1, IID_NULL, 0, DISPATCH_PROPERTYGET, &getParams, &result, nullptr, nullptr) == S_OK);
+	TEST_TRUE(V_VT(&result) == VT_BOOL);
+	TEST_TRUE(V_BOOL(&result) == VARIANT_TRUE);
+
+	TEST_TRUE(object->Invoke(2, IID_NULL, 0, DISPATCH_PROPERTYGET, &getParams, &result, nullptr, nullptr) == S_OK);
+	TEST_TRUE(V_VT(&result) == VT_DATE);
+}
+TEST_CASE_END
+
+TEST_CASE("string arguments are coerced using the caller's locale")
+{
+	typedef WCL::ComPtr<IDispatch> IDispatchPtr;
+
+	const LCID usEnglish = MAKELCID(MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US), SORT_DEFAULT);
+	const LCID ukEnglish = MAKELCID(MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_UK), SORT_DEFAULT);
+
+	TestServer   server;
+	IDispatchPtr object(new TestProperties, true);
+
+	VARIANT args[1];
+	DISPID  named = DISPID_PROPERTYPUT;
+
+	V_VT(&args[0]) = VT_BSTR; V_BSTR(&args[0]) = ::SysAllocString(OLESTR("2/1/2000"));
+
+	DISPPARAMS putParams = { args, &named, 1, 1 };
+	DISPPARAMS getParams = { nullptr, nullptr, 0, 0 };
+	VARIANT    usDate, ukDate;
+
+	::VariantInit(&usDate);
+	::VariantInit(&ukDate);
+
+	TEST_TRUE(object->Invoke(2, IID_NULL, usEnglish, DISPATCH_PROPERTYPUT, &putParams, nullptr, nullptr, nullptr) == S_OK);
+	TEST_TRUE(object->Invoke(2, IID_NULL, usEnglish, DISPATCH_PROPERTYGET, &getParams, &usDate, nullptr, nullptr) == S_OK);
+	TEST_TRUE(object->Invoke(2, IID_NULL, ukEnglish, DISPATCH_PROPERTYPUT, &putParams, nullptr, nullptr, nullptr) == S_OK);
+	TEST_TRUE(object->Invoke(2, IID_NULL, ukEnglish, DISPATCH_PROPERTYGET, &getParams, &ukDate, nullptr, nullptr) == S_OK);
+
+	// The US reading is the 1st of February, the UK reading the 2nd of January.
+	TEST_TRUE(V_DATE(&usDate) - V_DATE(&ukDate) == 30.0);
+
+	::VariantClear(&args[0]);
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Dispatch table throughput compared to the type library.
+
+BENCHMARK(DispatchTableInvoke)
+{
+	typedef WCL::ComPtr<ITestDispatch> ITestDispatchPtr;
+
+	TestServer       server;
+	ITestDispatchPtr object(new TestDispatch, true);
+	ITypeInfo*       typeInfo = server.GetTypeInfo(IID_ITestDispatch);
+
+	const size_t iterations = 100000;
+
+	VARIANT args[2];
+
+	V_VT(&args[1]) = VT_I4; V_I4(&args[1]) = 40;
+	V_VT(&args[0]) = VT_I4; V_I4(&args[0]) = 2;
+
+	DISPPARAMS params = { args, nullptr, 2, 0 };
+	VARIANT    result;
+
+	::VariantInit(&result);
+
+	Stopwatch tableTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		object->Invoke(DISPID_ADD, IID_NULL, 0, DISPATCH_METHOD, &params, &result, nullptr, nullptr);
+
+	ReportBenchmark("DispatchTableImpl::Invoke", iterations, tableTimer.ElapsedMs());
+
+	Stopwatch typeInfoTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		typeInfo->Invoke(object.get(), DISPID_ADD, DISPATCH_METHOD, &params, &result, nullptr, nullptr);
+
+	ReportBenchmark("ITypeInfo::Invoke", iterations, typeInfoTimer.ElapsedMs());
+}
@@ -7,12 +7,18 @@
 #include <Core/UnitTest.hpp>
 #include <WCL/ComPtr.hpp>
 #include <WCL/ComStr.hpp>
+#include <COM/ErrorObject.hpp>
+#include "Benchmark.hpp"
 
 #if (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 2)) // GCC 4.2+
 // missing initializer for member 'X'
 #pragma GCC diagnostic ignored "-Wmissing-field-initializers"
 #endif
 
+#ifndef _MSC_VER
+WCL_DECLARE_IFACETRAITS(ICreateErrorInfo, IID_ICreateErrorInfo);
+#endif
+
 TEST_SET(ErrorInfo)
 {
 	typedef WCL::ComPtr<IErrorInfo> IErrorInfoPtr;
@@ -59,5 +65,174 @@ TEST_CASE("throwing a COM error passes the function and error message")
 }
 TEST_CASE_END
 
+TEST_CASE("throwing a COM error can pass the interface and help details")
+{
+	const GUID   TEST_GUID = { 0x12345678, 0x1234, 0x1234, { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } };
+	const tchar* TEST_HELP_FILE = TXT("C:\\Help\\Test.chm");
+	const DWORD  TEST_HELP_CONTEXT = 42;
+
+	bool thrown = COM::SetComErrorInfo(TEST_GUID, __FUNCTION__, TXT("Description"), TEST_HELP_FILE, TEST_HELP_CONTEXT);
+
+	TEST_TRUE(thrown == true);
+
+	IErrorInfoPtr pErrorInfo;
+
+	TEST_TRUE(::GetErrorInfo(0, AttachTo(pErrorInfo)) == S_OK);
+
+	GUID		oGUID = { 0 };
+	WCL::ComStr bstrHelpFile;
+	DWORD		dwHelpContext = 0;
+
+	TEST_TRUE(pErrorInfo->GetGUID(&oGUID) == S_OK);
+	TEST_TRUE(oGUID == TEST_GUID);
+
+	TEST_TRUE(pErrorInfo->GetHelpFile(AttachTo(bstrHelpFile)) == S_OK);
+	TEST_TRUE(wcscmp(bstrHelpFile.Get(), T2W(TEST_HELP_FILE)) == 0);
+
+	TEST_TRUE(pErrorInfo->GetHelpContext(&dwHelpContext) == S_OK);
+	TEST_TRUE(dwHelpContext == TEST_HELP_CONTEXT);
+}
+TEST_CASE_END
+
+TEST_CASE("a long description is returned in full")
+{
+	tstring description(4096, TXT('X'));
+
+	TEST_TRUE(COM::SetComErrorInfo(__FUNCTION__, description.c_str()) == true);
+
+	IErrorInfoPtr pErrorInfo;
+	WCL::ComStr   bstrDescription;
+
+	TEST_TRUE(::GetErrorInfo(0, AttachTo(pErrorInfo)) == S_OK);
+	TEST_TRUE(pErrorInfo->GetDescription(AttachTo(bstrDescription)) == S_OK);
+	TEST_TRUE(wcslen(bstrDescription.Get()) == description.length());
+}
+TEST_CASE_END
+
+TEST_CASE("a recycled error object only returns its own strings")
+{
+	const tchar* TEST_DESCRIPTION = TXT("Description");
+	const tchar* TEST_HELP_FILE = TXT("C:\\Help\\Test.chm");
+
+	tstring longDescription(4096, TXT('X'));
+
+	TEST_TRUE(COM::SetComErrorInfo(GUID_NULL, __FUNCTION__, longDescription.c_str(), TEST_HELP_FILE, 0) == true);
+	::SetErrorInfo(0, nullptr);
+
+	TEST_TRUE(COM::SetComErrorInfo(__FUNCTION__, TEST_DESCRIPTION) == true);
+
+	IErrorInfoPtr pErrorInfo;
+	WCL::ComStr   bstrDescription;
+	WCL::ComStr   bstrHelpFile;
+
+	TEST_TRUE(::GetErrorInfo(0, AttachTo(pErrorInfo)) == S_OK);
+	TEST_TRUE(pErrorInfo->GetDescription(AttachTo(bstrDescription)) == S_OK);
+	TEST_TRUE(wcscmp(bstrDescription.Get(), T2W(TEST_DESCRIPTION)) == 0);
+	TEST_TRUE(pErrorInfo->GetHelpFile(AttachTo(bstrHelpFile)) == S_OK);
+	TEST_TRUE(bstrHelpFile.Get() == nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("an error object is marshalled by value as a system error object")
+{
+	typedef WCL::ComPtr<ICreateErrorInfo> ICreateErrorInfoPtr;
+
+	TEST_TRUE(COM::SetComErrorInfo(__FUNCTION__, TXT("Description")) == true);
+
+	IErrorInfoPtr pErrorInfo;
+
+	TEST_TRUE(::GetErrorInfo(0, AttachTo(pErrorInfo)) == S_OK);
+
+	ICreateErrorInfoPtr pSystemInfo;
+	IMarshal*           pSystemMarshal = nullptr;
+	IMarshal*           pMarshal = nullptr;
+	CLSID               oSystemClass = CLSID_NULL;
+	CLSID               oClass = CLSID_NULL;
+
+	TEST_TRUE(::CreateErrorInfo(AttachTo(pSystemInfo)) == S_OK);
+	TEST_TRUE(pSystemInfo->QueryInterface(IID_IMarshal, reinterpret_cast<void**>(&pSystemMarshal)) == S_OK);
+	TEST_TRUE(pErrorInfo->QueryInterface(IID_IMarshal, reinterpret_cast<void**>(&pMarshal)) == S_OK);
+
+	TEST_TRUE(pSystemMarshal->GetUnmarshalClass(IID_IErrorInfo, pSystemInfo.get(), MSHCTX_LOCAL, nullptr, MSHLFLAGS_NORMAL, &oSystemClass) == S_OK);
+	TEST_TRUE(pMarshal->GetUnmarshalClass(IID_IErrorInfo, pErrorInfo.get(), MSHCTX_LOCAL, nullptr, MSHLFLAGS_NORMAL, &oClass) == S_OK);
+	TEST_TRUE(IsEqualCLSID(oClass, oSystemClass));
+
+	pMarshal->Release();
+	pSystemMarshal->Release();
+
+	IStream* pStream = nullptr;
+
+	TEST_TRUE(::CreateStreamOnHGlobal(NULL, TRUE, &pStream) == S_OK);
+	TEST_TRUE(::CoMarshalInterface(pStream, IID_IErrorInfo, pErrorInfo.get(), MSHCTX_LOCAL, nullptr, MSHLFLAGS_NORMAL) == S_OK);
+
+	LARGE_INTEGER oStart = { 0 };
+	IErrorInfoPtr pCopy;
+	WCL::ComStr   bstrDescription;
+
+	TEST_TRUE(pStream->Seek(oStart, STREAM_SEEK_SET, nullptr) == S_OK);
+	TEST_TRUE(::CoUnmarshalInterface(pStream, IID_IErrorInfo, reinterpret_cast<void**>(AttachTo(pCopy))) == S_OK);
+	TEST_TRUE(pCopy.get() != pErrorInfo.get());
+	TEST_TRUE(pCopy->GetDescription(AttachTo(bstrDescription)) == S_OK);
+	TEST_TRUE(wcscmp(bstrDescription.Get(), L"Description") == 0);
+
+	pStream->Release();
+	::SetErrorInfo(0, nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("error objects are recycled rather than allocated for each error")
+{
+	COM::SetComErrorInfo(__FUNCTION__, TXT("Description"));
+
+	long highWaterMark = COM::ObjectPool<COM::ErrorObject>::HighWaterMark();
+
+	for (size_t i = 0; i != 1000; ++i)
+		COM::SetComErrorInfo(__FUNCTION__, TXT("Description"));
+
+	TEST_TRUE(COM::ObjectPool<COM::ErrorObject>::HighWaterMark() == highWaterMark);
+	TEST_TRUE(COM::ErrorObject::Outstanding() == 1);
+
+	::SetErrorInfo(0, nullptr);
+
+	TEST_TRUE(COM::ErrorObject::Outstanding() == 0);
+}
+TEST_CASE_END
+
 }
 TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Pooled error object throughput compared to CreateErrorInfo.
+
+BENCHMARK(ErrorObjectPooling)
+{
+	typedef WCL::ComPtr<IErrorInfo> IErrorInfoPtr;
+	typedef WCL::ComPtr<ICreateErrorInfo> ICreateErrorInfoPtr;
+
+	const size_t iterations = 100000;
+
+	Stopwatch pooledTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		COM::SetComErrorInfo(__FUNCTION__, TXT("Description"));
+
+	ReportBenchmark("SetComErrorInfo", iterations, pooledTimer.ElapsedMs());
+
+	Stopwatch createTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+	{
+		ICreateErrorInfoPtr pCreateErrorInfo;
+		IErrorInfoPtr       pErrorInfo;
+
+		::CreateErrorInfo(AttachTo(pCreateErrorInfo));
+		pCreateErrorInfo->SetSource(const_cast<wchar_t*>(A2W(__FUNCTION__)));
+		pCreateErrorInfo->SetDescription(const_cast<wchar_t*>(T2W(TXT("Description"))));
+		QueryInterface(pCreateErrorInfo, pErrorInfo);
+		::SetErrorInfo(0, pErrorInfo.get());
+	}
+
+	ReportBenchmark("CreateErrorInfo", iterations, createTimer.ElapsedMs());
+
+	::SetErrorInfo(0, nullptr);
+}
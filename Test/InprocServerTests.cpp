@@ -6,6 +6,108 @@
 #include "Common.hpp"
 #include <Core/UnitTest.hpp>
 #include "TestClasses.hpp"
+#include <WCL/Module.hpp>
+#include <COM/ComUtils.hpp>
+#include "Benchmark.hpp"
+
+//! The number of threads used by the lock count stress tests.
+static const size_t STRESS_THREADS = 32;
+
+//! The number of lock/unlock pairs each stress test thread performs.
+static const size_t STRESS_ITERATIONS = 10000;
+
+//! The number of times the benchmarks repeat the stress test.
+static const size_t BENCHMARK_RUNS = 10;
+
+//! The number of locks each stress test thread leaves held.
+static const size_t STRESS_HELD_LOCKS = 3;
+
+//! The number of objects created in each round of the class census test.
+static const size_t CENSUS_OBJECTS = 10;
+
+//! The number of rounds of the class census test.
+static const size_t CENSUS_ROUNDS = 100;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The class used by the class census tests, so that it has a census of its own.
+
+class CensusTestClass : public COM::ObjectBase<ITestInterface>
+{
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Release the objects created by another thread.
+
+static DWORD WINAPI ReleaseObjectsThread(LPVOID pParam)
+{
+	CensusTestClass** objects = static_cast<CensusTestClass**>(pParam);
+
+	for (size_t i = 0; i != CENSUS_OBJECTS; ++i)
+		objects[i]->Release();
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Lock and unlock the server repeatedly, leaving a few locks held.
+
+static DWORD WINAPI LockServerThread(LPVOID pParam)
+{
+	COM::Server& server = *static_cast<COM::Server*>(pParam);
+
+	for (size_t i = 0; i != STRESS_ITERATIONS; ++i)
+	{
+		server.Lock();
+		server.Unlock();
+	}
+
+	for (size_t i = 0; i != STRESS_HELD_LOCKS; ++i)
+		server.Lock();
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Increment and decrement a single shared counter repeatedly, for comparison.
+
+static DWORD WINAPI LockSingleCounterThread(LPVOID pParam)
+{
+	volatile LONG* pCount = static_cast<volatile LONG*>(pParam);
+
+	for (size_t i = 0; i != STRESS_ITERATIONS; ++i)
+	{
+		::InterlockedIncrement(pCount);
+		::InterlockedDecrement(pCount);
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the function on a number of threads and wait for them all to finish.
+
+static double RunOnThreads(LPTHREAD_START_ROUTINE pfnThread, LPVOID pParam)
+{
+	HANDLE ahThreads[STRESS_THREADS];
+
+	Stopwatch timer;
+
+	for (size_t i = 0; i != STRESS_THREADS; ++i)
+		ahThreads[i] = ::CreateThread(nullptr, 0, pfnThread, pParam, 0, nullptr);
+
+	::WaitForMultipleObjects(STRESS_THREADS, ahThreads, TRUE, INFINITE);
+
+	double elapsed = timer.ElapsedMs();
+
+	for (size_t i = 0; i != STRESS_THREADS; ++i)
+		::CloseHandle(ahThreads[i]);
+
+	return elapsed;
+}
 
 TEST_SET(InprocServer)
 {
@@ -26,6 +128,97 @@ TEST_CASE("locking and unlocking the server modifies the lock count")
 }
 TEST_CASE_END
 
+TEST_CASE("the lock count is exact when the server is locked and unlocked concurrently")
+{
+	TestServer server;
+
+	long count = server.LockCount();
+
+	RunOnThreads(LockServerThread, static_cast<COM::Server*>(&server));
+
+	TEST_TRUE(server.LockCount() == count + static_cast<long>(STRESS_THREADS * STRESS_HELD_LOCKS));
+
+	for (size_t i = 0; i != STRESS_THREADS * STRESS_HELD_LOCKS; ++i)
+		server.Unlock();
+
+	TEST_TRUE(server.LockCount() == count);
+}
+TEST_CASE_END
+
+TEST_CASE("by default an idle server can be unloaded immediately")
+{
+	TestServer server;
+
+	// Discard any error object left by an earlier test.
+	::SetErrorInfo(0, nullptr);
+
+	TEST_TRUE(server.CanUnload() == true);
+
+	server.Lock();
+
+	TEST_TRUE(server.CanUnload() == false);
+
+	server.Unlock();
+
+	TEST_TRUE(server.CanUnload() == true);
+	TEST_TRUE(server.DeferredUnloads() == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("an idle timeout defers unloading and counts the deferrals followed by reuse")
+{
+	TestServer server;
+
+	server.SetUnloadPolicy(60*1000, 0, 0);
+
+	TEST_TRUE(server.CanUnload() == false);
+	TEST_TRUE(server.CanUnload() == false);
+	TEST_TRUE(server.DeferredUnloads() == 0);
+
+	server.Lock();
+	server.Unlock();
+
+	TEST_TRUE(server.CanUnload() == false);
+	TEST_TRUE(server.DeferredUnloads() == 1);
+
+	server.SetUnloadPolicy(0, 0, 0);
+	::SetErrorInfo(0, nullptr);
+
+	TEST_TRUE(server.CanUnload() == true);
+}
+TEST_CASE_END
+
+TEST_CASE("a server loaded too often within the load window stays resident")
+{
+	TestServer server;
+
+	server.SetUnloadPolicy(0, 1, 60*1000);
+
+	TEST_TRUE(server.CanUnload() == false);
+	TEST_TRUE(server.RecentLoads() >= 1);
+}
+TEST_CASE_END
+
+TEST_CASE("an outstanding error object holds a server lock")
+{
+	TestServer server;
+
+	::SetErrorInfo(0, nullptr);
+
+	long count = server.LockCount();
+
+	COM::SetComErrorInfo(__FUNCTION__, TXT("Description"));
+
+	TEST_TRUE(server.LockCount() == count+1);
+	TEST_TRUE(server.CanUnload() == false);
+
+	::SetErrorInfo(0, nullptr);
+
+	TEST_TRUE(server.LockCount() == count);
+	TEST_TRUE(server.CanUnload() == true);
+}
+TEST_CASE_END
+
 TEST_CASE("this provides access to the current global instance")
 {
 	TestServer server;
@@ -45,5 +238,196 @@ TEST_CASE("loading the type library returns a valid object")
 }
 TEST_CASE_END
 
+TEST_CASE("the type library is loaded once and then shared until it is released")
+{
+	TestServer server;
+
+	COM::ITypeLibPtr first = server.LoadTypeLibrary();
+
+	TEST_TRUE(server.LoadTypeLibrary().get() == first.get());
+
+	server.ReleaseTypeLibrary();
+
+	TEST_TRUE(server.LoadTypeLibrary().get() != nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("getting the type information for a dual interface returns the same shared object")
+{
+	TestServer server;
+
+	CModule oModule(::GetModuleHandle(NULL)); // Simulate DLL load/unload.
+
+	ITypeInfo* first = server.GetTypeInfo(IID_ITestDispatch);
+
+	TEST_TRUE(first != nullptr);
+	TEST_TRUE(server.GetTypeInfo(IID_ITestDispatch) == first);
+}
+TEST_CASE_END
+
+TEST_CASE("getting the type information for an unknown interface throws")
+{
+	TestServer server;
+
+	CModule oModule(::GetModuleHandle(NULL)); // Simulate DLL load/unload.
+
+	TEST_THROWS(server.GetTypeInfo(IID_ITestInterface));
+}
+TEST_CASE_END
+
+TEST_CASE("the class census counts the live, peak and created objects of a class")
+{
+	TestServer      server;
+	COM::ClassStats before;
+	COM::ClassStats after;
+
+	TEST_TRUE(server.GetClassStats(CLSID_TestClass, before));
+
+	TestClass* objects[3];
+
+	for (size_t i = 0; i != 3; ++i)
+	{
+		objects[i] = new TestClass;
+		objects[i]->AddRef();
+	}
+
+	objects[0]->Release();
+	objects[1]->Release();
+
+	TEST_TRUE(server.GetClassStats(CLSID_TestClass, after));
+	TEST_TRUE(after.m_nLive == before.m_nLive+1);
+	TEST_TRUE(after.m_nPeak >= before.m_nLive+3);
+	TEST_TRUE(after.m_nCreated == before.m_nCreated+3);
+	TEST_TRUE(after.m_nBytes == after.m_nLive * sizeof(TestClass));
+
+	objects[2]->Release();
+
+	TEST_TRUE(server.GetClassStats(CLSID_TestClass, after));
+	TEST_TRUE(after.m_nLive == before.m_nLive);
+}
+TEST_CASE_END
+
+TEST_CASE("the class census peak is unaffected by objects being released on another thread")
+{
+	TestServer          server;
+	COM::ClassCounters& counters = COM::ClassCounters::Of<CensusTestClass>();
+
+	for (size_t round = 0; round != CENSUS_ROUNDS; ++round)
+	{
+		CensusTestClass* objects[CENSUS_OBJECTS];
+
+		for (size_t i = 0; i != CENSUS_OBJECTS; ++i)
+		{
+			objects[i] = new CensusTestClass;
+			objects[i]->AddRef();
+		}
+
+		HANDLE thread = ::CreateThread(nullptr, 0, ReleaseObjectsThread, objects, 0, nullptr);
+
+		::WaitForSingleObject(thread, INFINITE);
+		::CloseHandle(thread);
+	}
+
+	COM::ClassStats stats = counters.Stats();
+
+	TEST_TRUE(stats.m_nLive == 0);
+	TEST_TRUE(stats.m_nPeak == static_cast<long>(CENSUS_OBJECTS));
+	TEST_TRUE(stats.m_nCreated == CENSUS_OBJECTS * CENSUS_ROUNDS);
+
+	LONG high = 0;
+
+	for (size_t i = 0; i != COM::ClassCounters::NUM_STRIPES; ++i)
+	{
+		if (counters.m_aoStripes[i].m_nHigh > high)
+			high = counters.m_aoStripes[i].m_nHigh;
+	}
+
+	// The creating thread's stripe only reached a new high in the first round.
+	TEST_TRUE(high == static_cast<LONG>(CENSUS_OBJECTS));
+}
+TEST_CASE_END
+
+TEST_CASE("the class census is only available for classes in the class factory table")
+{
+	TestServer      server;
+	COM::ClassStats stats;
+
+	TEST_TRUE(!server.GetClassStats(CLSID_TestLocalClass, stats));
+}
+TEST_CASE_END
+
+TEST_CASE("the class census report has a line for every class")
+{
+	TestServer server;
+
+	tstring report = server.FormatClassCensus();
+
+	TEST_TRUE(report.find(COM::FormatGUID(CLSID_TestClass)) != tstring::npos);
+	TEST_TRUE(report.find(TXT("TestApartmentClass: live=")) != tstring::npos);
+}
+TEST_CASE_END
+
 }
 TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Striped lock count throughput compared to a single shared counter.
+
+BENCHMARK(LockCountStriping)
+{
+	const size_t iterations = BENCHMARK_RUNS * STRESS_THREADS * STRESS_ITERATIONS;
+
+	TestServer server;
+
+	double striped = 0.0;
+
+	for (size_t run = 0; run != BENCHMARK_RUNS; ++run)
+	{
+		striped += RunOnThreads(LockServerThread, static_cast<COM::Server*>(&server));
+
+		for (size_t i = 0; i != STRESS_THREADS * STRESS_HELD_LOCKS; ++i)
+			server.Unlock();
+	}
+
+	ReportBenchmark("Server lock/unlock (striped)", iterations, striped);
+
+	volatile LONG counter = 0;
+	double        single  = 0.0;
+
+	for (size_t run = 0; run != BENCHMARK_RUNS; ++run)
+		single += RunOnThreads(LockSingleCounterThread, const_cast<LONG*>(&counter));
+
+	ReportBenchmark("Server lock/unlock (single counter)", iterations, single);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Loading throughput of the cached type library compared to the module file.
+
+BENCHMARK(TypeLibraryLoading)
+{
+	const size_t iterations = 1000;
+
+	TestServer server;
+
+	server.LoadTypeLibrary();
+
+	tstring path = CModule::This().Path().c_str();
+
+	Stopwatch fileTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+	{
+		COM::ITypeLibPtr typeLib;
+
+		::LoadTypeLibEx(T2W(path), REGKIND_NONE, AttachTo(typeLib));
+	}
+
+	ReportBenchmark("LoadTypeLibEx", iterations, fileTimer.ElapsedMs());
+
+	Stopwatch cachedTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		server.LoadTypeLibrary();
+
+	ReportBenchmark("COM::Server::LoadTypeLibrary", iterations, cachedTimer.ElapsedMs());
+}
@@ -0,0 +1,171 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   LocalServerTests.cpp
+//! \brief  The unit tests for the LocalServer class.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include <COM/RegUtils.hpp>
+#include <WCL/ComPtr.hpp>
+#include <WCL/Module.hpp>
+#include "Benchmark.hpp"
+
+namespace
+{
+
+//! The IDispatch smart-pointer type.
+typedef WCL::ComPtr<IDispatch> IDispatchPtr;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create the server details for the test harness as a local server.
+
+COM::ServerRegInfo TestLocalServerInfo()
+{
+	COM::ServerRegInfo server;
+
+	server.m_eType      = COM::LOCAL_SERVER;
+	server.m_strFile    = CModule::This().Path().c_str();
+	server.m_strLibrary = TXT("TestLocalServer");
+	server.m_oLIBID     = LIBID_TestServerLib;
+
+	return server;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Joins the MTA for the lifetime of the object, if the thread isn't already
+//! in an STA.
+
+class MultiThreadedApartment : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	MultiThreadedApartment()
+		: m_hrInit(::CoInitializeEx(nullptr, COINIT_MULTITHREADED))
+	{
+	}
+
+	//! Destructor.
+	~MultiThreadedApartment()
+	{
+		if (SUCCEEDED(m_hrInit))
+			::CoUninitialize();
+	}
+
+private:
+	//
+	// Members.
+	//
+	HRESULT	m_hrInit;	//!< The result of joining the apartment.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Registers the test local server class for the current user for the
+//! lifetime of the object, so that it is unregistered however the test exits.
+
+class LocalClassRegistration : private Core::NotCopyable
+{
+public:
+	//! Default constructor.
+	LocalClassRegistration()
+	{
+		COM::RegisterCLSID(COM::USER, TestLocalServerInfo(), CLSID_TestLocalClass, TXT("TestLocalClass"), TXT("1"), COM::FREE_THREAD_APT);
+	}
+
+	//! Destructor.
+	~LocalClassRegistration()
+	{
+		COM::UnregisterCLSID(COM::USER, TestLocalServerInfo(), CLSID_TestLocalClass, TXT("TestLocalClass"), TXT("1"));
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create an instance of the test local server class.
+
+HRESULT CreateLocalObject(IDispatchPtr& object)
+{
+	return ::CoCreateInstance(CLSID_TestLocalClass, nullptr, CLSCTX_LOCAL_SERVER, IID_IDispatch, reinterpret_cast<void**>(AttachTo(object)));
+}
+
+//namespace
+}
+
+TEST_SET(LocalServer)
+{
+
+TEST_CASE("the embedding switch is recognised in either form and case")
+{
+	TEST_TRUE(COM::LocalServer::IsEmbedding(TXT("-Embedding")));
+	TEST_TRUE(COM::LocalServer::IsEmbedding(TXT("/embedding")));
+	TEST_TRUE(!COM::LocalServer::IsEmbedding(TXT("-RegServer")));
+}
+TEST_CASE_END
+
+TEST_CASE("an out-of-process object can be created and called")
+{
+	MultiThreadedApartment apartment;
+	LocalClassRegistration registration;
+
+	IDispatchPtr object;
+
+	TEST_TRUE(CreateLocalObject(object) == S_OK);
+
+	if (object.get() != nullptr)
+	{
+		long result = 0;
+
+		TEST_TRUE(InvokeAdd(object.get(), 1, 2, result) == S_OK);
+		TEST_TRUE(result == 3);
+
+		IDispatchPtr other;
+		long         otherResult = 0;
+
+		TEST_TRUE(CreateLocalObject(other) == S_OK);
+		TEST_TRUE((other.get() != nullptr) && (InvokeAdd(other.get(), 3, 4, otherResult) == S_OK));
+		TEST_TRUE(otherResult == 7);
+	}
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create-call-release round trip throughput of an out-of-process object.
+
+BENCHMARK(LocalServerRoundTrips)
+{
+	const size_t iterations = 1000;
+
+	MultiThreadedApartment apartment;
+	LocalClassRegistration registration;
+
+	// Launch the server and keep it running for the benchmark.
+	IDispatchPtr keepAlive;
+
+	HRESULT hr = CreateLocalObject(keepAlive);
+
+	if (FAILED(hr))
+		throw WCL::ComException(hr, TXT("Failed to launch the local server"));
+
+	long result = 0;
+
+	Stopwatch timer;
+
+	for (size_t i = 0; i != iterations; ++i)
+	{
+		IDispatchPtr object;
+
+		hr = CreateLocalObject(object);
+
+		if (FAILED(hr))
+			throw WCL::ComException(hr, TXT("Failed to create the local object"));
+
+		hr = InvokeAdd(object.get(), static_cast<long>(i), 1, result);
+
+		if (FAILED(hr))
+			throw WCL::ComException(hr, TXT("Failed to call the local object"));
+	}
+
+	ReportBenchmark("LocalServer create-call-release", iterations, timer.ElapsedMs());
+}
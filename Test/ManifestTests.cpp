@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ManifestTests.cpp
+//! \brief  The unit tests for the registration-free COM manifest functions.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include <COM/Manifest.hpp>
+#include <COM/ServerRegInfo.hpp>
+#include <COM/ComUtils.hpp>
+#include "TestClasses.hpp"
+
+namespace
+{
+
+//! A second class ID for the tests.
+const CLSID CLSID_OtherClass = { 0x01234567, 0x89AB, 0xCDEF, { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF } };
+
+//! The registration table used by the tests.
+const COM::ClassRegInfo TEST_CLASSES[] =
+{
+	{ &CLSID_TestClass,  TXT("TestClass"),  TXT("1"), COM::SINGLE_THREAD_APT },
+	{ &CLSID_OtherClass, TXT("OtherClass"), TXT("2"), COM::MAIN_THREAD_APT   },
+	{ nullptr,           nullptr,           nullptr,  static_cast<COM::ThreadingModel>(0) }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Create the server details used by the tests.
+
+COM::ServerRegInfo TestServerInfo()
+{
+	COM::ServerRegInfo server;
+
+	server.m_eType      = COM::INPROC_SERVER;
+	server.m_strFile    = TXT("C:\\Program Files\\Test\\TestServer.dll");
+	server.m_strLibrary = TXT("TestServer");
+	server.m_oLIBID     = LIBID_TestServerLib;
+	server.m_nMajor     = 1;
+	server.m_nMinor     = 2;
+
+	return server;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if the manifest contains the text.
+
+bool Contains(const tstring& strManifest, const tstring& strText)
+{
+	return (strManifest.find(strText) != tstring::npos);
+}
+
+//namespace
+}
+
+TEST_SET(Manifest)
+{
+
+TEST_CASE("the assembly is named after the library and only refers to the file name of the server")
+{
+	tstring manifest = COM::FormatManifest(TestServerInfo(), TEST_CLASSES);
+
+	TEST_TRUE(Contains(manifest, TXT("<assemblyIdentity type=\"win32\" name=\"TestServer\" version=\"1.2.0.0\"/>")));
+	TEST_TRUE(Contains(manifest, TXT("<file name=\"TestServer.dll\">")));
+	TEST_TRUE(!Contains(manifest, TXT("Program Files")));
+}
+TEST_CASE_END
+
+TEST_CASE("each class has its CLSID, ProgIDs and type library")
+{
+	tstring manifest = COM::FormatManifest(TestServerInfo(), TEST_CLASSES);
+	tstring clsid    = COM::FormatGUID(CLSID_TestClass);
+	tstring libid    = COM::FormatGUID(LIBID_TestServerLib);
+
+	TEST_TRUE(Contains(manifest, TXT("<comClass clsid=\"") + clsid + TXT("\" threadingModel=\"Apartment\" progid=\"TestServer.TestClass.1\" tlbid=\"") + libid + TXT("\" description=\"TestClass Class\">")));
+	TEST_TRUE(Contains(manifest, TXT("<progid>TestServer.TestClass</progid>")));
+	TEST_TRUE(Contains(manifest, TXT("<typelib tlbid=\"") + libid + TXT("\" version=\"1.2\" helpdir=\"\"/>")));
+}
+TEST_CASE_END
+
+TEST_CASE("a class which runs in the main STA has no threading model")
+{
+	tstring manifest = COM::FormatManifest(TestServerInfo(), TEST_CLASSES);
+	tstring clsid    = COM::FormatGUID(CLSID_OtherClass);
+
+	TEST_TRUE(Contains(manifest, TXT("<comClass clsid=\"") + clsid + TXT("\" progid=\"TestServer.OtherClass.2\"")));
+}
+TEST_CASE_END
+
+TEST_CASE("special characters in the names are escaped")
+{
+	COM::ServerRegInfo server = TestServerInfo();
+
+	server.m_strLibrary = TXT("Test&\"<Server>");
+
+	tstring manifest = COM::FormatManifest(server, TEST_CLASSES);
+
+	TEST_TRUE(Contains(manifest, TXT("name=\"Test&amp;&quot;&lt;Server&gt;\"")));
+	TEST_TRUE(!Contains(manifest, TXT("Test&\"")));
+}
+TEST_CASE_END
+
+TEST_CASE("writing the manifest to a file encodes it as UTF-8")
+{
+	tchar szFolder[MAX_PATH+1] = { 0 };
+
+	::GetTempPath(MAX_PATH, szFolder);
+
+	tstring file = tstring(szFolder) + TXT("COM.Test.Manifest.manifest");
+
+	COM::WriteManifest(file, TestServerInfo(), TEST_CLASSES);
+
+	HANDLE hFile = ::CreateFile(file.c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	TEST_TRUE(hFile != INVALID_HANDLE_VALUE);
+
+	char  szHeader[6] = { 0 };
+	DWORD dwRead = 0;
+
+	::ReadFile(hFile, szHeader, sizeof(szHeader)-1, &dwRead, nullptr);
+	::CloseHandle(hFile);
+	::DeleteFile(file.c_str());
+
+	TEST_TRUE(strcmp(szHeader, "<?xml") == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("writing to an invalid path throws")
+{
+	TEST_THROWS(COM::WriteManifest(TXT("?:\\Invalid\\Test.manifest"), TestServerInfo(), TEST_CLASSES));
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
@@ -0,0 +1,245 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   MemoryRegistryBackendTests.cpp
+//! \brief  The unit tests for the MemoryRegistryBackend class.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include <COM/MemoryRegistryBackend.hpp>
+#include <COM/RegistrationBatch.hpp>
+#include <COM/ServerRegInfo.hpp>
+#include <COM/ComUtils.hpp>
+#include "Benchmark.hpp"
+
+TEST_SET(MemoryRegistryBackend)
+{
+
+TEST_CASE("creating a key creates any missing parent keys")
+{
+	COM::MemoryRegistryBackend backend;
+
+	backend.CreateKey(TXT("CLSID\\{Class}\\InprocServer32"));
+
+	TEST_TRUE(backend.KeyCount() == 3);
+	TEST_TRUE(backend.KeyExists(TXT("CLSID")));
+	TEST_TRUE(backend.KeyExists(TXT("CLSID\\{Class}")));
+	TEST_TRUE(backend.KeyExists(TXT("CLSID\\{Class}\\InprocServer32")));
+	TEST_TRUE(!backend.KeyExists(TXT("CLSID\\{Other}")));
+}
+TEST_CASE_END
+
+TEST_CASE("key and value names are not case sensitive")
+{
+	COM::MemoryRegistryBackend backend;
+
+	COM::RegistryBackend::Key key = backend.CreateKey(TXT("Server.Class"));
+
+	backend.SetValue(key, TXT("Server.Class"), TXT("Name"), TXT("Value"));
+
+	TEST_TRUE(backend.CreateKey(TXT("SERVER.CLASS")) == key);
+	TEST_TRUE(backend.HasValue(key, TXT("NAME"), TXT("Value")));
+	TEST_TRUE(!backend.HasValue(key, TXT("NAME"), TXT("VALUE")));
+	TEST_TRUE(backend.KeyCount() == 1);
+}
+TEST_CASE_END
+
+TEST_CASE("setting a value replaces any existing value")
+{
+	COM::MemoryRegistryBackend backend;
+	tstring                    value;
+
+	COM::RegistryBackend::Key key = backend.CreateKey(TXT("Server.Class"));
+
+	backend.SetValue(key, TXT("Server.Class"), nullptr, TXT("First"));
+	backend.SetValue(key, TXT("Server.Class"), nullptr, TXT("Second"));
+
+	TEST_TRUE(backend.ValueCount() == 1);
+	TEST_TRUE(backend.GetValue(TXT("Server.Class"), nullptr, value) && (value == TXT("Second")));
+	TEST_TRUE(!backend.GetValue(TXT("Server.Class"), TXT("Missing"), value));
+}
+TEST_CASE_END
+
+TEST_CASE("a key can only be deleted when it has no subkeys")
+{
+	COM::MemoryRegistryBackend backend;
+
+	COM::RegistryBackend::Key key = backend.CreateKey(TXT("Server.Class\\CLSID"));
+
+	backend.SetValue(key, TXT("Server.Class\\CLSID"), nullptr, TXT("{Class}"));
+
+	TEST_TRUE(!backend.DeleteKey(TXT("Server.Class")));
+	TEST_TRUE(backend.DeleteKey(TXT("Server.Class\\CLSID")));
+	TEST_TRUE(backend.DeleteKey(TXT("Server.Class")));
+	TEST_TRUE(!backend.DeleteKey(TXT("Server.Class")));
+	TEST_TRUE(!backend.DeleteKey(TXT("")));
+	TEST_TRUE(backend.KeyCount() == 0);
+	TEST_TRUE(backend.ValueCount() == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("registering a class writes the same keys as the registry")
+{
+	COM::MemoryRegistryBackend backend;
+	COM::ServerRegInfo         server;
+	tstring                    value;
+
+	server.m_strFile    = TXT("C:\\Test\\Server.dll");
+	server.m_strLibrary = TXT("Server");
+
+	const tstring clsid = TXT("{12345678-1234-1234-0102-030405060708}");
+	CLSID         oCLSID;
+
+	TEST_TRUE(COM::ParseGUID(clsid.c_str(), oCLSID));
+
+	{
+		COM::RegistrationBatch batch(backend);
+
+		COM::RegisterCLSID(batch, server, oCLSID, TXT("Class"), TXT("1"), COM::ANY_APARTMENT);
+	}
+
+	TEST_TRUE(backend.GetValue(TXT("Server.Class\\CurVer"), nullptr, value) && (value == TXT("Server.Class.1")));
+	TEST_TRUE(backend.GetValue(TXT("CLSID\\") + clsid + TXT("\\InprocServer32"), nullptr, value) && (value == server.m_strFile));
+	TEST_TRUE(backend.GetValue(TXT("CLSID\\") + clsid + TXT("\\InprocServer32"), TXT("ThreadingModel"), value) && (value == TXT("Both")));
+
+	{
+		COM::RegistrationBatch batch(backend);
+
+		COM::UnregisterCLSID(batch, server, oCLSID, TXT("Class"), TXT("1"));
+	}
+
+	TEST_TRUE(backend.KeyCount() == 1);
+	TEST_TRUE(backend.KeyExists(TXT("CLSID")));
+	TEST_TRUE(backend.ValueCount() == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("a batch opens each registration key once and writes each value once")
+{
+	const size_t classes = 3;
+
+	COM::MemoryRegistryBackend backend;
+	COM::ServerRegInfo         server;
+
+	server.m_strFile    = TXT("C:\\Test\\Test.dll");
+	server.m_strLibrary = TXT("Test");
+
+	std::vector<CLSID> clsids(classes);
+
+	for (size_t i = 0; i != classes; ++i)
+		::CoCreateGuid(&clsids[i]);
+
+	COM::RegistrationBatch registerBatch(backend);
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::RegisterCLSID(registerBatch, server, clsids[i], CString::Fmt(TXT("Class%lu"), static_cast<ulong>(i)).c_str(), TXT("1"), COM::ANY_APARTMENT);
+
+	registerBatch.Commit();
+
+	TEST_TRUE(registerBatch.KeysOpened() == (classes * 10));
+	TEST_TRUE(registerBatch.ValuesWritten() == (classes * 11));
+
+	COM::RegistrationBatch unregisterBatch(backend);
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::UnregisterCLSID(unregisterBatch, server, clsids[i], CString::Fmt(TXT("Class%lu"), static_cast<ulong>(i)).c_str(), TXT("1"));
+
+	unregisterBatch.Commit();
+
+	TEST_TRUE(unregisterBatch.KeysDeleted() == (classes * 10));
+	TEST_TRUE(backend.KeyCount() == 1);
+}
+TEST_CASE_END
+
+TEST_CASE("a key deleted through a batch using a different case is recreated when written again")
+{
+	COM::MemoryRegistryBackend backend;
+	tstring                    value;
+
+	{
+		COM::RegistrationBatch batch(backend);
+
+		batch.SetValue(TXT("Server.Class\\CLSID"), TXT("{Class}"));
+		batch.DeleteKey(TXT("SERVER.CLASS\\clsid"));
+		batch.SetValue(TXT("server.class\\Clsid"), TXT("{Other}"));
+		batch.Commit();
+
+		TEST_TRUE(batch.KeysDeleted() == 1);
+		TEST_TRUE(batch.KeysOpened() == 2);
+		TEST_TRUE(batch.ValuesWritten() == 2);
+	}
+
+	TEST_TRUE(backend.KeyCount() == 2);
+	TEST_TRUE(backend.GetValue(TXT("Server.Class\\CLSID"), nullptr, value) && (value == TXT("{Other}")));
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+namespace
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! Write the key operations of a registration batch per class to stdout.
+
+void ReportBatchOperations(const char* pszName, const COM::RegistrationBatch& oBatch, size_t nClasses)
+{
+	double dClasses = static_cast<double>(nClasses);
+
+	std::cout << pszName << ": per class "
+	          << (oBatch.KeysOpened()    / dClasses) << " keys opened, "
+	          << (oBatch.ValuesWritten() / dClasses) << " values written, "
+	          << (oBatch.ValuesSkipped() / dClasses) << " values skipped, "
+	          << (oBatch.KeysDeleted()   / dClasses) << " keys deleted" << std::endl;
+}
+
+//namespace
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Registration cost per class without the registry, in time and key
+//! operations.
+
+BENCHMARK(MemoryRegistration)
+{
+	const size_t classes = 1000;
+
+	COM::MemoryRegistryBackend backend;
+	COM::ServerRegInfo         server;
+
+	server.m_strFile    = TXT("C:\\Test\\Benchmark.dll");
+	server.m_strLibrary = TXT("Benchmark");
+
+	std::vector<CLSID>   clsids(classes);
+	std::vector<tstring> names(classes);
+
+	for (size_t i = 0; i != classes; ++i)
+	{
+		::CoCreateGuid(&clsids[i]);
+		names[i] = CString::Fmt(TXT("Class%lu"), static_cast<ulong>(i)).c_str();
+	}
+
+	COM::RegistrationBatch registerBatch(backend);
+
+	Stopwatch registerTimer;
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::RegisterCLSID(registerBatch, server, clsids[i], names[i], TXT("1"), COM::ANY_APARTMENT);
+
+	registerBatch.Commit();
+
+	ReportBenchmark("COM::RegisterCLSID (memory)", classes, registerTimer.ElapsedMs());
+	ReportBatchOperations("COM::RegisterCLSID (memory)", registerBatch, classes);
+
+	COM::RegistrationBatch unregisterBatch(backend);
+
+	Stopwatch unregisterTimer;
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::UnregisterCLSID(unregisterBatch, server, clsids[i], names[i], TXT("1"));
+
+	unregisterBatch.Commit();
+
+	ReportBenchmark("COM::UnregisterCLSID (memory)", classes, unregisterTimer.ElapsedMs());
+	ReportBatchOperations("COM::UnregisterCLSID (memory)", unregisterBatch, classes);
+}
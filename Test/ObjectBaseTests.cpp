@@ -8,12 +8,259 @@
 #include "TestClasses.hpp"
 #include <COM/ClassFactory.hpp>
 #include <WCL/ComPtr.hpp>
+#include "Benchmark.hpp"
 
 #ifndef _MSC_VER
 WCL_DECLARE_IFACETRAITS(IUnknown, IID_IUnknown);
 WCL_DECLARE_IFACETRAITS(ITestInterface, IID_ITestInterface);
 #endif
 
+////////////////////////////////////////////////////////////////////////////////
+//! The apartment threaded variant of the ObjectBase test class.
+
+class ApartmentTestClass : public COM::ObjectBase<ITestInterface, COM::SINGLE_THREAD_APT>
+{
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The free threaded variant of the ObjectBase test class, which is agile.
+
+class FreeThreadedTestClass : public COM::ObjectBase<ITestInterface, COM::FREE_THREAD_APT, COM::FreeThreadedMarshalling>
+{
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The neutral apartment variant of the ObjectBase test class, which is agile.
+
+class NeutralTestClass : public COM::ObjectBase<ITestInterface, COM::NEUTRAL_APARTMENT, COM::FreeThreadedMarshalling>
+{
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The free-threaded variant of the dual interface test class.
+
+class AgileTestDispatch : public COM::ObjectBase<ITestDispatch, COM::ANY_APARTMENT, COM::FreeThreadedMarshalling>,
+                          public COM::DispatchTableImpl<AgileTestDispatch>
+{
+public:
+	AgileTestDispatch()
+		: COM::DispatchTableImpl<AgileTestDispatch>(IID_ITestDispatch)
+	{
+	}
+
+	virtual HRESULT COMCALL get_Name(BSTR* pbstrName)
+	{
+		if (pbstrName == nullptr)
+			return E_POINTER;
+
+		*pbstrName = ::SysAllocString(OLESTR("AgileTestDispatch"));
+		return S_OK;
+	}
+
+	virtual HRESULT COMCALL Add(long nLHS, long nRHS, long* pnResult)
+	{
+		if (pnResult == nullptr)
+			return E_POINTER;
+
+		*pnResult = nLHS + nRHS;
+		return S_OK;
+	}
+
+	DEFINE_INTERFACE_TABLE(ITestDispatch)
+		IMPLEMENT_INTERFACE(IID_ITestDispatch, ITestDispatch)
+		IMPLEMENT_INTERFACE(IID_IDispatch, ITestDispatch)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+
+	DEFINE_DISPATCH_TABLE(AgileTestDispatch)
+		IMPLEMENT_DISP_PROPGET(Name, 1)
+		IMPLEMENT_DISP_METHOD_RETVAL(Add, 2)
+	END_DISPATCH_TABLE()
+	IMPLEMENT_IDISPATCH_TABLE(AgileTestDispatch)
+};
+
+class TearOffPersist;
+class TearOffConnection;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The ObjectBase test class with its rarely used interfaces as tear-offs.
+
+class TearOffTestClass : public COM::ObjectBase<ITestInterface>
+{
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+		IMPLEMENT_TEAROFF_INTERFACE(IID_IPersist, TearOffPersist)
+		IMPLEMENT_CACHED_TEAROFF_INTERFACE(IID_IExternalConnection, TearOffConnection, m_oConnection)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+
+private:
+	COM::TearOffCache<TearOffConnection>	m_oConnection;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The uncached tear-off for the test class.
+
+class TearOffPersist : public COM::TearOff<TearOffTestClass, IPersist>
+{
+public:
+	TearOffPersist(TearOffTestClass& oOwner)
+		: COM::TearOff<TearOffTestClass, IPersist>(oOwner)
+	{
+	}
+
+	virtual HRESULT COMCALL GetClassID(CLSID* pCLSID)
+	{
+		if (pCLSID == nullptr)
+			return E_POINTER;
+
+		*pCLSID = CLSID_TestClass;
+		return S_OK;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The cached tear-off for the test class, which has state of its own.
+
+class TearOffConnection : public COM::TearOff<TearOffTestClass, IExternalConnection>
+{
+public:
+	TearOffConnection(TearOffTestClass& oOwner)
+		: COM::TearOff<TearOffTestClass, IExternalConnection>(oOwner)
+		, m_nConnections(0)
+	{
+	}
+
+	virtual DWORD COMCALL AddConnection(DWORD /*dwType*/, DWORD /*dwReserved*/)
+	{
+		return ++m_nConnections;
+	}
+
+	virtual DWORD COMCALL ReleaseConnection(DWORD /*dwType*/, DWORD /*dwReserved*/, BOOL /*bLastReleaseCloses*/)
+	{
+		return --m_nConnections;
+	}
+
+private:
+	DWORD	m_nConnections;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The same test class with every interface implemented by the object itself.
+
+class InlineTestClass : public COM::ObjectBase<ITestInterface>, public IPersist, public IExternalConnection
+{
+public:
+	InlineTestClass()
+		: m_nConnections(0)
+	{
+	}
+
+	virtual HRESULT COMCALL GetClassID(CLSID* pCLSID)
+	{
+		if (pCLSID == nullptr)
+			return E_POINTER;
+
+		*pCLSID = CLSID_TestClass;
+		return S_OK;
+	}
+
+	virtual DWORD COMCALL AddConnection(DWORD /*dwType*/, DWORD /*dwReserved*/)
+	{
+		return ++m_nConnections;
+	}
+
+	virtual DWORD COMCALL ReleaseConnection(DWORD /*dwType*/, DWORD /*dwReserved*/, BOOL /*bLastReleaseCloses*/)
+	{
+		return --m_nConnections;
+	}
+
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+		IMPLEMENT_INTERFACE(IID_IPersist, IPersist)
+		IMPLEMENT_INTERFACE(IID_IExternalConnection, IExternalConnection)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+
+private:
+	DWORD	m_nConnections;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The state for a series of calls made on an object from another apartment.
+
+struct CrossApartmentCalls
+{
+	IDispatch*	m_pObject;		//!< The object in the caller's apartment.
+	IStream*	m_pStream;		//!< The object marshalled for the calling thread.
+	size_t		m_nCalls;		//!< The number of calls to make.
+	bool		m_bDirect;		//!< Whether the unmarshalled pointer is the object.
+	bool		m_bSucceeded;	//!< Whether every call succeeded.
+	double		m_dElapsedMs;	//!< The time taken to make the calls.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The thread which makes the calls from a single-threaded apartment.
+
+static DWORD WINAPI CallFromApartment(LPVOID param)
+{
+	CrossApartmentCalls* calls    = static_cast<CrossApartmentCalls*>(param);
+	IDispatch*           dispatch = nullptr;
+
+	::CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+
+	if (SUCCEEDED(::CoGetInterfaceAndReleaseStream(calls->m_pStream, IID_IDispatch, reinterpret_cast<void**>(&dispatch))))
+	{
+		long      result = 0;
+		Stopwatch timer;
+
+		calls->m_bDirect    = (dispatch == calls->m_pObject);
+		calls->m_bSucceeded = true;
+
+		for (size_t i = 0; i != calls->m_nCalls; ++i)
+			calls->m_bSucceeded &= (InvokeAdd(dispatch, 1, 2, result) == S_OK);
+
+		calls->m_dElapsedMs = timer.ElapsedMs();
+
+		dispatch->Release();
+	}
+
+	::CoUninitialize();
+
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Call the object, which lives in the caller's apartment, from a thread in a
+//! different apartment.
+
+static CrossApartmentCalls CallAcrossApartments(IDispatch* object, size_t count)
+{
+	CrossApartmentCalls calls = { object, nullptr, count, false, false, 0.0 };
+
+	if (FAILED(::CoMarshalInterThreadInterfaceInStream(IID_IDispatch, object, &calls.m_pStream)))
+		return calls;
+
+	HANDLE thread = ::CreateThread(nullptr, 0, CallFromApartment, &calls, 0, nullptr);
+
+	::WaitForSingleObject(thread, INFINITE);
+	::CloseHandle(thread);
+
+	return calls;
+}
+
 TEST_SET(ObjectBase)
 {
 	typedef WCL::ComPtr<IUnknown> IUnknownPtr;
@@ -54,6 +301,29 @@ TEST_CASE("acquiring and releasing an interfaces modifies the reference count")
 }
 TEST_CASE_END
 
+TEST_CASE("an apartment threaded object maintains its reference count and the server lock count")
+{
+	TestServer          server;
+	ApartmentTestClass* object = new ApartmentTestClass;
+
+	long locks = server.LockCount();
+
+	ITestInterfacePtr iface1(object, true);
+
+	TEST_TRUE(object->GetRefCount() == 1);
+	TEST_TRUE(server.LockCount() == locks+1);
+
+	ITestInterfacePtr iface2(iface1);
+
+	TEST_TRUE(object->GetRefCount() == 2);
+
+	iface1.Release();
+	iface2.Release();
+
+	TEST_TRUE(server.LockCount() == locks);
+}
+TEST_CASE_END
+
 TEST_CASE("IUnknown can be acquired via any interface")
 {
 	TestServer        server;
@@ -66,6 +336,195 @@ TEST_CASE("IUnknown can be acquired via any interface")
 }
 TEST_CASE_END
 
+TEST_CASE("querying for a supported interface returns the interface adjusted pointer")
+{
+	TestServer        server;
+	TestClass*        object(new TestClass);
+	ITestInterfacePtr iface(object, true);
+
+	ISupportErrorInfo* info = nullptr;
+
+	TEST_TRUE(iface->QueryInterface(IID_ISupportErrorInfo, reinterpret_cast<void**>(&info)) == S_OK);
+	TEST_TRUE(info == static_cast<ISupportErrorInfo*>(object));
+
+	info->Release();
+}
+TEST_CASE_END
+
+TEST_CASE("querying for an unsupported interface returns E_NOINTERFACE and a null pointer")
+{
+	TestServer        server;
+	ITestInterfacePtr iface(new TestClass, true);
+
+	const IID IID_Unsupported = { 0x87654321, 0x4321, 0x4321, { 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01 } };
+	void*     result = iface.get();
+
+	TEST_TRUE(iface->QueryInterface(IID_Unsupported, &result) == E_NOINTERFACE);
+	TEST_TRUE(result == nullptr);
+
+	TEST_TRUE(iface->QueryInterface(IID_IMarshal, &result) == E_NOINTERFACE);
+	TEST_TRUE(result == nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("a free-threaded object exposes the free-threaded marshaler and IAgileObject")
+{
+	TestServer server;
+
+	long locks = server.LockCount();
+
+	{
+		IUnknownPtr object(static_cast<ITestDispatch*>(new AgileTestDispatch), true);
+		void*       result = nullptr;
+
+		TEST_TRUE(object->QueryInterface(IID_IMarshal, &result) == S_OK);
+		TEST_TRUE(result != nullptr);
+
+		static_cast<IUnknown*>(result)->Release();
+
+		TEST_TRUE(object->QueryInterface(COM::IID_IAgileObject, &result) == S_OK);
+		TEST_TRUE(result == object.get());
+
+		static_cast<IUnknown*>(result)->Release();
+	}
+
+	TEST_TRUE(server.LockCount() == locks);
+}
+TEST_CASE_END
+
+TEST_CASE("free-threaded marshalling can be used with any thread-safe threading model")
+{
+	TestServer server;
+
+	// An STA model with FreeThreadedMarshalling fails to compile.
+	IUnknownPtr freeThreaded(static_cast<ITestInterface*>(new FreeThreadedTestClass), true);
+	IUnknownPtr neutral(static_cast<ITestInterface*>(new NeutralTestClass), true);
+	IUnknownPtr any(static_cast<ITestDispatch*>(new AgileTestDispatch), true);
+	void*       result = nullptr;
+
+	TEST_TRUE(freeThreaded->QueryInterface(COM::IID_IAgileObject, &result) == S_OK);
+	static_cast<IUnknown*>(result)->Release();
+
+	TEST_TRUE(neutral->QueryInterface(COM::IID_IAgileObject, &result) == S_OK);
+	static_cast<IUnknown*>(result)->Release();
+
+	TEST_TRUE(any->QueryInterface(COM::IID_IAgileObject, &result) == S_OK);
+	static_cast<IUnknown*>(result)->Release();
+}
+TEST_CASE_END
+
+TEST_CASE("a standard object does not expose IAgileObject")
+{
+	TestServer  server;
+	IUnknownPtr object(new TestClass, true);
+	void*       result = nullptr;
+
+	TEST_TRUE(object->QueryInterface(COM::IID_IAgileObject, &result) == E_NOINTERFACE);
+	TEST_TRUE(result == nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("a free-threaded object is called directly from another apartment")
+{
+	const size_t iterations = 10;
+
+	HRESULT init = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	{
+		TestServer server;
+
+		TestDispatch*      standard = new TestDispatch;
+		AgileTestDispatch* agile    = new AgileTestDispatch;
+
+		standard->AddRef();
+		agile->AddRef();
+
+		CrossApartmentCalls proxied = CallAcrossApartments(standard, iterations);
+		CrossApartmentCalls direct  = CallAcrossApartments(agile, iterations);
+
+		agile->Release();
+		standard->Release();
+
+		TEST_TRUE(proxied.m_bSucceeded);
+		TEST_TRUE(!proxied.m_bDirect);
+		TEST_TRUE(direct.m_bSucceeded);
+		TEST_TRUE(direct.m_bDirect);
+	}
+
+	if (SUCCEEDED(init))
+		::CoUninitialize();
+}
+TEST_CASE_END
+
+TEST_CASE("querying for a tear-off interface creates one which shares the object's identity")
+{
+	TestServer        server;
+	TearOffTestClass* object = new TearOffTestClass;
+	ITestInterfacePtr iface(object, true);
+
+	IPersist* first  = nullptr;
+	IPersist* second = nullptr;
+	CLSID     clsid  = CLSID_NULL;
+
+	TEST_TRUE(iface->QueryInterface(IID_IPersist, reinterpret_cast<void**>(&first)) == S_OK);
+	TEST_TRUE(first->GetClassID(&clsid) == S_OK);
+	TEST_TRUE(IsEqualCLSID(clsid, CLSID_TestClass));
+	TEST_TRUE(object->GetRefCount() == 2);
+
+	IUnknown* unknown = nullptr;
+
+	TEST_TRUE(first->QueryInterface(IID_IUnknown, reinterpret_cast<void**>(&unknown)) == S_OK);
+	TEST_TRUE(unknown == static_cast<ITestInterface*>(object));
+
+	unknown->Release();
+
+	TEST_TRUE(first->QueryInterface(IID_IPersist, reinterpret_cast<void**>(&second)) == S_OK);
+	TEST_TRUE(second != first);
+
+	second->Release();
+	first->Release();
+
+	TEST_TRUE(object->GetRefCount() == 1);
+}
+TEST_CASE_END
+
+TEST_CASE("a cached tear-off is created once and lives as long as the object")
+{
+	TestServer        server;
+	TearOffTestClass* object = new TearOffTestClass;
+
+	long locks = server.LockCount();
+
+	ITestInterfacePtr iface(object, true);
+
+	IExternalConnection* first  = nullptr;
+	IExternalConnection* second = nullptr;
+
+	TEST_TRUE(iface->QueryInterface(IID_IExternalConnection, reinterpret_cast<void**>(&first)) == S_OK);
+	TEST_TRUE(iface->QueryInterface(IID_IExternalConnection, reinterpret_cast<void**>(&second)) == S_OK);
+	TEST_TRUE(first == second);
+	TEST_TRUE(first->AddConnection(EXTCONN_STRONG, 0) == 1);
+	TEST_TRUE(second->AddConnection(EXTCONN_STRONG, 0) == 2);
+	TEST_TRUE(object->GetRefCount() == 3);
+
+	first->Release();
+	second->Release();
+
+	TEST_TRUE(object->GetRefCount() == 1);
+
+	iface.Release();
+
+	TEST_TRUE(server.LockCount() == locks);
+}
+TEST_CASE_END
+
+TEST_CASE("tear-off interfaces reduce the size of an object")
+{
+	// Two inline vtable pointers and a counter are replaced by one cache pointer.
+	TEST_TRUE(sizeof(TearOffTestClass) + sizeof(void*) <= sizeof(InlineTestClass));
+}
+TEST_CASE_END
+
 TEST_CASE("creating and destroying an object modifies the server lock count")
 {
 	TestServer        server;
@@ -86,3 +545,37 @@ TEST_CASE_END
 
 }
 TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Cross-apartment call latency with and without the free-threaded marshaler.
+
+BENCHMARK(CrossApartmentLatency)
+{
+	const size_t iterations = 10000;
+
+	HRESULT init = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	{
+		TestServer server;
+
+		TestDispatch*      standard = new TestDispatch;
+		AgileTestDispatch* agile    = new AgileTestDispatch;
+
+		standard->AddRef();
+		agile->AddRef();
+
+		CrossApartmentCalls proxied = CallAcrossApartments(standard, iterations);
+
+		ReportBenchmark("ITestDispatch::Add (cross-apartment, proxy)", iterations, proxied.m_dElapsedMs);
+
+		CrossApartmentCalls direct = CallAcrossApartments(agile, iterations);
+
+		ReportBenchmark("ITestDispatch::Add (cross-apartment, free-threaded marshaler)", iterations, direct.m_dElapsedMs);
+
+		agile->Release();
+		standard->Release();
+	}
+
+	if (SUCCEEDED(init))
+		::CoUninitialize();
+}
@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ObjectPoolTests.cpp
+//! \brief  The unit tests for the ObjectPool and PooledObject classes.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include "Benchmark.hpp"
+#include <COM/ObjectPool.hpp>
+#include <WCL/ComPtr.hpp>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//! The pooled variant of the ObjectBase test class.
+
+class PooledTestClass : public COM::ObjectBase<ITestInterface>, public COM::PooledObject<PooledTestClass>
+{
+	DEFINE_INTERFACE_TABLE(ITestInterface)
+		IMPLEMENT_INTERFACE(IID_ITestInterface, ITestInterface)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+};
+
+TEST_SET(ObjectPool)
+{
+	typedef WCL::ComPtr<ITestInterface> ITestInterfacePtr;
+
+TEST_CASE("a block is at least as big as the object and suitably aligned")
+{
+	const size_t size = COM::ObjectPool<PooledTestClass>::BlockSize();
+
+	TEST_TRUE(size >= sizeof(PooledTestClass));
+	TEST_TRUE((size % MEMORY_ALLOCATION_ALIGNMENT) == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("releasing a pooled object returns its memory to the pool for reuse")
+{
+	TestServer server;
+
+	PooledTestClass* first = new PooledTestClass;
+	ITestInterfacePtr(first, true).Release();
+
+	PooledTestClass* second = new PooledTestClass;
+	ITestInterfacePtr iface(second, true);
+
+	TEST_TRUE(second == first);
+}
+TEST_CASE_END
+
+TEST_CASE("the high-water mark covers the peak number of live objects")
+{
+	TestServer server;
+
+	const size_t count = 200;
+	std::vector<ITestInterfacePtr> objects;
+
+	for (size_t i = 0; i != count; ++i)
+		objects.push_back(ITestInterfacePtr(new PooledTestClass, true));
+
+	long peak = PooledTestClass::PoolHighWaterMark();
+
+	TEST_TRUE(peak >= static_cast<long>(count));
+
+	objects.clear();
+
+	for (size_t i = 0; i != count; ++i)
+		objects.push_back(ITestInterfacePtr(new PooledTestClass, true));
+
+	TEST_TRUE(PooledTestClass::PoolHighWaterMark() == peak);
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Pooled create and release throughput compared to the heap.
+
+BENCHMARK(ObjectPoolAllocation)
+{
+	typedef WCL::ComPtr<ITestInterface> ITestInterfacePtr;
+
+	TestServer server;
+
+	const size_t iterations = 1000000;
+
+	Stopwatch heap;
+
+	for (size_t i = 0; i != iterations; ++i)
+		ITestInterfacePtr(new TestClass, true);
+
+	ReportBenchmark("ObjectBase create/release (heap)", iterations, heap.ElapsedMs());
+
+	Stopwatch pool;
+
+	for (size_t i = 0; i != iterations; ++i)
+		ITestInterfacePtr(new PooledTestClass, true);
+
+	ReportBenchmark("ObjectBase create/release (pool)", iterations, pool.ElapsedMs());
+}
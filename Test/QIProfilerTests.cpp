@@ -0,0 +1,239 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   QIProfilerTests.cpp
+//! \brief  The unit tests for the QIProfiler class.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include <COM/QIProfiler.hpp>
+#include <COM/ComUtils.hpp>
+#include "Benchmark.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+//! Find the profile entry for a class and interface.
+
+static const COM::QIProfileEntry* FindEntry(const COM::QIProfileEntries& entries, const COM::ClassCounters& counters, const IID& iid)
+{
+	for (COM::QIProfileEntries::const_iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if ( (it->m_pClass == &counters) && IsEqualIID(it->m_oIID, iid) )
+			return &*it;
+	}
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query the object for an interface a number of times.
+
+static void QueryRepeatedly(IUnknown* object, const IID& iid, size_t count)
+{
+	for (size_t i = 0; i != count; ++i)
+	{
+		IUnknown* result = nullptr;
+
+		if (SUCCEEDED(object->QueryInterface(iid, reinterpret_cast<void**>(&result))))
+			result->Release();
+	}
+}
+
+TEST_SET(QIProfiler)
+{
+
+TEST_CASE("the profiler can be enabled and disabled")
+{
+	COM::QIProfiler::Enable(true);
+
+	TEST_TRUE(COM::QIProfiler::IsEnabled());
+
+	COM::QIProfiler::Enable(false);
+
+	TEST_TRUE(!COM::QIProfiler::IsEnabled());
+}
+TEST_CASE_END
+
+TEST_CASE("successful and failed queries are recorded as hits and misses when enabled")
+{
+	COM::QIProfiler::Reset();
+	COM::QIProfiler::Enable(true);
+
+	TestClass* object = new TestClass;
+
+	object->AddRef();
+
+	QueryRepeatedly(object, IID_ITestInterface, 3);
+	QueryRepeatedly(object, IID_IPersist, 2);
+
+	object->Release();
+
+	COM::QIProfiler::Enable(false);
+
+	COM::QIProfileEntries entries;
+
+	COM::QIProfiler::Snapshot(entries);
+
+	const COM::ClassCounters&  counters = COM::ClassCounters::Of<TestClass>();
+	const COM::QIProfileEntry* hits     = FindEntry(entries, counters, IID_ITestInterface);
+	const COM::QIProfileEntry* misses   = FindEntry(entries, counters, IID_IPersist);
+
+	TEST_TRUE(hits != nullptr);
+	TEST_TRUE(hits->m_nHits == 3);
+	TEST_TRUE(hits->m_nMisses == 0);
+
+	TEST_TRUE(misses != nullptr);
+	TEST_TRUE(misses->m_nHits == 0);
+	TEST_TRUE(misses->m_nMisses == 2);
+}
+TEST_CASE_END
+
+TEST_CASE("queries are not recorded when the profiler is disabled")
+{
+	COM::QIProfiler::Reset();
+
+	TestClass* object = new TestClass;
+
+	object->AddRef();
+
+	QueryRepeatedly(object, IID_ITestInterface, 3);
+
+	object->Release();
+
+	COM::QIProfileEntries entries;
+
+	COM::QIProfiler::Snapshot(entries);
+
+	TEST_TRUE(entries.empty());
+}
+TEST_CASE_END
+
+TEST_CASE("resetting the profiler clears the recorded queries")
+{
+	COM::QIProfiler::Reset();
+	COM::QIProfiler::Enable(true);
+
+	TestClass* object = new TestClass;
+
+	object->AddRef();
+
+	QueryRepeatedly(object, IID_ITestInterface, 1);
+
+	object->Release();
+
+	COM::QIProfiler::Enable(false);
+	COM::QIProfiler::Reset();
+
+	COM::QIProfileEntries entries;
+
+	COM::QIProfiler::Snapshot(entries);
+
+	TEST_TRUE(entries.empty());
+	TEST_TRUE(COM::QIProfiler::Dropped() == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("the profile report names the classes and interfaces queried")
+{
+	TestServer server;
+
+	COM::QIProfiler::Reset();
+	COM::QIProfiler::Enable(true);
+
+	TestClass* object = new TestClass;
+
+	object->AddRef();
+
+	QueryRepeatedly(object, IID_ITestInterface, 2);
+
+	object->Release();
+
+	TestDispatch* dispatch = new TestDispatch;
+
+	dispatch->AddRef();
+
+	QueryRepeatedly(dispatch, IID_IDispatch, 1);
+	QueryRepeatedly(dispatch, IID_IPersist, 1);
+
+	dispatch->Release();
+
+	COM::QIProfiler::Enable(false);
+
+	tstring report    = server.FormatQIProfile();
+	tstring testClass = COM::FormatGUID(CLSID_TestClass) + TXT(": ") + COM::FormatGUID(IID_ITestInterface);
+
+	TEST_TRUE(report.find(testClass + TXT(" hits=2 misses=0")) != tstring::npos);
+	TEST_TRUE(report.find(TXT("TestApartmentClass: IDispatch hits=1 misses=0")) != tstring::npos);
+	TEST_TRUE(report.find(TXT("TestApartmentClass: IPersist hits=0 misses=1")) != tstring::npos);
+
+	COM::QIProfiler::Reset();
+}
+TEST_CASE_END
+
+TEST_CASE("every query made whilst the profiler is enabled is counted")
+{
+	const size_t iterations = 1000;
+
+	COM::QIProfiler::Reset();
+	COM::QIProfiler::Enable(true);
+
+	TestClass* object = new TestClass;
+
+	object->AddRef();
+
+	QueryRepeatedly(object, IID_ITestInterface, iterations);
+
+	object->Release();
+
+	COM::QIProfiler::Enable(false);
+
+	COM::QIProfileEntries entries;
+
+	COM::QIProfiler::Snapshot(entries);
+	COM::QIProfiler::Reset();
+
+	const COM::QIProfileEntry* entry = FindEntry(entries, COM::ClassCounters::Of<TestClass>(), IID_ITestInterface);
+
+	TEST_TRUE(entry != nullptr);
+	TEST_TRUE(entry->m_nHits == static_cast<long>(iterations));
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query throughput with the profiler disabled and enabled.
+
+BENCHMARK(QIProfilerOverhead)
+{
+	const size_t iterations = 1000000;
+
+	COM::QIProfiler::Enable(false);
+	COM::QIProfiler::Reset();
+
+	TestClass* object = new TestClass;
+
+	object->AddRef();
+
+	Stopwatch disabledTimer;
+
+	QueryRepeatedly(object, IID_ITestInterface, iterations);
+
+	double disabled = disabledTimer.ElapsedMs();
+
+	COM::QIProfiler::Enable(true);
+
+	Stopwatch enabledTimer;
+
+	QueryRepeatedly(object, IID_ITestInterface, iterations);
+
+	double enabled = enabledTimer.ElapsedMs();
+
+	COM::QIProfiler::Enable(false);
+	COM::QIProfiler::Reset();
+
+	object->Release();
+
+	ReportBenchmark("ObjectBase::QueryInterface (profiler disabled)", iterations, disabled);
+	ReportBenchmark("ObjectBase::QueryInterface (profiler enabled)", iterations, enabled);
+}
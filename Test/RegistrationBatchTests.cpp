@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   RegistrationBatchTests.cpp
+//! \brief  The unit tests for the RegistrationBatch class.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include <COM/RegistrationBatch.hpp>
+#include <COM/Win32RegistryBackend.hpp>
+#include <COM/ServerRegInfo.hpp>
+#include "Benchmark.hpp"
+
+namespace
+{
+
+//! The root key for the tests, under HKCU\Software\Classes.
+const tchar* TEST_ROOT = TXT("COM.Test.RegistrationBatch");
+
+//! The child key for the tests.
+const tchar* TEST_CHILD = TXT("COM.Test.RegistrationBatch\\Child");
+
+////////////////////////////////////////////////////////////////////////////////
+//! Read the default value of a key under HKCU\Software\Classes.
+
+tstring ReadTestValue(const tchar* pszSubKey)
+{
+	tstring strKey = tstring(TXT("Software\\Classes\\")) + pszSubKey;
+	tchar   szValue[MAX_PATH+1] = { 0 };
+	LONG    lSize = sizeof(szValue);
+
+	if (::RegQueryValue(HKEY_CURRENT_USER, strKey.c_str(), szValue, &lSize) != ERROR_SUCCESS)
+		return TXT("<missing>");
+
+	return szValue;
+}
+
+//namespace
+}
+
+TEST_SET(RegistrationBatch)
+{
+
+TEST_CASE("setting values creates the keys and opens each key once")
+{
+	{
+		COM::Win32RegistryBackend registry(COM::USER);
+		COM::RegistrationBatch    batch(registry);
+
+		batch.SetValue(TEST_ROOT, TXT("Root"));
+		batch.SetValue(TEST_CHILD, TXT("Child"));
+		batch.SetValue(TEST_CHILD, TXT("Name"), TXT("Value"));
+		batch.Commit();
+
+		TEST_TRUE(batch.KeysOpened() == 2);
+		TEST_TRUE(batch.ValuesWritten() == 3);
+		TEST_TRUE(batch.ValuesSkipped() == 0);
+	}
+
+	TEST_TRUE(ReadTestValue(TEST_ROOT) == TXT("Root"));
+	TEST_TRUE(ReadTestValue(TEST_CHILD) == TXT("Child"));
+}
+TEST_CASE_END
+
+TEST_CASE("values which are already correct are not written again")
+{
+	COM::Win32RegistryBackend registry(COM::USER);
+	COM::RegistrationBatch    batch(registry);
+
+	batch.SetValue(TEST_ROOT, TXT("Root"));
+	batch.SetValue(TEST_CHILD, TXT("Changed"));
+	batch.SetValue(TEST_CHILD, TXT("Name"), TXT("Value"));
+	batch.Commit();
+
+	TEST_TRUE(batch.ValuesWritten() == 1);
+	TEST_TRUE(batch.ValuesSkipped() == 2);
+	TEST_TRUE(ReadTestValue(TEST_CHILD) == TXT("Changed"));
+}
+TEST_CASE_END
+
+TEST_CASE("deleting a key closes any open handles to it first")
+{
+	COM::Win32RegistryBackend registry(COM::USER);
+	COM::RegistrationBatch    batch(registry);
+
+	batch.SetValue(TEST_CHILD, TXT("Child"));
+	batch.DeleteKey(TEST_CHILD);
+	batch.DeleteKey(TEST_ROOT);
+	batch.Commit();
+
+	TEST_TRUE(batch.KeysDeleted() == 2);
+	TEST_TRUE(ReadTestValue(TEST_CHILD) == TXT("<missing>"));
+	TEST_TRUE(ReadTestValue(TEST_ROOT) == TXT("<missing>"));
+}
+TEST_CASE_END
+
+TEST_CASE("deleting a missing key is not an error")
+{
+	COM::Win32RegistryBackend registry(COM::USER);
+	COM::RegistrationBatch    batch(registry);
+
+	batch.DeleteKey(TEST_ROOT);
+
+	TEST_TRUE(batch.KeysDeleted() == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("re-registering unchanged classes through a batch writes nothing")
+{
+	const size_t classes = 2;
+
+	COM::ServerRegInfo server;
+
+	server.m_strFile    = TXT("C:\\Test\\RegistrationBatch.dll");
+	server.m_strLibrary = TXT("COMTestRegistrationBatch");
+
+	std::vector<CLSID>   clsids(classes);
+	std::vector<tstring> names(classes);
+
+	for (size_t i = 0; i != classes; ++i)
+	{
+		::CoCreateGuid(&clsids[i]);
+		names[i] = CString::Fmt(TXT("Class%lu"), static_cast<ulong>(i)).c_str();
+	}
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::RegisterCLSID(COM::USER, server, clsids[i], names[i], TXT("1"), COM::ANY_APARTMENT);
+
+	COM::Win32RegistryBackend registry(COM::USER);
+	COM::RegistrationBatch    batch(registry);
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::RegisterCLSID(batch, server, clsids[i], names[i], TXT("1"), COM::ANY_APARTMENT);
+
+	batch.Commit();
+
+	TEST_TRUE(batch.ValuesWritten() == 0);
+	TEST_TRUE(batch.ValuesSkipped() == (classes * 11));
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::UnregisterCLSID(batch, server, clsids[i], names[i], TXT("1"));
+
+	batch.Commit();
+
+	TEST_TRUE(batch.KeysDeleted() == (classes * 10));
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Registration throughput of single calls compared to a batch.
+
+BENCHMARK(BatchRegistration)
+{
+	const size_t classes = 50;
+
+	COM::ServerRegInfo server;
+
+	server.m_strFile    = TXT("C:\\Test\\RegistrationBatch.dll");
+	server.m_strLibrary = TXT("COMTestRegistrationBatch");
+
+	std::vector<CLSID>   clsids(classes);
+	std::vector<tstring> names(classes);
+
+	for (size_t i = 0; i != classes; ++i)
+	{
+		::CoCreateGuid(&clsids[i]);
+		names[i] = CString::Fmt(TXT("Class%lu"), static_cast<ulong>(i)).c_str();
+	}
+
+	Stopwatch singleTimer;
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::RegisterCLSID(COM::USER, server, clsids[i], names[i], TXT("1"), COM::ANY_APARTMENT);
+
+	ReportBenchmark("COM::RegisterCLSID (single)", classes, singleTimer.ElapsedMs());
+
+	COM::Win32RegistryBackend registry(COM::USER);
+	COM::RegistrationBatch    batch(registry);
+
+	Stopwatch batchTimer;
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::RegisterCLSID(batch, server, clsids[i], names[i], TXT("1"), COM::ANY_APARTMENT);
+
+	batch.Commit();
+
+	ReportBenchmark("COM::RegisterCLSID (batch, unchanged)", classes, batchTimer.ElapsedMs());
+
+	for (size_t i = 0; i != classes; ++i)
+		COM::UnregisterCLSID(batch, server, clsids[i], names[i], TXT("1"));
+
+	batch.Commit();
+}
@@ -0,0 +1,215 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   ResultTests.cpp
+//! \brief  The unit tests for the Result class template.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include <Core/UnitTest.hpp>
+#include <WCL/ComPtr.hpp>
+#include <WCL/ComStr.hpp>
+#include "Benchmark.hpp"
+
+namespace
+{
+
+//! A value returned by the test functions.
+int g_nValue = 42;
+
+////////////////////////////////////////////////////////////////////////////////
+//! A function which fails without throwing.
+
+COM::Result<int*> GetValue(bool bFail)
+{
+	if (bFail)
+		return COM_FAILURE(E_INVALIDARG, TXT("Invalid value"));
+
+	return &g_nValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! A function which propagates the failure of another.
+
+COM::Result<void> CheckValue(bool bFail)
+{
+	COM::Result<int*> oValue = GetValue(bFail);
+
+	COM_PROPAGATE(oValue);
+
+	return COM::Result<void>();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! A COM method which reports failure by throwing.
+
+HRESULT ThrowingMethod(int* pnValue)
+{
+	HRESULT hr = S_OK;
+
+	try
+	{
+		if (pnValue == nullptr)
+			throw WCL::ComException(E_POINTER, TXT("pnValue is NULL"));
+
+		*pnValue = g_nValue;
+	}
+	COM_CATCH(hr)
+
+	return hr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! A COM method which reports failure by returning a Result.
+
+HRESULT ResultMethod(int* pnValue)
+{
+	if (pnValue == nullptr)
+		return COM_FAILURE(E_POINTER, TXT("pnValue is NULL")).Report();
+
+	*pnValue = g_nValue;
+
+	return S_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! A function which throws on its slow path.
+
+COM::Result<int*> SlowPath()
+{
+	try
+	{
+		throw WCL::ComException(E_ACCESSDENIED, TXT("Access denied"));
+	}
+	COM_CATCH_RESULT(int*)
+}
+
+//namespace
+}
+
+TEST_SET(Result)
+{
+	typedef WCL::ComPtr<IErrorInfo> IErrorInfoPtr;
+
+TEST_CASE("a result constructed from a value has succeeded")
+{
+	COM::Result<int*> result = GetValue(false);
+
+	TEST_TRUE(result.Succeeded() == true);
+	TEST_TRUE(result.Failed() == false);
+	TEST_TRUE(result.Code() == S_OK);
+	TEST_TRUE(result.Value() == &g_nValue);
+}
+TEST_CASE_END
+
+TEST_CASE("a result constructed from a failure has the code, message and source")
+{
+	COM::Result<int*> result = GetValue(true);
+
+	TEST_TRUE(result.Succeeded() == false);
+	TEST_TRUE(result.Failed() == true);
+	TEST_TRUE(result.Code() == E_INVALIDARG);
+	TEST_TRUE(tstring(result.GetFailure().Text()) == TXT("Invalid value"));
+	TEST_TRUE(strstr(result.GetFailure().Source(), "GetValue") != nullptr);
+}
+TEST_CASE_END
+
+TEST_CASE("a formatted failure message is copied")
+{
+	tstring message = TXT("Formatted");
+
+	COM::Failure failure(E_FAIL, message, __FUNCTION__);
+
+	message = TXT("Changed");
+
+	TEST_TRUE(tstring(failure.Text()) == TXT("Formatted"));
+}
+TEST_CASE_END
+
+TEST_CASE("a failure is propagated without being reported")
+{
+	::SetErrorInfo(0, nullptr);
+
+	COM::Result<void> result = CheckValue(true);
+
+	TEST_TRUE(result.Code() == E_INVALIDARG);
+	TEST_TRUE(strstr(result.GetFailure().Source(), "GetValue") != nullptr);
+
+	IErrorInfoPtr errorInfo;
+
+	TEST_TRUE(::GetErrorInfo(0, AttachTo(errorInfo)) == S_FALSE);
+
+	TEST_TRUE(CheckValue(false).Succeeded() == true);
+}
+TEST_CASE_END
+
+TEST_CASE("reporting a failure sets the COM error information")
+{
+	COM::Result<int*> result = GetValue(true);
+
+	TEST_TRUE(result.Report() == E_INVALIDARG);
+
+	IErrorInfoPtr errorInfo;
+	WCL::ComStr   description;
+
+	TEST_TRUE(::GetErrorInfo(0, AttachTo(errorInfo)) == S_OK);
+	TEST_TRUE(errorInfo->GetDescription(AttachTo(description)) == S_OK);
+	TEST_TRUE(wcscmp(description.Get(), L"Invalid value") == 0);
+}
+TEST_CASE_END
+
+TEST_CASE("a failure can be turned back into an exception")
+{
+	TEST_THROWS(GetValue(true).ValueOrThrow());
+	TEST_THROWS(CheckValue(true).ThrowIfFailed());
+
+	TEST_TRUE(GetValue(false).ValueOrThrow() == &g_nValue);
+}
+TEST_CASE_END
+
+TEST_CASE("an exception on a slow path is caught and returned as a failure")
+{
+	COM::Result<int*> result = SlowPath();
+
+	TEST_TRUE(result.Code() == E_ACCESSDENIED);
+	TEST_TRUE(tstring(result.GetFailure().Text()) == TXT("Access denied"));
+}
+TEST_CASE_END
+
+TEST_CASE("a reported failure returns the same code as a caught exception")
+{
+	int value = 0;
+
+	TEST_TRUE(ThrowingMethod(nullptr) == E_POINTER);
+	TEST_TRUE(ResultMethod(nullptr) == E_POINTER);
+	TEST_TRUE(ResultMethod(&value) == S_OK);
+	TEST_TRUE(value == g_nValue);
+
+	::SetErrorInfo(0, nullptr);
+}
+TEST_CASE_END
+
+}
+TEST_SET_END
+
+////////////////////////////////////////////////////////////////////////////////
+//! Failure path throughput of exceptions compared to results.
+
+BENCHMARK(FailurePaths)
+{
+	const size_t iterations = 10000;
+
+	Stopwatch throwTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		ThrowingMethod(nullptr);
+
+	ReportBenchmark("throw + COM_CATCH", iterations, throwTimer.ElapsedMs());
+
+	Stopwatch resultTimer;
+
+	for (size_t i = 0; i != iterations; ++i)
+		ResultMethod(nullptr);
+
+	ReportBenchmark("COM_FAILURE + Report", iterations, resultTimer.ElapsedMs());
+
+	::SetErrorInfo(0, nullptr);
+}
@@ -6,8 +6,38 @@
 #include "Common.hpp"
 #include <tchar.h>
 #include <Core/UnitTest.hpp>
+#include "TestClasses.hpp"
+#include "Benchmark.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the harness as the local server used by the LocalServer tests.
+
+static int RunLocalServer()
+{
+	try
+	{
+		TestLocalServer server;
+
+		server.Run();
+	}
+	catch (const Core::Exception& e)
+	{
+		TRACE1(TXT("Local server failed - %s\n"), e.twhat());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
 
 int _tmain(int argc, _TCHAR* argv[])
 {
+	// Launched by COM?
+	if ( (argc == 2) && COM::LocalServer::IsEmbedding(argv[1]) )
+		return RunLocalServer();
+
+	// Run the throughput comparisons instead of the unit tests?
+	if ( (argc == 2) && IsBenchmarkSwitch(argv[1]) )
+		return RunBenchmarks();
+
 	TEST_SUITE_MAIN(argc, argv);
 }
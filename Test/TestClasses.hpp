@@ -11,6 +11,9 @@
 #include <COM/ObjectBase.hpp>
 #include <COM/ServerRegInfo.hpp>
 #include <COM/InprocServer.hpp>
+#include <COM/LocalServer.hpp>
+#include <COM/DispatchTableImpl.hpp>
+#include <COM/AsyncCall.hpp>
 
 #if _MSC_VER > 1000
 #pragma once
@@ -22,6 +25,11 @@
 static const IID IID_ITestInterface   = { 0x12345678, 0x1234, 0x1234, { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } };
 static const CLSID CLSID_TestClass    = { 0x12345678, 0x1234, 0x1234, { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } };
 static const GUID LIBID_TestServerLib = { 0x12345678, 0x1234, 0x1234, { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } };
+static const IID IID_ITestDispatch    = { 0x7C565DD8, 0x37DB, 0x423A, { 0xBA, 0xC3, 0xD0, 0x37, 0x33, 0x67, 0x3B, 0x13 } };
+static const CLSID CLSID_TestLocalClass = { 0x69A269E9, 0x4951, 0x43B6, { 0x8C, 0x36, 0x73, 0x96, 0x3D, 0xF2, 0x62, 0x9E } };
+static const IID IID_ITestAsync       = { 0x3B0E4A52, 0x8D1F, 0x4C67, { 0x9A, 0x2E, 0x51, 0x7C, 0x0D, 0x94, 0xB3, 0x18 } };
+static const IID IID_AsyncITestAsync  = { 0x3B0E4A53, 0x8D1F, 0x4C67, { 0x9A, 0x2E, 0x51, 0x7C, 0x0D, 0x94, 0xB3, 0x18 } };
+static const CLSID CLSID_TestApartmentClass = { 0xE1D5C3A7, 0x2F48, 0x4B0A, { 0x86, 0x1C, 0x4D, 0xA9, 0x37, 0x0B, 0x5E, 0x62 } };
 
 ////////////////////////////////////////////////////////////////////////////////
 //! The ObjectBase test class interface.
@@ -46,16 +54,300 @@ class TestClass : public COM::ObjectBase<ITestInterface>
 	IMPLEMENT_IUNKNOWN()
 };
 
+////////////////////////////////////////////////////////////////////////////////
+//! The dual interface from the test type library.
+
+#if _MSC_VER > 1000 && _MSC_VER < 1900
+[uuid ("{7C565DD8-37DB-423A-BAC3-D03733673B13}")]
+#endif
+struct ITestDispatch : public IDispatch
+{
+	virtual HRESULT COMCALL get_Name(BSTR* pbstrName) = 0;
+	virtual HRESULT COMCALL Add(long nLHS, long nRHS, long* pnResult) = 0;
+};
+
+#ifndef _MSC_VER
+WCL_DECLARE_IFACETRAITS(ITestDispatch, IID_ITestDispatch);
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//! The dual interface test class, which uses the dispatch table.
+
+class TestDispatch : public COM::ObjectBase<ITestDispatch>, public COM::DispatchTableImpl<TestDispatch>
+{
+public:
+	TestDispatch()
+		: COM::DispatchTableImpl<TestDispatch>(IID_ITestDispatch)
+	{
+	}
+
+	virtual HRESULT COMCALL get_Name(BSTR* pbstrName)
+	{
+		if (pbstrName == nullptr)
+			return E_POINTER;
+
+		*pbstrName = ::SysAllocString(OLESTR("TestDispatch"));
+		return S_OK;
+	}
+
+	virtual HRESULT COMCALL Add(long nLHS, long nRHS, long* pnResult)
+	{
+		if (pnResult == nullptr)
+			return E_POINTER;
+
+		*pnResult = nLHS + nRHS;
+		return S_OK;
+	}
+
+	DEFINE_INTERFACE_TABLE(ITestDispatch)
+		IMPLEMENT_INTERFACE(IID_ITestDispatch, ITestDispatch)
+		IMPLEMENT_INTERFACE(IID_IDispatch, ITestDispatch)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+
+	DEFINE_DISPATCH_TABLE(TestDispatch)
+		IMPLEMENT_DISP_PROPGET(Name, 1)
+		IMPLEMENT_DISP_METHOD_RETVAL(Add, 2)
+	END_DISPATCH_TABLE()
+	IMPLEMENT_IDISPATCH_TABLE(TestDispatch)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The dispatch table test class for the boolean and date properties, which
+//! has no type library.
+
+class TestProperties : public COM::ObjectBase<IDispatch>, public COM::DispatchTableImpl<TestProperties>
+{
+public:
+	TestProperties()
+		: COM::DispatchTableImpl<TestProperties>(IID_IDispatch)
+		, m_bEnabled(VARIANT_FALSE)
+		, m_dtCreated(0.0)
+	{
+	}
+
+	HRESULT COMCALL get_Enabled(VARIANT_BOOL* pbEnabled)
+	{
+		*pbEnabled = m_bEnabled;
+		return S_OK;
+	}
+
+	HRESULT COMCALL put_Enabled(VARIANT_BOOL bEnabled)
+	{
+		m_bEnabled = bEnabled;
+		return S_OK;
+	}
+
+	HRESULT COMCALL get_Created(DATE* pdtCreated)
+	{
+		*pdtCreated = m_dtCreated;
+		return S_OK;
+	}
+
+	HRESULT COMCALL put_Created(DATE dtCreated)
+	{
+		m_dtCreated = dtCreated;
+		return S_OK;
+	}
+
+	DEFINE_INTERFACE_TABLE(IDispatch)
+		IMPLEMENT_INTERFACE(IID_IDispatch, IDispatch)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+
+	DEFINE_DISPATCH_TABLE(TestProperties)
+		IMPLEMENT_DISP_PROPGET_AS(Enabled, 1, COM::VariantBool)
+		IMPLEMENT_DISP_PROPPUT_AS(Enabled, 1, COM::VariantBool)
+		IMPLEMENT_DISP_PROPGET_AS(Created, 2, COM::VariantDate)
+		IMPLEMENT_DISP_PROPPUT_AS(Created, 2, COM::VariantDate)
+	END_DISPATCH_TABLE()
+	IMPLEMENT_IDISPATCH_TABLE(TestProperties)
+
+private:
+	VARIANT_BOOL	m_bEnabled;
+	DATE			m_dtCreated;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Call ITestDispatch::Add() through IDispatch.
+
+inline HRESULT InvokeAdd(IDispatch* pDispatch, long nLHS, long nRHS, long& nResult)
+{
+	VARIANTARG avtArgs[2];
+
+	// The arguments are in reverse order.
+	::VariantInit(&avtArgs[0]);
+	V_VT(&avtArgs[0]) = VT_I4;
+	V_I4(&avtArgs[0]) = nRHS;
+
+	::VariantInit(&avtArgs[1]);
+	V_VT(&avtArgs[1]) = VT_I4;
+	V_I4(&avtArgs[1]) = nLHS;
+
+	DISPPARAMS oParams = { avtArgs, nullptr, 2, 0 };
+	VARIANT    vtResult;
+
+	::VariantInit(&vtResult);
+
+	HRESULT hr = pDispatch->Invoke(2, IID_NULL, LOCALE_USER_DEFAULT, DISPATCH_METHOD, &oParams, &vtResult, nullptr, nullptr);
+
+	if (SUCCEEDED(hr))
+		nResult = V_I4(&vtResult);
+
+	::VariantClear(&vtResult);
+
+	return hr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The synchronous interface of the asynchronous call test class.
+
+struct ITestAsync : public IUnknown
+{
+	virtual HRESULT COMCALL Process(long nDuration, long* pnResult) = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The asynchronous interface of the asynchronous call test class, as MIDL
+//! would generate it from an [async_uuid] attribute on ITestAsync.
+
+struct AsyncITestAsync : public IUnknown
+{
+	virtual HRESULT COMCALL Begin_Process(long nDuration) = 0;
+	virtual HRESULT COMCALL Finish_Process(long* pnResult) = 0;
+};
+
+class TestAsync;
+
+////////////////////////////////////////////////////////////////////////////////
+//! The call object for the asynchronous call test class. A negative duration
+//! makes the call fail.
+
+class TestAsyncCall : public COM::AsyncCall<AsyncITestAsync, TestAsync>
+{
+public:
+	TestAsyncCall(IUnknown* pOuter, TestAsync& oObject);
+
+	virtual HRESULT COMCALL Begin_Process(long nDuration)
+	{
+		if (IsCallPending())
+			return RPC_E_CALL_PENDING;
+
+		m_nDuration = nDuration;
+
+		return BeginCall();
+	}
+
+	virtual HRESULT COMCALL Finish_Process(long* pnResult)
+	{
+		if (pnResult == nullptr)
+			return E_POINTER;
+
+		HRESULT hr = FinishCall();
+
+		if (SUCCEEDED(hr))
+			*pnResult = m_nResult;
+
+		return hr;
+	}
+
+protected:
+	virtual COM::Result<void> Execute();
+
+private:
+	long	m_nDuration;
+	long	m_nResult;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The asynchronous call test class. The method simulates a long-running call
+//! by sleeping for the duration.
+
+class TestAsync : public COM::ObjectBase<ITestAsync>, public COM::CallFactoryImpl<TestAsync, TestAsyncCall>
+{
+public:
+	TestAsync()
+		: COM::CallFactoryImpl<TestAsync, TestAsyncCall>(IID_AsyncITestAsync)
+	{
+	}
+
+	virtual HRESULT COMCALL Process(long nDuration, long* pnResult)
+	{
+		if (pnResult == nullptr)
+			return E_POINTER;
+
+		if (nDuration < 0)
+			return E_INVALIDARG;
+
+		::Sleep(nDuration);
+
+		*pnResult = nDuration;
+		return S_OK;
+	}
+
+	DEFINE_INTERFACE_TABLE(ITestAsync)
+		IMPLEMENT_INTERFACE(IID_ITestAsync, ITestAsync)
+		IMPLEMENT_INTERFACE(IID_ICallFactory, ICallFactory)
+	END_INTERFACE_TABLE()
+	IMPLEMENT_IUNKNOWN()
+};
+
+inline TestAsyncCall::TestAsyncCall(IUnknown* pOuter, TestAsync& oObject)
+	: COM::AsyncCall<AsyncITestAsync, TestAsync>(pOuter, IID_AsyncITestAsync, oObject)
+	, m_nDuration(0)
+	, m_nResult(0)
+{
+}
+
+inline COM::Result<void> TestAsyncCall::Execute()
+{
+	HRESULT hr = Target().Process(m_nDuration, &m_nResult);
+
+	if (FAILED(hr))
+		return COM_FAILURE(hr, TXT("The call failed"));
+
+	return COM::Result<void>();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //! The InprocServer test class.
 
 class TestServer : public COM::InprocServer
 {
 	DEFINE_REGISTRATION_TABLE(TXT("TestServer"), LIBID_TestServerLib, 1, 0)
+		DEFINE_CLASS_REG_INFO(CLSID_TestApartmentClass, TXT("TestApartmentClass"), TXT("1"), COM::SINGLE_THREAD_APT)
 	END_REGISTRATION_TABLE()
 
 	DEFINE_CLASS_FACTORY_TABLE()
 		DEFINE_CLASS(CLSID_TestClass, TestClass, ITestInterface)
+		DEFINE_CLASS(CLSID_TestApartmentClass, TestDispatch, ITestDispatch)
+	END_CLASS_FACTORY_TABLE()
+
+public:
+	//! Destructor. An error object left on the thread by a test holds a lock on
+	//! the server and so is discarded first. The threads are then stopped, as
+	//! DllCanUnloadNow() would do for a real server.
+	~TestServer()
+	{
+		::SetErrorInfo(0, nullptr);
+
+		StopAsyncWorkers();
+		StopApartments();
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! The LocalServer test class. The test harness runs this when it is launched
+//! by COM.
+
+class TestLocalServer : public COM::LocalServer
+{
+	DEFINE_REGISTRATION_TABLE(TXT("TestLocalServer"), LIBID_TestServerLib, 1, 0)
+		DEFINE_CLASS_REG_INFO(CLSID_TestLocalClass, TXT("TestLocalClass"), TXT("1"), COM::FREE_THREAD_APT)
+	END_REGISTRATION_TABLE()
+
+	DEFINE_CLASS_FACTORY_TABLE()
+		DEFINE_CLASS(CLSID_TestLocalClass, TestDispatch, ITestDispatch)
 	END_CLASS_FACTORY_TABLE()
 };
 
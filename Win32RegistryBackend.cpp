@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Win32RegistryBackend.cpp
+//! \brief  The Win32RegistryBackend class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "Win32RegistryBackend.hpp"
+
+namespace COM
+{
+
+//! The longest value which is compared with the current value before writing.
+static const size_t MAX_COMPARE_LEN = 511;
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction from the registration scope. This opens the HKCR root for the
+//! scope, which for USER is HKCU\Software\Classes.
+
+Win32RegistryBackend::Win32RegistryBackend(Scope scope)
+	: m_hRoot(HKEY_CLASSES_ROOT)
+	, m_bOwnsRoot(false)
+{
+	ASSERT((scope == MACHINE) || (scope == USER));
+
+	if (scope == USER)
+	{
+		LONG lResult = ::RegCreateKeyEx(HKEY_CURRENT_USER, TXT("Software\\Classes"), 0, nullptr, REG_OPTION_NON_VOLATILE,
+										KEY_READ | KEY_WRITE, nullptr, &m_hRoot, nullptr);
+
+		if (lResult != ERROR_SUCCESS)
+			throw WCL::ComException(HRESULT_FROM_WIN32(lResult), TXT("Failed to open the key 'HKCU\\Software\\Classes'"));
+
+		m_bOwnsRoot = true;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+Win32RegistryBackend::~Win32RegistryBackend()
+{
+	if (m_bOwnsRoot)
+		::RegCloseKey(m_hRoot);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Open a key, creating it and any missing parent keys if required.
+
+RegistryBackend::Key Win32RegistryBackend::CreateKey(const tstring& strSubKey)
+{
+	HKEY hKey = nullptr;
+
+	LONG lResult = ::RegCreateKeyEx(m_hRoot, strSubKey.c_str(), 0, nullptr, REG_OPTION_NON_VOLATILE,
+									KEY_READ | KEY_WRITE, nullptr, &hKey, nullptr);
+
+	if (lResult != ERROR_SUCCESS)
+		throw WCL::ComException(HRESULT_FROM_WIN32(lResult), CString::Fmt(TXT("Failed to create the key '<root>\\%s'"), strSubKey.c_str()));
+
+	return hKey;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Close a key opened by CreateKey().
+
+void Win32RegistryBackend::CloseKey(Key hKey)
+{
+	::RegCloseKey(static_cast<HKEY>(hKey));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Query if a value exists and is already set to the string. The existing
+//! value is read into a buffer just big enough for the new one, so a longer
+//! value fails the comparison without being read. Values too long for the
+//! buffer are never considered equal.
+
+bool Win32RegistryBackend::HasValue(Key hKey, const tchar* pszName, const tstring& strValue)
+{
+	if (strValue.length() > MAX_COMPARE_LEN)
+		return false;
+
+	tchar szCurrent[MAX_COMPARE_LEN+1];
+	DWORD dwType = REG_NONE;
+	DWORD dwSize = static_cast<DWORD>((strValue.length() + 1) * sizeof(tchar));
+	DWORD dwRead = dwSize;
+
+	LONG lResult = ::RegQueryValueEx(static_cast<HKEY>(hKey), pszName, nullptr, &dwType, reinterpret_cast<BYTE*>(szCurrent), &dwRead);
+
+	return ( (lResult == ERROR_SUCCESS) && (dwType == REG_SZ) && (dwRead == dwSize)
+		  && (memcmp(szCurrent, strValue.c_str(), dwSize) == 0) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Set a string value.
+
+void Win32RegistryBackend::SetValue(Key hKey, const tstring& strSubKey, const tchar* pszName, const tstring& strValue)
+{
+	DWORD dwSize = static_cast<DWORD>((strValue.length() + 1) * sizeof(tchar));
+
+	LONG lResult = ::RegSetValueEx(static_cast<HKEY>(hKey), pszName, 0, REG_SZ, reinterpret_cast<const BYTE*>(strValue.c_str()), dwSize);
+
+	if (lResult != ERROR_SUCCESS)
+		throw WCL::ComException(HRESULT_FROM_WIN32(lResult), CString::Fmt(TXT("Failed to write a value to the key '<root>\\%s'"), strSubKey.c_str()));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Delete a key, which must have no subkeys.
+
+bool Win32RegistryBackend::DeleteKey(const tstring& strSubKey)
+{
+	LONG lResult = ::RegDeleteKey(m_hRoot, strSubKey.c_str());
+
+#ifdef _DEBUG
+	if (lResult != ERROR_SUCCESS)
+		TRACE3(TXT("Failed to delete the key '<root>\\%s' [0x%08lX - %s]\n"), strSubKey.c_str(), lResult, CStrCvt::FormatError(lResult).c_str());
+#endif
+
+	return (lResult == ERROR_SUCCESS);
+}
+
+//namespace COM
+}
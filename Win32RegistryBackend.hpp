@@ -0,0 +1,63 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   Win32RegistryBackend.hpp
+//! \brief  The Win32RegistryBackend class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_WIN32REGISTRYBACKEND_HPP
+#define COM_WIN32REGISTRYBACKEND_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "RegistryBackend.hpp"
+#include "RegUtils.hpp"
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The registry backend for the Windows registry. The keys are stored under
+//! HKCR for the MACHINE scope and HKCU\Software\Classes for the USER scope.
+
+class Win32RegistryBackend : public RegistryBackend, private Core::NotCopyable
+{
+public:
+	//! Construction from the registration scope.
+	Win32RegistryBackend(Scope scope); // throw(ComException)
+
+	//! Destructor.
+	virtual ~Win32RegistryBackend();
+
+	//
+	// RegistryBackend methods.
+	//
+
+	//! Open a key, creating it and any missing parent keys if required.
+	virtual Key CreateKey(const tstring& strSubKey); // throw(ComException)
+
+	//! Close a key opened by CreateKey().
+	virtual void CloseKey(Key hKey);
+
+	//! Query if a value exists and is already set to the string.
+	virtual bool HasValue(Key hKey, const tchar* pszName, const tstring& strValue);
+
+	//! Set a string value.
+	virtual void SetValue(Key hKey, const tstring& strSubKey, const tchar* pszName, const tstring& strValue); // throw(ComException)
+
+	//! Delete a key, which must have no subkeys.
+	virtual bool DeleteKey(const tstring& strSubKey);
+
+private:
+	//
+	// Members.
+	//
+	HKEY		m_hRoot;			//!< The HKCR root for the scope.
+	bool		m_bOwnsRoot;		//!< Does the backend have to close the root?
+};
+
+//namespace COM
+}
+
+#endif // COM_WIN32REGISTRYBACKEND_HPP
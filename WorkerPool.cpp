@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   WorkerPool.cpp
+//! \brief  The WorkerPool class definition.
+//! \author Chris Oldwood
+
+#include "Common.hpp"
+#include "WorkerPool.hpp"
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! Construction with the number of threads.
+
+WorkerPool::WorkerPool(size_t nThreads)
+	: m_oLock()
+	, m_pHead(nullptr)
+	, m_pTail(nullptr)
+	, m_hSemaphore(::CreateSemaphore(nullptr, 0, LONG_MAX, nullptr))
+	, m_bStopping(false)
+	, m_nPending(0)
+	, m_nPeakPending(0)
+	, m_oThreads()
+{
+	ASSERT(nThreads != 0);
+
+	if (m_hSemaphore == nullptr)
+		throw WCL::ComException(HRESULT_FROM_WIN32(::GetLastError()), TXT("Failed to create the worker pool semaphore"));
+
+	m_oThreads.reserve(nThreads);
+
+	for (size_t i = 0; i != nThreads; ++i)
+	{
+		HANDLE hThread = ::CreateThread(nullptr, 0, ThreadProc, this, 0, nullptr);
+
+		if (hThread == nullptr)
+		{
+			HRESULT hr = HRESULT_FROM_WIN32(::GetLastError());
+
+			Stop();
+			::CloseHandle(m_hSemaphore);
+
+			throw WCL::ComException(hr, TXT("Failed to create a worker pool thread"));
+		}
+
+		m_oThreads.push_back(hThread);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+WorkerPool::~WorkerPool()
+{
+	Stop();
+
+	::CloseHandle(m_hSemaphore);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Queue an item of work. This returns false if the pool has been stopped.
+
+bool WorkerPool::Submit(WorkItem* pItem)
+{
+	ASSERT(pItem != nullptr);
+
+	{
+		CriticalSection::Lock oLock(m_oLock);
+
+		if (m_bStopping)
+			return false;
+
+		pItem->m_pNext = nullptr;
+
+		if (m_pTail != nullptr)
+			m_pTail->m_pNext = pItem;
+		else
+			m_pHead = pItem;
+
+		m_pTail = pItem;
+
+		LONG nPending = ::InterlockedIncrement(&m_nPending);
+
+		if (nPending > m_nPeakPending)
+			::InterlockedExchange(&m_nPeakPending, nPending);
+	}
+
+	::ReleaseSemaphore(m_hSemaphore, 1, nullptr);
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Run the outstanding work and then stop the threads. This waits for the
+//! threads to exit and so must not be called from a pool thread, or under the
+//! loader lock.
+
+void WorkerPool::Stop()
+{
+	{
+		CriticalSection::Lock oLock(m_oLock);
+
+		if (m_bStopping)
+			return;
+
+		m_bStopping = true;
+	}
+
+	if (m_oThreads.empty())
+		return;
+
+	// Wake every thread, each one exits once the queue is empty.
+	::ReleaseSemaphore(m_hSemaphore, static_cast<LONG>(m_oThreads.size()), nullptr);
+
+	for (Threads::const_iterator it = m_oThreads.begin(); it != m_oThreads.end(); ++it)
+	{
+		::WaitForSingleObject(*it, INFINITE);
+		::CloseHandle(*it);
+	}
+
+	m_oThreads.clear();
+
+	ASSERT(m_pHead == nullptr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Remove the next item from the queue. This returns nullptr if the queue is
+//! empty, which only happens once the pool is stopping.
+
+WorkItem* WorkerPool::Dequeue()
+{
+	CriticalSection::Lock oLock(m_oLock);
+
+	WorkItem* pItem = m_pHead;
+
+	if (pItem != nullptr)
+	{
+		m_pHead = pItem->m_pNext;
+
+		if (m_pHead == nullptr)
+			m_pTail = nullptr;
+
+		::InterlockedDecrement(&m_nPending);
+	}
+
+	return pItem;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! The pool thread function. The threads join the MTA, so that the work can
+//! use any free-threaded object without marshalling.
+
+DWORD WINAPI WorkerPool::ThreadProc(LPVOID pParam)
+{
+	WorkerPool* pPool = static_cast<WorkerPool*>(pParam);
+
+	HRESULT hr = ::CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+	for (;;)
+	{
+		::WaitForSingleObject(pPool->m_hSemaphore, INFINITE);
+
+		WorkItem* pItem = pPool->Dequeue();
+
+		if (pItem == nullptr)
+			break;
+
+		pItem->Run();
+	}
+
+	if (SUCCEEDED(hr))
+		::CoUninitialize();
+
+	return 0;
+}
+
+//namespace COM
+}
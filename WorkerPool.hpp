@@ -0,0 +1,162 @@
+////////////////////////////////////////////////////////////////////////////////
+//! \file   WorkerPool.hpp
+//! \brief  The WorkerPool class declaration.
+//! \author Chris Oldwood
+
+// Check for previous inclusion
+#ifndef COM_WORKERPOOL_HPP
+#define COM_WORKERPOOL_HPP
+
+#if _MSC_VER > 1000
+#pragma once
+#endif
+
+#include "CriticalSection.hpp"
+#include <vector>
+
+namespace COM
+{
+
+////////////////////////////////////////////////////////////////////////////////
+//! The base class for an item of work queued on a WorkerPool. The item is
+//! owned by the submitter and must stay alive until it has been run.
+
+class WorkItem
+{
+public:
+	//! Run the work, on a pool thread.
+	virtual void Run() = 0; // throw()
+
+protected:
+	//! Default constructor.
+	WorkItem();
+
+	//! Destructor.
+	~WorkItem();
+
+private:
+	//
+	// Members.
+	//
+	WorkItem*	m_pNext;		//!< The next item in the queue.
+
+	//
+	// Friends.
+	//
+	friend class WorkerPool;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! A fixed size pool of threads which run queued work items in FIFO order. The
+//! number of threads is bounded, so that a burst of requests queues up rather
+//! than each one creating (and contending for the CPU on) its own thread.
+//!
+//! The queue itself is not bounded. An item is owned by its submitter and is
+//! linked into the queue in place, so queueing allocates nothing, and each
+//! item is an asynchronous call which a client has begun and is waiting on.
+//! The queue can't hold more than the calls the clients have outstanding and
+//! rejecting a call would only turn a delay into a failure for the client.
+
+class WorkerPool : private Core::NotCopyable
+{
+public:
+	//! Construction with the number of threads.
+	WorkerPool(size_t nThreads); // throw(ComException)
+
+	//! Destructor.
+	~WorkerPool();
+
+	//
+	// Properties.
+	//
+
+	//! Get the number of threads.
+	size_t ThreadCount() const;
+
+	//! Get the number of items waiting to be run.
+	long Pending() const;
+
+	//! Get the highest number of items that have been waiting at once.
+	long PeakPending() const;
+
+	//
+	// Methods.
+	//
+
+	//! Queue an item of work.
+	bool Submit(WorkItem* pItem);
+
+	//! Run the outstanding work and then stop the threads.
+	void Stop();
+
+private:
+	//! The thread handles.
+	typedef std::vector<HANDLE> Threads;
+
+	//
+	// Members.
+	//
+	CriticalSection	m_oLock;		//!< The lock used to serialise the queue.
+	WorkItem*		m_pHead;		//!< The first item in the queue.
+	WorkItem*		m_pTail;		//!< The last item in the queue.
+	HANDLE			m_hSemaphore;	//!< The count of queued items.
+	bool			m_bStopping;	//!< Has the pool been stopped?
+	volatile LONG	m_nPending;		//!< The number of queued items.
+	volatile LONG	m_nPeakPending;	//!< The highest number of queued items.
+	Threads			m_oThreads;		//!< The pool threads.
+
+	//
+	// Internal methods.
+	//
+
+	//! Remove the next item from the queue.
+	WorkItem* Dequeue();
+
+	//! The pool thread function.
+	static DWORD WINAPI ThreadProc(LPVOID pParam);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//! Default constructor.
+
+inline WorkItem::WorkItem()
+	: m_pNext(nullptr)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Destructor.
+
+inline WorkItem::~WorkItem()
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of threads.
+
+inline size_t WorkerPool::ThreadCount() const
+{
+	return m_oThreads.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the number of items waiting to be run.
+
+inline long WorkerPool::Pending() const
+{
+	return m_nPending;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//! Get the highest number of items that have been waiting at once. If this
+//! regularly reaches the pool size the pool is too small for the load.
+
+inline long WorkerPool::PeakPending() const
+{
+	return m_nPeakPending;
+}
+
+//namespace COM
+}
+
+#endif // COM_WORKERPOOL_HPP